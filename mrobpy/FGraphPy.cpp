@@ -24,9 +24,12 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/eigen.h>
 #include <pybind11/stl.h>
+#include <pybind11/functional.h>
+#include <stdexcept>
 
 
 #include "mrob/factor_graph_solve.hpp"
+#include "mrob/factor_graph_solve_dense.hpp"
 #include "mrob/factors/nodePose2d.hpp"
 #include "mrob/factors/factor1Pose2d.hpp"
 #include "mrob/factors/factor2Poses2d.hpp"
@@ -122,29 +125,30 @@ public:
         this->add_node(n);
         return n->get_id();
     }
-    factor_id_t add_factor_1pose_3d(const SE3 &obs, uint_t nodeId, const py::EigenDRef<const Mat6> obsInvCov)
+    factor_id_t add_factor_1pose_3d(const SE3 &obs, uint_t nodeId, const py::EigenDRef<const Mat6> obsInvCov,
+            bool exactJacobian)
     {
         auto n1 = this->get_node(nodeId);
-        std::shared_ptr<mrob::Factor> f(new mrob::Factor1Pose3d(obs,n1,obsInvCov,robust_type_));
+        std::shared_ptr<mrob::Factor> f(new mrob::Factor1Pose3d(obs,n1,obsInvCov,robust_type_, exactJacobian));
         this->add_factor(f);
         return f->get_id();
     }
     factor_id_t add_factor_2poses_3d(const SE3 &obs, uint_t nodeOriginId, uint_t nodeTargetId,
-            const py::EigenDRef<const Mat6> obsInvCov, bool updateNodeTarget)
+            const py::EigenDRef<const Mat6> obsInvCov, bool updateNodeTarget, bool exactJacobian)
     {
         auto nO = this->get_node(nodeOriginId);
         auto nT = this->get_node(nodeTargetId);
-        std::shared_ptr<mrob::Factor> f(new mrob::Factor2Poses3d(obs,nO,nT,obsInvCov, updateNodeTarget, robust_type_));
+        std::shared_ptr<mrob::Factor> f(new mrob::Factor2Poses3d(obs,nO,nT,obsInvCov, updateNodeTarget, robust_type_, exactJacobian));
         this->add_factor(f);
         return f->get_id();
     }
     
     factor_id_t add_factor_2poses_3d_2obs(const SE3 &obs, const SE3 &obs2, uint_t nodeOriginId, uint_t nodeTargetId,
-                                     const py::EigenDRef<const Mat6> obsInvCov)
+                                     const py::EigenDRef<const Mat6> obsInvCov, bool exactJacobian)
     {
         auto nO = this->get_node(nodeOriginId);
         auto nT = this->get_node(nodeTargetId);
-        std::shared_ptr<mrob::Factor> f(new mrob::Factor2Poses3d2obs(obs,obs2,nO,nT,obsInvCov, robust_type_));
+        std::shared_ptr<mrob::Factor> f(new mrob::Factor2Poses3d2obs(obs,obs2,nO,nT,obsInvCov, robust_type_, exactJacobian));
         this->add_factor(f);
         return f->get_id();
     }
@@ -248,7 +252,8 @@ public:
         ef->add_point(point, n, W);
     }
 
-    void eigen_factor_plane_add_points_array(factor_id_t planeEigenId, factor_id_t nodePoseId, const py::EigenDRef<const MatX> pointsArray, matData_t &W)
+    template<typename Scalar>
+    void eigen_factor_plane_add_points_array(factor_id_t planeEigenId, factor_id_t nodePoseId, const py::EigenDRef<const MatXT<Scalar>> pointsArray, matData_t &W)
     {
         auto ef = this->get_eigen_factor(planeEigenId);
         auto n = this->get_node(nodePoseId);
@@ -300,8 +305,44 @@ public:
         return f->get_id();
     }
 
+    /**
+     * Solves the graph with the dense solver, which shares the nodes and factors of this graph.
+     * For small problems it avoids the overhead of the sparse structures. Since the graph
+     * only grows, the dense graph is kept and only new nodes and factors are added to it.
+     */
+    uint_t solve_dense(FGraphSolve::optimMethod method, uint_t maxIters, matData_t lambda, uint_t numThreads)
+    {
+        if (!eigen_factors_.empty())
+            throw std::invalid_argument("FGraph.solve_dense: Eigen factors are not supported by the dense solver");
+        for (factor_id_t i = dense_.number_nodes(); i < nodes_.size(); ++i)
+            dense_.add_node(nodes_[i]);
+        for (factor_id_t i = dense_.number_factors(); i < factors_.size(); ++i)
+            dense_.add_factor(factors_[i]);
+        dense_.set_number_threads(numThreads);
+        dense_.set_verbosity(log_.get_verbosity());
+        switch (method)
+        {
+            case FGraphSolve::optimMethod::GN:
+                return dense_.solve(Optimizer::NEWTON_RAPHSON, maxIters, lambda);
+            case FGraphSolve::optimMethod::LM:
+                return dense_.solve(Optimizer::LEVENBERG_MARQUARDT_SPHER, maxIters, lambda);
+            case FGraphSolve::optimMethod::LM_ELLIPS:
+                return dense_.solve(Optimizer::LEVENBERG_MARQUARDT_ELLIP, maxIters, lambda);
+            case FGraphSolve::optimMethod::DOGLEG:
+                return dense_.solve(Optimizer::DOGLEG, maxIters, lambda);
+            case FGraphSolve::optimMethod::GN_LINE_SEARCH:
+                return dense_.solve(Optimizer::NEWTON_RAPHSON_LINE_SEARCH, maxIters, lambda);
+            case FGraphSolve::optimMethod::LBFGS:
+                return dense_.solve(Optimizer::LBFGS, maxIters, lambda);
+            case FGraphSolve::optimMethod::NONLINEAR_CG:
+                return dense_.solve(Optimizer::NONLINEAR_CG, maxIters, lambda);
+        }
+        return 0;
+    }
+
 private:
     mrob::Factor::robustFactorType robust_type_;
+    FGraphSolveDense dense_;
 };
 
 void init_FGraph(py::module &m)
@@ -310,6 +351,31 @@ void init_FGraph(py::module &m)
         .value("GN", FGraphSolve::optimMethod::GN)
         .value("LM", FGraphSolve::optimMethod::LM)
         .value("LM_ELLIPS", FGraphSolve::optimMethod::LM_ELLIPS)
+        .value("DOGLEG", FGraphSolve::optimMethod::DOGLEG)
+        .value("GN_LINE_SEARCH", FGraphSolve::optimMethod::GN_LINE_SEARCH)
+        .value("LBFGS", FGraphSolve::optimMethod::LBFGS)
+        .value("NONLINEAR_CG", FGraphSolve::optimMethod::NONLINEAR_CG)
+        .export_values()
+        ;
+    py::enum_<FGraphSolve::solveStatus>(m, "FGraph.solveStatus")
+        .value("CONVERGED", FGraphSolve::solveStatus::CONVERGED)
+        .value("BUDGET_EXHAUSTED", FGraphSolve::solveStatus::BUDGET_EXHAUSTED)
+        .value("DIVERGED", FGraphSolve::solveStatus::DIVERGED)
+        .value("STOPPED", FGraphSolve::solveStatus::STOPPED)
+        .export_values()
+        ;
+    py::class_<FGraphSolve::ComponentReport>(m, "FGraph.ComponentReport",
+            "Result of a connected component, when components are solved independently")
+        .def_readonly("nodes", &FGraphSolve::ComponentReport::nodes)
+        .def_readonly("factors", &FGraphSolve::ComponentReport::factors)
+        .def_readonly("status", &FGraphSolve::ComponentReport::status)
+        .def_readonly("iterations", &FGraphSolve::ComponentReport::iterations)
+        .def_readonly("chi2", &FGraphSolve::ComponentReport::chi2)
+        ;
+    py::enum_<FGraphSolve::initMethod>(m, "FGraph.initMethod")
+        .value("SPANNING_TREE", FGraphSolve::initMethod::SPANNING_TREE)
+        .value("CHORDAL", FGraphSolve::initMethod::CHORDAL)
+        .value("ROTATION_AVERAGING", FGraphSolve::initMethod::ROTATION_AVERAGING)
         .export_values()
         ;
     py::enum_<Factor::robustFactorType>(m, "FGraph.robustFactorType")
@@ -335,13 +401,88 @@ void init_FGraph(py::module &m)
                     "Solves the corresponding FG.\n"
                     "Options:\n method = mrob.GN (Gauss Newton), by default option. It carries out a SINGLE iteration.\n"
                     "                  = mrob.LM (Levenberg-Marquard), it has several parameters:\n"
+                    "                  = mrob.LBFGS or mrob.NONLINEAR_CG, first order methods that only build the gradient.\n"
                     " - marIters = 30 (by default). Only for LM\n"
                     " - lambda = 1-6, LM paramter for the size of the update\n"
                     " - solutionTolerance: convergence criteria.",
                     py::arg("method") =  FGraphSolve::optimMethod::GN,
                     py::arg("maxIters") = 30,
                     py::arg("lambda") = 1e-6,
-                    py::arg("solutionTolerance") = 1e-2)
+                    py::arg("solutionTolerance") = 1e-2,
+                    py::call_guard<py::gil_scoped_release>())
+            .def("solve_budget", &FGraphSolve::solve_budget,
+                    "Anytime solve, it stops when there is no time left for another iteration in the budget (microseconds).\n"
+                    "Returns the status: mrob.CONVERGED, mrob.BUDGET_EXHAUSTED or mrob.DIVERGED,\n"
+                    "and the graph keeps the best solution found so far.",
+                    py::arg("deadlineMicroseconds"),
+                    py::arg("method") =  FGraphSolve::optimMethod::LM,
+                    py::arg("maxIters") = 100,
+                    py::arg("lambda") = 1e-6,
+                    py::arg("solutionTolerance") = 1e-2,
+                    py::call_guard<py::gil_scoped_release>())
+            .def("solve_dense", &FGraphPy::solve_dense,
+                    "Solves the FG with a dense Hessian and Cholesky, convenient for small problems.\n"
+                    "Unlike solve(), mrob.GN iterates until convergence. Factors are evaluated on\n"
+                    "num_threads threads (0 for all hardware threads). Eigen factors are not supported.\n"
+                    "Returns the number of iterations, 0 if the Hessian is rank deficient (GN).",
+                    py::arg("method") =  FGraphSolve::optimMethod::GN,
+                    py::arg("maxIters") = 30,
+                    py::arg("lambda") = 1e-6,
+                    py::arg("num_threads") = 1,
+                    py::call_guard<py::gil_scoped_release>())
+            .def("get_iteration_time", &FGraphSolve::get_iteration_time,
+                    "Returns the estimated time of one iteration in microseconds, from the last solve")
+            .def("get_iterations", &FGraphSolve::get_iterations,
+                    "Returns the number of iterations of the last solve")
+            .def("get_status", &FGraphSolve::get_status,
+                    "Returns the status of the last solve: mrob.CONVERGED, mrob.BUDGET_EXHAUSTED, mrob.DIVERGED or mrob.STOPPED")
+            .def("set_verbosity", &FGraphSolve::set_verbosity,
+                    "Sets the messages printed by the solver: mrob.SILENT, mrob.SUMMARY (by default) or mrob.ITERATIONS",
+                    py::arg("verbosity"))
+            .def("get_iteration_records", &FGraphSolve::get_iteration_records,
+                    "Returns the list of records (mrob.IterationRecord) of each iteration of the last solve:\n"
+                    "lambda, chi2, delta chi2, model fidelity, step norm and time of each phase in microseconds.",
+                    py::return_value_policy::copy)
+            .def("set_relinearize_threshold", &FGraphSolve::set_relinearize_threshold,
+                    "Factors are relinearized only if any of their nodes has accumulated updates (norm) over the threshold\n"
+                    "since it was last relinearized, the rest keep their Jacobians. By default 0.",
+                    py::arg("threshold"))
+            .def("get_relinearized_factors", &FGraphSolve::get_relinearized_factors,
+                    "Returns the number of factors relinearized the last time the problem was built")
+            .def("set_split_components", &FGraphSolve::set_split_components,
+                    "If split is True, each connected component (anchors do not connect them) is solved\n"
+                    "independently with its own LM state, on up to numThreads threads (0 for all hardware threads).",
+                    py::arg("split"),
+                    py::arg("numThreads") = 0)
+            .def("set_speculative_lambdas", &FGraphSolve::set_speculative_lambdas,
+                    "After a rejected LM step, numLambdas increasing values of lambda are factorized concurrently\n"
+                    "on up to numThreads threads (0 for all hardware threads) and the step with the lowest chi2 is taken.",
+                    py::arg("numLambdas"),
+                    py::arg("numThreads") = 0)
+            .def("set_mixed_precision", &FGraphSolve::set_mixed_precision,
+                    "If enable is True, the information matrix is factorized in single precision and the step is\n"
+                    "refined in double precision until |b - L dx| <= tolerance * |L| * |dx| or after maxRefinements corrections.\n"
+                    "Otherwise, or if the refinement fails, it is factorized in double precision.",
+                    py::arg("enable"),
+                    py::arg("maxRefinements") = 5,
+                    py::arg("tolerance") = 1e-14)
+            .def("get_number_components", &FGraphSolve::get_number_components,
+                    "Returns the number of connected components when the structure was last built")
+            .def("get_components_report", &FGraphSolve::get_components_report,
+                    "Returns the list of results (FGraph.ComponentReport) of each component after a split solve",
+                    py::return_value_policy::copy)
+            .def("set_iteration_callback", &FGraphSolve::set_iteration_callback,
+                    "Sets a function called after each iteration with its mrob.IterationRecord.\n"
+                    "If it returns True, the solver stops keeping the best solution. None removes the callback.",
+                    py::arg("callback"))
+            .def("initialize", &FGraphSolve::initialize,
+                    "Initializes the pose nodes from the relative pose factors (2D and 3D), before solving.\n"
+                    "Options:\n method = mrob.CHORDAL (by default), chordal relaxation of rotations and then translations.\n"
+                    "                  = mrob.SPANNING_TREE, composition of observations along a spanning tree.\n"
+                    "                  = mrob.ROTATION_AVERAGING, iterative averaging of rotations and then translations.\n"
+                    "Anchor nodes (or the first node of each connected component) keep their state.\n"
+                    "Returns False if a linear system is rank deficient, then nodes keep their state.",
+                    py::arg("method") = FGraphSolve::initMethod::CHORDAL)
             .def("chi2", &FGraphSolve::chi2,
                     "Calculated the chi2 of the problem.\n"
                     "By default re-evaluates residuals, \n"
@@ -401,7 +542,8 @@ void init_FGraph(py::module &m)
                     py::arg("obs2"),
                     py::arg("nodeOriginId"),
                     py::arg("nodeTargetId"),
-                    py::arg("obsInvCov"))
+                    py::arg("obsInvCov"),
+                    py::arg("exactJacobian") = false)
             // 2d Landmkarks
             .def("add_node_landmark_2d", &FGraphPy::add_node_landmark_2d,
                     "Landmarks are 2D points, in [x,y]. It requries initialization, "
@@ -421,14 +563,21 @@ void init_FGraph(py::module &m)
                     "Input are poses in 3D, as Lie Algebra of RBT around the Identity",
                     py::arg("x"),
                     py::arg("mode") = Node::nodeMode::STANDARD)
-            .def("add_factor_1pose_3d", &FGraphPy::add_factor_1pose_3d)
+            .def("add_factor_1pose_3d", &FGraphPy::add_factor_1pose_3d,
+                            "Factor observing a pose in 3D. If exactJacobian is true, uses the exact Jacobian of Ln instead of the identity",
+                            py::arg("obs"),
+                            py::arg("nodeId"),
+                            py::arg("obsInvCov"),
+                            py::arg("exactJacobian") = false)
             .def("add_factor_2poses_3d", &FGraphPy::add_factor_2poses_3d,
-                            "Factors connecting 2 poses. If last input set to true (by default false), also updates the value of the target Node according to the new obs + origin node",
+                            "Factors connecting 2 poses. If updateNodeTarget set to true (by default false), also updates the value of the target Node according to the new obs + origin node."
+                            " If exactJacobian is true, uses the exact Jacobian of Ln, recommended for large residuals",
                             py::arg("obs"),
                             py::arg("nodeOridingId"),
                             py::arg("nodeTargetId"),
                             py::arg("obsInvCov"),
-                            py::arg("updateNodeTarget") = false)
+                            py::arg("updateNodeTarget") = false,
+                            py::arg("exactJacobian") = false)
             // -----------------------------------------------------------------------------
             // Landmark or Point 3D
             .def("add_node_landmark_3d", &FGraphPy::add_node_landmark_3d,
@@ -485,12 +634,18 @@ void init_FGraph(py::module &m)
                     py::arg("nodePoseId"),
                     py::arg("point"),
                     py::arg("W"))
-            .def("eigen_factor_plane_add_points_array", &FGraphPy::eigen_factor_plane_add_points_array,
+            .def("eigen_factor_plane_add_points_array", &FGraphPy::eigen_factor_plane_add_points_array<matData_t>,
                     "Adds array of points given a node id and the EF them belongs to.",
                     py::arg("planeEigenId"),
                     py::arg("nodePoseId"),
                     py::arg("pointsArray"),
                     py::arg("W"))
+            .def("eigen_factor_plane_add_points_array", &FGraphPy::eigen_factor_plane_add_points_array<float>,
+                    "Adds a float32 array of points given a node id and the EF them belongs to.",
+                    py::arg("planeEigenId"),
+                    py::arg("nodePoseId"),
+                    py::arg("pointsArray"),
+                    py::arg("W"))
             .def("add_eigen_factor_plane_center", &FGraphPy::add_eigen_factor_plane_center)
             .def("add_eigen_factor_plane_raw", &FGraphPy::add_eigen_factor_plane_raw)
             .def("add_eigen_factor_point", &FGraphPy::add_eigen_factor_point)
@@ -40,7 +40,8 @@ namespace py = pybind11;
 
 using namespace mrob;
 
-Mat41 estimate_plane_py(const py::EigenDRef<const MatX> X, bool flagCentered = true)
+template<typename Scalar>
+Mat41 estimate_plane_py(const py::EigenDRef<const MatXT<Scalar>> X, bool flagCentered = true)
 {
     Mat41 plane = estimate_plane(X,flagCentered);
     return plane;
@@ -70,6 +71,8 @@ void init_PCPlanes(py::module &m)
         .value("GN_CLAMPED_HESSIAN", PlaneRegistration::SolveMode::GN_CLAMPED_HESSIAN)
         .value("LM_SPHER", PlaneRegistration::SolveMode::LM_SPHER)
         .value("LM_ELLIP", PlaneRegistration::SolveMode::LM_ELLIP)
+        .value("LBFGS", PlaneRegistration::SolveMode::LBFGS)
+        .value("NONLINEAR_CG", PlaneRegistration::SolveMode::NONLINEAR_CG)
         .export_values()
         ;
     // This class creates a synthetic testing
@@ -128,9 +131,13 @@ void init_PCPlanes(py::module &m)
             .def("initialize_last_pose_solution", &PlaneRegistration::set_last_pose,
                     "initializes the solution for some final input plane id (any integer and plane data structure")
             ;
-        m.def("estimate_plane", &estimate_plane_py, py::arg("pointsArray"), py::arg("flagCentered") = true);
-        m.def("estimate_normal", &estimate_normal);
-        m.def("estimate_centroid", &estimate_centroid);
+        // float32 arrays are bound to the single precision functions, so they are not converted to double
+        m.def("estimate_plane", &estimate_plane_py<matData_t>, py::arg("pointsArray"), py::arg("flagCentered") = true);
+        m.def("estimate_plane", &estimate_plane_py<float>, py::arg("pointsArray"), py::arg("flagCentered") = true);
+        m.def("estimate_normal", py::overload_cast<MatRefConst>(&estimate_normal));
+        m.def("estimate_normal", py::overload_cast<MatfRefConst>(&estimate_normal));
+        m.def("estimate_centroid", py::overload_cast<MatRefConst>(&estimate_centroid));
+        m.def("estimate_centroid", py::overload_cast<MatfRefConst>(&estimate_centroid));
         m.def("estimate_matrix_S", &estimate_matrix_S,
                 "This method inputs an array of Nx3 3d points and outputs the summation of the outer product of homogenous points 4x4");
 }
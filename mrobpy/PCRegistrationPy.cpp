@@ -29,11 +29,17 @@
 
 #include <pybind11/pybind11.h>
 #include <pybind11/eigen.h>
+#include <pybind11/stl.h>
 namespace py = pybind11;
 
 
 #include "mrob/SE3.hpp"
 #include "mrob/pc_registration.hpp"
+#include "mrob/local_map.hpp"
+#include "mrob/parallel.hpp"
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 
 
@@ -43,32 +49,697 @@ using namespace mrob;
 SE3 arun_solve(const py::EigenDRef<const MatX> X, const py::EigenDRef<const MatX> Y)
 {
     SE3 res;
-    PCRegistration::arun(X,Y,res);
+    {
+        py::gil_scoped_release release;
+        PCRegistration::arun(X,Y,res);
+    }
     return res;
 }
 
 
-SE3 gicp_solve(const py::EigenDRef<const MatX> X, const py::EigenDRef<const MatX> Y,
-        const py::EigenDRef<const MatX> covX, const py::EigenDRef<const MatX> covY)
+// float32 arrays are bound to the Scalar = float instances, so they are not converted to double
+template<typename Scalar>
+SE3 gicp_solve(const py::EigenDRef<const MatXT<Scalar>> X, const py::EigenDRef<const MatXT<Scalar>> Y,
+        const py::EigenDRef<const MatXT<Scalar>> covX, const py::EigenDRef<const MatXT<Scalar>> covY)
 {
     SE3 res;
-    PCRegistration::gicp(X,Y,covX,covY,res);
+    {
+        py::gil_scoped_release release;
+        PCRegistration::gicp(X,Y,covX,covY,res);
+    }
     return res;
 }
 
-SE3 weighted_solve(const py::EigenDRef<const MatX> X, const py::EigenDRef<const MatX> Y,
-        const py::EigenDRef<const MatX1> weight)
+template<typename Scalar>
+SE3 weighted_solve(const py::EigenDRef<const MatXT<Scalar>> X, const py::EigenDRef<const MatXT<Scalar>> Y,
+        const py::EigenDRef<const MatX1T<Scalar>> weight)
 {
     SE3 res;
-    PCRegistration::weighted_point(X,Y,weight,res);
+    {
+        py::gil_scoped_release release;
+        PCRegistration::weighted_point(X,Y,weight,res);
+    }
     return res;
 }
 
-void init_PCRegistration(py::module &m)
+/**
+ * Downsampled point clouds, returned by value as the normals
+ */
+template<typename Scalar>
+MatXT<Scalar> voxel_downsample_py(const py::EigenDRef<const MatXT<Scalar>> X, double voxelSize,
+        PCRegistration::downsampleMode mode, uint_t numThreads)
 {
-    m.def("arun", &arun_solve);
-    m.def("gicp", &gicp_solve);
-    m.def("weighted", &weighted_solve);
+    if (X.cols() != 3 || voxelSize <= 0.0)
+        throw std::invalid_argument("voxel_downsample: X must be a Nx3 array and the voxel size positive");
+    MatXT<Scalar> Xd;
+    {
+        py::gil_scoped_release release;
+        PCRegistration::voxel_downsample(X, voxelSize, Xd, mode, numThreads);
+    }
+    return Xd;
+}
+
+template<typename Scalar>
+MatXT<Scalar> random_downsample_py(const py::EigenDRef<const MatXT<Scalar>> X, uint_t M, uint_t seed)
+{
+    MatXT<Scalar> Xd;
+    PCRegistration::random_downsample(X, M, Xd, seed);
+    return Xd;
+}
+
+/**
+ * Deskewing in place: X must be a writable C-contiguous Nx3 array, so it is modified
+ * without a copy. float32 clouds are deskewed by the Scalar = float instances.
+ */
+template<typename Scalar>
+void deskew_py(Eigen::Ref<MatXT<Scalar>> X, const py::EigenDRef<const MatX1T<Scalar>> timestamps,
+        const SE3 &Tstart, const SE3 &Tend, uint_t numThreads)
+{
+    if (X.cols() != 3 || timestamps.rows() != X.rows())
+        throw std::invalid_argument("deskew: X must be a Nx3 array with a timestamp for each point");
+    py::gil_scoped_release release;
+    PCRegistration::deskew(X, timestamps, Tstart, Tend, numThreads);
+}
+
+template<typename Scalar>
+void deskew_poses_py(Eigen::Ref<MatXT<Scalar>> X, const py::EigenDRef<const MatX1T<Scalar>> timestamps,
+        const PCRegistration::BatchPoses &poses, uint_t numThreads)
+{
+    if (X.cols() != 3 || timestamps.rows() != X.rows())
+        throw std::invalid_argument("deskew: X must be a Nx3 array with a timestamp for each point");
+    if (poses.size() < 2)
+        throw std::invalid_argument("deskew: at least 2 poses are required");
+    py::gil_scoped_release release;
+    PCRegistration::deskew(X, timestamps, poses, numThreads);
+}
+
+/**
+ * Normals (Nx3) and GICP covariances (3Nx3) of a point cloud. The arrays are
+ * returned by value, so they are moved to numpy without a copy.
+ */
+template<typename Scalar>
+MatXT<Scalar> normals_solve(const py::EigenDRef<const MatXT<Scalar>> X, uint_t k, uint_t numThreads)
+{
+    if (X.cols() != 3)
+        throw std::invalid_argument("estimate_normals: X must be a Nx3 array");
+    MatXT<Scalar> normals;
+    {
+        py::gil_scoped_release release;
+        PCRegistration::estimate_normals(X, normals, k, numThreads);
+    }
+    return normals;
+}
+
+template<typename Scalar>
+MatXT<Scalar> covariances_solve(const py::EigenDRef<const MatXT<Scalar>> X, uint_t k, double epsilon, uint_t numThreads)
+{
+    if (X.cols() != 3)
+        throw std::invalid_argument("estimate_covariances: X must be a Nx3 array");
+    MatXT<Scalar> covariances;
+    {
+        py::gil_scoped_release release;
+        PCRegistration::estimate_covariances(X, covariances, k, epsilon, numThreads);
+    }
+    return covariances;
+}
+
+/**
+ * Batched registration of N problems with M correspondences each. Points are stacked
+ * by problem in X, Y and normals (NMx3) and the initial poses in T0 (4Nx4).
+ * Returns a tuple with the solutions (4Nx4), chi2, iterations and convergence of each problem.
+ */
+py::tuple batch_solve(PCRegistration::batchMetric metric,
+        const py::EigenDRef<const MatX> X, const py::EigenDRef<const MatX> Y,
+        const py::EigenDRef<const MatX> normals, const py::EigenDRef<const MatX> T0,
+        const MatX1 &weights, uint_t maxIters, double tol, uint_t numThreads)
+{
+    if (T0.cols() != 4 || T0.rows() % 4 != 0)
+        throw std::invalid_argument("batch registration: initial poses must be stacked as a 4Nx4 array");
+    uint_t N = T0.rows() / 4;
+    if (X.cols() != 3 || Y.cols() != 3 || X.rows() != Y.rows() || (N > 0 && X.rows() % N != 0))
+        throw std::invalid_argument("batch registration: X and Y must be NMx3 arrays");
+    if (metric == PCRegistration::POINT_TO_PLANE && (normals.cols() != 3 || normals.rows() != X.rows()))
+        throw std::invalid_argument("batch registration: normals must be a NMx3 array");
+    if (weights.size() != 0 && weights.size() != X.rows())
+        throw std::invalid_argument("batch registration: weights must have NM elements");
+
+    PCRegistration::BatchPoses T(N);
+    for (uint_t k = 0; k < N; ++k)
+        T[k] = SE3(Mat4(T0.block<4,4>(4*k, 0)));
+    std::vector<PCRegistration::BatchReport> report;
+    {
+        py::gil_scoped_release release;
+        PCRegistration::batch_solve(metric, X, Y, normals, weights, T, report, maxIters, tol, numThreads);
+    }
+
+    MatX Tsol(4*N, 4);
+    MatX1 chi2(N);
+    Eigen::Matrix<uint_t, Eigen::Dynamic, 1> iterations(N);
+    Eigen::Matrix<bool, Eigen::Dynamic, 1> converged(N);
+    for (uint_t k = 0; k < N; ++k)
+    {
+        Tsol.block<4,4>(4*k, 0) = T[k].T();
+        chi2(k) = report[k].chi2;
+        iterations(k) = report[k].iterations;
+        converged(k) = report[k].converged;
+    }
+    return py::make_tuple(Tsol, chi2, iterations, converged);
+}
+
+py::tuple batch_point_to_point(const py::EigenDRef<const MatX> X, const py::EigenDRef<const MatX> Y,
+        const py::EigenDRef<const MatX> T0, const MatX1 &weights, uint_t maxIters, double tol, uint_t numThreads)
+{
+    return batch_solve(PCRegistration::POINT_TO_POINT, X, Y, MatX(), T0, weights, maxIters, tol, numThreads);
+}
+
+py::tuple batch_point_to_plane(const py::EigenDRef<const MatX> X, const py::EigenDRef<const MatX> Y,
+        const py::EigenDRef<const MatX> normals, const py::EigenDRef<const MatX> T0,
+        const MatX1 &weights, uint_t maxIters, double tol, uint_t numThreads)
+{
+    return batch_solve(PCRegistration::POINT_TO_PLANE, X, Y, normals, T0, weights, maxIters, tol, numThreads);
+}
+
+/**
+ * Full ICP of X (Nx3) to Y (Mx3), starting from T0 (4x4).
+ * Returns a tuple with the solution T (SE3), iterations, correspondences, rmse and convergence.
+ */
+py::tuple icp_solve(const py::EigenDRef<const MatX> X, const py::EigenDRef<const MatX> Y, const Mat4 &T0,
+        PCRegistration::icpMetric metric, uint_t maxIters, double maxDistance, double tol,
+        uint_t numNeighbours, uint_t numThreads)
+{
+    if (X.cols() != 3 || Y.cols() != 3)
+        throw std::invalid_argument("icp: X and Y must be Nx3 arrays");
+    PCRegistration::ICPParameters params;
+    params.metric = metric;
+    params.maxIters = maxIters;
+    params.maxDistance = maxDistance;
+    params.tol = tol;
+    params.numNeighbours = numNeighbours;
+    params.numThreads = numThreads;
+    SE3 T(T0);
+    PCRegistration::ICPReport report;
+    {
+        py::gil_scoped_release release;
+        PCRegistration::icp(X, Y, T, params, report);
+    }
+    return py::make_tuple(T, report.iterations, report.correspondences, report.rmse, report.converged);
+}
+
+/**
+ * Local map for scan to map registration. Registration methods return a tuple
+ * (T, iterations, correspondences, rmse, converged) as icp().
+ */
+class LocalMapPy : public LocalMap
+{
+public:
+    LocalMapPy(const LocalMapParameters &params) : LocalMap(params) {}
+    py::tuple register_and_update_py(const py::EigenDRef<const MatX> scan)
+    {
+        if (scan.cols() != 3)
+            throw std::invalid_argument("LocalMap: scans must be Nx3 arrays");
+        PCRegistration::ICPReport report;
+        SE3 T;
+        {
+            py::gil_scoped_release release;
+            T = this->register_and_update(scan, report);
+        }
+        return py::make_tuple(T, report.iterations, report.correspondences, report.rmse, report.converged);
+    }
+    py::tuple register_scan_py(const py::EigenDRef<const MatX> scan, const SE3 &T0) const
+    {
+        if (scan.cols() != 3)
+            throw std::invalid_argument("LocalMap: scans must be Nx3 arrays");
+        PCRegistration::ICPReport report;
+        SE3 T(T0);
+        {
+            py::gil_scoped_release release;
+            this->register_scan(scan, T, report);
+        }
+        return py::make_tuple(T, report.iterations, report.correspondences, report.rmse, report.converged);
+    }
+    void insert_py(const py::EigenDRef<const MatX> scan, const SE3 &T)
+    {
+        if (scan.cols() != 3)
+            throw std::invalid_argument("LocalMap: scans must be Nx3 arrays");
+        this->insert(scan, T);
+    }
+    py::tuple get_voxels_py() const
+    {
+        MatX means, normals;
+        this->get_voxels(means, normals);
+        return py::make_tuple(means, normals);
+    }
+};
+
+/**
+ * Coarse to fine ICP over the list of voxel sizes, returns the same tuple as icp()
+ */
+py::tuple icp_pyramid_solve(const py::EigenDRef<const MatX> X, const py::EigenDRef<const MatX> Y,
+        const std::vector<double> &voxelSizes, const Mat4 &T0, PCRegistration::icpMetric metric,
+        uint_t maxIters, double maxDistance, double tol, uint_t numNeighbours, uint_t numThreads)
+{
+    if (X.cols() != 3 || Y.cols() != 3)
+        throw std::invalid_argument("icp_pyramid: X and Y must be Nx3 arrays");
+    PCRegistration::ICPParameters params;
+    params.metric = metric;
+    params.maxIters = maxIters;
+    params.maxDistance = maxDistance;
+    params.tol = tol;
+    params.numNeighbours = numNeighbours;
+    params.numThreads = numThreads;
+    SE3 T(T0);
+    PCRegistration::ICPReport report;
+    int iterations;
+    {
+        py::gil_scoped_release release;
+        iterations = PCRegistration::icp_pyramid(X, Y, T, voxelSizes, params, report);
+    }
+    return py::make_tuple(T, iterations, report.correspondences, report.rmse, report.converged);
+}
+
+/**
+ * RANSAC of the pairs X, Y (Nx3) with arun() hypotheses. Returns a tuple with the solution
+ * T (SE3), iterations, indices of the inliers (int64 array) and success.
+ */
+py::tuple ransac_arun_solve(const py::EigenDRef<const MatX> X, const py::EigenDRef<const MatX> Y,
+        double threshold, double confidence, uint_t maxIters, bool refine, uint_t seed, uint_t numThreads)
+{
+    if (X.cols() != 3 || Y.cols() != 3 || X.rows() != Y.rows())
+        throw std::invalid_argument("ransac_arun: X and Y must be Nx3 arrays of the same size");
+    if (threshold <= 0.0 || confidence <= 0.0 || confidence >= 1.0)
+        throw std::invalid_argument("ransac_arun: threshold must be positive and confidence in (0, 1)");
+    PCRegistration::RansacParameters params;
+    params.threshold = threshold;
+    params.confidence = confidence;
+    params.maxIters = maxIters;
+    params.refine = refine;
+    params.seed = seed;
+    params.numThreads = numThreads;
+    SE3 T;
+    PCRegistration::RansacReport report;
+    {
+        py::gil_scoped_release release;
+        PCRegistration::ransac_arun(X, Y, T, params, report);
+    }
+    Eigen::Matrix<int64_t, Eigen::Dynamic, 1> inliers(report.inliers.size());
+    for (uint_t i = 0; i < report.inliers.size(); ++i)
+        inliers(i) = report.inliers[i];
+    return py::make_tuple(T, report.iterations, inliers, report.success);
 }
 
+/**
+ * NDT registration of X (Nx3) to the Gaussians of the voxels of Y (Mx3), starting from T0 (4x4).
+ * Returns a tuple with the solution T (SE3), iterations, correspondences, score and convergence.
+ */
+py::tuple ndt_solve(const py::EigenDRef<const MatX> X, const py::EigenDRef<const MatX> Y, const Mat4 &T0,
+        double voxelSize, uint_t minPointsPerVoxel, double outlierRatio, bool searchNeighbours,
+        uint_t maxIters, double tol, uint_t numThreads)
+{
+    if (X.cols() != 3 || Y.cols() != 3)
+        throw std::invalid_argument("ndt: X and Y must be Nx3 arrays");
+    if (voxelSize <= 0.0 || outlierRatio < 0.0 || outlierRatio >= 1.0)
+        throw std::invalid_argument("ndt: voxel size must be positive and the outlier ratio in [0, 1)");
+    PCRegistration::NDTParameters params;
+    params.voxelSize = voxelSize;
+    params.minPointsPerVoxel = minPointsPerVoxel;
+    params.outlierRatio = outlierRatio;
+    params.searchNeighbours = searchNeighbours;
+    params.maxIters = maxIters;
+    params.tol = tol;
+    params.numThreads = numThreads;
+    SE3 T(T0);
+    PCRegistration::NDTReport report;
+    {
+        py::gil_scoped_release release;
+        PCRegistration::ndt(X, Y, T, params, report);
+    }
+    return py::make_tuple(T, report.iterations, report.correspondences, report.score, report.converged);
+}
+
+/**
+ * Batched registration of K independent pairs. Inputs are lists of C-contiguous float64
+ * arrays, converted once (with the GIL) only if they have another type or layout. The list
+ * keeps a reference to each array, so the C++ threads map the numpy memory directly, without
+ * copies and without the GIL. Each pair is solved on a single thread and the pairs are
+ * distributed over numThreads threads.
+ */
+using ArrayList = std::vector<py::array_t<double, py::array::c_style | py::array::forcecast>>;
+using TransformList = std::vector<Mat4, Eigen::aligned_allocator<Mat4>>;
+
+// C-contiguous arrays have the layout of the row-major MatX, so Refs to the maps do not copy them
+Eigen::Map<const MatX> map_array(const py::array_t<double, py::array::c_style | py::array::forcecast> &a)
+{
+    return Eigen::Map<const MatX>(a.data(), a.shape(0), a.ndim() > 1 ? a.shape(1) : 1);
+}
+
+Eigen::Map<const MatX1> map_vector(const py::array_t<double, py::array::c_style | py::array::forcecast> &a)
+{
+    return Eigen::Map<const MatX1>(a.data(), a.shape(0));
+}
 
+void check_batch(const ArrayList &X, const ArrayList &Y, const TransformList &T0, const char *name)
+{
+    if (X.size() != Y.size() || (!T0.empty() && T0.size() != X.size()))
+        throw std::invalid_argument(std::string(name) + ": lists of different sizes");
+    for (uint_t k = 0; k < X.size(); ++k)
+    {
+        if (X[k].ndim() != 2 || Y[k].ndim() != 2 || X[k].shape(1) != 3 || Y[k].shape(1) != 3 || X[k].shape(0) != Y[k].shape(0))
+            throw std::invalid_argument(std::string(name) + ": X and Y must be Nx3 arrays of the same size, pair " + std::to_string(k));
+    }
+}
+
+/**
+ * Stacked results: transforms (Kx4x4), iterations (K) and final costs (K)
+ */
+py::tuple batch_results(const TransformList &T, const std::vector<int64_t> &iterations, const MatX1 &costs)
+{
+    const py::ssize_t K = T.size();
+    py::array_t<double> Ts({K, py::ssize_t(4), py::ssize_t(4)});
+    auto r = Ts.mutable_unchecked<3>();
+    for (py::ssize_t k = 0; k < K; ++k)
+        for (py::ssize_t i = 0; i < 4; ++i)
+            for (py::ssize_t j = 0; j < 4; ++j)
+                r(k, i, j) = T[k](i, j);
+    return py::make_tuple(Ts, py::array_t<int64_t>(K, iterations.data()), costs);
+}
+
+py::tuple arun_batch(const ArrayList &X, const ArrayList &Y, uint_t numThreads)
+{
+    check_batch(X, Y, TransformList(), "arun_batch");
+    const uint_t K = X.size();
+    TransformList T(K);
+    std::vector<int64_t> iterations(K);
+    MatX1 costs(K);
+    {
+        py::gil_scoped_release release;
+        parallel_for(K, numThreads, [&](uint_t k)
+        {
+            const MatRefConst Xk = map_array(X[k]), Yk = map_array(Y[k]);
+            SE3 Tk;
+            iterations[k] = Xk.rows() >= 3 ? PCRegistration::arun(Xk, Yk, Tk) : 0;
+            T[k] = Tk.T();
+            costs(k) = PCRegistration::weighted_point_cost(Xk, Yk, MatX1::Ones(Xk.rows()), Tk);
+        });
+    }
+    return batch_results(T, iterations, costs);
+}
+
+py::tuple gicp_batch(const ArrayList &X, const ArrayList &Y, const ArrayList &covX, const ArrayList &covY,
+        const TransformList &T0, double tol, uint_t numThreads)
+{
+    check_batch(X, Y, T0, "gicp_batch");
+    const uint_t K = X.size();
+    if (covX.size() != K || covY.size() != K)
+        throw std::invalid_argument("gicp_batch: lists of different sizes");
+    for (uint_t k = 0; k < K; ++k)
+    {
+        for (const auto *cov : {&covX[k], &covY[k]})
+            if (cov->ndim() != 2 || cov->shape(0) != 3 * X[k].shape(0) || cov->shape(1) != 3)
+                throw std::invalid_argument("gicp_batch: covariances must be 3Nx3 arrays, pair " + std::to_string(k));
+        if (X[k].shape(0) < 3)
+            throw std::invalid_argument("gicp_batch: at least 3 correspondences are required, pair " + std::to_string(k));
+    }
+    TransformList T(K);
+    std::vector<int64_t> iterations(K);
+    MatX1 costs(K);
+    {
+        py::gil_scoped_release release;
+        parallel_for(K, numThreads, [&](uint_t k)
+        {
+            const MatRefConst Xk = map_array(X[k]), Yk = map_array(Y[k]);
+            const MatRefConst covXk = map_array(covX[k]), covYk = map_array(covY[k]);
+            SE3 Tk = T0.empty() ? SE3() : SE3(T0[k]);
+            iterations[k] = PCRegistration::gicp(Xk, Yk, covXk, covYk, Tk, tol, 1);
+            T[k] = Tk.T();
+            costs(k) = PCRegistration::gicp_cost(Xk, Yk, covXk, covYk, Tk);
+        });
+    }
+    return batch_results(T, iterations, costs);
+}
+
+py::tuple weighted_batch(const ArrayList &X, const ArrayList &Y, const ArrayList &weights,
+        const TransformList &T0, double tol, uint_t numThreads)
+{
+    check_batch(X, Y, T0, "weighted_batch");
+    const uint_t K = X.size();
+    if (weights.size() != K)
+        throw std::invalid_argument("weighted_batch: lists of different sizes");
+    for (uint_t k = 0; k < K; ++k)
+    {
+        if (weights[k].ndim() != 1 || weights[k].shape(0) != X[k].shape(0))
+            throw std::invalid_argument("weighted_batch: weights must be arrays of size N, pair " + std::to_string(k));
+        if (X[k].shape(0) < 3)
+            throw std::invalid_argument("weighted_batch: at least 3 correspondences are required, pair " + std::to_string(k));
+    }
+    TransformList T(K);
+    std::vector<int64_t> iterations(K);
+    MatX1 costs(K);
+    {
+        py::gil_scoped_release release;
+        parallel_for(K, numThreads, [&](uint_t k)
+        {
+            const MatRefConst Xk = map_array(X[k]), Yk = map_array(Y[k]);
+            const VectRefConst wk = map_vector(weights[k]);
+            SE3 Tk = T0.empty() ? SE3() : SE3(T0[k]);
+            iterations[k] = PCRegistration::weighted_point(Xk, Yk, wk, Tk, tol, 1);
+            T[k] = Tk.T();
+            costs(k) = PCRegistration::weighted_point_cost(Xk, Yk, wk, Tk);
+        });
+    }
+    return batch_results(T, iterations, costs);
+}
+
+void init_PCRegistration(py::module &m)
+{
+    py::enum_<PCRegistration::icpMetric>(m, "icpMetric")
+        .value("POINT_TO_POINT", PCRegistration::icpMetric::ICP_POINT_TO_POINT)
+        .value("POINT_TO_PLANE", PCRegistration::icpMetric::ICP_POINT_TO_PLANE)
+        .value("GICP", PCRegistration::icpMetric::ICP_GICP)
+        .export_values()
+        ;
+
+    m.def("arun", &arun_solve);
+    m.def("gicp", &gicp_solve<matData_t>);
+    m.def("gicp", &gicp_solve<float>);
+    m.def("weighted", &weighted_solve<matData_t>);
+    m.def("weighted", &weighted_solve<float>);
+    m.def("arun_batch", &arun_batch,
+            "Solves arun() for each pair of the lists X, Y (Nx3 arrays) in parallel, without the GIL. "
+            "Returns a tuple (T (Kx4x4), iterations (1 if solved, 0 if degenerate), costs 0.5 sum |y - Tx|^2).",
+            py::arg("X"),
+            py::arg("Y"),
+            py::arg("num_threads") = 0);
+    m.def("gicp_batch", &gicp_batch,
+            "Solves gicp() for each pair of the lists X, Y (Nx3 arrays) and covariances (3Nx3), "
+            "starting from the list T0 (4x4, identity if empty), in parallel without the GIL. "
+            "Returns a tuple (T (Kx4x4), iterations, costs 0.5 sum r' (covY + R covX R')^-1 r).",
+            py::arg("X"),
+            py::arg("Y"),
+            py::arg("covX"),
+            py::arg("covY"),
+            py::arg("T0") = TransformList(),
+            py::arg("tol") = 1e-4,
+            py::arg("num_threads") = 0);
+    m.def("weighted_batch", &weighted_batch,
+            "Solves weighted_point() for each pair of the lists X, Y (Nx3 arrays) and weights (N), "
+            "starting from the list T0 (4x4, identity if empty), in parallel without the GIL. "
+            "Returns a tuple (T (Kx4x4), iterations, costs 0.5 sum w |y - Tx|^2).",
+            py::arg("X"),
+            py::arg("Y"),
+            py::arg("weights"),
+            py::arg("T0") = TransformList(),
+            py::arg("tol") = 1e-4,
+            py::arg("num_threads") = 0);
+    m.def("batch_point_to_point", &batch_point_to_point,
+            "Solves N independent point to point registrations of M points each, in parallel. "
+            "X and Y are NMx3 arrays stacked by problem and T0 the 4Nx4 initial poses. "
+            "Returns a tuple (T, chi2, iterations, converged).",
+            py::arg("X"),
+            py::arg("Y"),
+            py::arg("T0"),
+            py::arg("weights") = MatX1(),
+            py::arg("max_iters") = 20,
+            py::arg("tol") = 1e-6,
+            py::arg("num_threads") = 0);
+    m.def("batch_point_to_plane", &batch_point_to_plane,
+            "Solves N independent point to plane registrations of M points each, in parallel. "
+            "X, Y and normals (of Y) are NMx3 arrays stacked by problem and T0 the 4Nx4 initial poses. "
+            "Returns a tuple (T, chi2, iterations, converged).",
+            py::arg("X"),
+            py::arg("Y"),
+            py::arg("normals"),
+            py::arg("T0"),
+            py::arg("weights") = MatX1(),
+            py::arg("max_iters") = 20,
+            py::arg("tol") = 1e-6,
+            py::arg("num_threads") = 0);
+    py::enum_<PCRegistration::downsampleMode>(m, "downsampleMode")
+        .value("CENTROID", PCRegistration::downsampleMode::DOWNSAMPLE_CENTROID)
+        .value("FIRST_POINT", PCRegistration::downsampleMode::DOWNSAMPLE_FIRST_POINT)
+        .export_values()
+        ;
+    m.def("voxel_downsample", &voxel_downsample_py<matData_t>,
+            "Voxel grid downsampling of X (Nx3) to the centroid or the first point of each voxel, "
+            "calculated in parallel.",
+            py::arg("X"),
+            py::arg("voxel_size"),
+            py::arg("mode") = PCRegistration::DOWNSAMPLE_CENTROID,
+            py::arg("num_threads") = 0);
+    m.def("voxel_downsample", &voxel_downsample_py<float>,
+            py::arg("X"),
+            py::arg("voxel_size"),
+            py::arg("mode") = PCRegistration::DOWNSAMPLE_CENTROID,
+            py::arg("num_threads") = 0);
+    m.def("random_downsample", &random_downsample_py<matData_t>,
+            "Random subset of M points of X, in their order in X.",
+            py::arg("X"),
+            py::arg("M"),
+            py::arg("seed") = 0);
+    m.def("random_downsample", &random_downsample_py<float>,
+            py::arg("X"),
+            py::arg("M"),
+            py::arg("seed") = 0);
+    m.def("deskew", &deskew_py<matData_t>,
+            "Motion compensation in place of the scan X (Nx3), whose points are measured at the "
+            "normalized timestamps in [0, 1] while moving from T_start to T_end. Each point is "
+            "transformed by the interpolated pose T_start exp(tau Ln(T_start^-1 T_end)).",
+            py::arg("X").noconvert(),
+            py::arg("timestamps"),
+            py::arg("T_start"),
+            py::arg("T_end"),
+            py::arg("num_threads") = 0);
+    m.def("deskew", &deskew_py<float>,
+            py::arg("X").noconvert(),
+            py::arg("timestamps"),
+            py::arg("T_start"),
+            py::arg("T_end"),
+            py::arg("num_threads") = 0);
+    m.def("deskew", &deskew_poses_py<matData_t>,
+            "Motion compensation in place over a list of poses evenly spaced in the timestamps [0, 1].",
+            py::arg("X").noconvert(),
+            py::arg("timestamps"),
+            py::arg("poses"),
+            py::arg("num_threads") = 0);
+    m.def("deskew", &deskew_poses_py<float>,
+            py::arg("X").noconvert(),
+            py::arg("timestamps"),
+            py::arg("poses"),
+            py::arg("num_threads") = 0);
+    m.def("estimate_normals", &normals_solve<matData_t>,
+            "Normals (Nx3) of the point cloud X from its k nearest neighbours, calculated in parallel.",
+            py::arg("X"),
+            py::arg("k") = 10,
+            py::arg("num_threads") = 0);
+    m.def("estimate_normals", &normals_solve<float>,
+            py::arg("X"),
+            py::arg("k") = 10,
+            py::arg("num_threads") = 0);
+    m.def("estimate_covariances", &covariances_solve<matData_t>,
+            "Covariances R diag(epsilon,1,1) R' of the local planes of the point cloud X, from "
+            "its k nearest neighbours, stacked as a 3Nx3 array as gicp() requires.",
+            py::arg("X"),
+            py::arg("k") = 10,
+            py::arg("epsilon") = 1e-3,
+            py::arg("num_threads") = 0);
+    m.def("estimate_covariances", &covariances_solve<float>,
+            py::arg("X"),
+            py::arg("k") = 10,
+            py::arg("epsilon") = 1e-3,
+            py::arg("num_threads") = 0);
+    py::class_<LocalMapParameters>(m, "LocalMapParameters")
+        .def(py::init<>())
+        .def_readwrite("metric", &LocalMapParameters::metric)
+        .def_readwrite("voxel_size", &LocalMapParameters::voxelSize)
+        .def_readwrite("scan_voxel_size", &LocalMapParameters::scanVoxelSize)
+        .def_readwrite("max_points_per_voxel", &LocalMapParameters::maxPointsPerVoxel)
+        .def_readwrite("min_points_per_voxel", &LocalMapParameters::minPointsPerVoxel)
+        .def_readwrite("max_range", &LocalMapParameters::maxRange)
+        .def_readwrite("max_distance", &LocalMapParameters::maxDistance)
+        .def_readwrite("max_iters", &LocalMapParameters::maxIters)
+        .def_readwrite("tol", &LocalMapParameters::tol)
+        .def_readwrite("num_neighbours", &LocalMapParameters::numNeighbours)
+        .def_readwrite("plane_epsilon", &LocalMapParameters::planeEpsilon)
+        .def_readwrite("num_threads", &LocalMapParameters::numThreads)
+        ;
+    py::class_<LocalMapPy>(m, "LocalMap",
+            "Local voxel map for scan to map registration, e.g. LiDAR odometry.")
+        .def(py::init<const LocalMapParameters &>(),
+                py::arg("params") = LocalMapParameters())
+        .def("register_and_update", &LocalMapPy::register_and_update_py,
+                "Registers the scan (Nx3, sensor frame) starting from a constant velocity prediction, "
+                "inserts it in the map and evicts the voxels out of range. "
+                "Returns a tuple (T, iterations, correspondences, rmse, converged).",
+                py::arg("scan"))
+        .def("register_scan", &LocalMapPy::register_scan_py,
+                "Registers the scan starting from T0 without modifying the map.",
+                py::arg("scan"),
+                py::arg("T0"))
+        .def("insert", &LocalMapPy::insert_py,
+                "Inserts the scan at pose T.",
+                py::arg("scan"),
+                py::arg("T"))
+        .def("evict", &LocalMapPy::evict,
+                "Removes the voxels farther than max_range from center.",
+                py::arg("center"))
+        .def("clear", &LocalMapPy::clear)
+        .def("set_pose", &LocalMapPy::set_pose,
+                "Sets the pose of the next scan and resets the velocity.")
+        .def("get_pose", &LocalMapPy::get_pose)
+        .def("number_voxels", &LocalMapPy::number_voxels)
+        .def("get_voxels", &LocalMapPy::get_voxels_py,
+                "Returns a tuple (means, normals) of the voxels with enough points.")
+        ;
+    m.def("icp", &icp_solve,
+            "Registers the point cloud X (Nx3) to Y (Mx3) starting from T0, searching the "
+            "nearest neighbours in Y at each iteration. Returns a tuple "
+            "(T, iterations, correspondences, rmse, converged).",
+            py::arg("X"),
+            py::arg("Y"),
+            py::arg("T0") = Mat4(Mat4::Identity()),
+            py::arg("metric") = PCRegistration::ICP_POINT_TO_POINT,
+            py::arg("max_iters") = 30,
+            py::arg("max_distance") = 1.0,
+            py::arg("tol") = 1e-6,
+            py::arg("num_neighbours") = 10,
+            py::arg("num_threads") = 0);
+    m.def("icp_pyramid", &icp_pyramid_solve,
+            "Coarse to fine ICP: X and Y are downsampled to each of the voxel sizes (0 for full "
+            "resolution) and registered from the solution of the previous level. "
+            "Returns a tuple (T, iterations, correspondences, rmse, converged).",
+            py::arg("X"),
+            py::arg("Y"),
+            py::arg("voxel_sizes"),
+            py::arg("T0") = Mat4(Mat4::Identity()),
+            py::arg("metric") = PCRegistration::ICP_POINT_TO_POINT,
+            py::arg("max_iters") = 30,
+            py::arg("max_distance") = 1.0,
+            py::arg("tol") = 1e-6,
+            py::arg("num_neighbours") = 10,
+            py::arg("num_threads") = 0);
+    m.def("ransac_arun", &ransac_arun_solve,
+            "Robust registration of the associated pairs X, Y (Nx3) with outliers: RANSAC over "
+            "minimal samples solved by arun(), refined on the inliers. Returns a tuple "
+            "(T, iterations, inliers, success).",
+            py::arg("X"),
+            py::arg("Y"),
+            py::arg("threshold"),
+            py::arg("confidence") = 0.999,
+            py::arg("max_iters") = 10000,
+            py::arg("refine") = true,
+            py::arg("seed") = 0,
+            py::arg("num_threads") = 0);
+    m.def("ndt", &ndt_solve,
+            "Normal Distributions Transform: registers X (Nx3) to the Gaussians of the voxels of "
+            "Y (Mx3) starting from T0, without nearest neighbour search. Returns a tuple "
+            "(T, iterations, correspondences, score, converged).",
+            py::arg("X"),
+            py::arg("Y"),
+            py::arg("T0") = Mat4(Mat4::Identity()),
+            py::arg("voxel_size") = 1.0,
+            py::arg("min_points_per_voxel") = 5,
+            py::arg("outlier_ratio") = 0.55,
+            py::arg("search_neighbours") = true,
+            py::arg("max_iters") = 30,
+            py::arg("tol") = 1e-6,
+            py::arg("num_threads") = 0);
+}
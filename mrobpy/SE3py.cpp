@@ -78,16 +78,32 @@ void init_geometry(py::module &m) {
         .def("transform", &SE3::transform,
                 "given a point in 3D, is transformed by the current RBT",
                 py::return_value_policy::copy)
-        .def("transform_array", &SE3::transform_array,
+        .def("transform_array", py::overload_cast<const MatX&>(&SE3::transform_array, py::const_),
                 "Given a stacked array of point Nx3, are transformed by the current RBT",
                 py::return_value_policy::copy,
               "Input is a an array Nx3 and output is Nx3") // makes a copy of the array. TODO, pass by Ref and avoid copying, look at ownership
+        .def("transform_array", py::overload_cast<const MatXf&>(&SE3::transform_array, py::const_),
+                "Given a stacked float32 array of point Nx3, are transformed by the current RBT",
+                py::return_value_policy::copy,
+              "Input is a an array Nx3 and output is Nx3, both in single precision")
         .def("inv", &SE3::inv,
                 "Outputs the inverse of the current SE3. This is a new object",
                 py::return_value_policy::copy)
         .def("adj", &SE3::adj,
                 "Returns the 6x6 adjoint matrix of the current SE3",
                 py::return_value_policy::copy)
+        .def("jacl", &SE3::jacl,
+                "Returns the 6x6 left Jacobian evaluated at Ln(T)",
+                py::return_value_policy::copy)
+        .def("jacr", &SE3::jacr,
+                "Returns the 6x6 right Jacobian evaluated at Ln(T)",
+                py::return_value_policy::copy)
+        .def("jacl_inv", &SE3::jacl_inv,
+                "Returns the inverse of the left Jacobian evaluated at Ln(T)",
+                py::return_value_policy::copy)
+        .def("jacr_inv", &SE3::jacr_inv,
+                "Returns the inverse of the right Jacobian evaluated at Ln(T)",
+                py::return_value_policy::copy)
         .def("distance", &SE3::distance,
                 "Calculates the distance between the current object and the argument as d = ||Ln(T^{1}*T_)||. If no element is provided, this is the norm of the object",
                 py::arg("rhs")=SE3())
@@ -128,6 +144,18 @@ void init_geometry(py::module &m) {
         .def("adj", &SO3::adj,
                 "Returns the 3x3 adjoint matrix of the SO3 element",
                 py::return_value_policy::copy)
+        .def("jacl", &SO3::jacl,
+                "Returns the 3x3 left Jacobian evaluated at Ln(R)",
+                py::return_value_policy::copy)
+        .def("jacr", &SO3::jacr,
+                "Returns the 3x3 right Jacobian evaluated at Ln(R)",
+                py::return_value_policy::copy)
+        .def("jacl_inv", &SO3::jacl_inv,
+                "Returns the inverse of the left Jacobian evaluated at Ln(R)",
+                py::return_value_policy::copy)
+        .def("jacr_inv", &SO3::jacr_inv,
+                "Returns the inverse of the right Jacobian evaluated at Ln(R)",
+                py::return_value_policy::copy)
         .def("distance", &SO3::distance,
                 "Calculates the distance between rotation matrices as ||Ln(R'*R_i)||")
         .def("print", &SO3::print, "Prints current information of the rotation")
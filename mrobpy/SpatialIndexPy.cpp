@@ -0,0 +1,208 @@
+/* Copyright (c) 2022, Gonzalo Ferrer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * SpatialIndexPy.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Gonzalo Ferrer
+ *              g.ferrer@skoltech.ru
+ *              Mobile Robotics Lab, Skoltech
+ */
+
+
+/**
+ * Python binding of the spatial indices of points, KD-tree and voxel hash map.
+ * As in scipy.spatial, distances are returned (not squared) and missing
+ * neighbours have index -1.
+ */
+
+#include <pybind11/pybind11.h>
+#include <pybind11/eigen.h>
+#include <pybind11/stl.h>
+namespace py = pybind11;
+
+#include "mrob/kd_tree.hpp"
+#include "mrob/voxel_hash_map.hpp"
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+
+
+using namespace mrob;
+
+using IndexArray = Eigen::Matrix<int64_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+/**
+ * Converts the outputs of the C++ queries, row major rows x cols, to numpy arrays
+ */
+py::tuple query_result(const std::vector<uint_t> &indices, const std::vector<matData_t> &distances2,
+                       uint_t rows, uint_t cols)
+{
+    IndexArray I(rows, cols);
+    MatX D(rows, cols);
+    for (uint_t i = 0; i < indices.size(); ++i)
+    {
+        I.data()[i] = indices[i] == KDTree::npos ? -1 : int64_t(indices[i]);
+        D.data()[i] = std::sqrt(distances2[i]);
+    }
+    return py::make_tuple(I, D);
+}
+
+const py::EigenDRef<const MatX>& check_points(const py::EigenDRef<const MatX> &Q)
+{
+    if (Q.cols() != 3)
+        throw std::invalid_argument("spatial index: points must be Nx3 arrays");
+    return Q;
+}
+
+
+class KDTreePy : public KDTree
+{
+public:
+    KDTreePy(const py::EigenDRef<const MatX> points, uint_t leafSize, uint_t numThreads) :
+        KDTree(check_points(points), leafSize, numThreads)
+    {
+    }
+    /**
+     * Returns a tuple (indices, distances) of the nearest point of each row of Q (Mx1 arrays)
+     */
+    py::tuple query_nearest(const py::EigenDRef<const MatX> Q, double maxDistance, uint_t numThreads) const
+    {
+        check_points(Q);
+        std::vector<uint_t> indices;
+        std::vector<matData_t> distances2;
+        {
+            py::gil_scoped_release release;
+            this->batch_nearest(Q, maxDistance * maxDistance, indices, distances2, numThreads);
+        }
+        return query_result(indices, distances2, Q.rows(), 1);
+    }
+    /**
+     * Returns a tuple (indices, distances) of the k nearest points of each row of Q (Mxk arrays)
+     */
+    py::tuple query_knn(const py::EigenDRef<const MatX> Q, uint_t k, uint_t numThreads) const
+    {
+        check_points(Q);
+        std::vector<uint_t> indices;
+        std::vector<matData_t> distances2;
+        {
+            py::gil_scoped_release release;
+            this->batch_knn(Q, k, indices, distances2, numThreads);
+        }
+        return query_result(indices, distances2, Q.rows(), std::min(k, this->size()));
+    }
+    std::vector<std::vector<uint_t>> query_radius(const py::EigenDRef<const MatX> Q, double radius, uint_t numThreads) const
+    {
+        check_points(Q);
+        std::vector<std::vector<uint_t>> indices;
+        {
+            py::gil_scoped_release release;
+            this->batch_radius(Q, radius, indices, numThreads);
+        }
+        return indices;
+    }
+};
+
+
+class VoxelHashMapPy : public VoxelHashMap
+{
+public:
+    VoxelHashMapPy(double voxelSize) : VoxelHashMap(voxelSize) {}
+    uint_t insert_points(const py::EigenDRef<const MatX> points)
+    {
+        check_points(points);
+        return this->insert_array(points);
+    }
+    py::tuple query_nearest(const py::EigenDRef<const MatX> Q, double maxDistance, uint_t numThreads) const
+    {
+        check_points(Q);
+        std::vector<uint_t> ids;
+        std::vector<matData_t> distances2;
+        {
+            py::gil_scoped_release release;
+            this->batch_nearest(Q, maxDistance * maxDistance, ids, distances2, numThreads);
+        }
+        return query_result(ids, distances2, Q.rows(), 1);
+    }
+    std::vector<uint_t> query_radius(const Mat31 &q, double radius) const
+    {
+        std::vector<uint_t> ids;
+        std::vector<matData_t> distances2;
+        this->radius(q, radius, ids, distances2);
+        return ids;
+    }
+};
+
+
+void init_spatial_index(py::module &m)
+{
+    py::class_<KDTreePy>(m, "KDTree",
+            "Static KD-tree of a point cloud Nx3, for nearest neighbour searches.")
+        .def(py::init<const py::EigenDRef<const MatX>, uint_t, uint_t>(),
+                "Builds the tree in parallel on num_threads threads (0 for all).",
+                py::arg("points"),
+                py::arg("leaf_size") = 16,
+                py::arg("num_threads") = 0)
+        .def("nearest", &KDTreePy::query_nearest,
+                "Nearest point of each row of Q (Mx3). Returns a tuple (indices, distances), "
+                "index -1 if there is no point closer than max_distance.",
+                py::arg("Q"),
+                py::arg("max_distance") = std::numeric_limits<double>::infinity(),
+                py::arg("num_threads") = 0)
+        .def("knn", &KDTreePy::query_knn,
+                "k nearest points of each row of Q (Mx3), sorted by distance. "
+                "Returns a tuple (indices, distances) of Mxk arrays.",
+                py::arg("Q"),
+                py::arg("k"),
+                py::arg("num_threads") = 0)
+        .def("radius", &KDTreePy::query_radius,
+                "List with the indices of the points within radius of each row of Q (Mx3).",
+                py::arg("Q"),
+                py::arg("radius"),
+                py::arg("num_threads") = 0)
+        .def("size", &KDTreePy::size)
+        ;
+
+    py::class_<VoxelHashMapPy>(m, "VoxelHashMap",
+            "Hash map of voxels for point clouds that change incrementally. Each point "
+            "inserted receives a consecutive id, used to remove it and returned by the queries.")
+        .def(py::init<double>(),
+                py::arg("voxel_size"))
+        .def("insert", &VoxelHashMapPy::insert_points,
+                "Inserts the points Nx3 and returns the id of the first one.",
+                py::arg("points"))
+        .def("remove", &VoxelHashMapPy::remove,
+                "Removes the point id, returns False if it was not in the map.",
+                py::arg("id"))
+        .def("remove_far", &VoxelHashMapPy::remove_far,
+                "Removes the voxels farther than distance from center and returns the number of points removed.",
+                py::arg("center"),
+                py::arg("distance"))
+        .def("clear", &VoxelHashMapPy::clear)
+        .def("nearest", &VoxelHashMapPy::query_nearest,
+                "Nearest point of each row of Q (Mx3) closer than max_distance. Returns a tuple (ids, distances), "
+                "id -1 if there is none. The cost grows with (max_distance / voxel_size)^3.",
+                py::arg("Q"),
+                py::arg("max_distance"),
+                py::arg("num_threads") = 0)
+        .def("radius", &VoxelHashMapPy::query_radius,
+                "Ids of the points within radius of q.",
+                py::arg("q"),
+                py::arg("radius"))
+        .def("size", &VoxelHashMapPy::size)
+        .def("number_voxels", &VoxelHashMapPy::number_voxels)
+        ;
+}
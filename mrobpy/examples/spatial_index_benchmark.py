@@ -0,0 +1,36 @@
+# Benchmark of the spatial indices on a 1M point cloud, compared with
+# scipy.spatial.cKDTree when it is available.
+import time
+import numpy as np
+import mrob
+
+N = 1000000
+X = np.random.rand(N,3)
+Q = np.random.rand(N,3)
+
+
+def timed(name, f):
+    t0 = time.perf_counter()
+    result = f()
+    print('{:40s} {:8.3f} s'.format(name, time.perf_counter() - t0))
+    return result
+
+for threads in [1, 0]:
+    print('mrob, threads =', 'all' if threads == 0 else threads)
+    tree = timed('KDTree build', lambda: mrob.geometry.KDTree(X, num_threads=threads))
+    timed('KDTree nearest, 1M queries', lambda: tree.nearest(Q, num_threads=threads))
+    timed('KDTree knn k=10, 1M queries', lambda: tree.knn(Q, 10, num_threads=threads))
+
+voxels = mrob.geometry.VoxelHashMap(0.01)
+timed('VoxelHashMap insert', lambda: voxels.insert(X))
+timed('VoxelHashMap nearest, 1M queries', lambda: voxels.nearest(Q, 0.02))
+
+try:
+    from scipy.spatial import cKDTree
+    print('scipy')
+    tree = timed('cKDTree build', lambda: cKDTree(X))
+    timed('cKDTree nearest, 1M queries', lambda: tree.query(Q, workers=1))
+    timed('cKDTree knn k=10, 1M queries', lambda: tree.query(Q, 10, workers=1))
+    timed('cKDTree nearest, 1M queries, all threads', lambda: tree.query(Q, workers=-1))
+except ImportError:
+    print('scipy is not installed, skipping the comparison')
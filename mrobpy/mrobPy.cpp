@@ -27,6 +27,7 @@
 
 
 #include "mrob/optimizer.hpp"
+#include "mrob/iteration_log.hpp"
 
 namespace py = pybind11;
 
@@ -37,6 +38,7 @@ void init_FGraph(py::module &m);
 //void init_FGraphDense(py::module &m);
 void init_PCRegistration(py::module &m);
 void init_PCPlanes(py::module &m);
+void init_spatial_index(py::module &m);
 
 
 
@@ -50,12 +52,39 @@ PYBIND11_MODULE(mrob, m) {
         .value("NEWTON_RAPHSON", mrob::Optimizer::optimMethod::NEWTON_RAPHSON)
         .value("LEVENBERG_MARQUARDT_SPHER", mrob::Optimizer::optimMethod::LEVENBERG_MARQUARDT_SPHER)
         .value("LEVENBERG_MARQUARDT_ELLIP", mrob::Optimizer::optimMethod::LEVENBERG_MARQUARDT_ELLIP)
+        .value("DOGLEG", mrob::Optimizer::optimMethod::DOGLEG)
+        .value("NEWTON_RAPHSON_LINE_SEARCH", mrob::Optimizer::optimMethod::NEWTON_RAPHSON_LINE_SEARCH)
+        .value("LBFGS", mrob::Optimizer::optimMethod::LBFGS)
+        .value("NONLINEAR_CG", mrob::Optimizer::optimMethod::NONLINEAR_CG)
         .export_values()
         ;
 
+    // Solvers telemetry, common to all modules
+    py::enum_<mrob::IterationLog::verbosityLevel>(m, "verbosityLevel")
+        .value("SILENT", mrob::IterationLog::verbosityLevel::SILENT)
+        .value("SUMMARY", mrob::IterationLog::verbosityLevel::SUMMARY)
+        .value("ITERATIONS", mrob::IterationLog::verbosityLevel::ITERATIONS)
+        .export_values()
+        ;
+    py::class_<mrob::IterationRecord>(m, "IterationRecord",
+            "Values of one iteration of a solver. Times are in microseconds.")
+        .def_readonly("iteration", &mrob::IterationRecord::iteration)
+        .def_readonly("lambda_", &mrob::IterationRecord::lambda)
+        .def_readonly("chi2", &mrob::IterationRecord::chi2)
+        .def_readonly("delta_chi2", &mrob::IterationRecord::deltaChi2)
+        .def_readonly("model_fidelity", &mrob::IterationRecord::modelFidelity)
+        .def_readonly("step_norm", &mrob::IterationRecord::stepNorm)
+        .def_readonly("accepted", &mrob::IterationRecord::accepted)
+        .def_readonly("time_build", &mrob::IterationRecord::timeBuild)
+        .def_readonly("time_factorize", &mrob::IterationRecord::timeFactorize)
+        .def_readonly("time_solve", &mrob::IterationRecord::timeSolve)
+        .def_readonly("time_chi2", &mrob::IterationRecord::timeChi2)
+        ;
+
     // TODO to be deprecated this namespace
     py::module m_geom = m.def_submodule("geometry");
     init_geometry(m_geom);
+    init_spatial_index(m_geom);
 
     // deprecated have removed this namespace
     // TODO Need the namespace for the enums, but the Gprah should not be on it, just directly visible
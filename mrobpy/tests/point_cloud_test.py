@@ -25,3 +25,152 @@ class TestPointCloud:
         print('Weighted point optimization solution =\n', T_wp.T())
 
         assert(np.ndarray.all(np.isclose(T.T(),T_wp.T())))
+
+    def test_point_cloud_registration_float32(self):
+        # float32 clouds are registered in single precision, without conversion to double
+        N = 500
+        X = np.random.rand(N,3).astype(np.float32)
+        T = mrob.geometry.SE3(np.random.rand(6))
+        Y = T.transform_array(X)
+        assert(Y.dtype == np.float32)
+
+        W = np.ones(N, dtype=np.float32)
+        T_wp = mrob.registration.weighted(X,Y,W)
+        assert(np.ndarray.all(np.isclose(T.T(),T_wp.T(), atol=1e-4)))
+
+    def test_icp(self):
+        # correspondences are unknown: Y is a shuffled copy of the transformed cloud
+        N = 2000
+        X = np.random.rand(N,3)
+        T = mrob.geometry.SE3(np.array([0.01, -0.02, 0.015, 0.02, 0.01, -0.01]))
+        Y = T.transform_array(X)[np.random.permutation(N)]
+
+        T_icp, iters, corr, rmse, converged = mrob.registration.icp(X, Y, metric=mrob.registration.POINT_TO_POINT)
+        assert(converged)
+        assert(np.ndarray.all(np.isclose(T.T(), T_icp.T(), atol=1e-4)))
+
+    def test_estimate_covariances(self):
+        # points on a smooth surface, the covariances are estimated from the neighbours
+        N = 5000
+        Y = np.random.rand(N,3)
+        Y[:,2] = 0.3*np.sin(3*Y[:,0]) + 0.2*np.cos(2*Y[:,1])
+        T = mrob.geometry.SE3(np.array([0.02, -0.01, 0.03, 0.05, -0.02, 0.01]))
+        X = T.inv().transform_array(Y)
+
+        normals = mrob.registration.estimate_normals(X)
+        assert(normals.shape == (N,3))
+        assert(np.allclose(np.linalg.norm(normals, axis=1), 1.0))
+
+        covX = mrob.registration.estimate_covariances(X)
+        covY = mrob.registration.estimate_covariances(Y)
+        assert(covX.shape == (3*N,3))
+        T_gicp = mrob.registration.gicp(X, Y, covX, covY)
+        assert(np.ndarray.all(np.isclose(T.T(), T_gicp.T(), atol=1e-6)))
+
+    def test_local_map(self):
+        # a room with a sloped floor, scanned from a sensor moving at constant velocity
+        N = 200000
+        world = np.random.uniform(-20, 20, (N,3))
+        world[:,2] = 0.02*world[:,0]
+        side = np.random.randint(0, 5, N)
+        world[side==1,0] = 20
+        world[side==2,0] = -20
+        world[side==3,1] = 20
+        world[side==4,1] = -20
+        walls = side > 0
+        world[walls,2] = np.random.uniform(0, 5, np.sum(walls))
+
+        local_map = mrob.registration.LocalMap()
+        for k in range(5):
+            T = mrob.geometry.SE3(np.array([0, 0, 0.02*k, 0.5*k, 0.2*k, 1.5]))
+            scan = T.inv().transform_array(world[np.random.choice(N, 30000, replace=False)])
+            if k == 0:
+                local_map.set_pose(T)
+            T_map, iters, corr, rmse, converged = local_map.register_and_update(scan)
+            assert(np.linalg.norm(T_map.T() - T.T()) < 0.05)
+        assert(local_map.number_voxels() > 0)
+
+    def test_downsample_and_icp_pyramid(self):
+        X = np.random.rand(10000,3)
+        Xd = mrob.registration.voxel_downsample(X, 0.25)
+        assert(Xd.shape == (64,3))
+        Xf = mrob.registration.voxel_downsample(X, 0.25, mode=mrob.registration.FIRST_POINT)
+        assert(np.all(Xf[0] == X[0]))
+        assert(mrob.registration.random_downsample(X, 100).shape == (100,3))
+
+        # surface with a large initial error, solved from coarse to fine
+        Y = np.random.uniform(-5, 5, (20000,3))
+        Y[:,2] = np.sin(0.6*Y[:,0]) + np.cos(0.4*Y[:,1])
+        T = mrob.geometry.SE3(np.array([0.1, -0.05, 0.3, 1.2, -0.8, 0.3]))
+        X = T.inv().transform_array(Y)
+        T_icp, iters, corr, rmse, converged = mrob.registration.icp_pyramid(X, Y, [2.0, 1.0, 0.5, 0.0])
+        assert(np.ndarray.all(np.isclose(T.T(), T_icp.T(), atol=1e-4)))
+
+    def test_ndt(self):
+        # surface and two walls, registered to the Gaussians of their voxels
+        Y = np.random.uniform(-5, 5, (30000,3))
+        Y[:,2] = np.sin(0.6*Y[:,0]) + np.cos(0.4*Y[:,1])
+        Y[:10000,0] = 5.0
+        Y[10000:20000,1] = 5.0
+        T = mrob.geometry.SE3(np.array([0.05, -0.03, 0.1, 0.3, -0.2, 0.1]))
+        X = T.inv().transform_array(Y)
+        T_ndt, iters, corr, score, converged = mrob.registration.ndt(X, Y)
+        assert(converged)
+        assert(corr == 30000)
+        assert(T_ndt.distance(T) < 1e-2)
+
+    def test_ransac_arun(self):
+        N = 10000
+        X = np.random.uniform(-10, 10, (N,3))
+        T = mrob.geometry.SE3(np.array([0.5, -1.3, 2.0, 3, -2, 1]))
+        Y = T.transform_array(X) + np.random.normal(0, 0.01, (N,3))
+        outliers = np.random.rand(N) < 0.8
+        Y[outliers] = np.random.uniform(-10, 10, (np.count_nonzero(outliers),3))
+        T_ransac, iters, inliers, success = mrob.registration.ransac_arun(X, Y, threshold=0.05)
+        assert(success)
+        assert(np.count_nonzero(outliers[inliers]) < 5)
+        assert(len(inliers) > 0.95 * np.count_nonzero(~outliers))
+        assert(T_ransac.distance(T) < 1e-2)
+
+    def test_batch_registration(self):
+        # independent pairs solved in parallel, compared with the single calls
+        K, N = 20, 200
+        Xs, Ys, Ws, Ts = [], [], [], []
+        for k in range(K):
+            X = np.random.rand(N,3)
+            T = mrob.geometry.SE3(0.3*np.random.rand(6))
+            Xs.append(X)
+            Ys.append(T.transform_array(X) + np.random.normal(0, 0.001, (N,3)))
+            Ws.append(np.ones(N))
+            Ts.append(T.T())
+        T_arun, solved, costs = mrob.registration.arun_batch(Xs, Ys)
+        assert(T_arun.shape == (K,4,4) and np.all(solved == 1))
+        assert(np.allclose(T_arun, np.array(Ts), atol=1e-2))
+        T_wp, iters, costs_wp = mrob.registration.weighted_batch(Xs, Ys, Ws)
+        for k in range(K):
+            assert(np.allclose(T_wp[k], mrob.registration.weighted(Xs[k], Ys[k], Ws[k]).T()))
+        # both are the least squares solution
+        assert(np.allclose(costs_wp, costs, rtol=1e-6))
+
+        covs = [np.tile(np.eye(3), (N,1)) for k in range(K)]
+        T_gicp, iters, costs_gicp = mrob.registration.gicp_batch(Xs, Ys, covs, covs, T0=T_arun)
+        assert(iters.shape == (K,) and costs_gicp.shape == (K,))
+        assert(np.allclose(T_gicp, np.array(Ts), atol=1e-2))
+
+    def test_deskew(self):
+        N = 1000
+        X = np.random.uniform(-20, 20, (N,3))
+        timestamps = np.random.rand(N)
+        T_start = mrob.geometry.SE3(np.array([0.1, 0.2, -0.3, 1, 2, 3]))
+        T_end = T_start * mrob.geometry.SE3(np.array([0.2, -0.1, 0.05, 0.5, -0.4, 0.3]))
+        xi = (T_start.inv() * T_end).Ln()
+        Xd = X.copy()
+        mrob.registration.deskew(Xd, timestamps, T_start, T_end)
+        for i in range(0, N, 97):
+            T = T_start * mrob.geometry.SE3(timestamps[i] * xi)
+            assert(np.allclose(Xd[i], T.transform(X[i])))
+
+        # float32 clouds are modified in place as well, and a list of poses is interpolated by segments
+        Xf = X.astype(np.float32)
+        mrob.registration.deskew(Xf, timestamps.astype(np.float32), [T_start, T_end])
+        assert(np.allclose(Xf, Xd, atol=1e-3))
@@ -0,0 +1,37 @@
+import numpy as np
+import mrob
+
+import pytest
+
+class TestSpatialIndex:
+    def test_kd_tree(self):
+        X = np.random.rand(2000,3)
+        Q = np.random.rand(100,3)
+        D = np.linalg.norm(Q[:,None,:] - X[None,:,:], axis=2)
+
+        tree = mrob.geometry.KDTree(X)
+        idx, dist = tree.nearest(Q)
+        assert(np.all(idx[:,0] == np.argmin(D, axis=1)))
+        assert(np.allclose(dist[:,0], np.min(D, axis=1)))
+
+        idx, dist = tree.knn(Q, 5)
+        assert(np.allclose(dist, np.sort(D, axis=1)[:,:5]))
+
+        neighbours = tree.radius(Q, 0.1)
+        assert([len(n) for n in neighbours] == list(np.sum(D <= 0.1, axis=1)))
+
+    def test_voxel_hash_map(self):
+        X = np.random.rand(2000,3)
+        Q = np.random.rand(100,3)
+        D = np.linalg.norm(Q[:,None,:] - X[None,:,:], axis=2)
+
+        voxels = mrob.geometry.VoxelHashMap(0.1)
+        assert(voxels.insert(X) == 0)
+        ids, dist = voxels.nearest(Q, 0.5)
+        assert(np.all(ids[:,0] == np.argmin(D, axis=1)))
+
+        # points removed are not returned anymore
+        for i in ids[:,0]:
+            voxels.remove(i)
+        ids_after, _ = voxels.nearest(Q, 0.5)
+        assert(not np.any(np.isin(ids_after[:,0], ids[:,0])))
@@ -0,0 +1,435 @@
+/* Copyright (c) 2022, Gonzalo Ferrer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * factor_graph_initialize.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Gonzalo Ferrer
+ *              g.ferrer@skoltech.ru
+ *              Mobile Robotics Lab, Skoltech
+ */
+
+#include "mrob/factor_graph_solve.hpp"
+#include "mrob/factors/factor2Poses2d.hpp"
+#include "mrob/factors/factor2Poses3d.hpp"
+
+#include <Eigen/LU> // determinant
+#include <Eigen/SVD>
+#include <Eigen/SparseCholesky>
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+using namespace mrob;
+
+namespace {
+
+/**
+ * Pose graph in matrix form, for rotations in SO(D), D = 2 or 3.
+ * Each edge is a relative observation such that T_j = T_i * T_ij
+ */
+template<int D>
+struct PoseGraph
+{
+    using MatR = Eigen::Matrix<matData_t, D, D>;
+    using VecT = Eigen::Matrix<matData_t, D, 1>;
+    struct Edge
+    {
+        uint_t i, j;
+        MatR Rij;
+        VecT tij;
+        matData_t wR; // scalar weight on rotations
+        MatR Wt; // information of the translation, in the frame of i
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    };
+    std::vector<std::shared_ptr<Node>> nodes; // ordered by id
+    std::vector<MatR, Eigen::aligned_allocator<MatR>> R;
+    std::vector<VecT, Eigen::aligned_allocator<VecT>> t;
+    std::vector<bool> fixed;
+    std::vector<Edge, Eigen::aligned_allocator<Edge>> edges;
+};
+
+/**
+ * Sorts the nodes by id and removes duplicates. The edge indices i,j
+ * are provisionally the node ids and here are converted to positions.
+ */
+template<int D>
+void index_nodes(PoseGraph<D> &g)
+{
+    std::sort(g.nodes.begin(), g.nodes.end(),
+            [](const std::shared_ptr<Node> &a, const std::shared_ptr<Node> &b){return a->get_id() < b->get_id();});
+    g.nodes.erase(std::unique(g.nodes.begin(), g.nodes.end()), g.nodes.end());
+    std::unordered_map<factor_id_t, uint_t> position;
+    for (uint_t k = 0; k < g.nodes.size(); ++k)
+        position[g.nodes[k]->get_id()] = k;
+    for (auto &e : g.edges)
+    {
+        e.i = position[e.i];
+        e.j = position[e.j];
+    }
+    g.R.resize(g.nodes.size());
+    g.t.resize(g.nodes.size());
+    g.fixed.resize(g.nodes.size());
+    for (uint_t k = 0; k < g.nodes.size(); ++k)
+        g.fixed[k] = g.nodes[k]->get_node_mode() == Node::nodeMode::ANCHOR;
+}
+
+/**
+ * Closest rotation matrix in the Frobenius norm, R = U diag(1,..,det(UV')) V'
+ */
+template<int D>
+typename PoseGraph<D>::MatR project_rotation(const typename PoseGraph<D>::MatR &M)
+{
+    Eigen::JacobiSVD<typename PoseGraph<D>::MatR> svd(M, Eigen::ComputeFullU | Eigen::ComputeFullV);
+    typename PoseGraph<D>::MatR S = PoseGraph<D>::MatR::Identity();
+    S(D-1,D-1) = (svd.matrixU() * svd.matrixV().transpose()).determinant() < 0 ? -1.0 : 1.0;
+    return svd.matrixU() * S * svd.matrixV().transpose();
+}
+
+/**
+ * Composes the relative observations along a BFS tree starting from the fixed nodes.
+ * Components without any fixed node are rooted (and fixed) at their node with lowest id.
+ */
+template<int D>
+void spanning_tree(PoseGraph<D> &g)
+{
+    const uint_t n = g.nodes.size();
+    std::vector<std::vector<uint_t>> adjacency(n);
+    for (uint_t k = 0; k < g.edges.size(); ++k)
+    {
+        adjacency[g.edges[k].i].push_back(k);
+        adjacency[g.edges[k].j].push_back(k);
+    }
+    std::vector<bool> visited(g.fixed);
+    std::queue<uint_t> open;
+    for (uint_t k = 0; k < n; ++k)
+        if (g.fixed[k])
+            open.push(k);
+    for (uint_t root = 0; root < n; ++root)
+    {
+        if (open.empty() && !visited[root])
+        {
+            g.fixed[root] = true;
+            visited[root] = true;
+            open.push(root);
+        }
+        while (!open.empty())
+        {
+            uint_t a = open.front();
+            open.pop();
+            for (uint_t k : adjacency[a])
+            {
+                const auto &e = g.edges[k];
+                if (a == e.i && !visited[e.j])
+                {
+                    g.R[e.j] = g.R[e.i] * e.Rij;
+                    g.t[e.j] = g.t[e.i] + g.R[e.i] * e.tij;
+                    visited[e.j] = true;
+                    open.push(e.j);
+                }
+                else if (a == e.j && !visited[e.i])
+                {
+                    g.R[e.i] = g.R[e.j] * e.Rij.transpose();
+                    g.t[e.i] = g.t[e.j] - g.R[e.i] * e.tij;
+                    visited[e.i] = true;
+                    open.push(e.i);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Indices of the free nodes in the linear systems, -1 for fixed nodes
+ */
+template<int D>
+std::vector<int> free_index(const PoseGraph<D> &g, uint_t &numberFree)
+{
+    std::vector<int> index(g.nodes.size(), -1);
+    numberFree = 0;
+    for (uint_t k = 0; k < g.nodes.size(); ++k)
+        if (!g.fixed[k])
+            index[k] = numberFree++;
+    return index;
+}
+
+void add_block(std::vector<Triplet> &triplets, int row, int col, const MatX &block)
+{
+    for (int r = 0; r < block.rows(); ++r)
+        for (int c = 0; c < block.cols(); ++c)
+            triplets.emplace_back(row + r, col + c, block(r,c));
+}
+
+/**
+ * Chordal relaxation: the constraints R_j = R_i R_ij are linear on the entries of R,
+ * which are solved without the orthogonality constraints and projected back to SO(D).
+ * For M = R', each edge is M_j - R_ij' M_i = 0, so the D columns of M share the same system.
+ * Returns false if the system is rank deficient, then the rotations are not modified.
+ */
+template<int D>
+bool chordal_rotations(PoseGraph<D> &g)
+{
+    uint_t F;
+    std::vector<int> index = free_index(g, F);
+    if (F == 0)
+        return true;
+    using MatR = typename PoseGraph<D>::MatR;
+    const MatR I = MatR::Identity();
+    std::vector<Triplet> triplets;
+    triplets.reserve(g.edges.size() * 4 * D * D);
+    Eigen::Matrix<matData_t, Eigen::Dynamic, D> B = Eigen::Matrix<matData_t, Eigen::Dynamic, D>::Zero(F*D, D);
+    for (const auto &e : g.edges)
+    {
+        int fi = index[e.i], fj = index[e.j];
+        if (fi >= 0)
+            add_block(triplets, fi*D, fi*D, e.wR * I);
+        if (fj >= 0)
+            add_block(triplets, fj*D, fj*D, e.wR * I);
+        if (fi >= 0 && fj >= 0)
+        {
+            add_block(triplets, fi*D, fj*D, -e.wR * e.Rij);
+            add_block(triplets, fj*D, fi*D, -e.wR * e.Rij.transpose());
+        }
+        else if (fi >= 0)
+            B.template middleRows<D>(fi*D) += e.wR * e.Rij * g.R[e.j].transpose();
+        else if (fj >= 0)
+            B.template middleRows<D>(fj*D) += e.wR * e.Rij.transpose() * g.R[e.i].transpose();
+    }
+    SMatCol H(F*D, F*D);
+    H.setFromTriplets(triplets.begin(), triplets.end());
+    Eigen::SimplicialLDLT<SMatCol> cholesky(H);
+    if (cholesky.info() != Eigen::Success)
+        return false;
+    Eigen::Matrix<matData_t, Eigen::Dynamic, D> X = cholesky.solve(B);
+    if (cholesky.info() != Eigen::Success || !X.allFinite())
+        return false;
+    for (uint_t k = 0; k < g.nodes.size(); ++k)
+        if (index[k] >= 0)
+            g.R[k] = project_rotation<D>(X.template middleRows<D>(index[k]*D).transpose());
+    return true;
+}
+
+/**
+ * Iterative rotation averaging: each free rotation is updated (Gauss-Seidel) with the chordal
+ * mean of the rotations predicted by its neighbours, R_k = proj( sum w R_i R_ik ).
+ */
+template<int D>
+void average_rotations(PoseGraph<D> &g, uint_t maxIters = 50, matData_t tolerance = 1e-8)
+{
+    using MatR = typename PoseGraph<D>::MatR;
+    const uint_t n = g.nodes.size();
+    std::vector<std::vector<uint_t>> adjacency(n);
+    for (uint_t k = 0; k < g.edges.size(); ++k)
+    {
+        adjacency[g.edges[k].i].push_back(k);
+        adjacency[g.edges[k].j].push_back(k);
+    }
+    for (uint_t iter = 0; iter < maxIters; ++iter)
+    {
+        matData_t maxChange = 0.0;
+        for (uint_t k = 0; k < n; ++k)
+        {
+            if (g.fixed[k] || adjacency[k].empty())
+                continue;
+            MatR S = MatR::Zero();
+            for (uint_t id : adjacency[k])
+            {
+                const auto &e = g.edges[id];
+                if (k == e.j)
+                    S += e.wR * g.R[e.i] * e.Rij;
+                else
+                    S += e.wR * g.R[e.j] * e.Rij.transpose();
+            }
+            MatR Rk = project_rotation<D>(S);
+            maxChange = std::max(maxChange, (Rk - g.R[k]).squaredNorm());
+            g.R[k] = Rk;
+        }
+        if (maxChange < tolerance)
+            break;
+    }
+}
+
+/**
+ * Given the rotations, translations are the solution of the linear LSQ
+ *   sum || t_j - t_i - R_i t_ij ||2_W,    W = R_i W_ij R_i'
+ * Returns false if the system is rank deficient, then the translations are not modified.
+ */
+template<int D>
+bool solve_translations(PoseGraph<D> &g)
+{
+    uint_t F;
+    std::vector<int> index = free_index(g, F);
+    if (F == 0)
+        return true;
+    using MatR = typename PoseGraph<D>::MatR;
+    using VecT = typename PoseGraph<D>::VecT;
+    std::vector<Triplet> triplets;
+    triplets.reserve(g.edges.size() * 4 * D * D);
+    MatX1 b = MatX1::Zero(F*D);
+    for (const auto &e : g.edges)
+    {
+        int fi = index[e.i], fj = index[e.j];
+        MatR W = g.R[e.i] * e.Wt * g.R[e.i].transpose();
+        VecT d = g.R[e.i] * e.tij;
+        if (fi >= 0)
+        {
+            add_block(triplets, fi*D, fi*D, W);
+            b.template segment<D>(fi*D) -= W * d;
+        }
+        if (fj >= 0)
+        {
+            add_block(triplets, fj*D, fj*D, W);
+            b.template segment<D>(fj*D) += W * d;
+        }
+        if (fi >= 0 && fj >= 0)
+        {
+            add_block(triplets, fi*D, fj*D, -W);
+            add_block(triplets, fj*D, fi*D, -W);
+        }
+        else if (fi >= 0)
+            b.template segment<D>(fi*D) += W * g.t[e.j];
+        else if (fj >= 0)
+            b.template segment<D>(fj*D) += W * g.t[e.i];
+    }
+    SMatCol H(F*D, F*D);
+    H.setFromTriplets(triplets.begin(), triplets.end());
+    Eigen::SimplicialLDLT<SMatCol> cholesky(H);
+    if (cholesky.info() != Eigen::Success)
+        return false;
+    MatX1 x = cholesky.solve(b);
+    if (cholesky.info() != Eigen::Success || !x.allFinite())
+        return false;
+    for (uint_t k = 0; k < g.nodes.size(); ++k)
+        if (index[k] >= 0)
+            g.t[k] = x.template segment<D>(index[k]*D);
+    return true;
+}
+
+/**
+ * Estimates the state of the non fixed nodes, given the current state of fixed nodes.
+ * Returns false if a linear system is rank deficient.
+ */
+template<int D>
+bool initialize_pose_graph(PoseGraph<D> &g, FGraphSolve::initMethod method)
+{
+    spanning_tree(g);
+    switch (method)
+    {
+        case FGraphSolve::initMethod::SPANNING_TREE:
+            return true;
+        case FGraphSolve::initMethod::CHORDAL:
+            return chordal_rotations(g) && solve_translations(g);
+        case FGraphSolve::initMethod::ROTATION_AVERAGING:
+            average_rotations(g);
+            return solve_translations(g);
+    }
+    return true;
+}
+
+}
+
+
+bool FGraphSolve::initialize(initMethod method)
+{
+    PoseGraph<2> graph2d;
+    PoseGraph<3> graph3d;
+    for (auto &f : factors_)
+    {
+        auto neighbours = f->get_neighbour_nodes();
+        if (auto f2d = dynamic_cast<Factor2Poses2d*>(f.get()))
+        {
+            Mat31 obs = f2d->get_obs();
+            if (auto odom = dynamic_cast<Factor2Poses2dOdom*>(f2d))
+                obs = odom->get_odometry_prediction(Mat31::Zero(), obs);
+            MatRefConst W = f2d->get_information_matrix();
+            PoseGraph<2>::Edge e;
+            e.i = neighbours->at(0)->get_id();
+            e.j = neighbours->at(1)->get_id();
+            e.Rij << std::cos(obs(2)), -std::sin(obs(2)),
+                     std::sin(obs(2)),  std::cos(obs(2));
+            e.tij = obs.head<2>();
+            e.wR = W(2,2);
+            e.Wt = W.topLeftCorner<2,2>();
+            graph2d.edges.push_back(e);
+            graph2d.nodes.push_back(neighbours->at(0));
+            graph2d.nodes.push_back(neighbours->at(1));
+        }
+        else if (auto f3d = dynamic_cast<Factor2Poses3d*>(f.get()))
+        {
+            Mat4 obs = f3d->get_obs();
+            MatRefConst W = f3d->get_information_matrix();
+            PoseGraph<3>::Edge e;
+            e.i = neighbours->at(0)->get_id();
+            e.j = neighbours->at(1)->get_id();
+            e.Rij = obs.topLeftCorner<3,3>();
+            e.tij = obs.topRightCorner<3,1>();
+            e.wR = W.topLeftCorner<3,3>().trace() / 3.0;
+            e.Wt = W.bottomRightCorner<3,3>();
+            graph3d.edges.push_back(e);
+            graph3d.nodes.push_back(neighbours->at(0));
+            graph3d.nodes.push_back(neighbours->at(1));
+        }
+    }
+
+    // 2D poses, state x = [x, y, theta]
+    if (!graph2d.edges.empty())
+    {
+        index_nodes(graph2d);
+        for (uint_t k = 0; k < graph2d.nodes.size(); ++k)
+        {
+            Mat31 x = graph2d.nodes[k]->get_state();
+            graph2d.R[k] << std::cos(x(2)), -std::sin(x(2)),
+                            std::sin(x(2)),  std::cos(x(2));
+            graph2d.t[k] = x.head<2>();
+        }
+        if (!initialize_pose_graph(graph2d, method))
+            return false;
+    }
+
+    // 3D poses, state is the transformation T
+    if (!graph3d.edges.empty())
+    {
+        index_nodes(graph3d);
+        for (uint_t k = 0; k < graph3d.nodes.size(); ++k)
+        {
+            Mat4 T = graph3d.nodes[k]->get_state();
+            graph3d.R[k] = T.topLeftCorner<3,3>();
+            graph3d.t[k] = T.topRightCorner<3,1>();
+        }
+        if (!initialize_pose_graph(graph3d, method))
+            return false;
+    }
+
+    // nodes are only modified once all the systems have been solved
+    for (uint_t k = 0; k < graph2d.nodes.size(); ++k)
+    {
+        if (graph2d.fixed[k])
+            continue;
+        Mat31 x;
+        x << graph2d.t[k], std::atan2(graph2d.R[k](1,0), graph2d.R[k](0,0));
+        graph2d.nodes[k]->set_state(x);
+    }
+    for (uint_t k = 0; k < graph3d.nodes.size(); ++k)
+    {
+        if (graph3d.fixed[k])
+            continue;
+        Mat4 T = Mat4::Identity();
+        T.topLeftCorner<3,3>() = graph3d.R[k];
+        T.topRightCorner<3,1>() = graph3d.t[k];
+        graph3d.nodes[k]->set_state(T);
+    }
+    this->invalidate_linearization();
+    return true;
+}
@@ -23,9 +23,11 @@
 
 
 #include "mrob/factor_graph_solve.hpp"
+#include "mrob/parallel.hpp"
 //#include "mrob/CustomCholesky.hpp"
 
-#include <iostream>
+#include <algorithm>
+#include <cmath>
 #include <Eigen/SparseCore>
 #include <Eigen/SparseLU>
 #include <Eigen/SparseCholesky>
@@ -37,10 +39,38 @@ using namespace std;
 using namespace Eigen;
 
 
+namespace {
+// method of the optimizer for each FGraphSolve method
+Optimizer::optimMethod optimizer_method(FGraphSolve::optimMethod method)
+{
+    switch(method)
+    {
+      case FGraphSolve::LM:
+        return Optimizer::LEVENBERG_MARQUARDT_SPHER;
+      case FGraphSolve::LM_ELLIPS:
+        return Optimizer::LEVENBERG_MARQUARDT_ELLIP;
+      case FGraphSolve::DOGLEG:
+        return Optimizer::DOGLEG;
+      case FGraphSolve::GN_LINE_SEARCH:
+        return Optimizer::NEWTON_RAPHSON_LINE_SEARCH;
+      case FGraphSolve::LBFGS:
+        return Optimizer::LBFGS;
+      case FGraphSolve::NONLINEAR_CG:
+        return Optimizer::NONLINEAR_CG;
+      case FGraphSolve::GN:
+      default:
+        return Optimizer::NEWTON_RAPHSON;
+    }
+}
+}
+
 FGraphSolve::FGraphSolve(matrixMethod method):
-	FGraph(), matrixMethod_(method), optimMethod_(GN), N_(0), M_(0),
-	lambda_(1e-6), solutionTolerance_(1e-2), buildAdjacencyFlag_(false)
+	FGraph(), OptimizerSparse(1e-2, 1e-6), matrixMethod_(method), optimMethod_(GN), N_(0), M_(0),
+	relinearizeThreshold_(0.0), relinearizedFactors_(0), relinearizeAll_(true), residualsUpdated_(false),
+	splitComponents_(false), builtSplit_(false), numThreads_(0), numberComponents_(0),
+	buildAdjacencyFlag_(false)
 {
+    structureSignature_.fill(0);
 
 }
 
@@ -58,41 +88,109 @@ uint_t FGraphSolve::solve(optimMethod method, uint_t maxIters, matData_t lambda,
      *               1.3959 % update values,
      *
      */
-    lambda_ = lambda;
+    this->solve_graph(method, maxIters, lambda, solutionTolerance, Tdeadline::max(), false);
+
+    // TODO add variable verbose to output times
+    if (0)
+        time_profiles_.print();
+
+    // a single GN iteration is not expected to converge
+    if (method == GN)
+        return status_ == DIVERGED ? 0 : iterations_;
+    return status_ == CONVERGED ? iterations_ : 0;
+}
+
+FGraphSolve::solveStatus FGraphSolve::solve_budget(uint_t deadlineMicroseconds, optimMethod method, uint_t maxIters,
+        matData_t lambda, matData_t solutionTolerance)
+{
+    Tdeadline deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(deadlineMicroseconds);
+    this->solve_graph(method, maxIters, lambda, solutionTolerance, deadline, true);
+    return status_;
+}
+
+void FGraphSolve::solve_graph(optimMethod method, uint_t maxIters, matData_t lambda, matData_t solutionTolerance,
+        Tdeadline deadline, bool budget)
+{
     solutionTolerance_ = solutionTolerance;
     time_profiles_.reset();
     optimMethod_ = method;
 
     assert(stateDim_ > 0 && "FGraphSolve::solve: empty node state");
 
-    uint_t iters(0);
+    // Patterns and indices are only rebuilt if the graph has changed
+    if (this->structure_changed())
+    {
+        time_profiles_.start();
+        this->build_structure();
+        time_profiles_.stop("Build structure");
+    }
+    // nodes and observations may have been modified since the last solve
+    residualsUpdated_ = false;
 
-    // Optimization
-    switch(method)
+    if (!components_.empty())
     {
-      case GN:
-        this->optimize_gauss_newton();// false => lambda = 0
-        this->update_nodes();
-        iters = 1;
-        break;
-      case LM:
-      case LM_ELLIPS:
-        iters = this->optimize_levenberg_marquardt(maxIters);
-        break;
-      default:
-        assert(0 && "FGraphSolve:: optimization method unknown");
+        this->solve_components(method, maxIters, lambda, solutionTolerance, deadline, budget);
+        return;
     }
 
+    // Optimization, solve() carries out a single GN iteration
+    Optimizer::solve(optimizer_method(method), method == GN && !budget ? 1 : maxIters, lambda, deadline);
 
+    // residuals correspond to the current (best) state and not to the last undone step
+    if (!residualsUpdated_)
+        this->chi2(true);
+}
 
-    // TODO add variable verbose to output times
-    if (0)
-        time_profiles_.print();
-        
-    return iters; 
+matData_t FGraphSolve::calculate_error()
+{
+    return this->chi2(!residualsUpdated_);
+}
+
+void FGraphSolve::calculate_gradient_hessian()
+{
+    this->build_problem();
 }
 
-void FGraphSolve::build_problem(bool useLambda)
+void FGraphSolve::calculate_gradient()
+{
+    // Jacobians of all factors, but not their blocks J'WJ
+    relinearizeAll_ = true;
+    time_profiles_.start();
+    this->build_adjacency();
+    time_profiles_.stop("Adjacency");
+
+    if (eigen_factors_.size()>0)
+    {
+        time_profiles_.start();
+        this->build_info_EF(false);
+        time_profiles_.stop("EFs Jacobian");
+    }
+
+    time_profiles_.start();
+    this->build_info_adjacency(false);
+    time_profiles_.stop("Gradient Adjacency");
+
+    // the blocks of L are outdated, so the next build of L relinearizes all factors
+    relinearizeAll_ = true;
+    residualsUpdated_ = true;
+}
+
+void FGraphSolve::update_state()
+{
+    this->update_nodes();
+}
+
+void FGraphSolve::bookkeep_state()
+{
+    this->synchronize_nodes_auxiliary_state();
+}
+
+void FGraphSolve::update_state_from_bookkeep()
+{
+    this->synchronize_nodes_state();
+}
+
+void FGraphSolve::build_problem()
 {
 
     // 1) Adjacency matrix A, it has to
@@ -122,291 +220,561 @@ void FGraphSolve::build_problem(bool useLambda)
     }
 
     // 1.3) (Optional) Eigen Factors
+    residualsUpdated_ = true;
+}
 
-    // Structure for LM and dampening GN-based methods
-    if (useLambda)
+void FGraphSolve::build_index_nodes_matrix()
+{
+    N_ = 0;
+    for (size_t i = 0; i < active_nodes_.size(); ++i)
     {
-        diagL_ = L_.diagonal();
+        // calculate the indices to access
+        uint_t dim = active_nodes_[i]->get_dim();
+        factor_id_t id = active_nodes_[i]->get_id();
+        indNodesMatrix_.emplace(id,N_);
+        N_ += dim;
     }
 }
 
-void FGraphSolve::optimize_gauss_newton(bool useLambda)
+std::array<factor_id_t, 6> FGraphSolve::get_structure_signature() const
 {
-    // requires a Column-storage matrix
-    SimplicialLDLT<SMatCol,Lower, AMDOrdering<SMatCol::StorageIndex>> cholesky;
-
-    this->build_problem(useLambda);
-
-    // compute cholesky solution
-    time_profiles_.start();
-    if (useLambda)
+    factor_id_t anchors = 0;
+    for (auto &n : nodes_)
     {
-        for (uint_t n = 0 ; n < N_; ++n)
-        {
-            if (optimMethod_ == LM)
-                L_.coeffRef(n,n) = lambda_ + diagL_(n);//Spherical
-            if (optimMethod_ == LM_ELLIPS)
-                L_.coeffRef(n,n) = (1.0 + lambda_)*diagL_(n);//Elipsoid
-        }
+        if (n->get_node_mode() == Node::nodeMode::ANCHOR)
+            anchors++;
     }
-    cholesky.compute(L_);
-    time_profiles_.stop("Gauss Newton create Cholesky");
-    time_profiles_.start();
-    dx_ = cholesky.solve(b_);
-    time_profiles_.stop("Gauss Newton solve Cholesky");
-
+    factor_id_t connectionsEF = 0;
+    for (auto &ef : eigen_factors_)
+        connectionsEF += ef->get_neighbour_nodes()->size();
+    return {{nodes_.size(), active_nodes_.size(), anchors,
+             factors_.size(), eigen_factors_.size(), connectionsEF}};
 }
 
-uint_t FGraphSolve::optimize_levenberg_marquardt(uint_t maxIters)
+bool FGraphSolve::structure_changed() const
 {
-    //SimplicialLDLT<SMatCol,Lower, AMDOrdering<SMatCol::StorageIndex>> cholesky;
-
-
-    // LM trust region as described in Bertsekas (p.105)
-
-    // 0) parameter initialization
-    lambda_ = 1e-5;
-    // sigma reference to the fidelity of the model at the proposed solution \in [0,1]
-    matData_t sigma1(0.25), sigma2(0.8);// 0 < sigma1 < sigma2 < 1
-    matData_t beta1(2.0), beta2(0.25); // lambda updates multiplier values, beta1 > 1 > beta2 >0
-    //matData_t lambdaMax, lambdaMin; // XXX lower bound unnecessary
-
-    matData_t currentChi2, deltaChi2, modelFidelity;
-    uint_t iter = 0;
-
-    do{
-        iter++;
-        // 1) solve subproblem and current error
-        this->optimize_gauss_newton(true);// Test if solved anything? no nans
-        currentChi2 = this->chi2(false);// TODO residuals don't need to be calculated again (see optimizer.cpp)
-        this->synchronize_nodes_auxiliary_state();// book-keeps states to undo updates
-        this->update_nodes();
-
+    return structureSignature_ != this->get_structure_signature() || builtSplit_ != splitComponents_;
+}
 
-        // 1.2) Check for convergence, needs update and re-evaluaiton of errors
-        deltaChi2 = currentChi2 - this->chi2(true);
-        std::cout << "\nFGraphSolve::optimize_levenberg_marquardt: iteration "
-                  << iter << " lambda = " << lambda_ << ", error " << currentChi2
-                  << ", and delta = " << deltaChi2
-                  << std::endl;
-        if (deltaChi2 < 0)
+factor_id_t FGraphSolve::build_components()
+{
+    // 1) Union-find of active nodes connected by factors, anchors are not joined.
+    //    Nodes are indexed by their position at active_nodes_, since a component keeps the original ids
+    const factor_id_t numberNodes = active_nodes_.size();
+    std::unordered_map<factor_id_t, factor_id_t> position;
+    position.reserve(numberNodes);
+    std::vector<factor_id_t> root(numberNodes);
+    for (factor_id_t n = 0; n < numberNodes; ++n)
+    {
+        position.emplace(active_nodes_[n]->get_id(), n);
+        root[n] = n;
+    }
+    auto find = [&root](factor_id_t n)
+    {
+        while (root[n] != n)
         {
-            // proposed dx did not improve, repeat 1) and reduce area of optimization = increase lambda
-            lambda_ *= beta1;
-            this->synchronize_nodes_state();
-            continue;
+            root[n] = root[root[n]];
+            n = root[n];
         }
-
-        // 1.3) check for convergence
-        if (deltaChi2 < solutionTolerance_)
+        return n;
+    };
+    // returns the position of the first active node in the list, or numberNodes if none
+    auto join = [&](const std::vector<std::shared_ptr<Node>> &neighbours)
+    {
+        factor_id_t first = numberNodes;
+        for (auto &node : neighbours)
         {
-            std::cout << "\nFGraphSolve::optimize_levenberg_marquardt: Converged Successfully" << std::endl;
-            return iter;
+            if (node->get_node_mode() == Node::nodeMode::ANCHOR)
+                continue;
+            factor_id_t n = position.at(node->get_id());
+            if (first == numberNodes)
+                first = n;
+            else
+                root[find(n)] = find(first);
         }
+        return first;
+    };
+    for (auto &f : factors_)
+        join(*f->get_neighbour_nodes());
+    for (auto &ef : eigen_factors_)
+        join(*ef->get_neighbour_nodes());
 
-
-        // 2) Fidelity of the quadratized model vs non-linear chi2 evaluation.
-        // f = chi2(x_k) - chi2(x_k + dx)
-        //     chi2(x_k) - m_k(dx)
-        // where m_k is the quadratized model = ||r||^2 - dx'*J' r + 0.5 dx'(J'J + lambda*D2)dx
-        modelFidelity = deltaChi2 / (dx_.dot(b_) - 0.5*dx_.dot(L_* dx_));
-        std::cout << "model fidelity = " << modelFidelity << " and m_k = " << dx_.dot(b_) << std::endl;
-
-        //3) update lambda
-        if (modelFidelity < sigma1)
-            lambda_ *= beta1;
-        if (modelFidelity > sigma2)
-            lambda_ *= beta2;
-
-
-    } while (iter < maxIters);
-
-    // output
-    std::cout << "FGraphSolve::optimize_levenberg_marquardt: failed to converge after "
-              << iter << " iterations and error " << currentChi2
-              << ", and delta = " << deltaChi2
-              << std::endl;
-    return 0; //Failed to converge is indicated with 0 iterations
-
+    // 2) Component label of each root, in order of appearance
+    std::vector<factor_id_t> label(numberNodes, numberNodes);
+    factor_id_t numberComponents = 0;
+    for (factor_id_t n = 0; n < numberNodes; ++n)
+    {
+        factor_id_t r = find(n);
+        if (label[r] == numberNodes)
+            label[r] = numberComponents++;
+    }
+    components_.clear();
+    if (!splitComponents_ || numberComponents <= 1)
+        return numberComponents;
+
+    // 3) A graph for each component, sharing nodes and factors. Node ids are not modified,
+    //    and factors only connected to anchors are not part of any component.
+    for (factor_id_t k = 0; k < numberComponents; ++k)
+        components_.emplace_back(new FGraphSolve(matrixMethod_));
+    for (factor_id_t n = 0; n < numberNodes; ++n)
+    {
+        auto &c = components_[label[find(n)]];
+        c->nodes_.push_back(active_nodes_[n]);
+        c->active_nodes_.push_back(active_nodes_[n]);
+        c->stateDim_ += active_nodes_[n]->get_dim();
+    }
+    for (auto &f : factors_)
+    {
+        factor_id_t first = join(*f->get_neighbour_nodes());
+        if (first == numberNodes)
+            continue;
+        auto &c = components_[label[find(first)]];
+        c->factors_.push_back(f);
+        c->obsDim_ += f->get_dim_obs();
+    }
+    for (auto &ef : eigen_factors_)
+    {
+        factor_id_t first = join(*ef->get_neighbour_nodes());
+        if (first != numberNodes)
+            components_[label[find(first)]]->eigen_factors_.push_back(ef);
+    }
+    return numberComponents;
 }
 
-void FGraphSolve::build_index_nodes_matrix()
+void FGraphSolve::solve_components(optimMethod method, uint_t maxIters, matData_t lambda, matData_t solutionTolerance,
+        Tdeadline deadline, bool budget)
 {
-    N_ = 0;
-    for (size_t i = 0; i < active_nodes_.size(); ++i)
+    for (auto &c : components_)
     {
-        // calculate the indices to access
-        uint_t dim = active_nodes_[i]->get_dim();
-        factor_id_t id = active_nodes_[i]->get_id();
-        indNodesMatrix_.emplace(id,N_);
-        N_ += dim;
+        c->set_verbosity(log_.get_verbosity());
+        c->set_iteration_callback(log_.get_callback());
+        c->set_relinearize_threshold(relinearizeThreshold_);
+        c->set_speculative_lambdas(speculativeLambdas_, speculativeThreads_);
+        c->set_mixed_precision(mixedPrecision_, maxRefinements_, refinementTolerance_);
+    }
+    componentsReport_.resize(components_.size());
+    parallel_for(components_.size(), numThreads_, [&](uint_t k)
+    {
+        FGraphSolve &c = *components_[k];
+        ComponentReport &report = componentsReport_[k];
+        report.nodes = c.active_nodes_.size();
+        report.factors = c.factors_.size() + c.eigen_factors_.size();
+        if (report.factors == 0)
+        {
+            // isolated nodes are not modified
+            report.status = CONVERGED;
+            report.iterations = 0;
+            report.chi2 = 0.0;
+            return;
+        }
+        if (budget)
+        {
+            auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+            c.solve_budget(static_cast<uint_t>(std::max<int64_t>(0, remaining.count())), method, maxIters, lambda, solutionTolerance);
+        }
+        else
+            c.solve(method, maxIters, lambda, solutionTolerance);
+        report.status = c.status_;
+        report.iterations = c.iterations_;
+        report.chi2 = c.chi2(false);
+    });
+
+    // The status is the worst among components: diverged, stopped, budget exhausted and converged
+    status_ = CONVERGED;
+    iterations_ = 0;
+    iterationTime_ = 0.0;
+    for (factor_id_t k = 0; k < components_.size(); ++k)
+    {
+        solveStatus s = componentsReport_[k].status;
+        if (s == DIVERGED || status_ == DIVERGED)
+            status_ = DIVERGED;
+        else if (s != CONVERGED && status_ != STOPPED)
+            status_ = s;
+        iterations_ = std::max(iterations_, componentsReport_[k].iterations);
+        iterationTime_ = std::max(iterationTime_, components_[k]->iterationTime_);
     }
+    log_.reset(0);
+    // nodes have been updated by the components
+    this->invalidate_linearization();
 }
 
-void FGraphSolve::build_adjacency()
+void FGraphSolve::build_structure()
 {
-    // 1) Node indexes bookkept. We use a map to ensure the index from nodes to the current active_node
-    indNodesMatrix_.clear();
-    this->build_index_nodes_matrix();
-    assert(N_ == stateDim_ && "FGraphSolve::buildAdjacency: State Dimensions are not coincident\n");
-
-
-    // 2.1) Check for consistency. With 0 observations the problem does not need to be build, EF may still build it
-    if (obsDim_ == 0)
+    using StorageIndex = SMatCol::StorageIndex;
+    structureSignature_ = this->get_structure_signature();
+    builtSplit_ = splitComponents_;
+
+    // 0) Connected components, if the problem is split each of them is built and solved on its own
+    numberComponents_ = this->build_components();
+    componentsReport_.clear();
+    if (!components_.empty())
     {
-        buildAdjacencyFlag_ = false;
+        this->invalidate_linearization();
         return;
     }
-    buildAdjacencyFlag_ = true;
-
-    // 2) resize properly matrices (if needed)
-    r_.resize(obsDim_,1);//dense vector TODO is it better to reserve and push_back??
-    A_.resize(obsDim_, stateDim_);//Sparse matrix clears data, but keeps the prev reserved space
-    W_.resize(obsDim_, obsDim_);//TODO should we reinitialize this all the time? an incremental should be fairly easy
-
 
+    // 1) Node indexes bookkept. We use a map to ensure the index from nodes to the current active_node
+    indNodesMatrix_.clear();
+    this->build_index_nodes_matrix();
+    assert(N_ == stateDim_ && "FGraphSolve::build_structure: State Dimensions are not coincident\n");
 
-    // 3) Evaluate every factor given the current state and bookeeping of Factor indices
+    // 2) Row of each factor in the adjacency matrix and space for its indices
     std::vector<uint_t> reservationA;
     reservationA.reserve( obsDim_ );
     std::vector<uint_t> reservationW;
     reservationW.reserve( obsDim_ );
-    std::vector<factor_id_t> indFactorsMatrix;
-    indFactorsMatrix.reserve(factors_.size());
+    indFactorsMatrix_.resize(factors_.size());
+    scatterOffsetL_.resize(factors_.size());
+    scatterOffsetB_.resize(factors_.size());
+    factor_id_t sizeL = 0, sizeB = 0;
+    uint_t maxDimObs = 1, maxDimNodes = 6;
     M_ = 0;
-    for (uint_t i = 0; i < factors_.size(); ++i)
+    for (factor_id_t i = 0; i < factors_.size(); ++i)
     {
-        auto f = factors_[i];
-        f->evaluate_residuals();
-        f->evaluate_jacobians();
-        f->evaluate_chi2();
-
-        // calculate dimensions for reservation and bookeping vector
+        auto &f = factors_[i];
         uint_t dim = f->get_dim_obs();
         uint_t allDim = f->get_all_nodes_dim();
         for (uint_t j = 0; j < dim; ++j)
         {
             reservationA.push_back(allDim);
-            reservationW.push_back(dim-j);//XXX this might be allocating more elements than necessary, check
+            reservationW.push_back(dim-j);
         }
-        indFactorsMatrix.push_back(M_);
+        indFactorsMatrix_[i] = M_;
         M_ += dim;
+        scatterOffsetL_[i] = sizeL;
+        sizeL += allDim * allDim;
+        scatterOffsetB_[i] = sizeB;
+        sizeB += allDim;
+        maxDimObs = std::max(maxDimObs, dim);
+        maxDimNodes = std::max(maxDimNodes, allDim);
     }
-    assert(M_ == obsDim_ && "FGraphSolve::buildAdjacency: Observation dimensions are not coincident\n");
-    A_.reserve(reservationA); //Exact allocation for elements.
-    W_.reserve(reservationW); //same
+    assert(M_ == obsDim_ && "FGraphSolve::build_structure: Observation dimensions are not coincident\n");
+    // With 0 observations the problem does not need to be build, EF may still build it
+    buildAdjacencyFlag_ = obsDim_ > 0;
 
-
-    // XXX This could be subject to parallelization, maybe on two steps: eval + build
+    // 3) Column in the state of each of the factor's Jacobian columns, -1 for anchor nodes
+    scatterB_.resize(sizeB);
     for (factor_id_t i = 0; i < factors_.size(); ++i)
     {
-        auto f = factors_[i];
-
-        // 4) Get the calculated residual
-        r_.block(indFactorsMatrix[i], 0, f->get_dim_obs(), 1) <<  f->get_residual();
+        auto neighNodes = factors_[i]->get_neighbour_nodes();
+        StorageIndex *cols = &scatterB_[scatterOffsetB_[i]];
+        uint_t totalK = 0;
+        for (uint_t j = 0; j < neighNodes->size(); ++j)
+        {
+            auto &node = (*neighNodes)[j];
+            // neighbour nodes are ordered by id, as the columns of the state, then A is filled in order
+            assert((j == 0 || (*neighNodes)[j-1]->get_id() < node->get_id()) && "FGraphSolve::build_structure: nodes are not ordered in the factor");
+            uint_t dimNode = node->get_dim();
+            bool isAnchor = node->get_node_mode() == Node::nodeMode::ANCHOR;
+            for (uint_t k = 0; k < dimNode; ++k)
+                cols[totalK + k] = isAnchor ? -1 : static_cast<StorageIndex>(indNodesMatrix_.at(node->get_id()) + k);
+            totalK += dimNode;
+        }
+        assert(totalK == factors_[i]->get_all_nodes_dim() && "FGraphSolve::build_structure: factor nodes dimensions are not coincident");
+    }
 
-        // 5) build Adjacency matrix as a composition of rows
-        // 5.1) Get the number of nodes involved. It is a vector of nodes
-        auto neighNodes = f->get_neighbour_nodes();
-        // Iterates over the Jacobian row
-        for (uint_t l=0; l < f->get_dim_obs() ; ++l)
+    // 4) Patterns of A and W. The values are written at build_adjacency() in the same order as inserted here
+    r_.resize(obsDim_,1);
+    A_.resize(obsDim_, stateDim_);
+    W_.resize(obsDim_, obsDim_);
+    if (buildAdjacencyFlag_)
+    {
+        A_.reserve(reservationA);
+        W_.reserve(reservationW);
+        for (factor_id_t i = 0; i < factors_.size(); ++i)
         {
-            uint_t totalK = 0;
-            // Iterates over the number of neighbour Nodes (ordered by construction)
-            for (uint_t j=0; j < neighNodes->size(); ++j)
+            uint_t dim = factors_[i]->get_dim_obs();
+            uint_t allDim = factors_[i]->get_all_nodes_dim();
+            const StorageIndex *cols = &scatterB_[scatterOffsetB_[i]];
+            for (uint_t l = 0; l < dim; ++l)
             {
-                uint_t dimNode = (*neighNodes)[j]->get_dim();
-                // check for node if it is an anchor node, then skip emplacement of Jacobian in the Adjacency
-                if ((*neighNodes)[j]->get_node_mode() == Node::nodeMode::ANCHOR)
+                StorageIndex iRow = indFactorsMatrix_[i] + l;
+                for (uint_t k = 0; k < allDim; ++k)
                 {
-                    totalK += dimNode;// we need to account for the dim in the Jacobian, to read the next block
-                    continue;//skip this loop
+                    if (cols[k] >= 0)
+                        A_.insert(iRow, cols[k]) = 0.0;
                 }
-                factor_id_t id = (*neighNodes)[j]->get_id();
-                for(uint_t k = 0; k < dimNode; ++k)
+                // only the upper triangular part of W
+                for (uint_t k = l; k < dim; ++k)
+                    W_.insert(iRow, indFactorsMatrix_[i] + k) = 0.0;
+            }
+        }
+        A_.makeCompressed();
+        W_.makeCompressed();
+    }
+
+    // 5) Pattern of L, as the blocks between all nodes in each factor, plus diagonal blocks of EFs and the diagonal
+    std::vector<Triplet> patternL, patternEF;
+    patternL.reserve(sizeL + N_);
+    for (factor_id_t i = 0; i < factors_.size(); ++i)
+    {
+        uint_t allDim = factors_[i]->get_all_nodes_dim();
+        const StorageIndex *cols = &scatterB_[scatterOffsetB_[i]];
+        for (uint_t a = 0; a < allDim; ++a)
+            for (uint_t b = 0; b < allDim; ++b)
+                if (cols[a] >= 0 && cols[b] >= 0)
+                    patternL.emplace_back(cols[a], cols[b], 0.0);
+    }
+    for (auto &ef : eigen_factors_)
+    {
+        for (auto &node : *ef->get_neighbour_nodes())
+        {
+            if (node->get_node_mode() == Node::nodeMode::ANCHOR)
+                continue;
+            // XXX if EF ever connected a node that is not 6D, then this will not hold.
+            assert(node->get_dim() == 6 && "FGraphSolve::build_structure: EF connected to a non 6D node");
+            StorageIndex startingIndex = indNodesMatrix_.at(node->get_id());
+            for (StorageIndex i = 0; i < 6; ++i)
+            {
+                for (StorageIndex j = 0; j < 6; ++j)
                 {
-                    // order according to the permutation vector
-                    uint_t iRow = indFactorsMatrix[i] + l;
-                    // In release mode, indexes outside will not trigger an exception
-                    uint_t iCol = indNodesMatrix_[id] + k;
-                    // This is an ordered insertion
-                    A_.insert(iRow,iCol) = f->get_jacobian()(l, k + totalK);
+                    patternL.emplace_back(startingIndex + i, startingIndex + j, 0.0);
+                    if (i <= j)
+                        patternEF.emplace_back(startingIndex + i, startingIndex + j, 0.0);
                 }
-                totalK += dimNode;
             }
         }
+    }
+    for (factor_id_t n = 0; n < N_; ++n)
+        patternL.emplace_back(n, n, 0.0);
+    hessian_.resize(N_, N_);
+    hessian_.setFromTriplets(patternL.begin(), patternL.end());
+    hessian_.makeCompressed();
+    hessianEF_.resize(N_, N_);
+    hessianEF_.setFromTriplets(patternEF.begin(), patternEF.end());
+    hessianEF_.makeCompressed();
+
+    // 6) Indices at the values of L for each factor block and EF Hessian entry
+    const StorageIndex *outer = hessian_.outerIndexPtr();
+    const StorageIndex *inner = hessian_.innerIndexPtr();
+    auto index_L = [outer, inner](StorageIndex row, StorageIndex col)
+    {
+        const StorageIndex *p = std::lower_bound(inner + outer[col], inner + outer[col+1], row);
+        assert(p != inner + outer[col+1] && *p == row && "FGraphSolve::build_structure: entry not in the pattern of L");
+        return static_cast<StorageIndex>(p - inner);
+    };
+    scatterL_.resize(sizeL);
+    for (factor_id_t i = 0; i < factors_.size(); ++i)
+    {
+        uint_t allDim = factors_[i]->get_all_nodes_dim();
+        const StorageIndex *cols = &scatterB_[scatterOffsetB_[i]];
+        StorageIndex *indL = &scatterL_[scatterOffsetL_[i]];
+        for (uint_t a = 0; a < allDim; ++a)
+            for (uint_t b = 0; b < allDim; ++b)
+                indL[a*allDim + b] = (cols[a] >= 0 && cols[b] >= 0) ? index_L(cols[a], cols[b]) : -1;
+    }
+    scatterEF_.resize(hessianEF_.nonZeros());
+    for (StorageIndex j = 0; j < hessianEF_.outerSize(); ++j)
+    {
+        for (StorageIndex p = hessianEF_.outerIndexPtr()[j]; p < hessianEF_.outerIndexPtr()[j+1]; ++p)
+        {
+            StorageIndex i = hessianEF_.innerIndexPtr()[p];
+            scatterEF_[p] = std::make_pair(index_L(i,j), index_L(j,i));
+        }
+    }
 
+    // 7) Dense vectors and scratch buffers
+    gradient_.resize(N_);
+    gradientEF_.resize(N_);
+    scratchW_.resize(maxDimObs, maxDimObs);
+    scratchWJ_.resize(maxDimObs, maxDimNodes);
+    scratchWr_.resize(maxDimObs);
+    scratchG_.resize(maxDimNodes);
+
+    // 8) Selective relinearization, all factors are relinearized at the first build
+    nodesDelta_.assign(N_, 0.0);
+    nodesStep_.assign(N_, 0.0);
+    factorsRelinearized_.resize(factors_.size());
+    robustWeights_.resize(factors_.size());
+    hessianBlocks_.resize(sizeL);
+    this->invalidate_linearization();
+
+    // 9) Symbolic decomposition (ordering and elimination tree) and diagonal of L, see OptimizerSparse
+    this->update_pattern();
+}
 
-        // 5) Get information matrix for every factor
-        // For robust factors, here is where the robust weights should be applied
-        matData_t robust_weight = 1.0;
-        for (uint_t l = 0; l < f->get_dim_obs(); ++l)
+void FGraphSolve::build_adjacency()
+{
+    relinearizedFactors_ = 0;
+    // 1) Check for consistency. With 0 observations the problem does not need to be build, EF may still build it
+    if (buildAdjacencyFlag_)
+    {
+        // 2) Evaluate factors given the current state and write values on the A and W patterns.
+        //    Residuals are only evaluated if they are not up to date (after chi2()), and Jacobians only
+        //    for factors connected to nodes whose accumulated updates are over the threshold.
+        using StorageIndex = SMatCol::StorageIndex;
+        matData_t *valuesA = A_.valuePtr(), *valuesW = W_.valuePtr();
+        const SMatRow::StorageIndex *outerA = A_.outerIndexPtr(), *outerW = W_.outerIndexPtr();
+        // XXX This could be subject to parallelization, maybe on two steps: eval + build
+        for (factor_id_t i = 0; i < factors_.size(); ++i)
         {
-            // only iterates over the upper triangular part
-            for (uint_t k = l; k < f->get_dim_obs(); ++k)
+            auto &f = factors_[i];
+            uint_t allDim = f->get_all_nodes_dim();
+            const StorageIndex *cols = &scatterB_[scatterOffsetB_[i]];
+            bool relinearize = relinearizeAll_;
+            for (uint_t k = 0; k < allDim; ++k)
+                relinearize = relinearize || (cols[k] >= 0 && nodesDelta_[cols[k]] > relinearizeThreshold_);
+            factorsRelinearized_[i] = relinearize;
+            if (!residualsUpdated_)
             {
-                uint_t iRow = indFactorsMatrix[i] + l;
-                uint_t iCol = indFactorsMatrix[i] + k;
-                robust_weight = f->evaluate_robust_weight(std::sqrt(f->get_chi2()));
-                W_.insert(iRow,iCol) = robust_weight * f->get_information_matrix()(l,k);
+                f->evaluate_residuals();
+                f->evaluate_chi2();
             }
-        }
-    } //end factors loop
 
+            // 3) Get the calculated residual
+            uint_t dim = f->get_dim_obs();
+            factor_id_t iRow = indFactorsMatrix_[i];
+            r_.segment(iRow, dim) = f->get_residual();
 
+            // 4) Adjacency matrix as a composition of rows, anchor nodes are skipped.
+            //    Not relinearized factors keep their values.
+            if (relinearize)
+            {
+                f->evaluate_jacobians();
+                relinearizedFactors_++;
+                auto J = f->get_jacobian();
+                for (uint_t l = 0; l < dim ; ++l)
+                {
+                    StorageIndex p = outerA[iRow + l];
+                    for (uint_t k = 0; k < allDim; ++k)
+                    {
+                        if (cols[k] >= 0)
+                            valuesA[p++] = J(l, k);
+                    }
+                }
+            }
+
+            // 5) Get information matrix for every factor (upper triangular)
+            // For robust factors, here is where the robust weights should be applied
+            matData_t robust_weight = f->evaluate_robust_weight(std::sqrt(f->get_chi2()));
+            robustWeights_[i] = robust_weight;
+            auto W = f->get_information_matrix();
+            for (uint_t l = 0; l < dim; ++l)
+            {
+                StorageIndex p = outerW[iRow + l];
+                for (uint_t k = l; k < dim; ++k)
+                    valuesW[p++] = robust_weight * W(l,k);
+            }
+        } //end factors loop
+    }
+
+    // 6) Relinearized nodes start accumulating updates again
+    for (auto &delta : nodesDelta_)
+    {
+        if (relinearizeAll_ || delta > relinearizeThreshold_)
+            delta = 0.0;
+    }
+    relinearizeAll_ = false;
 }
 
-void FGraphSolve::build_info_adjacency()
+void FGraphSolve::build_info_adjacency(bool hessian)
 {
     /**
-     * L_ dx = b_ corresponds to the normal equation A'*W*A dx = A'*W*r
-     * only store the lower part of the information matrix (symmetric)
-     *
-     * XXX: In terms of speed, using the selfadjointview does not improve,
-     * Eigen stores a temporary object and then copy only the upper part.
+     * L dx = -b corresponds to the normal equation A'*W*A dx = -A'*W*r,
+     * where L is hessian_ and b is gradient_. Both triangular parts of L are stored (symmetric).
      *
+     * Instead of the sparse product A'*W*A, each factor accumulates its
+     * block J'WJ directly on the values of L, whose pattern is precalculated.
+     * Small products are lazy (coefficient-based) so they do not allocate.
      */
+    using StorageIndex = SMatCol::StorageIndex;
+    matData_t *valuesL = hessian_.valuePtr();
+    if (hessian)
+        Map<MatX1>(valuesL, hessian_.nonZeros()).setZero();
+    gradient_.setZero();
+
     // check for a problem built
     if (buildAdjacencyFlag_)
     {
-        L_ = (A_.transpose() * W_.selfadjointView<Eigen::Upper>() * A_);
-        b_ = A_.transpose() * W_.selfadjointView<Eigen::Upper>() * r_;
+        for (factor_id_t i = 0; i < factors_.size(); ++i)
+        {
+            auto &f = factors_[i];
+            uint_t dim = f->get_dim_obs();
+            uint_t allDim = f->get_all_nodes_dim();
+            factor_id_t iRow = indFactorsMatrix_[i];
+            Map<MatX> W(scratchW_.data(), dim, dim);
+            Map<MatX> WJ(scratchWJ_.data(), dim, allDim);
+            Map<MatX1> Wr(scratchWr_.data(), dim);
+            Map<MatX1> g(scratchG_.data(), allDim);
+            // J'WJ is only calculated for relinearized factors, the rest keep their block
+            Map<MatX> H(&hessianBlocks_[scatterOffsetL_[i]], allDim, allDim);
+
+            // W (without robust weight) from its upper triangular view
+            auto infoW = f->get_information_matrix();
+            for (uint_t l = 0; l < dim; ++l)
+            {
+                for (uint_t k = l; k < dim; ++k)
+                {
+                    W(l,k) = infoW(l,k);
+                    W(k,l) = infoW(l,k);
+                }
+            }
+            auto J = f->get_jacobian();
+            if (hessian && factorsRelinearized_[i])
+            {
+                WJ.noalias() = W.lazyProduct(J);
+                H.noalias() = J.transpose().lazyProduct(WJ);
+            }
+            matData_t robustWeight = robustWeights_[i];
+            Wr.noalias() = W.lazyProduct(r_.segment(iRow, dim));
+            g.noalias() = robustWeight * J.transpose().lazyProduct(Wr);
+
+            const StorageIndex *cols = &scatterB_[scatterOffsetB_[i]];
+            const StorageIndex *indL = &scatterL_[scatterOffsetL_[i]];
+            for (uint_t a = 0; a < allDim; ++a)
+            {
+                if (cols[a] < 0)
+                    continue;
+                gradient_(cols[a]) += g(a);
+                for (uint_t b = 0; hessian && b < allDim; ++b)
+                {
+                    if (indL[a*allDim + b] >= 0)
+                        valuesL[indL[a*allDim + b]] += robustWeight * H(a,b);
+                }
+            }
+        }
     }
 
-    // If any EF, we should combine both solutions
+    // If any EF, we should combine both solutions, from its upper view
     if (eigen_factors_.size() > 0 )
     {
-        if (buildAdjacencyFlag_)
+        gradient_ += gradientEF_;
+        if (!hessian)
+            return;
+        const matData_t *valuesEF = hessianEF_.valuePtr();
+        for (size_t p = 0; p < scatterEF_.size(); ++p)
         {
-            L_ += hessianEF_.selfadjointView<Eigen::Upper>();
-            b_ += gradientEF_;
-        }
-        // case when there are pure EF and no other factor
-        else
-        {
-            L_ = hessianEF_.selfadjointView<Eigen::Upper>();
-            b_ = gradientEF_;
+            valuesL[scatterEF_[p].first] += valuesEF[p];
+            if (scatterEF_[p].second != scatterEF_[p].first)
+                valuesL[scatterEF_[p].second] += valuesEF[p];
         }
     }
 }
 
 
-void FGraphSolve::build_info_EF()
+void FGraphSolve::build_info_EF(bool hessian)
 {
-    gradientEF_.resize(stateDim_,1);
     gradientEF_.setZero();
-    std::vector<Triplet> hessianData;
-    // TODO if EF ever connected a node that is not 6D, then this will not hold.
-    hessianData.reserve(eigen_factors_.size()*21);//For each EF we reserve the uppder triangular view => 6+5+..+1  = 21
+    // Upper-view sparse matrix, its pattern is already created, duplicated entries will be summed
+    matData_t *valuesEF = hessianEF_.valuePtr();
+    if (hessian)
+        Map<MatX1>(valuesEF, hessianEF_.nonZeros()).setZero();
+    const SMatCol::StorageIndex *outerEF = hessianEF_.outerIndexPtr();
 
     for (size_t id = 0; id < eigen_factors_.size(); ++id)
     {
-        auto f = eigen_factors_[id];
-        f->evaluate_residuals();
-        f->evaluate_jacobians();//and Hessian
-        f->evaluate_chi2();
+        auto &f = eigen_factors_[id];
+        if (!residualsUpdated_)
+        {
+            f->evaluate_residuals();
+            f->evaluate_chi2();
+        }
+        if (hessian)
+            f->evaluate_jacobians();//and Hessian
+        else
+            f->evaluate_gradient();
         auto neighNodes = f->get_neighbour_nodes();
-        for (auto node : *neighNodes)
+        for (auto &node : *neighNodes)
         {
             uint_t indNode = node->get_id();
             if ( node->get_node_mode() == Node::nodeMode::ANCHOR)
@@ -415,28 +783,25 @@ void FGraphSolve::build_info_EF()
             }
             // Updating Jacobian, b should has been previously calculated
             Mat61 J = f->get_jacobian(indNode);
-            // It requires previous calculation of indNodesMatrix (in build adjacency)
-            gradientEF_.block<6,1>(indNodesMatrix_[indNode],0) += J;//TODO robust weight would go here
+            // It requires previous calculation of indNodesMatrix (in build structure)
+            factor_id_t startingIndex = indNodesMatrix_.at(indNode);
+            gradientEF_.block<6,1>(startingIndex,0) += J;//TODO robust weight would go here
+            if (!hessian)
+                continue;
 
-            // Updating the Hessian
+            // Updating the Hessian, only the upper triangular part of the diagonal block.
+            // Each column of the block stores contiguously the rows from the beginning of the block
             Mat6 H = f->get_hessian(indNode);
-            uint_t startingIndex = indNodesMatrix_[indNode];
             // XXX if EF ever connected a node that is not 6D, then this will not hold. TODO
             for (uint_t i = 0; i < 6; i++)
             {
                 for (uint_t j = i; j<6; j++)
                 {
-                    // convert the hessian to triplets, duplicated ones will be summed
-                    // https://eigen.tuxfamily.org/dox/classEigen_1_1SparseMatrix.html#a8f09e3597f37aa8861599260af6a53e0
-                    hessianData.emplace_back(Triplet(startingIndex+ i, startingIndex+ j, H(i,j)));
+                    valuesEF[outerEF[startingIndex + j] + i] += H(i,j);
                 }
             }
         }
     }
-
-    // create a Upper-view sparse matrix from the triplets:
-    hessianEF_.resize(stateDim_,stateDim_);
-    hessianEF_.setFromTriplets(hessianData.begin(), hessianData.end());
 }
 
 matData_t FGraphSolve::chi2(bool evaluateResidualsFlag)
@@ -462,22 +827,27 @@ matData_t FGraphSolve::chi2(bool evaluateResidualsFlag)
         }
         totalChi2 += ef->get_chi2();
     }
+    if (evaluateResidualsFlag)
+        residualsUpdated_ = true;
     return totalChi2;
 }
 
 void FGraphSolve::update_nodes()
 {
+    // dx_ is already the negative of the solution of the normal equations.
+    // x = x - alpha * H^(-1) * Grad = x + dx
+    // Depending on the optimization, it is already taking care of the step alpha, so we assume alpha = 1
     int acc_start = 0;
     for (uint_t i = 0; i < active_nodes_.size(); i++)
     {
-        // node update is the negative of dx just calculated.
-        // x = x - alpha * H^(-1) * Grad = x - dx
-        // Depending on the optimization, it is already taking care of the step alpha, so we assume alpha = 1
-        auto node_update = -dx_.block(acc_start, 0, active_nodes_[i]->get_dim(), 1);
-        active_nodes_[i]->update(node_update);
+        uint_t dim = active_nodes_[i]->get_dim();
+        active_nodes_[i]->update(dx_.segment(acc_start, dim));
 
-        acc_start += active_nodes_[i]->get_dim();
+        nodesStep_[acc_start] = dx_.segment(acc_start, dim).norm();
+        nodesDelta_[acc_start] += nodesStep_[acc_start];
+        acc_start += dim;
     }
+    residualsUpdated_ = false;
 }
 
 void FGraphSolve::synchronize_nodes_auxiliary_state()
@@ -491,22 +861,33 @@ void FGraphSolve::synchronize_nodes_state()
 {
     for (auto &&n : active_nodes_)
         n->set_state(n->get_auxiliary_state());
+    for (factor_id_t n = 0; n < nodesDelta_.size(); ++n)
+    {
+        nodesDelta_[n] = std::max(0.0, nodesDelta_[n] - nodesStep_[n]);
+        nodesStep_[n] = 0.0;
+    }
+    residualsUpdated_ = false;
+}
+
+void FGraphSolve::invalidate_linearization()
+{
+    relinearizeAll_ = true;
+    residualsUpdated_ = false;
 }
 
 // method to output (to python) or other programs the current state of the system.
-std::vector<MatX> FGraphSolve::get_estimated_state()
+// The output is cached, so matrices are only allocated the first time or when new nodes are added.
+const std::vector<MatX>& FGraphSolve::get_estimated_state()
 {
-    vector<MatX> results;
-    results.reserve(nodes_.size());
+    estimatedState_.resize(nodes_.size());
 
     for (uint_t i = 0; i < nodes_.size(); i++)
     {
         //nodes_[i]->print();
-        MatX updated_pos = nodes_[i]->get_state();
-        results.emplace_back(updated_pos);
+        estimatedState_[i] = nodes_[i]->get_state();
     }
 
-    return results;
+    return estimatedState_;
 }
 
 MatX1 FGraphSolve::get_chi2_array()
@@ -23,14 +23,16 @@
 
 
 #include "mrob/factor_graph_solve_dense.hpp"
+#include "mrob/parallel.hpp"
 #include <algorithm>
-#include <iterator>
-#include <iostream>
+#include <cmath>
 
 using namespace mrob;
+using namespace Eigen;
 
-FGraphSolveDense::FGraphSolveDense():
-        FGraph(), OptimizerDense()
+FGraphSolveDense::FGraphSolveDense(uint_t numThreads):
+        FGraph(), OptimizerDense(), numThreads_(numThreads),
+        indexedNodes_(0), indexedFactors_(0), scratchSize_(0)
 {
 
 }
@@ -40,130 +42,186 @@ FGraphSolveDense::~FGraphSolveDense()
 
 }
 
+void FGraphSolveDense::build_index_nodes_matrix()
+{
+    if (indexedNodes_ == nodes_.size() && indexedFactors_ == factors_.size())
+        return;
+    // nodes are only appended, so their id is the position on nodes_
+    indNodesMatrix_.resize(nodes_.size());
+    long N = 0;
+    for (factor_id_t i = 0; i < nodes_.size(); ++i)
+    {
+        if (nodes_[i]->get_node_mode() == Node::nodeMode::ANCHOR)
+        {
+            indNodesMatrix_[i] = -1;
+            continue;
+        }
+        indNodesMatrix_[i] = N;
+        N += nodes_[i]->get_dim();
+    }
+    assert(N == stateDim_ && "FGraphSolveDense::build_index_nodes_matrix: State Dimensions are not coincident\n");
+
+    // scratch for the symmetric W, W*J and W*r of the largest factor
+    scratchSize_ = 0;
+    for (auto &f : factors_)
+    {
+        uint_t dim = f->get_dim_obs();
+        scratchSize_ = std::max(scratchSize_, dim * (dim + f->get_all_nodes_dim() + 1));
+    }
+    indexedNodes_ = nodes_.size();
+    indexedFactors_ = factors_.size();
+}
+
+uint_t FGraphSolveDense::number_blocks() const
+{
+    factor_id_t blocks = std::min<factor_id_t>(mrob::get_number_threads(numThreads_), factors_.size());
+    return std::max<factor_id_t>(blocks, 1);
+}
 
 // Function from the parent class Optimizer.
 // This calculate the total chi2 of the graph, and re-evaluates residuals
 matData_t FGraphSolveDense::calculate_error()
 {
-    matData_t totalChi2 = 0.0;
-    for (uint_t i = 0; i < factors_.size(); ++i)
+    assert(eigen_factors_.empty() && "FGraphSolveDense: Eigen factors are not supported");
+    uint_t numberBlocks = number_blocks();
+    blockChi2_.assign(numberBlocks, 0.0);
+    parallel_for(numberBlocks, numberBlocks, [&](uint_t k)
     {
-        auto f = factors_[i];
-        f->evaluate_residuals();
-        f->evaluate_chi2();
-        totalChi2 += f->get_chi2();
-    }
+        factor_id_t first = factors_.size() * k / numberBlocks, last = factors_.size() * (k + 1) / numberBlocks;
+        for (factor_id_t i = first; i < last; ++i)
+        {
+            auto &f = factors_[i];
+            f->evaluate_residuals();
+            f->evaluate_chi2();
+            blockChi2_[k] += f->get_chi2();
+        }
+    });
+    matData_t totalChi2 = 0.0;
+    for (auto chi2 : blockChi2_)
+        totalChi2 += chi2;
     return totalChi2;
 }
-void FGraphSolveDense::calculate_gradient_hessian()
-{
-    // 1) calculate dimensionality and resize properly
-    uint_t n = this->get_dimension_state();
-    gradient_.resize(n);
-    gradient_.setZero();
-    hessian_.resize(n,n);
-    hessian_.setZero();
 
-    // 2) evaluate residuals and Jacobians
-    for (uint_t i = 0; i < factors_.size(); ++i)
+void FGraphSolveDense::build_block(uint_t k, uint_t numberBlocks, MatX &H, MatX1 &g, std::vector<matData_t> &scratch)
+{
+    H.setZero();
+    g.setZero();
+    factor_id_t first = factors_.size() * k / numberBlocks, last = factors_.size() * (k + 1) / numberBlocks;
+    for (factor_id_t i = first; i < last; ++i)
     {
-        auto f = factors_[i];
-        // XXX: If using some flags, this should no be needed (only for a case in LM)
+        // 1) evaluate residuals and Jacobians. Residuals are evaluated again, since
+        //    this function may be called after rejecting a step in LM
+        auto &f = factors_[i];
         f->evaluate_residuals();
         f->evaluate_jacobians();
         f->evaluate_chi2();
-    }
-
-    // 3) calculate the indexes for the nodes for block allocation
-    std::vector<uint_t> indNodesMatrix, indNodeId;
-    indNodesMatrix.reserve(nodes_.size());
-    indNodeId.reserve(nodes_.size());
-    uint_t N = 0, M = 0;
-    for (size_t i = 0; i < nodes_.size(); ++i)
-    {
-        // calculate the indices to access
-        uint_t dim = nodes_[i]->get_dim();
-        indNodesMatrix.push_back(N);
-        indNodeId.push_back(nodes_[i]->get_id()); //bookkeeps the nodes ids
-        N += dim;
-    }
-    assert(N == stateDim_ && "FGraphSolveDense::HessianAndGradient: State Dimensions are not coincident\n");
-
-    // 4) create Hessian and gradient, by traversing all nodes, looking for its factors
-    //    and completing the rows in the Hessian and gradient.
-    for (uint_t n = 0; n < nodes_.size(); ++n)
-    {
-        auto node = nodes_[n];
-        uint_t node_id =  node->get_id();
-        N = node->get_dim();
-        auto factors = node->get_neighbour_factors();
-        for ( uint_t i = 0; i < factors->size(); ++i )
+        uint_t dim = f->get_dim_obs();
+        uint_t allDim = f->get_all_nodes_dim();
+        matData_t robustWeight = f->evaluate_robust_weight(std::sqrt(f->get_chi2()));
+
+        // 2) W from its upper triangular view, W*J and W*r on the scratch
+        Map<MatX> W(scratch.data(), dim, dim);
+        Map<MatX> WJ(scratch.data() + dim * dim, dim, allDim);
+        Map<MatX1> Wr(scratch.data() + dim * (dim + allDim), dim);
+        auto infoW = f->get_information_matrix();
+        for (uint_t l = 0; l < dim; ++l)
         {
-            auto f = (*factors)[i];
-            auto nodes_connected = f->get_neighbour_nodes();
-            MatX J = f->get_jacobian();
-            uint_t D = f->get_dim();
-
-            // get the trans Jacobian corresponding to the node n. Always premultiplies in Hessian
-            MatX J_n_t;
-            uint_t matrix_index = 0;
-            for (uint_t m = 0; m < nodes_connected->size() ; ++m)
+            for (uint_t m = l; m < dim; ++m)
             {
-                if ((*nodes_connected)[m]->get_id() ==  node_id)
-                {
-                    J_n_t = J.block(0, matrix_index, D,N ).transpose();
-                    break;
-                }
-                matrix_index += (*nodes_connected)[m]->get_dim();
+                W(l,m) = robustWeight * infoW(l,m);
+                W(m,l) = W(l,m);
             }
-
-            // Calculate the second part corresponding on the second factor
-            matrix_index = 0;
-            for (uint_t m = 0; m < nodes_connected->size() ; ++m)
+        }
+        auto J = f->get_jacobian();
+        WJ.noalias() = W.lazyProduct(J);
+        Wr.noalias() = W.lazyProduct(f->get_residual());
+
+        // 3) blocks of each pair of nodes (a,b): H(a,b) += J_a' W J_b and g(a) += J_a' W r
+        auto nodes = f->get_neighbour_nodes();
+        uint_t colA = 0;
+        for (auto &nodeA : *nodes)
+        {
+            uint_t dimA = nodeA->get_dim();
+            long indA = indNodesMatrix_[nodeA->get_id()];
+            if (indA >= 0)
             {
-                auto node2 = (*nodes_connected)[m];
-                M = node2->get_dim();
-                MatX J_m = J.block(0, matrix_index, D,M);
-                matrix_index += M;
-                // Gradient: Grad(n) = \sum J_n_t*W*r
-                gradient_.segment(indNodesMatrix[n], N) +=
-                        J_n_t * f->get_information_matrix() * f->get_residual();
-                // Hessian: H(n,m) = \sum J_n_t'*W*J_m
-                // Look for the corresponding index
-                auto it = std::find(indNodeId.begin(), indNodeId.end(), node2->get_id());
-                auto index = std::distance(indNodeId.begin(), it);
-                // Only the current block row is filled in (corresponding to the n-node). We could use a triang view...
-                hessian_.block(indNodesMatrix[n], indNodesMatrix[index],N,M) +=
-                        J_n_t * f->get_information_matrix() * J_m;
+                auto Ja = J.middleCols(colA, dimA);
+                g.segment(indA, dimA).noalias() += Ja.transpose().lazyProduct(Wr);
+                uint_t colB = 0;
+                for (auto &nodeB : *nodes)
+                {
+                    uint_t dimB = nodeB->get_dim();
+                    long indB = indNodesMatrix_[nodeB->get_id()];
+                    if (indB >= 0)
+                        H.block(indA, indB, dimA, dimB).noalias() += Ja.transpose().lazyProduct(WJ.middleCols(colB, dimB));
+                    colB += dimB;
+                }
             }
+            colA += dimA;
         }
     }
-    //std::cout << "hessian matrix> \n" << hessian_ << std::endl;
+}
+
+void FGraphSolveDense::calculate_gradient_hessian()
+{
+    assert(eigen_factors_.empty() && "FGraphSolveDense: Eigen factors are not supported");
+    // 1) indexes of nodes and dimensionality. Resizing does not allocate while the size does not change
+    build_index_nodes_matrix();
+    uint_t n = stateDim_;
+    gradient_.resize(n);
+    hessian_.resize(n,n);
 
+    // 2) each block of factors is accumulated on its own Hessian and gradient
+    uint_t numberBlocks = number_blocks();
+    blockHessian_.resize(numberBlocks - 1);
+    blockGradient_.resize(numberBlocks - 1);
+    blockScratch_.resize(numberBlocks);
+    for (uint_t k = 0; k < numberBlocks; ++k)
+    {
+        blockScratch_[k].resize(scratchSize_);
+        if (k == 0)
+            continue;
+        blockHessian_[k-1].resize(n,n);
+        blockGradient_[k-1].resize(n);
+    }
+    parallel_for(numberBlocks, numberBlocks, [&](uint_t k)
+    {
+        if (k == 0)
+            build_block(k, numberBlocks, hessian_, gradient_, blockScratch_[k]);
+        else
+            build_block(k, numberBlocks, blockHessian_[k-1], blockGradient_[k-1], blockScratch_[k]);
+    });
+
+    // 3) reduction, always on the same order
+    for (uint_t k = 1; k < numberBlocks; ++k)
+    {
+        hessian_ += blockHessian_[k-1];
+        gradient_ += blockGradient_[k-1];
+    }
 }
-//void FGraphSolveDense::update_state(const MatX1 &dx)
+
 void FGraphSolveDense::update_state()
 {
-    int acc_start = 0;
-    for (uint_t i = 0; i < nodes_.size(); i++)
+    // dx_ already is the negative of the solution of the normal equations:
+    // x = x - alpha * H^(-1) * Grad = x + dx
+    // Depending on the optimization, it is already taking care of the step alpha, so we assume alpha = 1
+    uint_t accStart = 0;
+    for (auto &node : active_nodes_)
     {
-        // node update is the negative of dx just calculated.
-        // x = x - alpha * H^(-1) * Grad = x - dx
-        // Depending on the optimization, it is already taking care of the step alpha, so we assume alpha = 1
-        const auto &node_update = dx_.block(acc_start, 0, nodes_[i]->get_dim(), 1);
-        nodes_[i]->update(node_update);
-
-        acc_start += nodes_[i]->get_dim();
+        uint_t dim = node->get_dim();
+        node->update(dx_.segment(accStart, dim));
+        accStart += dim;
     }
 }
+
 void FGraphSolveDense::bookkeep_state()
 {
-    for (auto &&n : nodes_)
+    for (auto &&n : active_nodes_)
         n->set_auxiliary_state(n->get_state());
 }
+
 void FGraphSolveDense::update_state_from_bookkeep()
 {
-    for (auto &&n : nodes_)
+    for (auto &&n : active_nodes_)
         n->set_state(n->get_auxiliary_state());
 }
-
@@ -30,16 +30,16 @@ using namespace mrob;
 
 
 Factor1Pose3d::Factor1Pose3d(const Mat4 &observation, std::shared_ptr<Node> &n1,
-             const Mat6 &obsInf, Factor::robustFactorType robust_type):
-             Factor(6,6, robust_type), Tobs_(observation), W_(obsInf), J_(Mat6::Zero())
+             const Mat6 &obsInf, Factor::robustFactorType robust_type, bool exactJacobian):
+             Factor(6,6, robust_type), Tobs_(observation), W_(obsInf), J_(Mat6::Zero()), exactJacobian_(exactJacobian)
 {
     // Ordering here is not a problem, the node is unique
     neighbourNodes_.push_back(n1);
 }
 
 Factor1Pose3d::Factor1Pose3d(const SE3 &observation, std::shared_ptr<Node> &n1,
-             const Mat6 &obsInf, Factor::robustFactorType robust_type):
-             Factor(6,6, robust_type), Tobs_(observation), W_(obsInf), J_(Mat6::Zero())
+             const Mat6 &obsInf, Factor::robustFactorType robust_type, bool exactJacobian):
+             Factor(6,6, robust_type), Tobs_(observation), W_(obsInf), J_(Mat6::Zero()), exactJacobian_(exactJacobian)
 {
     // Ordering here is not a problem, the node is unique
     neighbourNodes_.push_back(n1);
@@ -60,7 +60,11 @@ void Factor1Pose3d::evaluate_jacobians()
     // Evaluate Jacobian (see document on SE3 and small perturbations)
     // J = d/dxi ln(T X-1 exp(-xi) (T X-1)-1)= - Adj_{T X-1} = - Adj(Tr)
     // J = d/dxi ln(exp(xi)X T-1  (T X-1)-1)= I
-    J_ = Mat6::Identity();
+    // and the exact one is J = d/dxi ln(exp(xi) X T-1) = Jl^-1(r)
+    if (exactJacobian_)
+        J_ = jacl_inv6(r_);
+    else
+        J_ = Mat6::Identity();
 }
 
 void Factor1Pose3d::evaluate_chi2()
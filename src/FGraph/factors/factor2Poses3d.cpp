@@ -31,8 +31,8 @@ using namespace mrob;
 
 Factor2Poses3d::Factor2Poses3d(const Mat4 &observation, std::shared_ptr<Node> &nodeOrigin,
         std::shared_ptr<Node> &nodeTarget, const Mat6 &obsInf, bool updateNodeTarget,
-        Factor::robustFactorType robust_type):
-        Factor(6,12,robust_type), Tobs_(observation), W_(obsInf)
+        Factor::robustFactorType robust_type, bool exactJacobian):
+        Factor(6,12,robust_type), Tobs_(observation), W_(obsInf), exactJacobian_(exactJacobian)
 {
     if (nodeOrigin->get_id() < nodeTarget->get_id())
     {
@@ -45,21 +45,21 @@ Factor2Poses3d::Factor2Poses3d(const Mat4 &observation, std::shared_ptr<Node> &n
         neighbourNodes_.push_back(nodeOrigin);
 
         // inverse observations to correctly modify this
-        Tobs_.inv();
+        Tobs_ = Tobs_.inv();
     }
     if (updateNodeTarget)
     {
         // Updates the child node such that it matches the odometry observation
         // carefull on the reference frame that Tobs is expressed at the X_origin frame, hence this change:
         Mat4 TxOrigin = nodeOrigin->get_state();
-        nodeTarget->set_state( TxOrigin * Tobs_.T() );
+        nodeTarget->set_state( TxOrigin * SE3(observation).T() );
     }
 }
 
 Factor2Poses3d::Factor2Poses3d(const SE3 &observation, std::shared_ptr<Node> &nodeOrigin,
         std::shared_ptr<Node> &nodeTarget, const Mat6 &obsInf, bool updateNodeTarget,
-        Factor::robustFactorType robust_type):
-        Factor(6,12, robust_type), Tobs_(observation), W_(obsInf)
+        Factor::robustFactorType robust_type, bool exactJacobian):
+        Factor(6,12, robust_type), Tobs_(observation), W_(obsInf), exactJacobian_(exactJacobian)
 {
     if (nodeOrigin->get_id() < nodeTarget->get_id())
     {
@@ -72,14 +72,14 @@ Factor2Poses3d::Factor2Poses3d(const SE3 &observation, std::shared_ptr<Node> &no
         neighbourNodes_.push_back(nodeOrigin);
 
         // inverse observations to correctly modify this
-        Tobs_.inv();
+        Tobs_ = Tobs_.inv();
     }
     if (updateNodeTarget)
     {
         // Updates the child node such that it matches the odometry observation
         // carefull on the reference frame that Tobs is expressed at the X_origin frame, hence this change:
         Mat4 TxOrigin = nodeOrigin->get_state();
-        nodeTarget->set_state( TxOrigin * Tobs_.T() );
+        nodeTarget->set_state( TxOrigin * SE3(observation).T() );
     }
 }
 
@@ -100,8 +100,18 @@ void Factor2Poses3d::evaluate_residuals()
 void Factor2Poses3d::evaluate_jacobians()
 {
     // it assumes you already have evaluated residuals
-    J_.topLeftCorner<6,6>() = Mat6::Identity();
-    J_.topRightCorner<6,6>() = -Tr_.adj();
+    // Ln(Exp(dxo) Tr Exp(-dxt)) = r + Jl^-1(r) (dxo - Adj(Tr) dxt)
+    if (exactJacobian_)
+    {
+        Mat6 JlInv = jacl_inv6(r_);
+        J_.topLeftCorner<6,6>() = JlInv;
+        J_.topRightCorner<6,6>().noalias() = -JlInv * Tr_.adj();
+    }
+    else
+    {
+        J_.topLeftCorner<6,6>() = Mat6::Identity();
+        J_.topRightCorner<6,6>() = -Tr_.adj();
+    }
 }
 
 void Factor2Poses3d::evaluate_chi2()
@@ -31,8 +31,8 @@ using namespace mrob;
 
 Factor2Poses3d2obs::Factor2Poses3d2obs(const Mat4 &observation, const Mat4 &observation2, std::shared_ptr<Node> &nodeOrigin,
         std::shared_ptr<Node> &nodeTarget, const Mat6 &obsInf,
-        Factor::robustFactorType robust_type):
-        Factor(6,12,robust_type), Tobs_(observation), Tobs2_(observation2), W_(obsInf)
+        Factor::robustFactorType robust_type, bool exactJacobian):
+        Factor(6,12,robust_type), Tobs_(observation), Tobs2_(observation2), W_(obsInf), exactJacobian_(exactJacobian)
 {
     if (nodeOrigin->get_id() < nodeTarget->get_id())
     {
@@ -53,8 +53,8 @@ Factor2Poses3d2obs::Factor2Poses3d2obs(const Mat4 &observation, const Mat4 &obse
 
 Factor2Poses3d2obs::Factor2Poses3d2obs(const SE3 &observation, const SE3 &observation2, std::shared_ptr<Node> &nodeOrigin,
         std::shared_ptr<Node> &nodeTarget, const Mat6 &obsInf,
-        Factor::robustFactorType robust_type):
-        Factor(6,12, robust_type), Tobs_(observation),Tobs2_(observation2), W_(obsInf)
+        Factor::robustFactorType robust_type, bool exactJacobian):
+        Factor(6,12, robust_type), Tobs_(observation),Tobs2_(observation2), W_(obsInf), exactJacobian_(exactJacobian)
 {
     if (nodeOrigin->get_id() < nodeTarget->get_id())
     {
@@ -86,8 +86,18 @@ void Factor2Poses3d2obs::evaluate_residuals()
 void Factor2Poses3d2obs::evaluate_jacobians()
 {
     // it assumes you already have evaluated residuals and  Tr (note Tr is not the exact residual but the required for the derivative)
-    J_.topLeftCorner<6,6>() = Mat6::Identity();
-    J_.topRightCorner<6,6>() = Tr_.adj();
+    // Ln(Exp(dxo) To Tobs Exp(dxt) Tt Tobs2^-1) = r + Jl^-1(r) (dxo + Adj(To Tobs) dxt)
+    if (exactJacobian_)
+    {
+        Mat6 JlInv = jacl_inv6(r_);
+        J_.topLeftCorner<6,6>() = JlInv;
+        J_.topRightCorner<6,6>().noalias() = JlInv * Tr_.adj();
+    }
+    else
+    {
+        J_.topLeftCorner<6,6>() = Mat6::Identity();
+        J_.topRightCorner<6,6>() = Tr_.adj();
+    }
 }
 
 void Factor2Poses3d2obs::evaluate_chi2()
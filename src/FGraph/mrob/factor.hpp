@@ -226,7 +226,17 @@ public:
     virtual VectRefConst get_state() const = 0;
     virtual void add_point(const Mat31& p, std::shared_ptr<Node> &node, mrob::matData_t &W) = 0;
     virtual MatRefConst get_hessian(mrob::factor_id_t id = 0) const = 0;
-    virtual void add_points_array(const MatX &P, std::shared_ptr<Node> &node, mrob::matData_t &W) = 0;
+    /**
+     * Evaluates only the Jacobians (gradient) given the residuals, for first order methods.
+     * By default it evaluates the Hessians too, factors with expensive Hessians override it.
+     */
+    virtual void evaluate_gradient() {this->evaluate_jacobians();}
+    virtual void add_points_array(MatRefConst P, std::shared_ptr<Node> &node, mrob::matData_t &W) = 0;
+    /**
+     * Adds a single precision array of points, Nx3. Each point is converted when it is
+     * added, so the array is not copied to double precision.
+     */
+    void add_points_array(MatfRefConst P, std::shared_ptr<Node> &node, mrob::matData_t &W);
     virtual void add_points_S_matrix(const Mat4 &S, std::shared_ptr<Node> &node, mrob::matData_t &W) = 0;
 
 };
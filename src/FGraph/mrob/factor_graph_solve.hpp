@@ -27,7 +27,10 @@
 
 #include "mrob/factor_graph.hpp"
 #include "mrob/time_profiling.hpp"
+#include "mrob/optimizer.hpp"
 #include <unordered_map>
+#include <array>
+#include <memory>
 
 namespace mrob {
 
@@ -70,8 +73,17 @@ namespace mrob {
  *                     Bertsekas p.105 proposes a similar heuristic approach for the trust
  *                     region, which we convert to lambda estimation (we follow Bertsekas' notation in code).
  *  - LM_Ellipsoid implementation. Slightly different than LM-Spherical on how to condition the information matrix.
+ *
+ * The iterations are run by the sparse optimizer (see OptimizerSparse): this class evaluates
+ * the residuals (chi2), builds the normal equations, the information matrix L = J'WJ
+ * (the Hessian) and the vector b = J'Wr (the gradient), and updates the nodes.
+ *
+ * Memory: the sparsity pattern of all matrices, the symbolic Cholesky decomposition and
+ * the indices where each factor writes its block are calculated only when the structure
+ * of the graph changes (new nodes, factors or EF observations). The rest of iterations
+ * write values in place and do not allocate heap memory (see allocation_counter.hpp).
  */
-class FGraphSolve: public FGraph
+class FGraphSolve: public FGraph, public OptimizerSparse
 {
 public:
     /**
@@ -82,9 +94,31 @@ public:
     /**
      * This enums optimization methods available:
      *  - Gauss Newton
-     *  - Levenberg Marquardt (trust-region-like for lambda adjustment) TODO LM elliptical?
+     *  - Levenberg Marquardt (trust-region-like for lambda adjustment), spherical or elliptical damping
+     *  - Powell's Dogleg, which after a rejected step only recomputes the step inside the new radius
+     *  - Gauss Newton with a backtracking line search (Armijo condition)
+     *  - L-BFGS and nonlinear conjugate gradient, first order methods that only build the gradient b,
+     *    which avoids the Hessians of Eigen factors
+     */
+    enum optimMethod{GN=0, LM, LM_ELLIPS, DOGLEG, GN_LINE_SEARCH, LBFGS, NONLINEAR_CG};
+    /**
+     * This enums the initialization methods for pose graphs (see initialize()):
+     *  - Spanning tree: composition of relative observations along a BFS tree
+     *  - Chordal: linear relaxation on the rotation matrices, projected to SO(n)
+     *  - Rotation averaging: iterative chordal mean of rotations from the spanning tree
      */
-    enum optimMethod{GN=0, LM, LM_ELLIPS};
+    enum initMethod{SPANNING_TREE=0, CHORDAL, ROTATION_AVERAGING};
+    /**
+     * Result of each connected component, when components are solved independently
+     */
+    struct ComponentReport
+    {
+        factor_id_t nodes; // active nodes
+        factor_id_t factors; // factors and eigen factors
+        solveStatus status;
+        uint_t iterations;
+        matData_t chi2;
+    };
 
     FGraphSolve(matrixMethod method = ADJ);
     virtual ~FGraphSolve();
@@ -94,10 +128,83 @@ public:
      * ultimately on the function input,
      * by default optim method is Gauss Newton
      *
+     * GN carries out a single iteration.
+     *
      * Return: number of iterations
      *         Failed to converge = 0 iterations
      */
     uint_t solve(optimMethod method = GN, uint_t maxIters = 20, matData_t lambda = 1e-6, matData_t solutionTolerance = 1e-2);
+    /**
+     * Anytime version of solve(), with a wall-clock budget (in microseconds) starting at the call.
+     *
+     * Before each iteration, it checks whether another iteration fits in the remaining time,
+     * given the cost per iteration estimated from the time profiles of previous solves
+     * (see get_iteration_time()). When it stops, nodes keep the best state found so far
+     * and residuals correspond to that state.
+     *
+     * For GN and DOGLEG, a step with a chi2 that is not finite is undone and reported as diverged.
+     * For LM and DOGLEG, rejected steps are undone as usual. For GN_LINE_SEARCH, it is reported as
+     * diverged if no step along the GN direction decreases chi2.
+     *
+     * The status, iterations, estimated time per iteration, iteration records, verbosity and callback
+     * are those of the optimizer (see Optimizer::get_status()).
+     *
+     * Return: status code of the solution
+     */
+    solveStatus solve_budget(uint_t deadlineMicroseconds, optimMethod method = LM, uint_t maxIters = 100,
+            matData_t lambda = 1e-6, matData_t solutionTolerance = 1e-2);
+    /**
+     * Selective relinearization: a factor is relinearized (Jacobians and its block J'WJ)
+     * only if any of its nodes has accumulated updates larger than the threshold
+     * (sum of the norms of the updates) since that node was last relinearized.
+     * The rest of factors keep the Jacobians from their last linearization point,
+     * while residuals are always evaluated at the current state.
+     *
+     * By default 0, all factors connected to nodes that have been updated are relinearized.
+     * Eigen factors are always relinearized.
+     */
+    void set_relinearize_threshold(matData_t threshold) {relinearizeThreshold_ = threshold;}
+    matData_t get_relinearize_threshold() const {return relinearizeThreshold_;}
+    /**
+     * Returns the number of factors relinearized the last time the problem was built
+     */
+    factor_id_t get_relinearized_factors() const {return relinearizedFactors_;}
+    /**
+     * Connected components are the sets of active nodes connected by factors or eigen factors.
+     * Anchor nodes do not connect components, since they are not updated.
+     *
+     * If split is true and there is more than one component, each of them is solved as an
+     * independent problem, with its own LM state (lambda and convergence), on up to numThreads
+     * threads (0 for all hardware threads). The status and iterations of the solve are the worst
+     * among components, and each component is reported at get_components_report().
+     * In that case, the matrices of the whole problem (information, adjacency, etc.) are not built,
+     * the records of each iteration are not kept and the iteration callback is called from the
+     * threads solving each component.
+     */
+    void set_split_components(bool split, uint_t numThreads = 0) {splitComponents_ = split; numThreads_ = numThreads;}
+    /**
+     * Returns the number of connected components when the structure was last built
+     */
+    factor_id_t get_number_components() const {return numberComponents_;}
+    /**
+     * Returns the result of each component after a solve with split components
+     */
+    const std::vector<ComponentReport>& get_components_report() const {return componentsReport_;}
+    /**
+     * Initializes the state of pose nodes from the relative pose factors,
+     * Factor2Poses2d (and Odom) and Factor2Poses3d, before calling solve().
+     *
+     * Anchor nodes keep their state. For each connected component of poses without
+     * anchors, the node with the lowest id keeps its state and the rest are initialized
+     * relative to it. The rest of nodes and factors are ignored.
+     *
+     * Rotations are estimated first, according to the method, and then translations are
+     * calculated by solving a linear LSQ given those rotations (except for SPANNING_TREE).
+     *
+     * Returns false if a linear system is rank deficient (e.g. a factor without information),
+     * then the nodes keep their current state.
+     */
+    bool initialize(initMethod method = CHORDAL);
     /**
      * Evaluates the current solution chi2.
      *
@@ -110,7 +217,7 @@ public:
      * Returns a Reference to the solution vector
      * of all variables, vectors, matrices, etc.
      */
-    std::vector<MatX> get_estimated_state();
+    const std::vector<MatX>& get_estimated_state();
 
     /**
      * Functions to set the matrix method building
@@ -124,7 +231,7 @@ public:
      * CHeck out more here: https://pybind11.readthedocs.io/en/stable/advanced/cast/eigen.html
      * TODO If true, it re-evaluates the problem
      */
-    SMatCol get_information_matrix() { return L_;}
+    SMatCol get_information_matrix() { return hessian_;}
     /**
      * Returns a copy to the Adjacency matrix.
      * There is a conversion (implies copy) from Row to Col-convention (which is what np.array needs)
@@ -141,73 +248,72 @@ public:
      * Returns a copy to the processed residuals in state space b = A'Wr.
      * TODO If true, it re-evaluates the problem
      */
-    MatX1 get_vector_b() { return b_;}
+    MatX1 get_vector_b() { return gradient_;}
     /**
      * Returns a vector of chi2 values for each of the factors.
      */
     MatX1 get_chi2_array();
 
 protected:
+    /**
+     * Functions required by the optimizer: chi2, only evaluating the residuals if the state has
+     * changed since they were evaluated, the normal equations (see build_problem()), and the
+     * update or book-keeping of the state of the nodes.
+     *
+     * For first order methods, calculate_gradient() only builds b. All factors are relinearized,
+     * since the line search requires the exact gradient, and L is not updated.
+     */
+    matData_t calculate_error() override;
+    void calculate_gradient_hessian() override;
+    void calculate_gradient() override;
+    void update_state() override;
+    void bookkeep_state() override;
+    void update_state_from_bookkeep() override;
+
+    /**
+     * Solve and solve_budget(): builds the structure if it has changed and solves the
+     * problem, or each of its components, by the optimizer.
+     */
+    void solve_graph(optimMethod method, uint_t maxIters, matData_t lambda, matData_t solutionTolerance,
+            Tdeadline deadline, bool budget);
     /**
      * build problem creates an information matrix L, W and a vector b
      *
      * It chooses from building the information from the adjacency matrix,
      * directly building info or schur (TODO)
-     *
-     * If bool useLambda is true, it also stores a vector D2 containing the diagonal
-     * of the information matrix L
      */
-    void build_problem(bool useLambda = false);
+    void build_problem();
     /**
      * This protected method creates an Adjacency matrix, iterating over
      * all factors in the FG and creates a block diagonal matrix W with each factors information.
      * As a result, residuals, Jacobians and chi2 values are up to date
      *
+     * Values are written on the patterns calculated at build_structure()
      */
     void build_adjacency();
     /**
      * From the adjacency matrix it creates the information matrix as
      *              L = A^T * W * A
      * The residuals are also calculated as b = A^T * W *r
+     *
+     * Each factor block J'WJ is accumulated directly on the values of L.
+     * If hessian is false, only b is calculated.
      */
-    void build_info_adjacency();
+    void build_info_adjacency(bool hessian = true);
     /**
      * Builds the information matrix directly from Eigen Factors.
      * It follows a different approach than build adjacency, it will only create
      * a Hessian and Jacobian when at least one EF is present.
+     * If hessian is false, only the Jacobians are evaluated (see EigenFactor::evaluate_gradient()).
      */
-    void build_info_EF();
+    void build_info_EF(bool hessian = true);
     void build_schur(); // TODO
 
-    /**
-     * Once the matrix L is generated, it solves the linearized LSQ
-     * by using the Gauss-Newton algorithm
-     *
-     * Input useLambda (default false) builds the GN problem with lambda factor on the diagonal
-     *    L = A'*A + lambda * I
-     */
-    void optimize_gauss_newton(bool useLambda = false);
-
-    /**
-     * It generates the information matrix as
-     *              L' = L +  lambda * I
-     *
-     * TODO, the preconditioning could be adapted to expected values, such as w < pi and v < avg
-     *               L' = L +  lambda * D2
-     *
-     * Iteratively updates the solution given the right estimation of lambda
-     * Parameters are necessary to be specified in advance, o.w. it would use default values.
-     *
-     * input maxIters, before returning a result
-     *
-     * output: number of iterations it took to converge.
-     *    0 when incorrect solution
-     */
-    uint_t optimize_levenberg_marquardt(uint_t maxIters);
 
     /**
-     * Function that updates all nodes with the current solution,
-     * this must be called after solving the problem
+     * Function that updates all nodes with the current step dx_,
+     * this must be called after solving the problem.
+     * It also accumulates the norm of the update of each node, for selective relinearization.
      */
     void update_nodes();
 
@@ -215,9 +321,15 @@ protected:
      * Synchronize state variable in all nodes
      * exactly value the current state.
      *
-     * Usually this function un-does an incorrect update of the state.
+     * Usually this function un-does an incorrect update of the state,
+     * so the last update is also removed from the accumulated updates.
      */
     void synchronize_nodes_state();
+    /**
+     * Marks the current state as unknown to the factors: all factors are relinearized
+     * and residuals are evaluated at the next build of the problem.
+     */
+    void invalidate_linearization();
 
     /**
      * Synchronize auxiliary state variables in all nodes
@@ -236,6 +348,32 @@ protected:
      */
     void build_index_nodes_matrix();
 
+    /**
+     * Returns true if nodes, factors or EF observations have been added
+     * (or nodes have changed its mode) since the last structure was built.
+     */
+    bool structure_changed() const;
+    std::array<factor_id_t, 6> get_structure_signature() const;
+    /**
+     * Builds everything that depends only on the structure of the graph:
+     * node indices, the patterns of A, W, L and the EF Hessian, the indices
+     * where each factor block is written and the symbolic decomposition.
+     * After this, building the problem does not allocate memory.
+     */
+    void build_structure();
+    /**
+     * Labels the connected components of active nodes. If the problem is split,
+     * it creates a graph for each of them, sharing its nodes and factors.
+     * Returns the number of components.
+     */
+    factor_id_t build_components();
+    /**
+     * Solves the graphs of each component in parallel, either by solve() or by solve_budget()
+     * if budget is true, and combines their status.
+     */
+    void solve_components(optimMethod method, uint_t maxIters, matData_t lambda, matData_t solutionTolerance,
+            Tdeadline deadline, bool budget);
+
     // Variables for solving the FGraph
     matrixMethod matrixMethod_;
     optimMethod optimMethod_;
@@ -245,29 +383,52 @@ protected:
     factor_id_t M_; // total number of observation variables
 
     std::unordered_map<factor_id_t, factor_id_t > indNodesMatrix_;
+    std::vector<factor_id_t> indFactorsMatrix_; // row in A where each factor starts
+
+    // Structure bookkeeping: nodes, active nodes, anchors, factors, EFs and EF-node connections
+    std::array<factor_id_t, 6> structureSignature_;
+    // For each factor, indices at the values of L and b where J'WJ and J'Wr are accumulated (-1 for anchors)
+    std::vector<SMatCol::StorageIndex> scatterL_, scatterB_;
+    std::vector<factor_id_t> scatterOffsetL_, scatterOffsetB_;
+    // For each value in hessianEF_ (upper), the indices of that entry and its transposed at L values
+    std::vector<std::pair<SMatCol::StorageIndex, SMatCol::StorageIndex>> scatterEF_;
 
     SMatRow A_; //Adjacency matrix, as a Row sparse matrix. The reason is for filling in row-fashion for each factor
     SMatRow W_; //A block diagonal information matrix. For types Adjacency it calculates its block transposed squared root
     MatX1 r_; // Residuals as given by the factors
 
-    SMatCol L_; //Information matrix. For Eigen Cholesky AMD Ordering it is necessary Col convention for compilation.
-    MatX1 b_; // Post-processed residuals, A'*W*r
-
-    // Correction deltas
-    MatX1 dx_;
-
-    // Particular parameters for Levenberg-Marquard
-    matData_t lambda_; // current value of lambda
-    matData_t solutionTolerance_;
-    MatX1 diagL_; //diagonal matrix (vector) of L to update it efficiently
-
+    // The information matrix L (hessian_, both triangular parts) and b = A'*W*r (gradient_) are those of the optimizer.
+    // The step dx_ = -L^-1 b is applied to the nodes, as x = x + dx.
+
+    // Scratch buffers for building each factor block, sized to the largest factor
+    MatX scratchW_, scratchWJ_;
+    MatX1 scratchWr_, scratchG_;
+    std::vector<MatX> estimatedState_;
+
+    // Selective relinearization: for each node (at its first column) the accumulated norm of updates since its last
+    // relinearization and its last update. For each factor, whether it was relinearized at the last build,
+    // its robust weight and its block J'WJ (without robust weight) at the last linearization point.
+    matData_t relinearizeThreshold_;
+    std::vector<matData_t> nodesDelta_, nodesStep_;
+    std::vector<uint8_t> factorsRelinearized_;
+    std::vector<matData_t> robustWeights_, hessianBlocks_;
+    factor_id_t relinearizedFactors_;
+    bool relinearizeAll_;
+    bool residualsUpdated_; // residuals and chi2 of all factors correspond to the current state
+
+    // Connected components, with a graph for each of them if the problem is split
+    bool splitComponents_, builtSplit_;
+    uint_t numThreads_;
+    factor_id_t numberComponents_;
+    std::vector<std::unique_ptr<FGraphSolve>> components_;
+    std::vector<ComponentReport> componentsReport_;
 
     // Methods for handling Eigen factors. If not used, no problem
     SMatCol hessianEF_;
     MatX1 gradientEF_;
     bool buildAdjacencyFlag_;
 
-    // time profiling
+    // time profiling of the structure and the phases of building the problem
     TimeProfiling time_profiles_;
 };
 
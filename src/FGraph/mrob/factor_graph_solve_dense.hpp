@@ -26,25 +26,41 @@
 
 #include "mrob/optimizer.hpp"
 #include "mrob/factor_graph.hpp"
-#include "mrob/time_profiling.hpp"
+#include <vector>
 
 namespace mrob {
 
 
 /**
  * Class FGraphSolveDense solve a factor graph problem assuming dense
- * precision matrix.
+ * precision matrix. For small and medium size problems this avoids the
+ * overhead of the sparse structures and ordering of FGraphSolve.
  *
  * It inherits from two classes:
  *  - FGraph: structure for adding generic factors
- *  - Optimizer: Optimization methods given some abstract routines
+ *  - OptimizerDense: Optimization methods given some abstract routines
+ *
+ * The Hessian is accumulated factor by factor: each factor adds its blocks
+ * J_a' W J_b at the positions of its nodes a and b in the state, which are
+ * precalculated for all nodes. Anchor nodes are not part of the state.
+ * Eigen factors are not supported.
+ *
+ * The evaluation of factors can be distributed over several threads, each
+ * of them accumulating a block of factors on its own Hessian and gradient,
+ * which are added at the end, so the result does not depend on scheduling.
  */
 class FGraphSolveDense: public FGraph, public OptimizerDense
 {
   public:
-    FGraphSolveDense();
+    FGraphSolveDense(uint_t numThreads = 1);
     ~FGraphSolveDense();
 
+    /**
+     * Number of threads used for evaluating factors, 0 for all hardware threads
+     */
+    void set_number_threads(uint_t numThreads) {numThreads_ = numThreads;}
+    uint_t get_number_threads() const {return numThreads_;}
+
     // Function from the parent class Optimizer
     virtual matData_t calculate_error() override;
     virtual void calculate_gradient_hessian() override;
@@ -52,6 +68,31 @@ class FGraphSolveDense: public FGraph, public OptimizerDense
     virtual void bookkeep_state() override;
     virtual void update_state_from_bookkeep() override;
 
+  protected:
+    /**
+     * Calculates the position of each node on the state and the workspaces,
+     * only when nodes or factors have been added since the last call.
+     */
+    void build_index_nodes_matrix();
+    /**
+     * Number of blocks of factors, each of them evaluated by one thread
+     */
+    uint_t number_blocks() const;
+    /**
+     * Evaluates and accumulates the factors of block k on H and g
+     */
+    void build_block(uint_t k, uint_t numberBlocks, MatX &H, MatX1 &g, std::vector<matData_t> &scratch);
+
+    uint_t numThreads_;
+    factor_id_t indexedNodes_, indexedFactors_;
+    // position on the state of each node by id, -1 for anchor nodes
+    std::vector<long> indNodesMatrix_;
+    // Hessian and gradient of each block, except the first one, accumulated on hessian_ and gradient_
+    std::vector<MatX> blockHessian_;
+    std::vector<MatX1> blockGradient_;
+    std::vector<std::vector<matData_t>> blockScratch_;
+    std::vector<matData_t> blockChi2_;
+    uint_t scratchSize_;
 };
 
 
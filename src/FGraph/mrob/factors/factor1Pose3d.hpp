@@ -39,15 +39,19 @@ namespace mrob{
  *
  * In particular, the residual of this factor is:
  *   r = (x - obs) = Tx * Tobs^{-1}
+ *
+ * The Jacobian is by default the identity, or Jl^-1(r) if exactJacobian is set.
  */
 
 class Factor1Pose3d : public Factor
 {
   public:
     Factor1Pose3d(const Mat4 &observation, std::shared_ptr<Node> &n1, const Mat6 &obsInf,
-            Factor::robustFactorType robust_type = Factor::robustFactorType::QUADRATIC);
+            Factor::robustFactorType robust_type = Factor::robustFactorType::QUADRATIC,
+            bool exactJacobian = false);
     Factor1Pose3d(const SE3 &observation, std::shared_ptr<Node> &n1, const Mat6 &obsInf,
-            Factor::robustFactorType robust_type = Factor::robustFactorType::QUADRATIC);
+            Factor::robustFactorType robust_type = Factor::robustFactorType::QUADRATIC,
+            bool exactJacobian = false);
     ~Factor1Pose3d() override = default;
     /**
      * Returns the chi2 error and fills the residual vector
@@ -69,6 +73,7 @@ class Factor1Pose3d : public Factor
     SE3 Tobs_, Tr_;//Transformation for the observation and the residual
     Mat6 W_;//inverse of observation covariance (information matrix)
     Mat6 J_;//Jacobian
+    bool exactJacobian_;
 
 
 };
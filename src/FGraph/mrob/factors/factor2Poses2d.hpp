@@ -105,8 +105,9 @@ namespace mrob{
 
         void evaluate_residuals() override;
         void evaluate_jacobians() override;
-
-    private:
+        /**
+         * Returns the pose after applying the odometry motion [rot1, trans, rot2] to state
+         */
         Mat31 get_odometry_prediction(Mat31 state, Mat31 motion);
 
     };
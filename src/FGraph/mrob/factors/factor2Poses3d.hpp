@@ -68,6 +68,11 @@ namespace mrob{
  *
  * The observations relate a pair of nodes. The order matters, since this will
  * affect the order on the Jacobian block matrix
+ *
+ * The Jacobian is by default the small residual approximation J = [I, -Adj(Tr)].
+ * If exactJacobian is set, it is the exact one, including the inverse left Jacobian of Ln:
+ *   J = Jl^-1(r) [I, -Adj(Tr)]
+ * which is slightly more expensive but converges in fewer iterations on graphs with large residuals.
  */
 
 class Factor2Poses3d : public Factor
@@ -75,10 +80,12 @@ class Factor2Poses3d : public Factor
   public:
     Factor2Poses3d(const Mat4 &observation, std::shared_ptr<Node> &nodeOrigin,
             std::shared_ptr<Node> &nodeTarget, const Mat6 &obsInf, bool updateNodeTarget=false,
-            Factor::robustFactorType robust_type = Factor::robustFactorType::QUADRATIC);
+            Factor::robustFactorType robust_type = Factor::robustFactorType::QUADRATIC,
+            bool exactJacobian = false);
     Factor2Poses3d(const SE3 &observation, std::shared_ptr<Node> &nodeOrigin,
             std::shared_ptr<Node> &nodeTarget, const Mat6 &obsInf, bool updateNodeTarget=false,
-            Factor::robustFactorType robust_type = Factor::robustFactorType::QUADRATIC);
+            Factor::robustFactorType robust_type = Factor::robustFactorType::QUADRATIC,
+            bool exactJacobian = false);
     ~Factor2Poses3d() override = default;
     /**
      * Jacobians are not evaluated, just the residuals
@@ -106,6 +113,7 @@ class Factor2Poses3d : public Factor
     SE3 Tr_; // Residual Transformation
     Mat6 W_;//inverse of observation covariance (information matrix)
     Mat<6,12> J_;//Joint Jacobian
+    bool exactJacobian_;
 
   public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW // as proposed by Eigen
@@ -66,10 +66,12 @@ class Factor2Poses3d2obs : public Factor
   public:
     Factor2Poses3d2obs(const Mat4 &observation, const Mat4 &observation2, std::shared_ptr<Node> &nodeOrigin,
             std::shared_ptr<Node> &nodeTarget, const Mat6 &obsInf,
-            Factor::robustFactorType robust_type = Factor::robustFactorType::QUADRATIC);
+            Factor::robustFactorType robust_type = Factor::robustFactorType::QUADRATIC,
+            bool exactJacobian = false);
     Factor2Poses3d2obs(const SE3 &observation, const SE3 &observation2, std::shared_ptr<Node> &nodeOrigin,
             std::shared_ptr<Node> &nodeTarget, const Mat6 &obsInf,
-            Factor::robustFactorType robust_type = Factor::robustFactorType::QUADRATIC);
+            Factor::robustFactorType robust_type = Factor::robustFactorType::QUADRATIC,
+            bool exactJacobian = false);
     ~Factor2Poses3d2obs() override = default;
     /**
      * Jacobians are not evaluated, just the residuals
@@ -97,6 +99,7 @@ class Factor2Poses3d2obs : public Factor
     SE3 Tr_; // Residual Transformation
     Mat6 W_;//inverse of observation covariance (information matrix)
     Mat<6,12> J_;//Joint Jacobian
+    bool exactJacobian_;
 
   public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW // as proposed by Eigen
@@ -0,0 +1,485 @@
+/* Copyright (c) 2022, Gonzalo Ferrer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * test_FGraph.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Gonzalo Ferrer
+ *              g.ferrer@skoltech.ru
+ *              Mobile Robotics Lab, Skoltech
+ */
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch.hpp>
+
+#include "mrob/factor_graph_solve.hpp"
+#include "mrob/factor_graph_solve_dense.hpp"
+#include "mrob/factors/nodePose3d.hpp"
+#include "mrob/factors/factor1Pose3d.hpp"
+#include "mrob/factors/factor2Poses3d.hpp"
+#include "mrob/factors/nodeLandmark2d.hpp"
+#include "mrob/allocation_counter.hpp"
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+// Allows access to the protected matrices for testing
+class FGraphSolveTest : public mrob::FGraphSolve
+{
+public:
+    void build() { this->build_structure(); this->build_problem(); }
+};
+
+// Rosenbrock residuals r = [10 (y - x^2), 1 - x] on a 2d landmark, for a factor graph where LM rejects steps
+class FactorRosenbrock : public mrob::Factor
+{
+public:
+    FactorRosenbrock(std::shared_ptr<mrob::Node> &node) : mrob::Factor(2, 2)
+    {
+        neighbourNodes_.push_back(node);
+    }
+    void evaluate_residuals() override
+    {
+        mrob::Mat21 x = neighbourNodes_[0]->get_state();
+        r_ << 10*(x(1) - x(0)*x(0)), 1 - x(0);
+    }
+    void evaluate_jacobians() override
+    {
+        J_ << -20*neighbourNodes_[0]->get_state()(0,0), 10, -1, 0;
+    }
+    void evaluate_chi2() override { chi2_ = 0.5*r_.squaredNorm(); }
+    mrob::MatRefConst get_obs() const override {return W_;}
+    mrob::VectRefConst get_residual() const override {return r_;}
+    mrob::MatRefConst get_information_matrix() const override {return W_;}
+    mrob::MatRefConst get_jacobian(mrob::factor_id_t) const override {return J_;}
+
+    mrob::Mat21 r_;
+    mrob::Mat2 J_, W_ = mrob::Mat2::Identity();
+};
+
+// Pose graph: chain of poses plus loop closures with exact observations from ground truth
+// and perturbed initial states. The first node is anchored or observed by a unary factor.
+void build_pose_graph(mrob::FGraph &graph, std::vector<mrob::SE3> &groundTruth, bool anchor,
+        bool exactJacobian = false, double noise = 0.05)
+{
+    const int N = 10;
+    mrob::Mat6 obsInformation = mrob::Mat6::Identity();
+    std::vector<std::shared_ptr<mrob::Node>> nodes;
+    for (int i = 0; i < N; ++i)
+    {
+        mrob::Mat61 xi;
+        xi << 0.1*i, -0.05*i, 0.2*i, 1.0*i, 0.5*i*i*0.1, -0.3*i;
+        groundTruth.emplace_back(xi);
+        mrob::Mat61 dxi = mrob::Mat61::Random()*noise;
+        mrob::SE3 Tini = groundTruth.back();
+        Tini.update_lhs(dxi);
+        auto mode = (anchor && i == 0) ? mrob::Node::nodeMode::ANCHOR : mrob::Node::nodeMode::STANDARD;
+        std::shared_ptr<mrob::Node> n(new mrob::NodePose3d(i == 0 ? groundTruth.back() : Tini, mode));
+        graph.add_node(n);
+        nodes.push_back(n);
+    }
+    if (!anchor)
+    {
+        std::shared_ptr<mrob::Factor> f0(new mrob::Factor1Pose3d(groundTruth[0], nodes[0], obsInformation*1e6,
+                mrob::Factor::QUADRATIC, exactJacobian));
+        graph.add_factor(f0);
+    }
+    for (int i = 1; i < N; ++i)
+    {
+        mrob::SE3 Tobs = groundTruth[i-1].inv() * groundTruth[i];
+        std::shared_ptr<mrob::Factor> f(new mrob::Factor2Poses3d(Tobs, nodes[i-1], nodes[i], obsInformation,
+                false, mrob::Factor::QUADRATIC, exactJacobian));
+        graph.add_factor(f);
+    }
+    for (int i = 3; i < N; i += 3)
+    {
+        mrob::SE3 Tobs = groundTruth[0].inv() * groundTruth[i];
+        std::shared_ptr<mrob::Factor> f(new mrob::Factor2Poses3d(Tobs, nodes[0], nodes[i], obsInformation));
+        graph.add_factor(f);
+    }
+}
+
+TEST_CASE("FGraphSolve tests")
+{
+    SECTION("Information matrix is the normal equations of the adjacency")
+    {
+        for (bool anchor : {false, true})
+        {
+            FGraphSolveTest graph;
+            std::vector<mrob::SE3> groundTruth;
+            build_pose_graph(graph, groundTruth, anchor);
+            graph.build();
+            mrob::SMatCol A = graph.get_adjacency_matrix();
+            mrob::SMatCol W = graph.get_W_matrix();
+            mrob::MatX L = graph.get_information_matrix();
+            mrob::MatX Lref = A.transpose() * W.selfadjointView<Eigen::Upper>() * A;
+            REQUIRE((L - Lref).norm() == Approx(0.0).margin(1e-9));
+            mrob::MatX1 b = graph.get_vector_b();
+            REQUIRE(b.rows() == L.rows());
+        }
+    }
+
+    SECTION("Gauss Newton and Levenberg Marquardt converge to ground truth")
+    {
+        for (auto method : {mrob::FGraphSolve::GN, mrob::FGraphSolve::LM, mrob::FGraphSolve::LM_ELLIPS})
+        {
+            mrob::FGraphSolve graph;
+            std::vector<mrob::SE3> groundTruth;
+            build_pose_graph(graph, groundTruth, false);
+            for (int i = 0; i < 5; ++i)
+                graph.solve(method);
+            REQUIRE(graph.chi2() == Approx(0.0).margin(1e-8));
+            auto &state = graph.get_estimated_state();
+            for (size_t i = 0; i < groundTruth.size(); ++i)
+                REQUIRE((state[i] - groundTruth[i].T()).norm() == Approx(0.0).margin(1e-5));
+        }
+    }
+
+    SECTION("Initialization recovers the poses from exact observations")
+    {
+        for (auto method : {mrob::FGraphSolve::SPANNING_TREE, mrob::FGraphSolve::CHORDAL, mrob::FGraphSolve::ROTATION_AVERAGING})
+        {
+            for (bool anchor : {false, true})
+            {
+                mrob::FGraphSolve graph;
+                std::vector<mrob::SE3> groundTruth;
+                build_pose_graph(graph, groundTruth, anchor, false, 1.0);
+                REQUIRE(graph.chi2() > 1.0);
+                REQUIRE(graph.initialize(method));
+                REQUIRE(graph.chi2() == Approx(0.0).margin(1e-12));
+            }
+        }
+    }
+
+    SECTION("Initialization keeps the state if the linear systems are rank deficient")
+    {
+        for (auto method : {mrob::FGraphSolve::CHORDAL, mrob::FGraphSolve::ROTATION_AVERAGING})
+        {
+            mrob::FGraphSolve graph;
+            std::vector<mrob::SE3> groundTruth;
+            build_pose_graph(graph, groundTruth, true, false, 1.0);
+            // a node only observed by a factor without information
+            std::shared_ptr<mrob::Node> n(new mrob::NodePose3d(groundTruth.back()));
+            graph.add_node(n);
+            std::shared_ptr<mrob::Node> origin = graph.get_node(0);
+            std::shared_ptr<mrob::Factor> f(new mrob::Factor2Poses3d(mrob::SE3(), origin, n, mrob::Mat6::Zero()));
+            graph.add_factor(f);
+            std::vector<mrob::MatX> states;
+            for (mrob::factor_id_t i = 0; i < graph.number_nodes(); ++i)
+                states.push_back(graph.get_node(i)->get_state());
+            REQUIRE_FALSE(graph.initialize(method));
+            for (mrob::factor_id_t i = 0; i < graph.number_nodes(); ++i)
+                REQUIRE(graph.get_node(i)->get_state() == states[i]);
+        }
+    }
+
+    SECTION("Observations between nodes in decreasing id order")
+    {
+        mrob::FGraphSolve graph;
+        std::vector<mrob::SE3> groundTruth;
+        build_pose_graph(graph, groundTruth, false);
+        std::shared_ptr<mrob::Node> n0 = graph.get_node(0), n5 = graph.get_node(5);
+        mrob::SE3 Tobs = groundTruth[5].inv() * groundTruth[0];
+        std::shared_ptr<mrob::Factor> f(new mrob::Factor2Poses3d(Tobs, n5, n0, mrob::Mat6::Identity()));
+        graph.add_factor(f);
+        graph.solve(mrob::FGraphSolve::LM);
+        REQUIRE(graph.chi2() == Approx(0.0).margin(1e-8));
+    }
+
+    SECTION("Exact Jacobians converge faster on large residuals")
+    {
+        mrob::uint_t iters[2];
+        for (bool exact : {false, true})
+        {
+            mrob::FGraphSolve graph;
+            std::vector<mrob::SE3> groundTruth;
+            build_pose_graph(graph, groundTruth, false, exact, 0.5);
+            iters[exact] = graph.solve(mrob::FGraphSolve::LM, 100);
+            REQUIRE(graph.chi2() == Approx(0.0).margin(1e-8));
+        }
+        REQUIRE(iters[1] <= iters[0]);
+    }
+
+    SECTION("Anytime solve stops at the budget and keeps the best state")
+    {
+        mrob::FGraphSolve graph;
+        std::vector<mrob::SE3> groundTruth;
+        build_pose_graph(graph, groundTruth, false, false, 0.5);
+        mrob::matData_t chi2Initial = graph.chi2();
+        // no time for any iteration
+        REQUIRE(graph.solve_budget(0) == mrob::FGraphSolve::BUDGET_EXHAUSTED);
+        REQUIRE(graph.get_iterations() == 0);
+        REQUIRE(graph.chi2() == Approx(chi2Initial));
+        // iteration budget
+        REQUIRE(graph.solve_budget(1e7, mrob::FGraphSolve::LM, 1) == mrob::FGraphSolve::BUDGET_EXHAUSTED);
+        REQUIRE(graph.get_iterations() == 1);
+        REQUIRE(graph.chi2() <= chi2Initial);
+        REQUIRE(graph.get_iteration_time() > 0.0);
+        for (auto method : {mrob::FGraphSolve::LM, mrob::FGraphSolve::GN})
+        {
+            REQUIRE(graph.solve_budget(1e7, method) == mrob::FGraphSolve::CONVERGED);
+            REQUIRE(graph.chi2() == Approx(0.0).margin(1e-8));
+        }
+    }
+
+    SECTION("Iteration records and callback to stop the solver")
+    {
+        mrob::FGraphSolve graph;
+        std::vector<mrob::SE3> groundTruth;
+        build_pose_graph(graph, groundTruth, false, false, 0.5);
+        graph.set_verbosity(mrob::IterationLog::SILENT);
+        mrob::matData_t chi2Initial = graph.chi2();
+        mrob::uint_t iters = graph.solve(mrob::FGraphSolve::LM, 100);
+        auto &records = graph.get_iteration_records();
+        REQUIRE(records.size() == iters);
+        REQUIRE(records.front().chi2 == Approx(chi2Initial));
+        REQUIRE(records.back().accepted);
+        REQUIRE(records.back().deltaChi2 < 1e-2);
+        for (auto &r : records)
+        {
+            REQUIRE(r.lambda > 0.0);
+            REQUIRE(r.stepNorm > 0.0);
+            REQUIRE(r.timeBuild >= 0.0);
+        }
+        // stops after the first accepted step
+        mrob::FGraphSolve graph2;
+        groundTruth.clear();
+        build_pose_graph(graph2, groundTruth, false, false, 0.5);
+        graph2.set_verbosity(mrob::IterationLog::SILENT);
+        graph2.set_iteration_callback([](const mrob::IterationRecord &r){ return r.accepted; });
+        REQUIRE(graph2.solve(mrob::FGraphSolve::LM, 100) == 0);
+        REQUIRE(graph2.get_status() == mrob::FGraphSolve::STOPPED);
+        REQUIRE(graph2.get_iteration_records().size() == graph2.get_iterations());
+        REQUIRE(graph2.chi2() == Approx(graph2.get_iteration_records().back().chi2 - graph2.get_iteration_records().back().deltaChi2));
+    }
+
+    SECTION("Dogleg and Gauss-Newton with line search converge to ground truth")
+    {
+        for (auto method : {mrob::FGraphSolve::DOGLEG, mrob::FGraphSolve::GN_LINE_SEARCH})
+        {
+            mrob::FGraphSolve graph;
+            std::vector<mrob::SE3> groundTruth;
+            build_pose_graph(graph, groundTruth, false, false, 0.5);
+            graph.set_verbosity(mrob::IterationLog::SILENT);
+            REQUIRE(graph.solve(method, 100) > 0);
+            REQUIRE(graph.get_status() == mrob::FGraphSolve::CONVERGED);
+            REQUIRE(graph.chi2() == Approx(0.0).margin(1e-8));
+            for (size_t i = 0; i < groundTruth.size(); ++i)
+                REQUIRE((graph.get_estimated_state()[i] - groundTruth[i].T()).norm() == Approx(0.0).margin(1e-5));
+            REQUIRE(graph.get_iteration_records().back().lambda == 0.0);
+        }
+    }
+
+    SECTION("L-BFGS and nonlinear CG converge to ground truth")
+    {
+        for (auto method : {mrob::FGraphSolve::LBFGS, mrob::FGraphSolve::NONLINEAR_CG})
+        {
+            mrob::FGraphSolve graph;
+            std::vector<mrob::SE3> groundTruth;
+            build_pose_graph(graph, groundTruth, true, false, 0.1);
+            graph.set_verbosity(mrob::IterationLog::SILENT);
+            REQUIRE(graph.solve(method, 1000, 1e-6, 1e-14) > 0);
+            REQUIRE(graph.get_status() == mrob::FGraphSolve::CONVERGED);
+            REQUIRE(graph.chi2() == Approx(0.0).margin(1e-8));
+            for (size_t i = 0; i < groundTruth.size(); ++i)
+                REQUIRE((graph.get_estimated_state()[i] - groundTruth[i].T()).norm() == Approx(0.0).margin(1e-4));
+            // the information matrix is built again with all factors relinearized
+            graph.solve(mrob::FGraphSolve::GN);
+            REQUIRE(graph.chi2() == Approx(0.0).margin(1e-8));
+        }
+    }
+
+    SECTION("Mixed precision factorization converges as the double precision one")
+    {
+        for (auto method : {mrob::FGraphSolve::GN, mrob::FGraphSolve::LM, mrob::FGraphSolve::DOGLEG})
+        {
+            mrob::FGraphSolve graph;
+            std::vector<mrob::SE3> groundTruth;
+            build_pose_graph(graph, groundTruth, true);
+            graph.set_verbosity(mrob::IterationLog::SILENT);
+            graph.set_mixed_precision(true);
+            for (int i = 0; i < 5; ++i)
+                graph.solve(method, 100, 1e-6, 1e-12);
+            REQUIRE(graph.chi2() == Approx(0.0).margin(1e-8));
+            for (size_t i = 0; i < groundTruth.size(); ++i)
+                REQUIRE((graph.get_estimated_state()[i] - groundTruth[i].T()).norm() == Approx(0.0).margin(1e-5));
+        }
+    }
+
+    SECTION("Speculative LM tries several lambdas after a rejected step")
+    {
+        mrob::uint_t iters[2], rejected[2];
+        for (mrob::uint_t k : {1u, 4u})
+        {
+            mrob::FGraphSolve graph;
+            std::vector<std::shared_ptr<mrob::Node>> nodes;
+            for (int i = 0; i < 20; ++i)
+            {
+                nodes.emplace_back(new mrob::NodeLandmark2d(mrob::Mat21(-1.2, 1.0)));
+                graph.add_node(nodes.back());
+                std::shared_ptr<mrob::Factor> f(new FactorRosenbrock(nodes.back()));
+                graph.add_factor(f);
+            }
+            graph.set_verbosity(mrob::IterationLog::SILENT);
+            graph.set_speculative_lambdas(k, 2);
+            iters[k > 1] = graph.solve(mrob::FGraphSolve::LM, 100, 1e-6, 1e-12);
+            REQUIRE(iters[k > 1] > 0);
+            for (auto &n : nodes)
+                REQUIRE((n->get_state() - mrob::Mat21::Ones()).norm() == Approx(0.0).margin(1e-4));
+            rejected[k > 1] = 0;
+            for (auto &r : graph.get_iteration_records())
+                rejected[k > 1] += !r.accepted;
+        }
+        REQUIRE(rejected[0] > rejected[1]);
+        REQUIRE(iters[1] <= iters[0]);
+    }
+
+    SECTION("Selective relinearization converges and skips nodes that did not move")
+    {
+        mrob::FGraphSolve graph;
+        std::vector<mrob::SE3> groundTruth;
+        build_pose_graph(graph, groundTruth, false, false, 0.5);
+        graph.set_verbosity(mrob::IterationLog::SILENT);
+        graph.set_relinearize_threshold(1e-2);
+        graph.solve(mrob::FGraphSolve::LM, 100);
+        REQUIRE(graph.chi2() == Approx(0.0).margin(1e-8));
+        for (size_t i = 0; i < groundTruth.size(); ++i)
+            REQUIRE((graph.get_estimated_state()[i] - groundTruth[i].T()).norm() == Approx(0.0).margin(1e-5));
+        // at convergence, updates are below the threshold
+        REQUIRE(graph.get_relinearized_factors() < graph.number_factors());
+    }
+
+    SECTION("Connected components are solved independently")
+    {
+        // three disconnected pose graphs, the last one with an anchor that is not part of its component
+        mrob::FGraphSolve graph;
+        std::vector<mrob::SE3> groundTruth[3];
+        for (int k = 0; k < 3; ++k)
+            build_pose_graph(graph, groundTruth[k], k == 2, false, 0.5);
+        graph.set_verbosity(mrob::IterationLog::SILENT);
+        graph.set_split_components(true, 2);
+        REQUIRE(graph.solve(mrob::FGraphSolve::LM, 100) > 0);
+        REQUIRE(graph.get_number_components() == 3);
+        REQUIRE(graph.get_status() == mrob::FGraphSolve::CONVERGED);
+        auto &report = graph.get_components_report();
+        REQUIRE(report.size() == 3);
+        REQUIRE(report[2].nodes == 9);
+        for (auto &r : report)
+        {
+            REQUIRE(r.status == mrob::FGraphSolve::CONVERGED);
+            REQUIRE(r.chi2 == Approx(0.0).margin(1e-8));
+        }
+        REQUIRE(graph.solve(mrob::FGraphSolve::GN) == 1);
+        REQUIRE(graph.chi2() == Approx(0.0).margin(1e-8));
+        auto &state = graph.get_estimated_state();
+        for (int k = 0; k < 3; ++k)
+            for (size_t i = 0; i < groundTruth[k].size(); ++i)
+                REQUIRE((state[10*k + i] - groundTruth[k][i].T()).norm() == Approx(0.0).margin(1e-5));
+        // the whole problem is built again if components are not split
+        graph.set_split_components(false);
+        graph.solve(mrob::FGraphSolve::GN);
+        REQUIRE(graph.get_components_report().empty());
+        REQUIRE(graph.chi2() == Approx(0.0).margin(1e-8));
+    }
+
+    SECTION("Dense solver converges to ground truth and detects rank deficiency")
+    {
+        for (mrob::uint_t threads : {1u, 3u})
+        {
+            for (auto method : {mrob::Optimizer::NEWTON_RAPHSON, mrob::Optimizer::LEVENBERG_MARQUARDT_SPHER,
+                                mrob::Optimizer::LEVENBERG_MARQUARDT_ELLIP})
+            {
+                mrob::FGraphSolveDense graph(threads);
+                std::vector<mrob::SE3> groundTruth;
+                build_pose_graph(graph, groundTruth, method == mrob::Optimizer::NEWTON_RAPHSON, false, 0.5);
+                graph.set_verbosity(mrob::IterationLog::SILENT);
+                REQUIRE(graph.solve(method, 100) > 0);
+                REQUIRE(graph.calculate_error() == Approx(0.0).margin(1e-8));
+                for (size_t i = 0; i < groundTruth.size(); ++i)
+                    REQUIRE((graph.get_node(i)->get_state() - groundTruth[i].T()).norm() == Approx(0.0).margin(1e-5));
+            }
+        }
+        // two poses and a relative observation: the global pose is not observable
+        mrob::FGraphSolveDense graph;
+        graph.set_verbosity(mrob::IterationLog::SILENT);
+        std::shared_ptr<mrob::Node> n0(new mrob::NodePose3d(mrob::SE3()));
+        std::shared_ptr<mrob::Node> n1(new mrob::NodePose3d(mrob::SE3()));
+        graph.add_node(n0);
+        graph.add_node(n1);
+        mrob::Mat61 xi = mrob::Mat61::Ones();
+        std::shared_ptr<mrob::Factor> f(new mrob::Factor2Poses3d(mrob::SE3(xi), n0, n1, mrob::Mat6::Identity()));
+        graph.add_factor(f);
+        REQUIRE(graph.solve(mrob::Optimizer::NEWTON_RAPHSON) == 0);
+        REQUIRE((n0->get_state() - mrob::Mat4::Identity()).norm() == Approx(0.0));
+    }
+
+}
+
+TEST_CASE("FGraphSolve does not allocate once the structure is built")
+{
+    if (!mrob::allocation_counter_enabled())
+    {
+        WARN("Skipped: the library is compiled without MROB_ALLOCATION_COUNTER");
+        return;
+    }
+
+    SECTION("Gauss Newton and Levenberg Marquardt on a pose graph")
+    {
+        mrob::FGraphSolve graph;
+        std::vector<mrob::SE3> groundTruth;
+        build_pose_graph(graph, groundTruth, false);
+        // the first solve builds the structure (and LM allocates the stdout buffer on its first print)
+        graph.solve(mrob::FGraphSolve::LM);
+        uint64_t start = mrob::get_allocation_count();
+        graph.solve(mrob::FGraphSolve::GN);
+        graph.solve(mrob::FGraphSolve::LM);
+        graph.chi2();
+        REQUIRE(mrob::get_allocation_count() - start == 0);
+    }
+
+    SECTION("Dogleg, line search and speculative LM with rejected steps")
+    {
+        for (auto method : {mrob::FGraphSolve::DOGLEG, mrob::FGraphSolve::GN_LINE_SEARCH, mrob::FGraphSolve::LM})
+        {
+            mrob::FGraphSolve graph;
+            std::vector<std::shared_ptr<mrob::Node>> nodes;
+            for (int i = 0; i < 20; ++i)
+            {
+                nodes.emplace_back(new mrob::NodeLandmark2d(mrob::Mat21(-1.2, 1.0)));
+                graph.add_node(nodes.back());
+                std::shared_ptr<mrob::Factor> f(new FactorRosenbrock(nodes.back()));
+                graph.add_factor(f);
+            }
+            graph.set_verbosity(mrob::IterationLog::SILENT);
+            // candidates on a single thread, parallel_for allocates the threads it starts
+            graph.set_speculative_lambdas(4, 1);
+            mrob::MatX initial = nodes[0]->get_state();
+            // the first solve builds the structure and the buffers of each method, the second one starts
+            // again from the initial state, so it goes through the same rejected steps or backtracking
+            graph.solve(method, 100, 1e-6, 1e-12);
+            for (auto &n : nodes)
+                n->set_state(initial);
+            uint64_t start = mrob::get_allocation_count();
+            graph.solve(method, 100, 1e-6, 1e-12);
+            REQUIRE(mrob::get_allocation_count() - start == 0);
+            mrob::uint_t rejected = 0;
+            for (auto &r : graph.get_iteration_records())
+                rejected += !r.accepted;
+            if (method != mrob::FGraphSolve::GN_LINE_SEARCH)
+                REQUIRE(rejected > 0);
+        }
+    }
+}
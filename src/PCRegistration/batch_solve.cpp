@@ -0,0 +1,222 @@
+/* Copyright (c) 2022, Gonzalo Ferrer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * batch_solve.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Gonzalo Ferrer
+ *              g.ferrer@skoltech.ru
+ *              Mobile Robotics Lab, Skoltech 
+ */
+
+#include <Eigen/Cholesky>
+#include <algorithm>
+#include <vector>
+#include "mrob/pc_registration.hpp"
+#include "mrob/parallel.hpp"
+#include "mrob/block_reduce.hpp"
+
+
+using namespace mrob;
+using namespace mrob::detail;
+
+namespace {
+// chi2, gradient (6) and upper triangular part of the Hessian (21, by rows) of the point to plane problem
+using PlaneSums = Eigen::Matrix<matData_t, 28, 1>;
+
+/**
+ * Calculates the chi2 of the correspondences [first, first + M) at T, and the
+ * gradient g = J'Wr and Hessian H = J'WJ of the left perturbation of T.
+ * Jacobians follow the factors Factor1PosePoint2Point and Factor1PosePoint2Plane.
+ */
+matData_t build_problem(PCRegistration::batchMetric metric, MatRefConst X, MatRefConst Y,
+        MatRefConst normals, VectRefConst weights, uint_t first, uint_t M,
+        const SE3 &T, Mat61 &g, Mat6 &H)
+{
+    matData_t chi2 = 0.0;
+    g.setZero();
+    H.setZero();
+    Mat<3,6> Jr;
+    Mat61 Jn;
+    for (uint_t i = first; i < first + M; ++i)
+    {
+        matData_t w = weights.size() > 0 ? weights(i) : 1.0;
+        Mat31 Tx = T.transform(X.row(i));
+        Mat31 r = Tx - Y.row(i).transpose();
+        if (metric == PCRegistration::POINT_TO_POINT)
+        {
+            // J = [-(Tx)^, I]
+            Jr << -hat3(Tx), Mat3::Identity();
+            chi2 += 0.5 * w * r.squaredNorm();
+            g.noalias() += w * Jr.transpose() * r;
+            H.noalias() += w * Jr.transpose() * Jr;
+        }
+        else
+        {
+            // J' = [(Tx)^ n; n]
+            Mat31 n = normals.row(i).transpose();
+            matData_t rn = n.dot(r);
+            Jn << hat3(Tx) * n, n;
+            chi2 += 0.5 * w * rn * rn;
+            g.noalias() += w * rn * Jn;
+            H.noalias() += w * Jn * Jn.transpose();
+        }
+    }
+    return chi2;
+}
+
+/**
+ * Point to plane chi2, gradient and Hessian of the correspondences [first, last), in SoA
+ * blocks as the reductions of gicp(). For each point p = Tx, the residual is n'(p - y)
+ * and its Jacobian J' = [p x n; n].
+ */
+void reduce_point_to_plane(const PointsSoA<matData_t> &X, const PointsSoA<matData_t> &Y,
+                           const PointsSoA<matData_t> &normals, const Mat3 &R, const Mat31 &t,
+                           uint_t first, uint_t last, PlaneSums &sums)
+{
+    sums.setZero();
+    BlockArray<matData_t> p[3], rn, J[6];
+    for (uint_t start = first; start < last; start += blockSize)
+    {
+        const uint_t n = std::min(blockSize, last - start);
+        for (uint_t i = 0; i < 3; ++i)
+            p[i] = R(i,0) * X.col(0).segment(start, n).array() + R(i,1) * X.col(1).segment(start, n).array() +
+                   R(i,2) * X.col(2).segment(start, n).array() + t(i);
+        for (uint_t i = 0; i < 3; ++i)
+            J[3 + i] = normals.col(i).segment(start, n).array();
+        rn = J[3] * (p[0] - Y.col(0).segment(start, n).array()) + J[4] * (p[1] - Y.col(1).segment(start, n).array()) +
+             J[5] * (p[2] - Y.col(2).segment(start, n).array());
+        for (uint_t i = 0; i < 3; ++i)
+        {
+            const uint_t i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+            J[i] = p[i1] * J[3 + i2] - p[i2] * J[3 + i1];
+        }
+        sums(0) += 0.5 * block_sum(rn * rn);
+        for (uint_t i = 0, k = 7; i < 6; ++i)
+        {
+            sums(1 + i) += block_sum(rn * J[i]);
+            for (uint_t j = i; j < 6; ++j, ++k)
+                sums(k) += block_sum(J[i] * J[j]);
+        }
+    }
+}
+
+/**
+ * Levenberg-Marquardt on the 6x6 system of a single problem, where build(T, g, H)
+ * returns the chi2 at T and calculates its gradient and Hessian. All matrices
+ * are fixed-size, so no memory is allocated.
+ */
+template<typename Build>
+PCRegistration::BatchReport solve_problem(Build build, SE3 &T, uint_t maxIters, double tol)
+{
+    PCRegistration::BatchReport report{0, 0.0, false};
+    Mat61 g, gNew;
+    Mat6 H, HNew;
+    matData_t chi2 = build(T, g, H);
+    matData_t lambda = 1e-5;
+    Eigen::LDLT<Mat6> ldlt;
+    while (report.iterations < maxIters)
+    {
+        ++report.iterations;
+        // Marquardt's scaling, plus a small constant for rank deficient problems (e.g. planar scenes)
+        Mat6 Hl = H;
+        Hl.diagonal().array() += lambda * (H.diagonal().array() + 1e-9);
+        ldlt.compute(Hl);
+        if (ldlt.info() != Eigen::Success || !ldlt.isPositive())
+        {
+            lambda *= 10.0;
+            continue;
+        }
+        Mat61 dxi = -ldlt.solve(g);
+        SE3 TNew(T);
+        TNew.update_lhs(dxi);
+        matData_t chi2New = build(TNew, gNew, HNew);
+        if (chi2New <= chi2)
+        {
+            T = TNew;
+            chi2 = chi2New;
+            g = gNew;
+            H = HNew;
+            lambda = std::max(lambda * 0.1, 1e-9);
+        }
+        else
+            lambda *= 10.0;
+        if (dxi.norm() < tol)
+        {
+            report.converged = true;
+            break;
+        }
+    }
+    report.chi2 = chi2;
+    return report;
+}
+
+}
+
+void PCRegistration::batch_solve(batchMetric metric, MatRefConst X, MatRefConst Y, MatRefConst normals,
+                 VectRefConst weights, BatchPoses &T, std::vector<BatchReport> &report,
+                 uint_t maxIters, double tol, uint_t numThreads)
+{
+    uint_t N = T.size();
+    report.resize(N);
+    if (N == 0)
+        return;
+    assert(X.cols() == 3  && "PCRegistration::batch_solve: Incorrect sizing, we expect NMx3");
+    assert(X.rows() % N == 0  && "PCRegistration::batch_solve: All problems must have the same number of correspondences");
+    assert(Y.rows() == X.rows()  && "PCRegistration::batch_solve: Same number of correspondences");
+    assert((metric != POINT_TO_PLANE || normals.rows() == X.rows()) && "PCRegistration::batch_solve: A normal for each correspondence");
+    assert((weights.size() == 0 || weights.size() == X.rows()) && "PCRegistration::batch_solve: A weight for each correspondence");
+    uint_t M = X.rows() / N;
+
+    parallel_for(N, numThreads, [&](uint_t k)
+    {
+        report[k] = solve_problem([&](const SE3 &Tk, Mat61 &g, Mat6 &H)
+        {
+            return build_problem(metric, X, Y, normals, weights, k * M, M, Tk, g, H);
+        }, T[k], maxIters, tol);
+    });
+}
+
+int PCRegistration::point_to_plane(MatRefConst X, MatRefConst Y, MatRefConst normals, SE3 &T,
+                                   double tol, uint_t numThreads, uint_t maxIters)
+{
+    assert(X.cols() == 3  && "PCRegistration::point_to_plane: Incorrect sizing, we expect Nx3");
+    assert(Y.rows() == X.rows()  && "PCRegistration::point_to_plane: Same number of correspondences");
+    assert(normals.rows() == X.rows() && "PCRegistration::point_to_plane: A normal for each correspondence");
+    const uint_t N = X.rows();
+
+    // SoA copies of the points and normals, reduced in parallel on ranges of fixed size as gicp()
+    const PointsSoA<matData_t> Xs = X, Ys = Y, normalsS = normals;
+    const uint_t numTasks = (N + taskSize - 1) / taskSize;
+    std::vector<PlaneSums> partialSums(numTasks);
+    BatchReport report = solve_problem([&](const SE3 &Tk, Mat61 &g, Mat6 &H)
+    {
+        const Mat3 R = Tk.R();
+        const Mat31 t = Tk.t();
+        parallel_for(numTasks, numThreads, [&](uint_t k)
+        {
+            reduce_point_to_plane(Xs, Ys, normalsS, R, t, k*taskSize, std::min((k+1)*taskSize, N), partialSums[k]);
+        });
+        PlaneSums s = PlaneSums::Zero();
+        for (const auto &partial : partialSums)
+            s += partial;
+        g = s.segment<6>(1);
+        for (uint_t i = 0, k = 7; i < 6; ++i)
+            for (uint_t j = i; j < 6; ++j, ++k)
+                H(i, j) = H(j, i) = s(k);
+        return s(0);
+    }, T, maxIters, tol);
+    return report.iterations;
+}
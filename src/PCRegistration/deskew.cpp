@@ -0,0 +1,138 @@
+/* Copyright (c) 2022, Gonzalo Ferrer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * deskew.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Gonzalo Ferrer
+ *              g.ferrer@skoltech.ru
+ *              Mobile Robotics Lab, Skoltech
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "mrob/pc_registration.hpp"
+#include "mrob/parallel.hpp"
+
+
+using namespace mrob;
+
+namespace
+{
+// points processed by each parallel task
+constexpr uint_t chunkSize = 4096;
+// below this angle the rotation of a segment is linearized
+constexpr matData_t smallAngle = 1e-6;
+
+/**
+ * Segment T(tau) = T0 exp(tau xi), being xi = [theta k, v] and K = k^. By the Rodrigues formula
+ * and the V matrix of SE3::exp(), only a = sin(tau theta) and b = 1 - cos(tau theta) depend on tau
+ *      R(tau) = I + a K + b K^2
+ *      t(tau) = tau v + b/theta K v + (tau - a/theta) K^2 v
+ * so a point x is transformed as
+ *      T(tau) x = R0 x + t0 + a (A x - c3) + b (B x + c2) + tau c1,
+ * with A = R0 K, B = R0 K^2, c1 = R0 (v + K^2 v), c2 = R0 K v / theta and c3 = R0 K^2 v / theta.
+ * For small angles R(tau) = I + tau w^ and t(tau) = tau v + tau^2/2 w^ v, which is the same expression
+ * with a = tau, b = tau^2, A = R0 w^, B = 0, c1 = R0 v, c2 = R0 w^ v / 2 and c3 = 0.
+ */
+struct Segment
+{
+    Mat3 R0, A, B;
+    Mat31 t0, c1, c2, c3;
+    matData_t theta;
+    bool small;
+};
+
+Segment create_segment(const SE3 &T0, const SE3 &T1)
+{
+    Segment s;
+    const Mat61 xi = (T0.inv() * T1).ln_vee();
+    const Mat31 w = xi.head<3>(), v = xi.tail<3>();
+    s.R0 = T0.R();
+    s.t0 = T0.t();
+    s.theta = w.norm();
+    s.small = s.theta < smallAngle;
+    if (s.small)
+    {
+        s.A = s.R0 * hat3(w);
+        s.B.setZero();
+        s.c1 = s.R0 * v;
+        s.c2 = 0.5 * s.A * v;
+        s.c3.setZero();
+        return s;
+    }
+    const Mat3 K = hat3(w / s.theta);
+    const Mat3 K2 = K * K;
+    s.A = s.R0 * K;
+    s.B = s.R0 * K2;
+    s.c1 = s.R0 * (v + K2 * v);
+    s.c2 = s.R0 * K * v / s.theta;
+    s.c3 = s.R0 * K2 * v / s.theta;
+    return s;
+}
+
+template<typename Scalar>
+void deskew_scalar(Eigen::Ref<MatXT<Scalar>> X, const Eigen::Ref<const MatX1T<Scalar>> &timestamps,
+                   const PCRegistration::BatchPoses &poses, uint_t numThreads)
+{
+    assert(X.cols() == 3 && "PCRegistration::deskew: Incorrect sizing, we expect Nx3");
+    assert(timestamps.rows() == X.rows() && "PCRegistration::deskew: a timestamp for each point");
+    assert(poses.size() >= 2 && "PCRegistration::deskew: at least 2 poses");
+    const uint_t numSegments = poses.size() - 1;
+    std::vector<Segment> segments(numSegments);
+    for (uint_t k = 0; k < numSegments; ++k)
+        segments[k] = create_segment(poses[k], poses[k + 1]);
+
+    const uint_t N = X.rows();
+    parallel_for((N + chunkSize - 1) / chunkSize, numThreads, [&](uint_t task)
+    {
+        for (uint_t i = task * chunkSize; i < std::min(N, (task + 1) * chunkSize); ++i)
+        {
+            // segment of the timestamp and time inside it
+            const matData_t tau = std::min(std::max(static_cast<matData_t>(timestamps(i)), 0.0), 1.0) * numSegments;
+            const uint_t k = std::min(static_cast<uint_t>(tau), numSegments - 1);
+            const matData_t t = tau - k;
+            const Segment &s = segments[k];
+            const Mat31 x = X.row(i).transpose().template cast<matData_t>();
+            const matData_t a = s.small ? t : std::sin(t * s.theta);
+            const matData_t b = s.small ? t * t : 1.0 - std::cos(t * s.theta);
+            const Mat31 p = s.R0 * x + s.t0 + a * (s.A * x - s.c3) + b * (s.B * x + s.c2) + t * s.c1;
+            X.row(i) = p.transpose().template cast<Scalar>();
+        }
+    });
+}
+}
+
+
+void PCRegistration::deskew(MatRef X, VectRefConst timestamps, const SE3 &Tstart, const SE3 &Tend, uint_t numThreads)
+{
+    deskew_scalar<matData_t>(X, timestamps, PCRegistration::BatchPoses{Tstart, Tend}, numThreads);
+}
+
+void PCRegistration::deskew(MatfRef X, VectfRefConst timestamps, const SE3 &Tstart, const SE3 &Tend, uint_t numThreads)
+{
+    deskew_scalar<float>(X, timestamps, PCRegistration::BatchPoses{Tstart, Tend}, numThreads);
+}
+
+void PCRegistration::deskew(MatRef X, VectRefConst timestamps, const BatchPoses &poses, uint_t numThreads)
+{
+    deskew_scalar<matData_t>(X, timestamps, poses, numThreads);
+}
+
+void PCRegistration::deskew(MatfRef X, VectfRefConst timestamps, const BatchPoses &poses, uint_t numThreads)
+{
+    deskew_scalar<float>(X, timestamps, poses, numThreads);
+}
@@ -0,0 +1,161 @@
+/* Copyright (c) 2022, Gonzalo Ferrer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * downsample.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Gonzalo Ferrer
+ *              g.ferrer@skoltech.ru
+ *              Mobile Robotics Lab, Skoltech
+ */
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <tuple>
+#include <vector>
+#include <cassert>
+#include "mrob/pc_registration.hpp"
+#include "mrob/voxel_hash_map.hpp"
+#include "mrob/parallel.hpp"
+
+
+using namespace mrob;
+
+namespace
+{
+// Points are processed by parallel tasks of fixed ranges, and equal voxels are sorted by
+// the index of their points, so the output does not depend on the number of threads.
+constexpr uint_t taskSize = 16384;
+
+struct PointKey
+{
+    VoxelKey key;
+    uint_t index;
+    bool operator<(const PointKey &p) const
+    {
+        return std::tie(key.x, key.y, key.z, index) < std::tie(p.key.x, p.key.y, p.key.z, p.index);
+    }
+};
+
+/**
+ * Sorts by chunks in parallel, which are merged by pairs at each level
+ */
+void parallel_sort(std::vector<PointKey> &keys, uint_t numThreads)
+{
+    const uint_t N = keys.size();
+    parallel_for((N + taskSize - 1) / taskSize, numThreads, [&](uint_t task)
+    {
+        std::sort(keys.begin() + task * taskSize, keys.begin() + std::min(N, (task + 1) * taskSize));
+    });
+    for (uint_t width = taskSize; width < N; width *= 2)
+    {
+        parallel_for((N + 2 * width - 1) / (2 * width), numThreads, [&](uint_t pair)
+        {
+            uint_t middle = std::min(N, (2 * pair + 1) * width);
+            uint_t end = std::min(N, (2 * pair + 2) * width);
+            std::inplace_merge(keys.begin() + 2 * pair * width, keys.begin() + middle, keys.begin() + end);
+        });
+    }
+}
+
+template<typename Scalar>
+void voxel_downsample_impl(const Eigen::Ref<const MatXT<Scalar>> &X, matData_t voxelSize, MatXT<Scalar> &Xd,
+                           PCRegistration::downsampleMode mode, uint_t numThreads)
+{
+    assert(X.cols() == 3 && voxelSize > 0.0 && "PCRegistration::voxel_downsample: we expect Nx3 and a positive voxel size");
+    const uint_t N = X.rows();
+    std::vector<PointKey> keys(N);
+    parallel_for((N + taskSize - 1) / taskSize, numThreads, [&](uint_t task)
+    {
+        for (uint_t i = task * taskSize; i < std::min(N, (task + 1) * taskSize); ++i)
+            keys[i] = PointKey{VoxelKey::from_point(X.row(i).template cast<matData_t>(), voxelSize), i};
+    });
+    parallel_sort(keys, numThreads);
+
+    // voxels are ranges of equal keys, output in the order of their first point in X
+    std::vector<std::pair<uint_t, uint_t>> voxels; // first point and start of the range
+    for (uint_t i = 0; i < N; ++i)
+    {
+        if (i == 0 || !(keys[i].key == keys[i-1].key))
+            voxels.emplace_back(keys[i].index, i);
+    }
+    const uint_t M = voxels.size();
+    std::vector<uint_t> order(M);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](uint_t a, uint_t b){return voxels[a].first < voxels[b].first;});
+
+    Xd.resize(M, 3);
+    parallel_for((M + taskSize - 1) / taskSize, numThreads, [&](uint_t task)
+    {
+        for (uint_t i = task * taskSize; i < std::min(M, (task + 1) * taskSize); ++i)
+        {
+            uint_t v = order[i];
+            if (mode == PCRegistration::DOWNSAMPLE_FIRST_POINT)
+            {
+                Xd.row(i) = X.row(voxels[v].first);
+                continue;
+            }
+            uint_t begin = voxels[v].second;
+            uint_t end = v + 1 < M ? voxels[v + 1].second : N;
+            Mat13 sum = Mat13::Zero();
+            for (uint_t j = begin; j < end; ++j)
+                sum += X.row(keys[j].index).template cast<matData_t>();
+            Xd.row(i) = (sum / (end - begin)).template cast<Scalar>();
+        }
+    });
+}
+
+template<typename Scalar>
+void random_downsample_impl(const Eigen::Ref<const MatXT<Scalar>> &X, uint_t M, MatXT<Scalar> &Xd, uint_t seed)
+{
+    const uint_t N = X.rows();
+    M = std::min(M, N);
+    // partial Fisher-Yates shuffle, the selected points keep their order in X
+    std::vector<uint_t> indices(N);
+    std::iota(indices.begin(), indices.end(), 0);
+    std::mt19937 generator(seed);
+    for (uint_t i = 0; i < M; ++i)
+    {
+        std::uniform_int_distribution<uint_t> distribution(i, N - 1);
+        std::swap(indices[i], indices[distribution(generator)]);
+    }
+    std::sort(indices.begin(), indices.begin() + M);
+    Xd.resize(M, 3);
+    for (uint_t i = 0; i < M; ++i)
+        Xd.row(i) = X.row(indices[i]);
+}
+
+}
+
+void PCRegistration::voxel_downsample(MatRefConst X, matData_t voxelSize, MatX &Xd, downsampleMode mode, uint_t numThreads)
+{
+    voxel_downsample_impl<matData_t>(X, voxelSize, Xd, mode, numThreads);
+}
+
+void PCRegistration::voxel_downsample(MatfRefConst X, matData_t voxelSize, MatXf &Xd, downsampleMode mode, uint_t numThreads)
+{
+    voxel_downsample_impl<float>(X, voxelSize, Xd, mode, numThreads);
+}
+
+void PCRegistration::random_downsample(MatRefConst X, uint_t M, MatX &Xd, uint_t seed)
+{
+    random_downsample_impl<matData_t>(X, M, Xd, seed);
+}
+
+void PCRegistration::random_downsample(MatfRefConst X, uint_t M, MatXf &Xd, uint_t seed)
+{
+    random_downsample_impl<float>(X, M, Xd, seed);
+}
@@ -21,24 +21,139 @@
  *              Mobile Robotics Lab, Skoltech 
  */
 
-#include <Eigen/LU> // for inverse and determinant
-
-#include <memory>
-#include <iostream>
+#include <Eigen/Cholesky>
+#include <algorithm>
+#include <vector>
 #include "mrob/pc_registration.hpp" // GICP function is defined here
+#include "mrob/parallel.hpp"
+#include "mrob/block_reduce.hpp"
 
 
 using namespace mrob;
+using namespace mrob::detail;
 
-int PCRegistration::gicp(MatRefConst X, MatRefConst Y,
-           MatRefConst covX, MatRefConst covY, SE3 &T, double tol)
+namespace
+{
+// Symmetric 3x3 matrices are stored by their 6 upper triangular terms: 00, 01, 02, 11, 12, 22
+template<typename Scalar>
+using CovariancesSoA = Eigen::Matrix<Scalar, Eigen::Dynamic, 6, Eigen::ColMajor>;
+constexpr uint_t sym[3][3] = {{0, 1, 2}, {1, 3, 4}, {2, 4, 5}};
+// gradient (6), bottom right (6 symmetric), top right (9, by rows) and top left (6 symmetric) blocks of the Hessian
+using Sums = Eigen::Matrix<matData_t, 27, 1>;
+
+template<typename Scalar>
+CovariancesSoA<Scalar> covariances_soa(const Eigen::Ref<const MatXT<Scalar>> &cov)
+{
+    const uint_t N = cov.rows() / 3;
+    CovariancesSoA<Scalar> res(N, 6);
+    for (uint_t n = 0; n < N; ++n)
+        for (uint_t i = 0; i < 3; ++i)
+            for (uint_t j = i; j < 3; ++j)
+                res(n, sym[i][j]) = cov(3*n + i, j);
+    return res;
+}
+
+/**
+ * Gradient and Hessian of the points [first, last). For each point p = Tx, r = y - Tx,
+ * L = (covY + R covX R')^-1 and Jr = [p^ ; -I], the gradient is Jr' L r and the Hessian
+ *      Jr' L Jr = [ -p^ L p^   p^ L
+ *                   -L p^      L    ]
+ */
+template<typename Scalar>
+void reduce_points(const PointsSoA<Scalar> &X, const PointsSoA<Scalar> &Y,
+                   const CovariancesSoA<Scalar> &covX, const CovariancesSoA<Scalar> &covY,
+                   const Eigen::Matrix<Scalar, 3, 3> &R, const Eigen::Matrix<Scalar, 3, 1> &t,
+                   uint_t first, uint_t last, Sums &sums)
+{
+    sums.setZero();
+    BlockArray<Scalar> p[3], r[3], C[6], L[6], v[3], Mh[3][3];
+    for (uint_t start = first; start < last; start += blockSize)
+    {
+        const uint_t n = std::min(blockSize, last - start);
+        // 1) residuals r = y - Tx
+        for (uint_t i = 0; i < 3; ++i)
+        {
+            p[i] = R(i,0) * X.col(0).segment(start, n).array() + R(i,1) * X.col(1).segment(start, n).array() +
+                   R(i,2) * X.col(2).segment(start, n).array() + t(i);
+            r[i] = Y.col(i).segment(start, n).array() - p[i];
+        }
+
+        // 2) joint covariance C = covY + R covX R', symmetric terms of covX are added once
+        for (uint_t i = 0; i < 3; ++i)
+        {
+            for (uint_t j = i; j < 3; ++j)
+            {
+                BlockArray<Scalar> &c = C[sym[i][j]];
+                c = covY.col(sym[i][j]).segment(start, n).array();
+                for (uint_t k = 0; k < 3; ++k)
+                {
+                    c += R(i,k) * R(j,k) * covX.col(sym[k][k]).segment(start, n).array();
+                    for (uint_t l = k + 1; l < 3; ++l)
+                        c += (R(i,k) * R(j,l) + R(i,l) * R(j,k)) * covX.col(sym[k][l]).segment(start, n).array();
+                }
+            }
+        }
+
+        // 3) closed form inverse L = adj(C) / det(C)
+        L[0] = C[3] * C[5] - C[4] * C[4];
+        L[1] = C[2] * C[4] - C[1] * C[5];
+        L[2] = C[1] * C[4] - C[2] * C[3];
+        L[3] = C[0] * C[5] - C[2] * C[2];
+        L[4] = C[1] * C[2] - C[0] * C[4];
+        L[5] = C[0] * C[3] - C[1] * C[1];
+        BlockArray<Scalar> invDet = (C[0] * L[0] + C[1] * L[1] + C[2] * L[2]).inverse();
+        for (uint_t i = 0; i < 6; ++i)
+            L[i] *= invDet;
+
+        // 4) gradient [v x p; -v], v = L r
+        for (uint_t i = 0; i < 3; ++i)
+            v[i] = L[sym[i][0]] * r[0] + L[sym[i][1]] * r[1] + L[sym[i][2]] * r[2];
+        for (uint_t i = 0; i < 3; ++i)
+        {
+            const uint_t i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+            sums(i) += block_sum(v[i1] * p[i2] - v[i2] * p[i1]);
+            sums(3 + i) -= block_sum(v[i]);
+        }
+
+        // 5) Hessian blocks L, p^ L and -p^ L p^
+        for (uint_t i = 0; i < 6; ++i)
+            sums(6 + i) += block_sum(L[i]);
+        for (uint_t i = 0; i < 3; ++i)
+        {
+            const uint_t i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+            for (uint_t j = 0; j < 3; ++j)
+            {
+                Mh[i][j] = p[i1] * L[sym[i2][j]] - p[i2] * L[sym[i1][j]];
+                sums(12 + 3*i + j) += block_sum(Mh[i][j]);
+            }
+        }
+        for (uint_t i = 0; i < 3; ++i)
+        {
+            for (uint_t j = i; j < 3; ++j)
+            {
+                const uint_t j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+                sums(21 + sym[i][j]) -= block_sum(Mh[i][j1] * p[j2] - Mh[i][j2] * p[j1]);
+            }
+        }
+    }
+}
+
+template<typename Scalar>
+int gicp_scalar(const Eigen::Ref<const MatXT<Scalar>> &X, const Eigen::Ref<const MatXT<Scalar>> &Y,
+           const Eigen::Ref<const MatXT<Scalar>> &covX, const Eigen::Ref<const MatXT<Scalar>> &covY, SE3 &T, double tol,
+           uint_t numThreads, uint_t maxIters)
 {
     assert(X.cols() == 3  && "PCRegistration::Gicp: Incorrect sizing, we expect Nx3");
     assert(X.rows() >= 3  && "PCRegistration::Gicp: Incorrect sizing, we expect at least 3 correspondences (not aligned)");
     assert(Y.rows() == X.rows()  && "PCRegistration::Gicp: Same number of correspondences");
     uint_t N = X.rows();
     // TODO precalculation of T by reduced Arun
-    // TODO different number of iterations and convergence criterion
+
+    // SoA copies of the points and covariances, so the values of consecutive points are contiguous
+    const PointsSoA<Scalar> Xs = X, Ys = Y;
+    const CovariancesSoA<Scalar> covXs = covariances_soa<Scalar>(covX), covYs = covariances_soa<Scalar>(covY);
+    const uint_t numTasks = (N + taskSize - 1) / taskSize;
+    std::vector<Sums> partialSums(numTasks);
 
     // Initialize Jacobian and Hessian
     Mat61 J = Mat61::Zero();
@@ -47,33 +162,65 @@ int PCRegistration::gicp(MatRefConst X, MatRefConst Y,
     double deltaUpdate = 1e3;
     do
     {
-        J.setZero();
-        H.setZero();
-        // not vectoried operations (due to Jacobian)
-        for ( uint_t i = 0; i < N ; ++i)
+        const Eigen::Matrix<Scalar, 3, 3> R = T.R().cast<Scalar>();
+        const Eigen::Matrix<Scalar, 3, 1> t = T.t().cast<Scalar>();
+        parallel_for(numTasks, numThreads, [&](uint_t k)
         {
-            // 1) Calculate residual r = y - Tx and the inverse of joint covariance
-            Mat31 Txi = T.transform(X.row(i));
-            Mat31 r = Y.row(i).transpose() - Txi;
-            Mat3 Li = (covY.block<3,3>(3*i,0) + T.R() * covX.block<3,3>(3*i,0) * T.R().transpose()).inverse();
-
-            // 2) Calculate Jacobian for residual Jf = df1/d xi = r1' Li * Jr, where Jr = [(Tx)^ ; -I])
-            Mat<3,6> Jr;
-            Jr << hat3(Txi) , -Mat3::Identity();
-            Mat<1,6> Ji = r.transpose() * Li * Jr;
-            J += Ji;//Eigen manages this for us
-
-            // 3) Hessian Hi ~ Jr' * Li * Jr
-            Mat6 Hi = Jr.transpose() * Li * Jr;
-            H += Hi;
+            reduce_points<Scalar>(Xs, Ys, covXs, covYs, R, t, k*taskSize, std::min((k+1)*taskSize, N), partialSums[k]);
+        });
+        Sums s = Sums::Zero();
+        for (const auto &partial : partialSums)
+            s += partial;
+
+        // 1) Jacobian Jf = df1/d xi = sum r' L Jr and Hessian H = sum Jr' L Jr
+        J = s.head<6>();
+        for (uint_t i = 0; i < 3; ++i)
+        {
+            for (uint_t j = 0; j < 3; ++j)
+            {
+                H(i, j) = s(21 + sym[i][j]);
+                H(i, 3 + j) = s(12 + 3*i + j);
+                H(3 + j, i) = s(12 + 3*i + j);
+                H(3 + i, 3 + j) = s(6 + sym[i][j]);
+            }
         }
-        // 4) Update Solution
-        Mat61 dxi = -H.inverse()*J;
+
+        // 2) Update Solution
+        Mat61 dxi = -H.ldlt().solve(J);
         T.update_lhs(dxi); //Left side update
         deltaUpdate = dxi.norm();
         iters++;
 
-    }while(deltaUpdate > tol && iters < 20);
+    }while(deltaUpdate > tol && iters < maxIters);
 
     return iters; // number of iterations
 }
+}
+
+int PCRegistration::gicp(MatRefConst X, MatRefConst Y,
+           MatRefConst covX, MatRefConst covY, SE3 &T, double tol, uint_t numThreads, uint_t maxIters)
+{
+    return gicp_scalar<matData_t>(X, Y, covX, covY, T, tol, numThreads, maxIters);
+}
+
+int PCRegistration::gicp(MatfRefConst X, MatfRefConst Y,
+           MatfRefConst covX, MatfRefConst covY, SE3 &T, double tol, uint_t numThreads, uint_t maxIters)
+{
+    return gicp_scalar<float>(X, Y, covX, covY, T, tol, numThreads, maxIters);
+}
+
+double PCRegistration::gicp_cost(MatRefConst X, MatRefConst Y, MatRefConst covX, MatRefConst covY, const SE3 &T)
+{
+    assert(X.cols() == 3 && Y.rows() == X.rows() && "PCRegistration::gicp_cost: Incorrect sizing, we expect Nx3");
+    const Mat3 R = T.R();
+    const Mat31 t = T.t();
+    double cost = 0.0;
+    for (uint_t i = 0; i < X.rows(); ++i)
+    {
+        const Mat31 r = Y.row(i).transpose() - R * X.row(i).transpose() - t;
+        const Mat3 Cx = covX.block<3,3>(3*i, 0).selfadjointView<Eigen::Upper>();
+        const Mat3 C = Mat3(covY.block<3,3>(3*i, 0).selfadjointView<Eigen::Upper>()) + R * Cx * R.transpose();
+        cost += r.dot(C.ldlt().solve(r));
+    }
+    return 0.5 * cost;
+}
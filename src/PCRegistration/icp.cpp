@@ -0,0 +1,169 @@
+/* Copyright (c) 2022, Gonzalo Ferrer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * icp.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Gonzalo Ferrer
+ *              g.ferrer@skoltech.ru
+ *              Mobile Robotics Lab, Skoltech
+ */
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <cmath>
+#include "mrob/pc_registration.hpp"
+#include "mrob/kd_tree.hpp"
+#include "mrob/parallel.hpp"
+
+
+using namespace mrob;
+
+namespace
+{
+// points searched by each parallel task
+constexpr uint_t chunkSize = 1024;
+}
+
+void PCRegistration::solve_correspondences(icpMetric metric, MatRefConst X, MatRefConst Y, MatRefConst normalsY,
+                                           MatRefConst covX, MatRefConst covY, SE3 &T, double tol, uint_t numThreads,
+                                           uint_t maxIters)
+{
+    switch (metric)
+    {
+      case ICP_POINT_TO_POINT:
+        weighted_point(X, Y, MatX1::Ones(X.rows()), T, tol, numThreads, maxIters);
+        break;
+      case ICP_POINT_TO_PLANE:
+        point_to_plane(X, Y, normalsY, T, tol, numThreads, maxIters);
+        break;
+      case ICP_GICP:
+        gicp(X, Y, covX, covY, T, tol, numThreads, maxIters);
+        break;
+    }
+}
+
+int PCRegistration::icp(MatRefConst X, MatRefConst Y, SE3 &T, const ICPParameters &params, ICPReport &report)
+{
+    assert(X.cols() == 3 && Y.cols() == 3 && "PCRegistration::icp: Incorrect sizing, we expect Nx3");
+    const uint_t N = X.rows();
+    report = ICPReport{0, 0, 0.0, false};
+
+    // 1) Index of Y and local planes, calculated once
+    KDTree treeY(Y, 16, params.numThreads);
+    MatX normalsY, covX, covY;
+    if (params.metric == ICP_POINT_TO_PLANE)
+        estimate_local_planes(treeY, Y, params.numNeighbours, params.planeEpsilon, params.numThreads, &normalsY, nullptr);
+    if (params.metric == ICP_GICP)
+    {
+        estimate_local_planes(treeY, Y, params.numNeighbours, params.planeEpsilon, params.numThreads, nullptr, &covY);
+        KDTree treeX(X, 16, params.numThreads);
+        estimate_local_planes(treeX, X, params.numNeighbours, params.planeEpsilon, params.numThreads, nullptr, &covX);
+    }
+
+    // 2) Buffers of the correspondences, allocated for all points of X
+    constexpr uint_t noMatch = std::numeric_limits<uint_t>::max();
+    std::vector<uint_t> match(N);
+    std::vector<matData_t> distance2(N);
+    MatX Xc(N, 3), Yc(N, 3), normalsC, covXc, covYc;
+    if (params.metric == ICP_POINT_TO_PLANE)
+        normalsC.resize(N, 3);
+    if (params.metric == ICP_GICP)
+    {
+        covXc.resize(3 * N, 3);
+        covYc.resize(3 * N, 3);
+    }
+    const matData_t maxDistance2 = params.maxDistance * params.maxDistance;
+
+    while (report.iterations < params.maxIters)
+    {
+        report.iterations++;
+        // 3) Nearest point of Y to each point of X at the current T
+        const Mat3 R = T.R();
+        const Mat31 t = T.t();
+        parallel_for((N + chunkSize - 1) / chunkSize, params.numThreads, [&](uint_t task)
+        {
+            for (uint_t i = task * chunkSize; i < std::min(N, (task + 1) * chunkSize); ++i)
+            {
+                Mat31 q = R * X.row(i).transpose() + t;
+                if (!treeY.nearest(q, maxDistance2, match[i], distance2[i]))
+                    match[i] = noMatch;
+            }
+        });
+
+        // 4) Correspondences under the distance gate, in the order of X
+        uint_t M = 0;
+        matData_t sumDistance2 = 0.0;
+        for (uint_t i = 0; i < N; ++i)
+        {
+            if (match[i] == noMatch)
+                continue;
+            Xc.row(M) = X.row(i);
+            Yc.row(M) = Y.row(match[i]);
+            if (params.metric == ICP_POINT_TO_PLANE)
+                normalsC.row(M) = normalsY.row(match[i]);
+            if (params.metric == ICP_GICP)
+            {
+                covXc.block<3,3>(3*M, 0) = covX.block<3,3>(3*i, 0);
+                covYc.block<3,3>(3*M, 0) = covY.block<3,3>(3*match[i], 0);
+            }
+            sumDistance2 += distance2[i];
+            ++M;
+        }
+        report.correspondences = M;
+        report.rmse = M > 0 ? std::sqrt(sumDistance2 / M) : 0.0;
+        if (M < 3)
+            break;
+
+        // 5) Solve the correspondences from the current T
+        SE3 Tprevious(T);
+        // buffers of normals and covariances are empty if the metric does not use them
+        solve_correspondences(params.metric, Xc.topRows(M), Yc.topRows(M),
+                              normalsC.topRows(normalsC.rows() > 0 ? M : 0),
+                              covXc.topRows(covXc.rows() > 0 ? 3*M : 0), covYc.topRows(covYc.rows() > 0 ? 3*M : 0),
+                              T, params.tol, params.numThreads, params.solverIters);
+
+        // 6) Convergence when the correspondences do not change T
+        if ((T * Tprevious.inv()).ln_vee().norm() < params.tol)
+        {
+            report.converged = true;
+            break;
+        }
+    }
+    return report.iterations;
+}
+
+int PCRegistration::icp_pyramid(MatRefConst X, MatRefConst Y, SE3 &T, const std::vector<matData_t> &voxelSizes,
+                                const ICPParameters &params, ICPReport &report)
+{
+    report = ICPReport{0, 0, 0.0, false};
+    ICPParameters levelParams(params);
+    MatX Xd, Yd;
+    int iterations = 0;
+    for (matData_t voxelSize : voxelSizes)
+    {
+        levelParams.maxDistance = std::max(params.maxDistance, 3.0 * voxelSize);
+        if (voxelSize > 0.0)
+        {
+            voxel_downsample(X, voxelSize, Xd, DOWNSAMPLE_CENTROID, params.numThreads);
+            voxel_downsample(Y, voxelSize, Yd, DOWNSAMPLE_CENTROID, params.numThreads);
+            iterations += icp(Xd, Yd, T, levelParams, report);
+        }
+        else
+            iterations += icp(X, Y, T, levelParams, report);
+    }
+    return iterations;
+}
@@ -0,0 +1,267 @@
+/* Copyright (c) 2022, Gonzalo Ferrer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * local_map.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Gonzalo Ferrer
+ *              g.ferrer@skoltech.ru
+ *              Mobile Robotics Lab, Skoltech
+ */
+
+#include <Eigen/Eigenvalues>
+#include <vector>
+#include <cmath>
+#include <cassert>
+#include "mrob/local_map.hpp"
+#include "mrob/parallel.hpp"
+
+
+using namespace mrob;
+
+namespace
+{
+// points processed by each parallel task
+constexpr uint_t chunkSize = 1024;
+}
+
+
+LocalMap::LocalMap(const LocalMapParameters &params) :
+        params_(params), initialized_(false)
+{
+}
+
+const SE3& LocalMap::register_and_update(MatRefConst scan, PCRegistration::ICPReport &report)
+{
+    if (params_.scanVoxelSize > 0.0)
+        PCRegistration::voxel_downsample(scan, params_.scanVoxelSize, points_,
+                                         PCRegistration::DOWNSAMPLE_FIRST_POINT, params_.numThreads);
+    else
+        points_ = scan;
+    if (!initialized_)
+    {
+        report = PCRegistration::ICPReport{0, 0, 0.0, false};
+        this->insert(points_, pose_);
+        initialized_ = true;
+        return pose_;
+    }
+    // constant velocity model for the initial guess
+    SE3 T = pose_ * velocity_;
+    this->register_scan(points_, T, report);
+    velocity_ = pose_.inv() * T;
+    pose_ = T;
+    this->insert(points_, pose_);
+    this->evict(pose_.t());
+    return pose_;
+}
+
+int LocalMap::register_scan(MatRefConst scan, SE3 &T, PCRegistration::ICPReport &report) const
+{
+    assert(scan.cols() == 3 && "LocalMap::register_scan: Incorrect sizing, we expect Nx3");
+    const uint_t N = scan.rows();
+    const PCRegistration::icpMetric metric = params_.metric;
+    report = PCRegistration::ICPReport{0, 0, 0.0, false};
+
+    MatX covScan;
+    if (metric == PCRegistration::ICP_GICP)
+        PCRegistration::estimate_covariances(scan, covScan, params_.numNeighbours, params_.planeEpsilon, params_.numThreads);
+
+    // buffers of the correspondences, normals and covariances only if the metric uses them
+    std::vector<const Voxel*> match(N);
+    std::vector<matData_t> distance2(N);
+    MatX Xc(N, 3), Yc(N, 3), normalsC, covXc, covYc;
+    if (metric == PCRegistration::ICP_POINT_TO_PLANE)
+        normalsC.resize(N, 3);
+    if (metric == PCRegistration::ICP_GICP)
+    {
+        covXc.resize(3 * N, 3);
+        covYc.resize(3 * N, 3);
+    }
+
+    while (report.iterations < params_.maxIters)
+    {
+        report.iterations++;
+        // 1) Closest voxel to each point of the scan at the current T
+        const Mat3 R = T.R();
+        const Mat31 t = T.t();
+        parallel_for((N + chunkSize - 1) / chunkSize, params_.numThreads, [&](uint_t task)
+        {
+            for (uint_t i = task * chunkSize; i < std::min(N, (task + 1) * chunkSize); ++i)
+                match[i] = this->find_voxel(R * scan.row(i).transpose() + t, distance2[i]);
+        });
+
+        // 2) Correspondences to the voxel means, in the order of the scan
+        uint_t M = 0;
+        matData_t sumDistance2 = 0.0;
+        for (uint_t i = 0; i < N; ++i)
+        {
+            const Voxel *voxel = match[i];
+            if (!voxel)
+                continue;
+            Xc.row(M) = scan.row(i);
+            Yc.row(M) = voxel->mean.transpose();
+            if (metric == PCRegistration::ICP_POINT_TO_PLANE)
+                normalsC.row(M) = voxel->normal.transpose();
+            if (metric == PCRegistration::ICP_GICP)
+            {
+                covXc.block<3,3>(3*M, 0) = covScan.block<3,3>(3*i, 0);
+                covYc.block<3,3>(3*M, 0) = voxel->covariance;
+            }
+            sumDistance2 += distance2[i];
+            ++M;
+        }
+        report.correspondences = M;
+        report.rmse = M > 0 ? std::sqrt(sumDistance2 / M) : 0.0;
+        if (M < 3)
+            break;
+
+        // 3) Solve and check convergence as icp()
+        SE3 Tprevious(T);
+        PCRegistration::solve_correspondences(metric, Xc.topRows(M), Yc.topRows(M),
+                              normalsC.topRows(normalsC.rows() > 0 ? M : 0),
+                              covXc.topRows(covXc.rows() > 0 ? 3*M : 0), covYc.topRows(covYc.rows() > 0 ? 3*M : 0),
+                              T, params_.tol, params_.numThreads, params_.solverIters);
+        if ((T * Tprevious.inv()).ln_vee().norm() < params_.tol)
+        {
+            report.converged = true;
+            break;
+        }
+    }
+    return report.iterations;
+}
+
+void LocalMap::insert(MatRefConst scan, const SE3 &T)
+{
+    assert(scan.cols() == 3 && "LocalMap::insert: Incorrect sizing, we expect Nx3");
+    const Mat3 R = T.R();
+    const Mat31 t = T.t();
+    std::vector<Voxel*> updated;
+    for (uint_t i = 0; i < scan.rows(); ++i)
+    {
+        Mat41 p;
+        p << R * scan.row(i).transpose() + t, 1.0;
+        VoxelKey key = VoxelKey::from_point(p.head<3>(), params_.voxelSize);
+        auto it = voxels_.find(key);
+        if (it == voxels_.end())
+            it = voxels_.emplace(key, Voxel{Mat4::Zero(), 0, false, Mat31::Zero(), Mat31::Zero(), Mat3::Zero()}).first;
+        Voxel &voxel = it->second;
+        if (params_.maxPointsPerVoxel > 0 && voxel.count >= params_.maxPointsPerVoxel)
+            continue;
+        voxel.S += p * p.transpose();
+        voxel.count++;
+        if (!voxel.updated)
+        {
+            // elements of the hash map are not moved by rehashing
+            voxel.updated = true;
+            updated.push_back(&voxel);
+        }
+    }
+
+    // planes of the updated voxels
+    const Mat3 D = Mat31(params_.planeEpsilon, 1.0, 1.0).asDiagonal();
+    parallel_for((updated.size() + chunkSize - 1) / chunkSize, params_.numThreads, [&](uint_t task)
+    {
+        Eigen::SelfAdjointEigenSolver<Mat3> eigs;
+        for (uint_t i = task * chunkSize; i < std::min<uint_t>(updated.size(), (task + 1) * chunkSize); ++i)
+        {
+            Voxel &voxel = *updated[i];
+            voxel.updated = false;
+            if (voxel.count < params_.minPointsPerVoxel)
+                continue;
+            voxel.mean = voxel.S.block<3,1>(0,3) / voxel.count;
+            Mat3 C = voxel.S.topLeftCorner<3,3>() / voxel.count - voxel.mean * voxel.mean.transpose();
+            eigs.computeDirect(C);
+            const Mat3 &E = eigs.eigenvectors();
+            voxel.normal = E.col(0);
+            voxel.covariance = E * D * E.transpose();
+        }
+    });
+}
+
+uint_t LocalMap::evict(const Mat31 &center)
+{
+    uint_t removed = 0;
+    const matData_t maxRange2 = params_.maxRange * params_.maxRange;
+    for (auto it = voxels_.begin(); it != voxels_.end(); )
+    {
+        const VoxelKey &k = it->first;
+        Mat31 voxelCenter = (Mat31(k.x, k.y, k.z).array() + 0.5) * params_.voxelSize;
+        if ((voxelCenter - center).squaredNorm() > maxRange2)
+        {
+            it = voxels_.erase(it);
+            removed++;
+        }
+        else
+            ++it;
+    }
+    return removed;
+}
+
+void LocalMap::clear()
+{
+    voxels_.clear();
+    pose_ = SE3();
+    velocity_ = SE3();
+    initialized_ = false;
+}
+
+void LocalMap::set_pose(const SE3 &T)
+{
+    pose_ = T;
+    velocity_ = SE3();
+}
+
+void LocalMap::get_voxels(MatX &means, MatX &normals) const
+{
+    uint_t M = 0;
+    for (const auto &it : voxels_)
+        M += it.second.count >= params_.minPointsPerVoxel;
+    means.resize(M, 3);
+    normals.resize(M, 3);
+    M = 0;
+    for (const auto &it : voxels_)
+    {
+        if (it.second.count < params_.minPointsPerVoxel)
+            continue;
+        means.row(M) = it.second.mean.transpose();
+        normals.row(M) = it.second.normal.transpose();
+        ++M;
+    }
+}
+
+const LocalMap::Voxel* LocalMap::find_voxel(const Mat31 &p, matData_t &distance2) const
+{
+    // the voxel of p and its neighbours on the side of p in each axis
+    const matData_t size = params_.voxelSize;
+    const VoxelKey k = VoxelKey::from_point(p, size);
+    const int side[3] = {p(0) / size - k.x < 0.5 ? -1 : 1,
+                         p(1) / size - k.y < 0.5 ? -1 : 1,
+                         p(2) / size - k.z < 0.5 ? -1 : 1};
+    const Voxel *closest = nullptr;
+    distance2 = params_.maxDistance * params_.maxDistance;
+    for (int n = 0; n < 8; ++n)
+    {
+        auto it = voxels_.find(VoxelKey{k.x + (n & 1) * side[0], k.y + ((n >> 1) & 1) * side[1], k.z + ((n >> 2) & 1) * side[2]});
+        if (it == voxels_.end() || it->second.count < params_.minPointsPerVoxel)
+            continue;
+        matData_t d2 = (it->second.mean - p).squaredNorm();
+        if (d2 < distance2)
+        {
+            distance2 = d2;
+            closest = &it->second;
+        }
+    }
+    return closest;
+}
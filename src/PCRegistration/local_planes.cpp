@@ -0,0 +1,113 @@
+/* Copyright (c) 2022, Gonzalo Ferrer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * local_planes.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Gonzalo Ferrer
+ *              g.ferrer@skoltech.ru
+ *              Mobile Robotics Lab, Skoltech
+ */
+
+#include <Eigen/Eigenvalues>
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include "mrob/pc_registration.hpp"
+#include "mrob/kd_tree.hpp"
+#include "mrob/parallel.hpp"
+
+
+using namespace mrob;
+
+namespace
+{
+// points processed by each parallel task
+constexpr uint_t chunkSize = 1024;
+
+template<typename Scalar>
+void estimate_planes(const BasicKDTree<Scalar> &tree, const Eigen::Ref<const MatXT<Scalar>> &X, uint_t k,
+                     matData_t epsilon, uint_t numThreads, MatXT<Scalar> *normals, MatXT<Scalar> *covariances)
+{
+    assert(X.cols() == 3 && X.rows() == tree.size() && "PCRegistration::estimate_local_planes: Incorrect sizing, we expect Nx3");
+    const uint_t N = X.rows();
+    if (normals)
+        normals->resize(N, 3);
+    if (covariances)
+        covariances->resize(3 * N, 3);
+    const Mat3 D = Mat31(epsilon, 1.0, 1.0).asDiagonal();
+    parallel_for((N + chunkSize - 1) / chunkSize, numThreads, [&](uint_t task)
+    {
+        std::vector<uint_t> neighbours;
+        std::vector<Scalar> distances2;
+        Eigen::SelfAdjointEigenSolver<Mat3> eigs;
+        for (uint_t i = task * chunkSize; i < std::min(N, (task + 1) * chunkSize); ++i)
+        {
+            tree.knn(X.row(i).transpose(), k, neighbours, distances2);
+            // moments relative to the query point, which avoids the cancellation
+            // of large coordinates, e.g. clouds far from the origin
+            const Mat13 origin = X.row(i).template cast<matData_t>();
+            Mat31 mean = Mat31::Zero();
+            Mat3 C = Mat3::Zero();
+            for (uint_t n : neighbours)
+            {
+                Mat31 d = (X.row(n).template cast<matData_t>() - origin).transpose();
+                mean += d;
+                C += d * d.transpose();
+            }
+            mean /= neighbours.size();
+            C = C / neighbours.size() - mean * mean.transpose();
+            // closed form for 3x3 matrices, eigenvalues are sorted in increasing order
+            eigs.computeDirect(C);
+            const Mat3 &R = eigs.eigenvectors();
+            if (normals)
+                normals->row(i) = R.col(0).transpose().template cast<Scalar>();
+            if (covariances)
+                covariances->template block<3,3>(3*i, 0) = (R * D * R.transpose()).template cast<Scalar>();
+        }
+    });
+}
+
+}
+
+void PCRegistration::estimate_normals(MatRefConst X, MatX &normals, uint_t k, uint_t numThreads)
+{
+    KDTree tree(X, 16, numThreads);
+    estimate_planes<matData_t>(tree, X, k, 0.0, numThreads, &normals, nullptr);
+}
+
+void PCRegistration::estimate_normals(MatfRefConst X, MatXf &normals, uint_t k, uint_t numThreads)
+{
+    KDTreeFloat tree(X, 16, numThreads);
+    estimate_planes<float>(tree, X, k, 0.0, numThreads, &normals, nullptr);
+}
+
+void PCRegistration::estimate_covariances(MatRefConst X, MatX &covariances, uint_t k, double epsilon, uint_t numThreads)
+{
+    KDTree tree(X, 16, numThreads);
+    estimate_planes<matData_t>(tree, X, k, epsilon, numThreads, nullptr, &covariances);
+}
+
+void PCRegistration::estimate_covariances(MatfRefConst X, MatXf &covariances, uint_t k, double epsilon, uint_t numThreads)
+{
+    KDTreeFloat tree(X, 16, numThreads);
+    estimate_planes<float>(tree, X, k, epsilon, numThreads, nullptr, &covariances);
+}
+
+void PCRegistration::estimate_local_planes(const KDTree &tree, MatRefConst X, uint_t k, double epsilon, uint_t numThreads,
+                                           MatX *normals, MatX *covariances)
+{
+    estimate_planes<matData_t>(tree, X, k, epsilon, numThreads, normals, covariances);
+}
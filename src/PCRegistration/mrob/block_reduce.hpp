@@ -0,0 +1,54 @@
+/* Copyright (c) 2022, Gonzalo Ferrer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * block_reduce.hpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Gonzalo Ferrer
+ *              g.ferrer@skoltech.ru
+ *              Mobile Robotics Lab, Skoltech
+ */
+
+#ifndef BLOCK_REDUCE_HPP_
+#define BLOCK_REDUCE_HPP_
+
+#include "mrob/matrix_base.hpp"
+
+namespace mrob{
+/**
+ * Internal helpers of the reductions over points in PCRegistration (gicp, weighted_point, ransac_arun).
+ *
+ * Points are processed in blocks on the stack, in SoA layout, so operations are vectorized over points.
+ * Each parallel task reduces a fixed range of points, so the sums do not depend on the number of threads.
+ */
+namespace detail{
+
+constexpr uint_t blockSize = 256;
+constexpr uint_t taskSize = 64 * blockSize;
+
+template<typename Scalar>
+using BlockArray = Eigen::Array<Scalar, Eigen::Dynamic, 1, 0, blockSize, 1>;
+template<typename Scalar>
+using PointsSoA = Eigen::Matrix<Scalar, Eigen::Dynamic, 3, Eigen::ColMajor>;
+
+// Sums of a block are in the precision of the points, and they are accumulated over blocks in matData_t
+template<typename Derived>
+matData_t block_sum(const Eigen::ArrayBase<Derived> &a)
+{
+    return static_cast<matData_t>(a.sum());
+}
+
+}}//namespace
+#endif /* BLOCK_REDUCE_HPP_ */
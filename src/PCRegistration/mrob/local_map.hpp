@@ -0,0 +1,141 @@
+/* Copyright (c) 2022, Gonzalo Ferrer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * local_map.hpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Gonzalo Ferrer
+ *              g.ferrer@skoltech.ru
+ *              Mobile Robotics Lab, Skoltech
+ */
+
+#ifndef LOCAL_MAP_HPP_
+#define LOCAL_MAP_HPP_
+
+#include "mrob/matrix_base.hpp"
+#include "mrob/SE3.hpp"
+#include "mrob/pc_registration.hpp"
+#include "mrob/voxel_hash_map.hpp"
+#include <unordered_map>
+
+namespace mrob{
+
+/**
+ * Parameters of the LocalMap
+ */
+struct LocalMapParameters
+{
+    PCRegistration::icpMetric metric = PCRegistration::ICP_POINT_TO_PLANE;
+    matData_t voxelSize = 1.0; // of the map
+    matData_t scanVoxelSize = 0.5; // scans are downsampled to one point per voxel of this size, 0 to use all points
+    uint_t maxPointsPerVoxel = 20; // voxels stop accumulating points when reached, 0 for unbounded
+    uint_t minPointsPerVoxel = 3; // voxels with fewer points are not used for correspondences
+    matData_t maxRange = 100.0; // voxels farther than it from the current pose are evicted
+    matData_t maxDistance = 1.0; // correspondences farther than it are discarded
+    uint_t maxIters = 30;
+    matData_t tol = 1e-4; // converged when the update of the pose |Ln(T_k T_{k-1}^-1)| < tol
+    uint_t solverIters = 20; // maximum iterations of the solver on each set of correspondences
+    uint_t numNeighbours = 10; // to estimate the covariances of the scan for ICP_GICP
+    matData_t planeEpsilon = 1e-3; // variance along the normal of the GICP covariances
+    uint_t numThreads = 0; // 0 for all hardware threads
+};
+
+
+/**
+ * Class LocalMap registers a stream of scans (e.g. LiDAR odometry) against a local map,
+ * instead of against the previous scan.
+ *
+ * The map is a hash of voxels, each of them storing the Gaussian statistics of its
+ * points as the matrix S = sum [p;1][p;1]', from which the mean, normal and plane
+ * covariance R diag(epsilon,1,1) R' of the voxel are calculated. Scans are registered
+ * with the metrics of icp(): points of the scan are associated to the mean of the
+ * closest voxel (among the 8 voxels around the point), in parallel, and solved as
+ * point to point, point to plane (normal of the voxel) or GICP (covariance of the
+ * voxel and of the neighbourhood of the scan point). Point to point is biased by the
+ * discretization of the means, so it is only accurate with small voxels.
+ *
+ * register_and_update() implements the streaming API: the initial guess is given by a
+ * constant velocity model, the scan is registered, inserted at the solution and the
+ * voxels out of range are evicted.
+ */
+class LocalMap
+{
+public:
+    LocalMap(const LocalMapParameters &params = LocalMapParameters());
+    ~LocalMap() = default;
+
+    /**
+     * Registers the scan (Nx3, in the sensor frame), updates the map and returns the pose
+     * of the scan. The first scan is inserted at the current pose (identity by default)
+     * and its report has no iterations.
+     */
+    const SE3& register_and_update(MatRefConst scan, PCRegistration::ICPReport &report);
+    /**
+     * Registers the scan against the map starting from T, which is updated with
+     * the solution. The map is not modified. Returns the number of iterations.
+     */
+    int register_scan(MatRefConst scan, SE3 &T, PCRegistration::ICPReport &report) const;
+    /**
+     * Inserts the scan at pose T, without downsampling
+     */
+    void insert(MatRefConst scan, const SE3 &T);
+    /**
+     * Removes the voxels farther than maxRange from center, returns the number removed
+     */
+    uint_t evict(const Mat31 &center);
+    void clear();
+
+    /**
+     * Sets the pose of the next scan and resets the velocity
+     */
+    void set_pose(const SE3 &T);
+    const SE3& get_pose() const {return pose_;}
+    uint_t number_voxels() const {return voxels_.size();}
+    /**
+     * Means and normals (Mx3) of the voxels with enough points
+     */
+    void get_voxels(MatX &means, MatX &normals) const;
+    const LocalMapParameters& get_parameters() const {return params_;}
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW // as proposed by Eigen
+
+protected:
+    struct Voxel
+    {
+        Mat4 S;
+        uint_t count;
+        bool updated; // since its plane was calculated
+        Mat31 mean;
+        Mat31 normal;
+        Mat3 covariance;
+    };
+    using VoxelMap = std::unordered_map<VoxelKey, Voxel, VoxelKeyHash, std::equal_to<VoxelKey>,
+                                        Eigen::aligned_allocator<std::pair<const VoxelKey, Voxel>>>;
+
+    /**
+     * Closest voxel to p with enough points, among the 8 voxels whose centers surround p.
+     * Returns null if there is none closer than maxDistance.
+     */
+    const Voxel* find_voxel(const Mat31 &p, matData_t &distance2) const;
+
+    LocalMapParameters params_;
+    VoxelMap voxels_;
+    SE3 pose_, velocity_;
+    bool initialized_;
+    MatX points_; // downsampled scan
+};
+
+}
+
+#endif /* LOCAL_MAP_HPP_ */
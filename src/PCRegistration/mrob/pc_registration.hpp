@@ -26,6 +26,8 @@
 
 #include "mrob/matrix_base.hpp"
 #include "mrob/SE3.hpp"
+#include "mrob/kd_tree.hpp"
+#include <vector>
 
 namespace mrob{
 /**
@@ -71,10 +73,27 @@ int arun(MatRefConst X, MatRefConst Y, SE3 &T);
  * The covariances provided are of the form S = R diag(e,1,1) R', so they MUST have been already processed.
  * The right way is a block matrix of covariances of the form Cov = [Cov_1, Cov_2,..., Cov_N], i.e, Cov \in R^{3x3N}
  *
- * Returns the number of iterations until convergence
+ * Covariances are symmetric, only their upper triangular part is read.
+ *
+ * Points are reduced in parallel on numThreads threads (0 for all hardware threads),
+ * in ranges of fixed size, so the result does not depend on the number of threads and
+ * small problems are solved on the calling thread.
+ *
+ * Returns the number of iterations until convergence, at most maxIters
  */
 int gicp(MatRefConst X, MatRefConst Y,
-        MatRefConst covX, MatRefConst covY, SE3 &T, double tol = 1e-4);
+        MatRefConst covX, MatRefConst covY, SE3 &T, double tol = 1e-4, uint_t numThreads = 0, uint_t maxIters = 20);
+/**
+ * Single precision GICP: the operations on each point, and the sums over blocks of a few
+ * hundred points, are in single precision. The 6x6 Hessian and gradient are accumulated
+ * over blocks in double precision.
+ */
+int gicp(MatfRefConst X, MatfRefConst Y,
+        MatfRefConst covX, MatfRefConst covY, SE3 &T, double tol = 1e-4, uint_t numThreads = 0, uint_t maxIters = 20);
+/**
+ * Cost minimized by gicp() at T, 0.5 sum r' (covY + R covX R')^-1 r with r = y - Tx
+ */
+double gicp_cost(MatRefConst X, MatRefConst Y, MatRefConst covX, MatRefConst covY, const SE3 &T);
 
 
 /**
@@ -90,10 +109,291 @@ int gicp(MatRefConst X, MatRefConst Y,
  *
  * The weights provided are of the form
  *
- * Returns the number of iterations until convergence
+ * Points are reduced in parallel on numThreads threads (0 for all hardware threads), as in gicp().
+ *
+ * Returns the number of iterations until convergence, at most maxIters
  */
 int weighted_point(MatRefConst X, MatRefConst Y,
-                   VectRefConst w, SE3 &T, double tol = 1e-4);
+                   VectRefConst w, SE3 &T, double tol = 1e-4, uint_t numThreads = 0, uint_t maxIters = 20);
+/**
+ * Single precision weighted point registration, the 6x6 Hessian and gradient
+ * are accumulated over blocks of points in double precision, as in gicp().
+ */
+int weighted_point(MatfRefConst X, MatfRefConst Y,
+                   VectfRefConst w, SE3 &T, double tol = 1e-4, uint_t numThreads = 0, uint_t maxIters = 20);
+/**
+ * Cost minimized by weighted_point() at T, 0.5 sum w |y - Tx|^2
+ */
+double weighted_point_cost(MatRefConst X, MatRefConst Y, VectRefConst w, const SE3 &T);
+
+
+/**
+ * Parameters of ransac_arun()
+ */
+struct RansacParameters
+{
+    matData_t threshold = 0.1; // correspondences are inliers if |y - Tx| < threshold
+    matData_t confidence = 0.999; // probability of drawing at least one sample free of outliers
+    uint_t maxIters = 10000; // maximum number of hypotheses
+    bool refine = true; // the best hypothesis is refined by weighted_point() on its inliers
+    uint_t seed = 0;
+    uint_t numThreads = 0; // 0 for all hardware threads
+};
+
+/**
+ * Result of ransac_arun()
+ */
+struct RansacReport
+{
+    uint_t iterations; // hypotheses generated
+    std::vector<uint_t> inliers; // indices of the inliers of the solution
+    bool success; // a hypothesis with at least 3 inliers was found
+};
+
+/**
+ * RANSAC over associated pairs X, Y (Nx3) contaminated with outliers, whose hypotheses are
+ * the solutions of arun() on minimal samples of 3 pairs. Samples whose pairwise distances
+ * in X and Y differ by more than 2 threshold are not rigid, so they are discarded before
+ * solving them.
+ *
+ * Hypotheses are generated and scored (number of inliers) in parallel, in batches over
+ * numThreads threads, and the residuals of all pairs are evaluated in blocks vectorized
+ * over the pairs. Scoring a hypothesis stops as soon as it can not improve the best one.
+ * The number of hypotheses is adapted to the inlier ratio of the best hypothesis, as
+ * log(1 - confidence) / log(1 - w^3). Samples only depend on the seed and the index of the
+ * hypothesis, so the result does not depend on the number of threads.
+ *
+ * T is the solution, refined on its inliers if required.
+ * Returns the number of inliers.
+ */
+uint_t ransac_arun(MatRefConst X, MatRefConst Y, SE3 &T, const RansacParameters &params, RansacReport &report);
+
+
+/**
+ * Metrics available for the batched registration:
+ *  - POINT_TO_POINT: r = Tx - y, as in Factor1PosePoint2Point, weight w I
+ *  - POINT_TO_PLANE: r = n'(Tx - y), as in Factor1PosePoint2Plane, weight w
+ */
+enum batchMetric{POINT_TO_POINT = 0, POINT_TO_PLANE};
+
+/**
+ * Result of each of the problems solved in batch_solve
+ */
+struct BatchReport
+{
+    uint_t iterations;
+    matData_t chi2; // 0.5 sum w r'r at the solution
+    bool converged;
+};
+using BatchPoses = std::vector<SE3, Eigen::aligned_allocator<SE3>>;
+
+/**
+ * Batched registration of many small independent problems with the same structure,
+ * each of them a single pose T_k and M correspondences. The number of problems N
+ * is T.size() and the correspondences are stacked by problem, i.e., rows
+ * [k*M, (k+1)*M) of X, Y (and normals) belong to problem k, so X \in R^{NMx3}.
+ *
+ * Each problem is solved by Levenberg-Marquardt on a dense 6x6 system, which avoids
+ * all the overhead of building a factor graph for such small problems, and the
+ * problems are distributed over numThreads threads (0 for all hardware threads).
+ *
+ * Normals are only used for POINT_TO_PLANE and weights are optional (empty for w = 1).
+ * T contains the initial poses and it is updated with the solutions.
+ */
+void batch_solve(batchMetric metric, MatRefConst X, MatRefConst Y, MatRefConst normals,
+                 VectRefConst weights, BatchPoses &T, std::vector<BatchReport> &report,
+                 uint_t maxIters = 20, double tol = 1e-6, uint_t numThreads = 0);
+/**
+ * Point to plane registration of a single problem X, Y, normals (Nx3), with the same
+ * Levenberg-Marquardt as batch_solve(). Instead of solving each problem on one thread,
+ * the correspondences are reduced in parallel on numThreads threads (0 for all hardware
+ * threads) in ranges of fixed size, as in gicp().
+ *
+ * Returns the number of iterations, at most maxIters
+ */
+int point_to_plane(MatRefConst X, MatRefConst Y, MatRefConst normals, SE3 &T,
+                   double tol = 1e-6, uint_t numThreads = 0, uint_t maxIters = 20);
+
+
+/**
+ * Modes of voxel_downsample(): each voxel is represented by the centroid of its
+ * points or by its first point in X.
+ */
+enum downsampleMode{DOWNSAMPLE_CENTROID = 0, DOWNSAMPLE_FIRST_POINT};
+
+/**
+ * Voxel grid downsampling of X (Nx3) to one point per occupied voxel of size voxelSize,
+ * in the order of the first point of each voxel in X. Points are processed in parallel on
+ * numThreads threads (0 for all hardware threads), in ranges of fixed size, so the
+ * result does not depend on the number of threads. Voxels are grouped by sorting their keys,
+ * and centroids are calculated in double precision.
+ */
+void voxel_downsample(MatRefConst X, matData_t voxelSize, MatX &Xd,
+                      downsampleMode mode = DOWNSAMPLE_CENTROID, uint_t numThreads = 0);
+void voxel_downsample(MatfRefConst X, matData_t voxelSize, MatXf &Xd,
+                      downsampleMode mode = DOWNSAMPLE_CENTROID, uint_t numThreads = 0);
+/**
+ * Uniform random subset of M points of X, without repetition and in their order in X.
+ */
+void random_downsample(MatRefConst X, uint_t M, MatX &Xd, uint_t seed = 0);
+void random_downsample(MatfRefConst X, uint_t M, MatXf &Xd, uint_t seed = 0);
+
+
+/**
+ * Motion compensation (deskewing) of a scan X (Nx3) measured while the sensor moved from
+ * Tstart to Tend. Each point is measured at its normalized timestamp tau in [0, 1] (e.g.
+ * (t - t_start) / (t_end - t_start), clamped otherwise) from the interpolated pose
+ *      T(tau) = Tstart exp(tau xi),   xi = Ln(Tstart^-1 Tend),
+ * as in PlaneRegistration, and it is transformed in place by T(tau). With Tstart = I the
+ * points are expressed in the frame of the start of the scan.
+ *
+ * The axis of rotation of xi is constant, so exp(tau xi) is calculated in closed form from
+ * sin(tau theta) and cos(tau theta) of each point. Points are processed in parallel on
+ * numThreads threads (0 for all hardware threads), in double precision for float clouds.
+ */
+void deskew(MatRef X, VectRefConst timestamps, const SE3 &Tstart, const SE3 &Tend, uint_t numThreads = 0);
+void deskew(MatfRef X, VectfRefConst timestamps, const SE3 &Tstart, const SE3 &Tend, uint_t numThreads = 0);
+/**
+ * Deskewing over a sequence of K >= 2 poses evenly spaced in [0, 1], pose k at tau = k / (K-1).
+ * Each point is transformed by the interpolation between the poses before and after its timestamp.
+ */
+void deskew(MatRef X, VectRefConst timestamps, const BatchPoses &poses, uint_t numThreads = 0);
+void deskew(MatfRef X, VectfRefConst timestamps, const BatchPoses &poses, uint_t numThreads = 0);
+
+
+/**
+ * Estimates the local plane of each point of X (Nx3) from the covariance of its k nearest
+ * neighbours (including itself), searched on a KDTree of X. The normal is the eigenvector
+ * of the smallest eigenvalue, calculated in closed form, and the GICP covariance is the
+ * regularized plane S = R diag(epsilon,1,1) R', being the first column of R the normal.
+ *
+ * Covariances are stacked as a 3Nx3 array, which is the layout read by gicp(). The
+ * neighbourhood statistics are calculated in double precision for float clouds.
+ * Points are processed in parallel on numThreads threads (0 for all hardware threads).
+ */
+void estimate_normals(MatRefConst X, MatX &normals, uint_t k = 10, uint_t numThreads = 0);
+void estimate_normals(MatfRefConst X, MatXf &normals, uint_t k = 10, uint_t numThreads = 0);
+void estimate_covariances(MatRefConst X, MatX &covariances, uint_t k = 10, double epsilon = 1e-3, uint_t numThreads = 0);
+void estimate_covariances(MatfRefConst X, MatXf &covariances, uint_t k = 10, double epsilon = 1e-3, uint_t numThreads = 0);
+/**
+ * Same estimation reusing a KDTree already built on X. Any of the outputs may be null if
+ * it is not required, the others are resized.
+ */
+void estimate_local_planes(const KDTree &tree, MatRefConst X, uint_t k, double epsilon, uint_t numThreads,
+                           MatX *normals, MatX *covariances);
+
+
+/**
+ * Metrics available for icp(), where correspondences are solved by:
+ *  - ICP_POINT_TO_POINT: weighted_point() with unit weights
+ *  - ICP_POINT_TO_PLANE: point_to_plane(), the normals of Y are estimated from their neighbours
+ *  - ICP_GICP: gicp(), the covariances of X and Y are estimated from their neighbours as
+ *    S = R diag(e,1,1) R', being the first column of R the normal.
+ */
+enum icpMetric{ICP_POINT_TO_POINT = 0, ICP_POINT_TO_PLANE, ICP_GICP};
+
+/**
+ * Parameters of icp()
+ */
+struct ICPParameters
+{
+    icpMetric metric = ICP_POINT_TO_POINT;
+    uint_t maxIters = 30; // iterations of correspondence search and solve
+    matData_t maxDistance = 1.0; // correspondences farther than it are discarded
+    matData_t tol = 1e-6; // converged when the update of T between iterations |Ln(T_k T_{k-1}^-1)| < tol
+    uint_t solverIters = 20; // maximum iterations of the solver on each set of correspondences
+    uint_t numNeighbours = 10; // to estimate normals and covariances
+    matData_t planeEpsilon = 1e-3; // variance along the normal of the GICP covariances
+    uint_t numThreads = 0; // 0 for all hardware threads
+};
+
+/**
+ * Result of icp()
+ */
+struct ICPReport
+{
+    uint_t iterations;
+    uint_t correspondences; // at the last iteration
+    matData_t rmse; // of the correspondences at the last iteration, before solving them
+    bool converged;
+};
+
+/**
+ * Solves the correspondences X, Y (Mx3) with one of the metrics of icp(), from the current T.
+ * normalsY (Mx3) are only used by ICP_POINT_TO_PLANE and covX, covY (3Mx3) by ICP_GICP,
+ * otherwise they may be empty. The solver stops at tol or after maxIters iterations.
+ */
+void solve_correspondences(icpMetric metric, MatRefConst X, MatRefConst Y, MatRefConst normalsY,
+                           MatRefConst covX, MatRefConst covY, SE3 &T, double tol = 1e-6, uint_t numThreads = 0,
+                           uint_t maxIters = 20);
+
+/**
+ * Iterative Closest Point: X and Y are not associated. A KD-tree is built on Y once,
+ * and on each iteration the nearest point of Y to each T x_i is searched in parallel. The
+ * correspondences closer than maxDistance are solved according to the metric, starting
+ * from the current T, until T converges or there are less than 3 correspondences.
+ *
+ * T contains the initial pose and it is updated with the solution.
+ * Returns the number of iterations.
+ */
+int icp(MatRefConst X, MatRefConst Y, SE3 &T, const ICPParameters &params, ICPReport &report);
+
+/**
+ * Coarse to fine ICP: X and Y are downsampled with voxel_downsample() (centroids) for each
+ * of the voxelSizes, from coarse to fine, and icp() is solved at each level starting from
+ * the solution of the previous one. A voxel size 0 is the full resolution.
+ *
+ * Coarse levels have fewer points and accept farther correspondences: the distance gate
+ * of each level is max(params.maxDistance, 3 voxelSize), which widens the convergence basin.
+ * The report is of the finest level and the iterations returned are the sum of all levels.
+ */
+int icp_pyramid(MatRefConst X, MatRefConst Y, SE3 &T, const std::vector<matData_t> &voxelSizes,
+                const ICPParameters &params, ICPReport &report);
+
+
+/**
+ * Parameters of ndt()
+ */
+struct NDTParameters
+{
+    matData_t voxelSize = 1.0; // of the Gaussians of Y
+    uint_t minPointsPerVoxel = 5; // voxels with fewer points are not used
+    matData_t eigenvalueRatio = 0.01; // eigenvalues of the covariances are at least this ratio of the largest one
+    matData_t outlierRatio = 0.55; // weight of the uniform distribution in the score, in [0, 1)
+    bool searchNeighbours = true; // points are scored against their voxel and its 6 face neighbours, or only their voxel
+    uint_t maxIters = 30;
+    matData_t tol = 1e-6; // converged when the Newton step |dxi| < tol
+    uint_t numThreads = 0; // 0 for all hardware threads
+};
+
+/**
+ * Result of ndt()
+ */
+struct NDTReport
+{
+    uint_t iterations;
+    uint_t correspondences; // points of X inside a voxel of Y, at the last iteration
+    matData_t score; // sum of the Gaussian scores of the points at the solution, larger is better
+    bool converged;
+};
+
+/**
+ * Normal Distributions Transform (Magnusson 2009): Y is represented by the Gaussians of its
+ * voxels, accumulated once as S = sum [y;1][y;1]', and each point p = Tx is scored as
+ *      -d1 exp(-d2/2 (p - mu)' Sigma^-1 (p - mu))
+ * against the Gaussians of its voxel (and neighbours), where d1 and d2 approximate a mixture of
+ * the Gaussian and a uniform distribution of weight outlierRatio. There is no nearest neighbour
+ * search, the voxel of a point is a hash lookup.
+ *
+ * The score is maximized by Newton steps with the exact Hessian over the left update
+ * T <- exp(dxi) T, modified to be positive definite, and a backtracking line search.
+ * Points are reduced in parallel on numThreads threads in ranges of fixed size, so the
+ * result does not depend on the number of threads.
+ *
+ * T contains the initial pose and it is updated with the solution.
+ * Returns the number of iterations.
+ */
+int ndt(MatRefConst X, MatRefConst Y, SE3 &T, const NDTParameters &params, NDTReport &report);
 
 
 }}//namespace
@@ -0,0 +1,248 @@
+/* Copyright (c) 2022, Gonzalo Ferrer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * ndt.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Gonzalo Ferrer
+ *              g.ferrer@skoltech.ru
+ *              Mobile Robotics Lab, Skoltech
+ */
+
+#include <Eigen/Eigenvalues>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include <cmath>
+#include "mrob/pc_registration.hpp"
+#include "mrob/voxel_hash_map.hpp"
+#include "mrob/parallel.hpp"
+
+
+using namespace mrob;
+
+namespace
+{
+// points reduced by each parallel task
+constexpr uint_t chunkSize = 1024;
+
+struct Gaussian
+{
+    Mat31 mean;
+    Mat3 information; // inverse of the regularized covariance
+    bool valid;
+};
+
+/**
+ * Gaussians of the voxels of Y, indexed by their key
+ */
+struct GaussianGrid
+{
+    std::unordered_map<VoxelKey, uint_t, VoxelKeyHash> index;
+    std::vector<Gaussian> gaussians;
+
+    const Gaussian* find(const VoxelKey &key) const
+    {
+        auto it = index.find(key);
+        if (it == index.end() || !gaussians[it->second].valid)
+            return nullptr;
+        return &gaussians[it->second];
+    }
+};
+
+void build_grid(MatRefConst Y, const PCRegistration::NDTParameters &params, GaussianGrid &grid)
+{
+    // 1) moments S = sum [y;1][y;1]' of each voxel
+    std::vector<Mat4, Eigen::aligned_allocator<Mat4>> S;
+    for (uint_t i = 0; i < Y.rows(); ++i)
+    {
+        Mat41 p;
+        p << Y.row(i).transpose(), 1.0;
+        auto it = grid.index.emplace(VoxelKey::from_point(p.head<3>(), params.voxelSize), S.size());
+        if (it.second)
+            S.push_back(Mat4::Zero());
+        S[it.first->second] += p * p.transpose();
+    }
+
+    // 2) mean and inverse covariance, whose eigenvalues are bounded so flat voxels are not singular
+    grid.gaussians.resize(S.size());
+    parallel_for((S.size() + chunkSize - 1) / chunkSize, params.numThreads, [&](uint_t task)
+    {
+        Eigen::SelfAdjointEigenSolver<Mat3> eigs;
+        for (uint_t i = task * chunkSize; i < std::min<uint_t>(S.size(), (task + 1) * chunkSize); ++i)
+        {
+            Gaussian &g = grid.gaussians[i];
+            const matData_t count = S[i](3,3);
+            g.valid = false;
+            if (count < params.minPointsPerVoxel)
+                continue;
+            g.mean = S[i].block<3,1>(0,3) / count;
+            Mat3 C = S[i].topLeftCorner<3,3>() / count - g.mean * g.mean.transpose();
+            eigs.computeDirect(C);
+            Mat31 lambda = eigs.eigenvalues();
+            if (!(lambda(2) > 0.0))
+                continue;
+            lambda = lambda.cwiseMax(params.eigenvalueRatio * lambda(2));
+            const Mat3 &E = eigs.eigenvectors();
+            g.information = E * lambda.cwiseInverse().asDiagonal() * E.transpose();
+            g.valid = true;
+        }
+    });
+}
+
+/**
+ * Cost f = sum d1 exp(-d2/2 q) of the points (d1 < 0), its gradient and Hessian over the left update
+ */
+struct Reduction
+{
+    matData_t cost;
+    uint_t count;
+    Mat61 gradient;
+    Mat6 hessian;
+};
+
+/**
+ * Reduces the points [first, last) of X at T. For p = Tx and dp/dxi = [-p^ I], being
+ * d = p - mu, v = Sigma^-1 d and e = exp(-d2/2 d'v), each Gaussian adds to the cost d1 e, to
+ * the gradient c e [p^ v; v] and to the Hessian
+ *      c e ([-p^ Sigma^-1 p^   p^ Sigma^-1    - d2 [p^ v; v][p^ v; v]' + second order terms of p)
+ *             -Sigma^-1 p^     Sigma^-1   ]
+ * with c = -d1 d2 > 0. The second derivatives of exp(dxi) p contracted with v are
+ * 1/2(v p' + p v') - v'p I in the rotation block and -1/2 v^ in the rotation-translation block.
+ */
+void reduce_points(MatRefConst X, const GaussianGrid &grid, const Mat3 &R, const Mat31 &t,
+                   const PCRegistration::NDTParameters &params, matData_t d1, matData_t d2,
+                   bool derivatives, uint_t first, uint_t last, Reduction &res)
+{
+    static const int offsets[7][3] = {{0,0,0}, {1,0,0}, {-1,0,0}, {0,1,0}, {0,-1,0}, {0,0,1}, {0,0,-1}};
+    const uint_t numOffsets = params.searchNeighbours ? 7 : 1;
+    const matData_t c = -d1 * d2;
+    res.cost = 0.0;
+    res.count = 0;
+    res.gradient.setZero();
+    res.hessian.setZero();
+    for (uint_t i = first; i < last; ++i)
+    {
+        const Mat31 p = R * X.row(i).transpose() + t;
+        const VoxelKey k = VoxelKey::from_point(p, params.voxelSize);
+        bool found = false;
+        for (uint_t n = 0; n < numOffsets; ++n)
+        {
+            const Gaussian *g = grid.find(VoxelKey{k.x + offsets[n][0], k.y + offsets[n][1], k.z + offsets[n][2]});
+            if (!g)
+                continue;
+            found = true;
+            const Mat31 d = p - g->mean;
+            const Mat31 v = g->information * d;
+            const matData_t e = std::exp(-0.5 * d2 * d.dot(v));
+            res.cost += d1 * e;
+            if (!derivatives)
+                continue;
+            Mat61 Jv;
+            Jv << p.cross(v), v;
+            res.gradient += c * e * Jv;
+            const Mat3 P = hat3(p);
+            const Mat3 PL = P * g->information;
+            Mat6 H;
+            H.topLeftCorner<3,3>() = -PL * P + 0.5 * (v * p.transpose() + p * v.transpose()) - v.dot(p) * Mat3::Identity();
+            H.topRightCorner<3,3>() = PL - 0.5 * hat3(v);
+            H.bottomLeftCorner<3,3>() = H.topRightCorner<3,3>().transpose();
+            H.bottomRightCorner<3,3>() = g->information;
+            H -= d2 * Jv * Jv.transpose();
+            res.hessian += c * e * H;
+        }
+        res.count += found;
+    }
+}
+}
+
+
+int PCRegistration::ndt(MatRefConst X, MatRefConst Y, SE3 &T, const NDTParameters &params, NDTReport &report)
+{
+    assert(X.cols() == 3 && "PCRegistration::ndt: Incorrect sizing, we expect Nx3");
+    assert(Y.cols() == 3 && "PCRegistration::ndt: Incorrect sizing, we expect Mx3");
+    assert(params.outlierRatio >= 0.0 && params.outlierRatio < 1.0 && "PCRegistration::ndt: outlier ratio in [0, 1)");
+    report = NDTReport{0, 0, 0.0, false};
+    GaussianGrid grid;
+    build_grid(Y, params, grid);
+
+    // Gaussian approximation of the mixture c1 exp(-q/2) + c2 (Magnusson 2009, eq. 6.8)
+    const matData_t c1 = 10.0 * (1.0 - params.outlierRatio);
+    const matData_t c2 = params.outlierRatio / std::pow(params.voxelSize, 3);
+    const matData_t d3 = -std::log(c2);
+    const matData_t d1 = -std::log(c1 + c2) - d3;
+    const matData_t d2 = -2.0 * std::log((-std::log(c1 * std::exp(-0.5) + c2) - d3) / d1);
+
+    const uint_t N = X.rows();
+    const uint_t numTasks = (N + chunkSize - 1) / chunkSize;
+    std::vector<Reduction, Eigen::aligned_allocator<Reduction>> partial(numTasks);
+    auto reduce = [&](const SE3 &Tk, bool derivatives, Reduction &res)
+    {
+        const Mat3 R = Tk.R();
+        const Mat31 t = Tk.t();
+        parallel_for(numTasks, params.numThreads, [&](uint_t task)
+        {
+            reduce_points(X, grid, R, t, params, d1, d2, derivatives, task * chunkSize,
+                          std::min(N, (task + 1) * chunkSize), partial[task]);
+        });
+        res = Reduction{0.0, 0, Mat61::Zero(), Mat6::Zero()};
+        for (const auto &r : partial)
+        {
+            res.cost += r.cost;
+            res.count += r.count;
+            res.gradient += r.gradient;
+            res.hessian += r.hessian;
+        }
+    };
+
+    Reduction current, trial;
+    Eigen::SelfAdjointEigenSolver<Mat6> eigs;
+    reduce(T, true, current);
+    while (report.iterations < params.maxIters && current.count > 0)
+    {
+        report.iterations++;
+        // 1) Newton step, the Hessian is modified to be positive definite by the absolute value of its eigenvalues
+        eigs.compute(current.hessian);
+        Mat61 lambda = eigs.eigenvalues().cwiseAbs();
+        lambda = lambda.cwiseMax(1e-9 * std::max(lambda.maxCoeff(), 1e-12));
+        const Mat6 &E = eigs.eigenvectors();
+        Mat61 dxi = -E * lambda.cwiseInverse().asDiagonal() * E.transpose() * current.gradient;
+
+        // 2) backtracking line search on the cost (Armijo condition), converged when the step is below tol
+        bool accepted = false;
+        while (dxi.norm() >= params.tol)
+        {
+            SE3 Tk(T);
+            Tk.update_lhs(dxi);
+            reduce(Tk, false, trial);
+            if (trial.cost <= current.cost + 1e-4 * current.gradient.dot(dxi))
+            {
+                T = Tk;
+                accepted = true;
+                break;
+            }
+            dxi *= 0.5;
+        }
+        if (!accepted)
+        {
+            report.converged = true;
+            break;
+        }
+        reduce(T, true, current);
+    }
+    report.correspondences = current.count;
+    report.score = -current.cost;
+    return report.iterations;
+}
@@ -0,0 +1,204 @@
+/* Copyright (c) 2022, Gonzalo Ferrer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * ransac.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Gonzalo Ferrer
+ *              g.ferrer@skoltech.ru
+ *              Mobile Robotics Lab, Skoltech
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "mrob/pc_registration.hpp"
+#include "mrob/parallel.hpp"
+#include "mrob/block_reduce.hpp"
+
+
+using namespace mrob;
+using namespace mrob::detail;
+
+namespace
+{
+// hypotheses generated and scored in parallel before updating the best one and the number of iterations
+constexpr uint_t batchSize = 64;
+
+/**
+ * Counter based random numbers (splitmix64), so each hypothesis draws its sample
+ * independently of the others and of the thread evaluating it
+ */
+uint64_t splitmix64(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+/**
+ * Draws 3 different indices in [0, N) for hypothesis h
+ */
+void draw_sample(uint_t seed, uint_t h, uint_t N, uint_t sample[3])
+{
+    uint64_t state = splitmix64((static_cast<uint64_t>(seed) << 32) ^ h);
+    for (uint_t i = 0; i < 3; ++i)
+    {
+        bool repeated;
+        do
+        {
+            state = splitmix64(state);
+            sample[i] = state % N;
+            repeated = false;
+            for (uint_t j = 0; j < i; ++j)
+                repeated |= sample[i] == sample[j];
+        } while (repeated);
+    }
+}
+
+/**
+ * Rigid transformations preserve distances, so the distances between the pairs of the
+ * sample in X and Y differ at most 2 threshold for inliers
+ */
+bool is_rigid(const Mat3 &Xs, const Mat3 &Ys, matData_t threshold)
+{
+    for (uint_t i = 0; i < 3; ++i)
+    {
+        const uint_t j = (i + 1) % 3;
+        if (std::abs((Xs.row(i) - Xs.row(j)).norm() - (Ys.row(i) - Ys.row(j)).norm()) > 2.0 * threshold)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Number of inliers of T. If it can not be larger than bound, it stops and returns 0.
+ */
+uint_t count_inliers(const PointsSoA<matData_t> &X, const PointsSoA<matData_t> &Y, const SE3 &T, matData_t threshold2, uint_t bound)
+{
+    const Mat3 R = T.R();
+    const Mat31 t = T.t();
+    const uint_t N = X.rows();
+    BlockArray<matData_t> r2, r;
+    uint_t count = 0;
+    for (uint_t start = 0; start < N; start += blockSize)
+    {
+        const uint_t n = std::min(blockSize, N - start);
+        if (count + (N - start) <= bound)
+            return 0;
+        r2.setZero(n);
+        for (uint_t i = 0; i < 3; ++i)
+        {
+            r = Y.col(i).segment(start, n).array() - t(i) - R(i,0) * X.col(0).segment(start, n).array() -
+                R(i,1) * X.col(1).segment(start, n).array() - R(i,2) * X.col(2).segment(start, n).array();
+            r2 += r * r;
+        }
+        count += (r2 < threshold2).count();
+    }
+    return count;
+}
+
+void get_inliers(const PointsSoA<matData_t> &X, const PointsSoA<matData_t> &Y, const SE3 &T, matData_t threshold2, std::vector<uint_t> &inliers)
+{
+    inliers.clear();
+    for (uint_t i = 0; i < X.rows(); ++i)
+        if ((Y.row(i).transpose() - T.transform(X.row(i).transpose())).squaredNorm() < threshold2)
+            inliers.push_back(i);
+}
+}
+
+
+uint_t PCRegistration::ransac_arun(MatRefConst X, MatRefConst Y, SE3 &T, const RansacParameters &params, RansacReport &report)
+{
+    assert(X.cols() == 3 && "PCRegistration::ransac_arun: Incorrect sizing, we expect Nx3");
+    assert(Y.rows() == X.rows() && Y.cols() == 3 && "PCRegistration::ransac_arun: Same number of correspondences");
+    const uint_t N = X.rows();
+    report.iterations = 0;
+    report.inliers.clear();
+    report.success = false;
+    if (N < 3)
+        return 0;
+
+    const PointsSoA<matData_t> Xs = X, Ys = Y;
+    const matData_t threshold2 = params.threshold * params.threshold;
+    std::vector<uint_t> scores(batchSize);
+    std::vector<SE3, Eigen::aligned_allocator<SE3>> hypotheses(batchSize);
+    uint_t bestInliers = 0;
+    uint_t requiredIters = params.maxIters;
+    while (report.iterations < std::min(requiredIters, params.maxIters))
+    {
+        // 1) batch of hypotheses, scored against the best one of the previous batches
+        const uint_t h0 = report.iterations;
+        const uint_t numHypotheses = std::min(batchSize, params.maxIters - h0);
+        const uint_t bound = bestInliers;
+        parallel_for(numHypotheses, params.numThreads, [&](uint_t k)
+        {
+            scores[k] = 0;
+            uint_t sample[3];
+            draw_sample(params.seed, h0 + k, N, sample);
+            Mat3 Xm, Ym;
+            for (uint_t i = 0; i < 3; ++i)
+            {
+                Xm.row(i) = X.row(sample[i]);
+                Ym.row(i) = Y.row(sample[i]);
+            }
+            if (!is_rigid(Xm, Ym, params.threshold) || !arun(Xm, Ym, hypotheses[k]))
+                return;
+            scores[k] = count_inliers(Xs, Ys, hypotheses[k], threshold2, bound);
+        });
+        report.iterations += numHypotheses;
+
+        // 2) best hypothesis, the first one of the batch on ties, and the iterations required by its inlier ratio
+        for (uint_t k = 0; k < numHypotheses; ++k)
+        {
+            if (scores[k] > bestInliers && scores[k] >= 3)
+            {
+                bestInliers = scores[k];
+                T = hypotheses[k];
+                report.success = true;
+            }
+        }
+        if (report.success)
+        {
+            const matData_t w = static_cast<matData_t>(bestInliers) / N;
+            const matData_t outlierSample = 1.0 - w * w * w;
+            if (outlierSample <= 0.0)
+                break;
+            const matData_t iters = std::ceil(std::log(1.0 - params.confidence) / std::log(outlierSample));
+            if (iters < params.maxIters)
+                requiredIters = static_cast<uint_t>(std::max(iters, 0.0));
+        }
+    }
+    if (!report.success)
+        return 0;
+
+    // 3) refinement on the inliers of the best hypothesis
+    get_inliers(Xs, Ys, T, threshold2, report.inliers);
+    if (params.refine)
+    {
+        const uint_t M = report.inliers.size();
+        MatX Xin(M, 3), Yin(M, 3);
+        for (uint_t i = 0; i < M; ++i)
+        {
+            Xin.row(i) = X.row(report.inliers[i]);
+            Yin.row(i) = Y.row(report.inliers[i]);
+        }
+        weighted_point(Xin, Yin, MatX1::Ones(M), T, 1e-6, params.numThreads);
+        get_inliers(Xs, Ys, T, threshold2, report.inliers);
+    }
+    return report.inliers.size();
+}
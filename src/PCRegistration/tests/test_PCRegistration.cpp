@@ -0,0 +1,211 @@
+/* Copyright (c) 2022, Gonzalo Ferrer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * test_PCRegistration.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Gonzalo Ferrer
+ *              g.ferrer@skoltech.ru
+ *              Mobile Robotics Lab, Skoltech
+ */
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch.hpp>
+
+#include "mrob/pc_registration.hpp"
+
+#include <Eigen/Cholesky>
+#include <Eigen/LU>
+#include <vector>
+
+
+// Previous GICP implementation, reducing the gradient and Hessian point by point in Scalar
+// and accumulating them in double. Returns the number of iterations.
+template<typename Scalar>
+int gicp_per_point(const mrob::MatXT<Scalar> &X, const mrob::MatXT<Scalar> &Y,
+                   const mrob::MatXT<Scalar> &covX, const mrob::MatXT<Scalar> &covY, mrob::SE3 &T, double tol)
+{
+    using Mat31s = Eigen::Matrix<Scalar, 3, 1>;
+    using Mat3s = Eigen::Matrix<Scalar, 3, 3>;
+    int iters = 0;
+    double deltaUpdate;
+    do
+    {
+        mrob::Mat61 J = mrob::Mat61::Zero();
+        mrob::Mat6 H = mrob::Mat6::Zero();
+        const Mat3s R = T.R().cast<Scalar>();
+        const Mat31s t = T.t().cast<Scalar>();
+        for (mrob::uint_t i = 0; i < X.rows(); ++i)
+        {
+            Mat31s Txi = R * X.row(i).transpose() + t;
+            Mat31s r = Y.row(i).transpose() - Txi;
+            Mat3s Li = (covY.template block<3,3>(3*i,0) + R * covX.template block<3,3>(3*i,0) * R.transpose()).inverse();
+            Eigen::Matrix<Scalar, 3, 6> Jr;
+            Jr <<       0, -Txi(2),  Txi(1), -1,  0,  0,
+                   Txi(2),       0, -Txi(0),  0, -1,  0,
+                  -Txi(1),  Txi(0),       0,  0,  0, -1;
+            J += (r.transpose() * Li * Jr).transpose().template cast<mrob::matData_t>();
+            H += (Jr.transpose() * Li * Jr).template cast<mrob::matData_t>();
+        }
+        mrob::Mat61 dxi = -H.ldlt().solve(J);
+        T.update_lhs(dxi);
+        deltaUpdate = dxi.norm();
+        iters++;
+    }while(deltaUpdate > tol && iters < 20);
+    return iters;
+}
+
+TEST_CASE("GICP agrees with the per point reduction")
+{
+    using namespace mrob::PCRegistration;
+    // more than one parallel range of points, and a last block of points not full
+    const mrob::uint_t N = 20000;
+    mrob::MatX X = 2.0*mrob::MatX::Random(N, 3), covX(3*N, 3), covY(3*N, 3);
+    for (mrob::uint_t i = 0; i < N; ++i)
+    {
+        mrob::Mat3 A = mrob::Mat3::Random();
+        covX.middleRows(3*i, 3) = A*A.transpose() + 0.01*mrob::Mat3::Identity();
+        A.setRandom();
+        covY.middleRows(3*i, 3) = A*A.transpose() + 0.01*mrob::Mat3::Identity();
+    }
+    mrob::Mat61 xi;
+    xi << 0.2, -0.1, 0.3, 0.5, -0.4, 0.2;
+    const mrob::SE3 groundTruth(xi);
+    mrob::MatX Y = groundTruth.transform_array(X) + 0.01*mrob::MatX::Random(N, 3);
+    const mrob::MatXf Xf = X.cast<float>(), Yf = Y.cast<float>(), covXf = covX.cast<float>(), covYf = covY.cast<float>();
+
+    SECTION("A single step from the identity")
+    {
+        mrob::SE3 T, Tref, Tf, Tfref;
+        REQUIRE(gicp(X, Y, covX, covY, T, 1e10, 4) == 1);
+        REQUIRE(gicp_per_point<mrob::matData_t>(X, Y, covX, covY, Tref, 1e10) == 1);
+        REQUIRE(T.distance(Tref) == Approx(0.0).margin(1e-10));
+        REQUIRE(gicp(Xf, Yf, covXf, covYf, Tf, 1e10, 4) == 1);
+        REQUIRE(gicp_per_point<float>(Xf, Yf, covXf, covYf, Tfref, 1e10) == 1);
+        REQUIRE(Tf.distance(Tfref) == Approx(0.0).margin(1e-6));
+        REQUIRE(Tf.distance(Tref) == Approx(0.0).margin(1e-6));
+    }
+
+    SECTION("Until convergence")
+    {
+        mrob::SE3 T, Tref, Tf, Tfref;
+        REQUIRE(gicp(X, Y, covX, covY, T, 1e-8, 4) == gicp_per_point<mrob::matData_t>(X, Y, covX, covY, Tref, 1e-8));
+        REQUIRE(T.distance(Tref) == Approx(0.0).margin(1e-10));
+        REQUIRE(T.distance(groundTruth) < 0.01);
+        gicp(Xf, Yf, covXf, covYf, Tf, 1e-4, 4);
+        gicp_per_point<float>(Xf, Yf, covXf, covYf, Tfref, 1e-4);
+        REQUIRE(Tf.distance(Tfref) == Approx(0.0).margin(1e-6));
+        REQUIRE(Tf.distance(T) == Approx(0.0).margin(1e-6));
+    }
+}
+
+
+TEST_CASE("Batched registration agrees with the registration of each problem")
+{
+    using namespace mrob::PCRegistration;
+    const mrob::uint_t N = 16, M = 50;
+    mrob::MatX X = mrob::MatX::Random(N*M, 3), Y(N*M, 3), Yexact(N*M, 3), normals(N*M, 3);
+    BatchPoses groundTruth;
+    for (mrob::uint_t k = 0; k < N; ++k)
+    {
+        mrob::Mat61 xi = mrob::Mat61::Random()*0.3;
+        groundTruth.emplace_back(xi);
+        Yexact.middleRows(k*M, M) = groundTruth.back().transform_array(mrob::MatX(X.middleRows(k*M, M)));
+    }
+    Y = Yexact + 0.01*mrob::MatX::Random(N*M, 3);
+    normals.setRandom();
+    normals.rowwise().normalize();
+    const mrob::MatX noNormals(0, 3);
+    const mrob::MatX1 noWeights(0);
+    // identity covariances, then GICP minimizes the same cost as the point to point metric
+    mrob::MatX cov(3*M, 3);
+    for (mrob::uint_t i = 0; i < M; ++i)
+        cov.middleRows(3*i, 3).setIdentity();
+
+    SECTION("Point to point, as Arun and GICP")
+    {
+        BatchPoses T(N);
+        std::vector<BatchReport> report;
+        batch_solve(POINT_TO_POINT, X, Y, noNormals, noWeights, T, report, 50, 1e-10);
+        REQUIRE(report.size() == N);
+        for (mrob::uint_t k = 0; k < N; ++k)
+        {
+            REQUIRE(report[k].converged);
+            mrob::MatX Xk = X.middleRows(k*M, M), Yk = Y.middleRows(k*M, M);
+            mrob::SE3 Tarun, Tgicp;
+            REQUIRE(arun(Xk, Yk, Tarun) == 1);
+            REQUIRE(T[k].distance(Tarun) == Approx(0.0).margin(1e-6));
+            gicp(Xk, Yk, cov, cov, Tgicp, 1e-10);
+            REQUIRE(T[k].distance(Tgicp) == Approx(0.0).margin(1e-6));
+            REQUIRE(report[k].chi2 == Approx(weighted_point_cost(Xk, Yk, mrob::MatX1::Ones(M), T[k])));
+            REQUIRE(T[k].distance(groundTruth[k]) < 0.05);
+        }
+    }
+
+    SECTION("Weighted point to point, as the weighted point registration")
+    {
+        mrob::MatX1 weights = mrob::MatX1::Random(N*M).array() + 1.5;
+        BatchPoses T(N);
+        std::vector<BatchReport> report;
+        batch_solve(POINT_TO_POINT, X, Y, noNormals, weights, T, report, 50, 1e-10);
+        for (mrob::uint_t k = 0; k < N; ++k)
+        {
+            REQUIRE(report[k].converged);
+            mrob::MatX Xk = X.middleRows(k*M, M), Yk = Y.middleRows(k*M, M);
+            mrob::MatX1 wk = weights.segment(k*M, M);
+            mrob::SE3 Tweighted;
+            weighted_point(Xk, Yk, wk, Tweighted, 1e-10);
+            REQUIRE(T[k].distance(Tweighted) == Approx(0.0).margin(1e-6));
+            REQUIRE(report[k].chi2 == Approx(weighted_point_cost(Xk, Yk, wk, T[k])));
+        }
+    }
+
+    SECTION("Point to plane recovers the ground truth without noise")
+    {
+        BatchPoses T(N);
+        std::vector<BatchReport> report;
+        batch_solve(POINT_TO_PLANE, X, Yexact, normals, noWeights, T, report, 50, 1e-10);
+        for (mrob::uint_t k = 0; k < N; ++k)
+        {
+            REQUIRE(report[k].converged);
+            REQUIRE(report[k].chi2 == Approx(0.0).margin(1e-12));
+            REQUIRE(T[k].distance(groundTruth[k]) == Approx(0.0).margin(1e-6));
+        }
+    }
+}
+
+TEST_CASE("Point to plane of a single problem agrees with the batched solver")
+{
+    using namespace mrob::PCRegistration;
+    // more than one parallel range of points, and a last block of points not full
+    const mrob::uint_t N = 40000;
+    mrob::MatX X = 2.0*mrob::MatX::Random(N, 3), normals = mrob::MatX::Random(N, 3);
+    normals.rowwise().normalize();
+    mrob::Mat61 xi;
+    xi << 0.1, -0.2, 0.1, 0.3, 0.2, -0.4;
+    const mrob::SE3 groundTruth(xi);
+    mrob::MatX Y = groundTruth.transform_array(X) + 0.01*mrob::MatX::Random(N, 3);
+
+    for (mrob::uint_t maxIters : {1, 2, 50})
+    {
+        BatchPoses T(1);
+        std::vector<BatchReport> report;
+        batch_solve(POINT_TO_PLANE, X, Y, normals, mrob::MatX1(), T, report, maxIters, 1e-10, 1);
+        mrob::SE3 Tplane;
+        REQUIRE(point_to_plane(X, Y, normals, Tplane, 1e-10, 4, maxIters) == (int)report[0].iterations);
+        REQUIRE(report[0].iterations <= maxIters);
+        REQUIRE(Tplane.distance(T[0]) == Approx(0.0).margin(1e-10));
+    }
+}
@@ -21,17 +21,59 @@
  *              Mobile Robotics Lab, Skoltech 
  */
 
-#include <Eigen/LU> // for inverse and determinant
-
-#include <memory>
-#include <iostream>
+#include <Eigen/Cholesky>
+#include <algorithm>
+#include <vector>
 #include "mrob/pc_registration.hpp"
+#include "mrob/parallel.hpp"
+#include "mrob/block_reduce.hpp"
 
 
 using namespace mrob;
+using namespace mrob::detail;
 
-int PCRegistration::weighted_point(MatRefConst X, MatRefConst Y,
-                                   VectRefConst weight,  SE3 &T, double tol)
+namespace
+{
+// sum of w, w p, w p p' (xx, yy, zz, xy, xz, yz), w y x p and w r, with p = Tx and r = y - Tx
+using Sums = Eigen::Matrix<matData_t, 16, 1>;
+
+template<typename Scalar>
+void reduce_points(const PointsSoA<Scalar> &X, const PointsSoA<Scalar> &Y, const Eigen::Ref<const MatX1T<Scalar>> &weight,
+                   const Eigen::Matrix<Scalar, 3, 3> &R, const Eigen::Matrix<Scalar, 3, 1> &t,
+                   uint_t first, uint_t last, Sums &sums)
+{
+    sums.setZero();
+    BlockArray<Scalar> p[3], r[3];
+    for (uint_t start = first; start < last; start += blockSize)
+    {
+        const uint_t n = std::min(blockSize, last - start);
+        auto w = weight.segment(start, n).array();
+        for (uint_t i = 0; i < 3; ++i)
+        {
+            p[i] = R(i,0) * X.col(0).segment(start, n).array() + R(i,1) * X.col(1).segment(start, n).array() +
+                   R(i,2) * X.col(2).segment(start, n).array() + t(i);
+            r[i] = Y.col(i).segment(start, n).array() - p[i];
+        }
+        sums(0) += block_sum(w);
+        for (uint_t i = 0; i < 3; ++i)
+        {
+            sums(1+i) += block_sum(w * p[i]);
+            sums(4+i) += block_sum(w * p[i] * p[i]);
+            sums(13+i) += block_sum(w * r[i]);
+        }
+        sums(7) += block_sum(w * p[0] * p[1]);
+        sums(8) += block_sum(w * p[0] * p[2]);
+        sums(9) += block_sum(w * p[1] * p[2]);
+        // r x p = y x p
+        sums(10) += block_sum(w * (r[1] * p[2] - r[2] * p[1]));
+        sums(11) += block_sum(w * (r[2] * p[0] - r[0] * p[2]));
+        sums(12) += block_sum(w * (r[0] * p[1] - r[1] * p[0]));
+    }
+}
+
+template<typename Scalar>
+int weighted_point_scalar(const Eigen::Ref<const MatXT<Scalar>> &X, const Eigen::Ref<const MatXT<Scalar>> &Y,
+                          const Eigen::Ref<const MatX1T<Scalar>> &weight,  SE3 &T, double tol, uint_t numThreads, uint_t maxIters)
 {
     assert(X.cols() == 3  && "PCRegistration::Gicp: Incorrect sizing, we expect Nx3");
     assert(X.rows() >= 3  && "PCRegistration::Gicp: Incorrect sizing, we expect at least 3 correspondences (not aligned)");
@@ -39,6 +81,11 @@ int PCRegistration::weighted_point(MatRefConst X, MatRefConst Y,
     uint_t N = X.rows();
     // TODO precalculation of T by reduced Arun
 
+    // SoA copies of the points, so coordinates of consecutive points are contiguous
+    const PointsSoA<Scalar> Xs = X, Ys = Y;
+    const uint_t numTasks = (N + taskSize - 1) / taskSize;
+    std::vector<Sums> partialSums(numTasks);
+
     // Initialize Jacobian and Hessian
     Mat61 J = Mat61::Zero();
     Mat6 H = Mat6::Zero();
@@ -46,32 +93,62 @@ int PCRegistration::weighted_point(MatRefConst X, MatRefConst Y,
     double deltaUpdate = 1e3;
     do
     {
-        J.setZero();
-        H.setZero();
-        // not vectoried operations (due to Jacobian)
-        for ( uint_t i = 0; i < N ; ++i)
+        const Eigen::Matrix<Scalar, 3, 3> R = T.R().cast<Scalar>();
+        const Eigen::Matrix<Scalar, 3, 1> t = T.t().cast<Scalar>();
+        parallel_for(numTasks, numThreads, [&](uint_t k)
         {
-            // 1) Calculate residual r = y - Tx and the inverse of joint covariance
-            Mat31 Txi = T.transform(X.row(i));
-            Mat31 r = Y.row(i).transpose() - Txi;
-
-            // 2) Calculate Jacobian for residual Jf = df/d xi = w * r' Jr, where Jr = [(Tx)^ ; -I])
-            Mat<3,6> Jr;
-            Jr << hat3(Txi) , -Mat3::Identity();
-            Mat<1,6> Ji = weight(i) * r.transpose() * Jr;
-            J += Ji;//Eigen manages this for us
-
-            // 3) Hessian Hi ~ w * Jr' * Jr
-            Mat6 Hi = weight(i) * Jr.transpose() * Jr;
-            H += Hi;
-        }
-        // 4) Update Solution
-        Mat61 dxi = -H.inverse()*J;
+            reduce_points<Scalar>(Xs, Ys, weight, R, t, k*taskSize, std::min((k+1)*taskSize, N), partialSums[k]);
+        });
+        Sums s = Sums::Zero();
+        for (const auto &partial : partialSums)
+            s += partial;
+
+        // 1) Jacobian for residual Jf = df/d xi = sum w * r' Jr, where Jr = [(Tx)^ ; -I])
+        J << s.segment<3>(10), -s.segment<3>(13);
+
+        // 2) Hessian H = sum w * Jr' * Jr = sum w [ |p|^2 I - pp'   p^
+        //                                           -p^              I ]
+        Mat3 Hpp;
+        Hpp << s(5) + s(6), -s(7),       -s(8),
+               -s(7),       s(4) + s(6), -s(9),
+               -s(8),       -s(9),       s(4) + s(5);
+        H.topLeftCorner<3,3>() = Hpp;
+        H.topRightCorner<3,3>() = hat3(s.segment<3>(1));
+        H.bottomLeftCorner<3,3>() = -hat3(s.segment<3>(1));
+        H.bottomRightCorner<3,3>() = s(0) * Mat3::Identity();
+
+        // 3) Update Solution
+        Mat61 dxi = -H.ldlt().solve(J);
         T.update_lhs(dxi); //Left side update
         deltaUpdate = dxi.norm();
         iters++;
 
-    }while(deltaUpdate > tol && iters < 20);
+    }while(deltaUpdate > tol && iters < maxIters);
 
     return iters; // number of iterations
 }
+}
+
+int PCRegistration::weighted_point(MatRefConst X, MatRefConst Y,
+                                   VectRefConst weight,  SE3 &T, double tol, uint_t numThreads, uint_t maxIters)
+{
+    return weighted_point_scalar<matData_t>(X, Y, weight, T, tol, numThreads, maxIters);
+}
+
+int PCRegistration::weighted_point(MatfRefConst X, MatfRefConst Y,
+                                   VectfRefConst weight,  SE3 &T, double tol, uint_t numThreads, uint_t maxIters)
+{
+    return weighted_point_scalar<float>(X, Y, weight, T, tol, numThreads, maxIters);
+}
+
+double PCRegistration::weighted_point_cost(MatRefConst X, MatRefConst Y, VectRefConst weight, const SE3 &T)
+{
+    assert(X.cols() == 3 && Y.rows() == X.rows() && weight.rows() == X.rows() &&
+           "PCRegistration::weighted_point_cost: Incorrect sizing, we expect Nx3");
+    const Mat3 R = T.R();
+    const Mat31 t = T.t();
+    double cost = 0.0;
+    for (uint_t i = 0; i < X.rows(); ++i)
+        cost += weight(i) * (Y.row(i).transpose() - R * X.row(i).transpose() - t).squaredNorm();
+    return 0.5 * cost;
+}
@@ -0,0 +1,187 @@
+/* Copyright (c) 2022, Gonzalo Ferrer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * allocation_counter.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Gonzalo Ferrer
+ *              g.ferrer@skoltech.ru
+ *              Mobile Robotics Lab, Skoltech
+ */
+
+#include "mrob/allocation_counter.hpp"
+
+#ifdef MROB_ALLOCATION_COUNTER
+
+#include <atomic>
+#include <cstdlib>
+#include <cerrno>
+#include <new>
+
+namespace {
+// relaxed ordering is enough, we only need an eventually consistent total
+std::atomic<uint64_t> allocationCount(0);
+
+inline void count_allocation()
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+}
+}
+
+#ifdef __GLIBC__
+// The malloc family is interposed on glibc and forwarded to the internal implementation.
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void *ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+
+void* malloc(size_t size)
+{
+    count_allocation();
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size)
+{
+    count_allocation();
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void *ptr, size_t size)
+{
+    count_allocation();
+    return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size)
+{
+    count_allocation();
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+    count_allocation();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+    count_allocation();
+    void *p = __libc_memalign(alignment, size);
+    if (p == nullptr)
+        return ENOMEM;
+    *ptr = p;
+    return 0;
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+}
+
+// operator new is counted here, so it must not go through the counted malloc again
+#define MROB_RAW_MALLOC __libc_malloc
+#define MROB_RAW_FREE __libc_free
+#else
+#define MROB_RAW_MALLOC std::malloc
+#define MROB_RAW_FREE std::free
+#endif
+
+void* operator new(std::size_t size)
+{
+    count_allocation();
+    if (size == 0)
+        size = 1;
+    void *p = MROB_RAW_MALLOC(size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](std::size_t size)
+{
+    return ::operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    count_allocation();
+    return MROB_RAW_MALLOC(size == 0 ? 1 : size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t &tag) noexcept
+{
+    return ::operator new(size, tag);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    MROB_RAW_FREE(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    MROB_RAW_FREE(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    MROB_RAW_FREE(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+    MROB_RAW_FREE(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t&) noexcept
+{
+    MROB_RAW_FREE(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t&) noexcept
+{
+    MROB_RAW_FREE(ptr);
+}
+
+bool mrob::allocation_counter_enabled()
+{
+    return true;
+}
+
+uint64_t mrob::get_allocation_count()
+{
+    return allocationCount.load(std::memory_order_relaxed);
+}
+
+#else
+
+bool mrob::allocation_counter_enabled()
+{
+    return false;
+}
+
+uint64_t mrob::get_allocation_count()
+{
+    return 0;
+}
+
+#endif
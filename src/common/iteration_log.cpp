@@ -0,0 +1,70 @@
+/* Copyright (c) 2022, Gonzalo Ferrer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * iteration_log.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Gonzalo Ferrer
+ *              g.ferrer@skoltech.ru
+ *              Mobile Robotics Lab, Skoltech
+ */
+
+#include "mrob/iteration_log.hpp"
+#include <iostream>
+
+using namespace mrob;
+
+
+IterationLog::IterationLog() :
+        verbosity_(SUMMARY)
+{
+}
+
+void IterationLog::reset(uint_t maxIters)
+{
+    records_.clear();
+    if (records_.capacity() < maxIters)
+        records_.reserve(maxIters);
+}
+
+bool IterationLog::add(const IterationRecord &record)
+{
+    // the buffer only grows if the solver exceeds the iterations reserved
+    records_.push_back(record);
+    if (verbosity_ >= ITERATIONS)
+        print_record(record);
+    if (callback_)
+        return callback_(record);
+    return false;
+}
+
+void IterationLog::print_summary(const char *solver, const char *message, uint_t iters, matData_t chi2) const
+{
+    std::cout << solver << ": " << message << " after " << iters
+              << " iterations and error " << chi2 << std::endl;
+}
+
+void IterationLog::print_record(const IterationRecord &record) const
+{
+    std::cout << "iteration " << record.iteration
+              << ", lambda = " << record.lambda
+              << ", error = " << record.chi2
+              << ", delta = " << record.deltaChi2
+              << ", model fidelity = " << record.modelFidelity
+              << ", |dx| = " << record.stepNorm
+              << (record.accepted ? "" : " (rejected)")
+              << ", time [us] = " << record.timeBuild + record.timeFactorize + record.timeSolve + record.timeChi2
+              << std::endl;
+}
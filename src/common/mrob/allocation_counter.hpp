@@ -0,0 +1,56 @@
+/* Copyright (c) 2022, Gonzalo Ferrer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * allocation_counter.hpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Gonzalo Ferrer
+ *              g.ferrer@skoltech.ru
+ *              Mobile Robotics Lab, Skoltech
+ */
+
+#ifndef ALLOCATION_COUNTER_HPP_
+#define ALLOCATION_COUNTER_HPP_
+
+#include <cstdint>
+
+namespace mrob {
+
+/**
+ * Opt-in heap allocation counter, used for profiling and for
+ * catching regressions on loops that should not allocate.
+ *
+ * When the library is compiled with MROB_ALLOCATION_COUNTER (cmake option
+ * of the same name) the global operator new is replaced by a counting one.
+ * On glibc the malloc family is also hooked, since Eigen allocates dense
+ * matrices through std::malloc and bypasses operator new.
+ *
+ * Otherwise these functions are no-ops and the count is always 0.
+ */
+
+/**
+ * Returns true if the counter was compiled in.
+ */
+bool allocation_counter_enabled();
+
+/**
+ * Returns the total number of heap allocations (all threads)
+ * since the program started.
+ */
+uint64_t get_allocation_count();
+
+}
+
+#endif /* ALLOCATION_COUNTER_HPP_ */
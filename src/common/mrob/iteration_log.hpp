@@ -0,0 +1,116 @@
+/* Copyright (c) 2022, Gonzalo Ferrer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * iteration_log.hpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Gonzalo Ferrer
+ *              g.ferrer@skoltech.ru
+ *              Mobile Robotics Lab, Skoltech
+ */
+
+#ifndef ITERATION_LOG_HPP_
+#define ITERATION_LOG_HPP_
+
+#include "mrob/matrix_base.hpp"
+#include <vector>
+#include <functional>
+
+namespace mrob {
+
+/**
+ * Values of one iteration of an iterative solver. Times are in microseconds
+ * and correspond only to this iteration. Fields that do not apply to a
+ * method (e.g. lambda in Gauss-Newton) are 0.
+ */
+struct IterationRecord
+{
+    uint_t iteration;
+    matData_t lambda;
+    matData_t chi2; // before the step
+    matData_t deltaChi2; // chi2 decrease by the step (< 0 if rejected)
+    matData_t modelFidelity;
+    matData_t stepNorm;
+    bool accepted;
+    matData_t timeBuild; // linearization: residuals, Jacobians and information matrix
+    matData_t timeFactorize;
+    matData_t timeSolve;
+    matData_t timeChi2;
+};
+
+
+/**
+ * Class IterationLog keeps the records of the iterations of the last solve,
+ * prints them according to the verbosity level and calls an optional user
+ * callback after each iteration, which may request to stop the solver.
+ *
+ * Levels of verbosity:
+ *  - SILENT: nothing is printed
+ *  - SUMMARY: a single line at the end of the solve (default)
+ *  - ITERATIONS: also a line for each iteration
+ *
+ * Records are reserved at reset(), so logging does not allocate once the
+ * buffer has reached the maximum number of iterations. When printing is
+ * disabled, nothing is formatted.
+ */
+class IterationLog
+{
+public:
+    enum verbosityLevel{SILENT=0, SUMMARY, ITERATIONS};
+    /**
+     * The callback receives each record and returns true to stop the solver
+     */
+    using Tcallback = std::function<bool(const IterationRecord&)>;
+
+    IterationLog();
+    ~IterationLog() = default;
+
+    /**
+     * Clears the records and reserves space for maxIters
+     */
+    void reset(uint_t maxIters);
+    /**
+     * Stores the record, prints it at verbosity ITERATIONS and calls the callback.
+     * Returns true if the callback requested to stop.
+     */
+    bool add(const IterationRecord &record);
+    /**
+     * Prints the final message of the solver if verbosity is SUMMARY or higher.
+     * Messages are literals, so no temporary string is created.
+     */
+    void summary(const char *solver, const char *message, uint_t iters, matData_t chi2) const
+    {
+        if (verbosity_ >= SUMMARY)
+            print_summary(solver, message, iters, chi2);
+    }
+
+    void set_verbosity(verbosityLevel verbosity) {verbosity_ = verbosity;}
+    verbosityLevel get_verbosity() const {return verbosity_;}
+    void set_callback(const Tcallback &callback) {callback_ = callback;}
+    const Tcallback& get_callback() const {return callback_;}
+    const std::vector<IterationRecord>& get_records() const {return records_;}
+
+protected:
+    void print_summary(const char *solver, const char *message, uint_t iters, matData_t chi2) const;
+    void print_record(const IterationRecord &record) const;
+
+    verbosityLevel verbosity_;
+    Tcallback callback_;
+    std::vector<IterationRecord> records_;
+};
+
+}
+
+#endif /* ITERATION_LOG_HPP_ */
@@ -0,0 +1,378 @@
+/* Copyright (c) 2022, Gonzalo Ferrer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * kd_tree.hpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Gonzalo Ferrer
+ *              g.ferrer@skoltech.ru
+ *              Mobile Robotics Lab, Skoltech
+ */
+
+#ifndef KD_TREE_HPP_
+#define KD_TREE_HPP_
+
+#include "mrob/matrix_base.hpp"
+#include "mrob/parallel.hpp"
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <cassert>
+
+namespace mrob{
+
+/**
+ * Class BasicKDTree is a static k-d tree of 3D points for nearest neighbour,
+ * k nearest neighbours and radius searches.
+ *
+ * The tree is built once from an array of points Nx3, which are copied in the
+ * order of the leaves, so points of a leaf are contiguous in memory. Each node
+ * splits its points by the median of the dimension with the largest extent, until
+ * leaves have at most leafSize points. Since splits are by the median, the layout
+ * of the nodes only depends on N, so the subtrees below the first levels are built
+ * in parallel and the result does not depend on the number of threads.
+ *
+ * Queries are const and do not allocate (except their outputs), so they can be
+ * run concurrently from several threads. The batch_ methods distribute the queries
+ * of an array over threads. Indices are always of the input array.
+ *
+ * Scalar is the type of the points and distances: KDTree for matData_t and
+ * KDTreeFloat for single precision point clouds.
+ */
+template<typename Scalar>
+class BasicKDTree
+{
+public:
+    using Point = Eigen::Matrix<Scalar, 3, 1>;
+    using PointsRefConst = const Eigen::Ref<const MatXT<Scalar>>;
+    // index returned by batch_nearest() for queries without neighbour
+    static constexpr uint_t npos = std::numeric_limits<uint_t>::max();
+
+    /**
+     * Builds the tree on numThreads threads (0 for all hardware threads)
+     */
+    BasicKDTree(PointsRefConst points, uint_t leafSize = 16, uint_t numThreads = 0);
+    ~BasicKDTree() = default;
+
+    /**
+     * Nearest point to q closer than sqrt(maxDistance2). Returns false if there is none,
+     * otherwise its index and squared distance.
+     */
+    bool nearest(const Point &q, Scalar maxDistance2, uint_t &index, Scalar &distance2) const;
+    /**
+     * The k nearest points to q, sorted by distance. If the tree has less than k points, all of them.
+     */
+    void knn(const Point &q, uint_t k, std::vector<uint_t> &indices, std::vector<Scalar> &distances2) const;
+    /**
+     * All points at a distance from q lower or equal than radius, in no particular order.
+     */
+    void radius(const Point &q, Scalar radius, std::vector<uint_t> &indices, std::vector<Scalar> &distances2) const;
+
+    /**
+     * Nearest point of each row of Q (Mx3). Queries without a point closer than
+     * sqrt(maxDistance2) have index npos and infinite distance.
+     */
+    void batch_nearest(PointsRefConst Q, Scalar maxDistance2, std::vector<uint_t> &indices,
+                       std::vector<Scalar> &distances2, uint_t numThreads = 0) const;
+    /**
+     * k nearest points of each row of Q (Mx3), as row major arrays M x min(k, size()).
+     */
+    void batch_knn(PointsRefConst Q, uint_t k, std::vector<uint_t> &indices,
+                   std::vector<Scalar> &distances2, uint_t numThreads = 0) const;
+    /**
+     * Points within radius of each row of Q (Mx3)
+     */
+    void batch_radius(PointsRefConst Q, Scalar radius, std::vector<std::vector<uint_t>> &indices,
+                      uint_t numThreads = 0) const;
+
+    uint_t size() const {return indices_.size();}
+
+protected:
+    struct Node
+    {
+        uint_t begin, end; // range of points in the node
+        uint_t left, right; // children, 0 for leaves (the root is never a child)
+        uint_t dim;
+        Scalar split;
+    };
+    // nodes pending to visit and the squared distance from the query to their splitting plane.
+    // Splits are by the median, so the depth of the tree (and of the stack) is below 32
+    struct StackEntry
+    {
+        uint_t node;
+        Scalar distance2;
+    };
+    static constexpr uint_t maxStack_ = 64;
+    static constexpr uint_t batchSize_ = 1024;
+
+    /**
+     * Number of nodes of a subtree of n points, which are stored consecutively:
+     * the node, its left subtree and its right subtree.
+     */
+    uint_t count_nodes(uint_t n) const;
+    /**
+     * Builds the subtree of node id. Subtrees at depth levels below are not built but
+     * added to pending, if not null.
+     */
+    void build(uint_t id, uint_t begin, uint_t end, PointsRefConst points,
+               uint_t depth, std::vector<Node> *pending);
+    /**
+     * Visits the leaves closer to q than bound(), calling visit(i, d2) for each of their points
+     */
+    template<typename Bound, typename Visit>
+    void traverse(const Point &q, Bound bound, Visit visit) const;
+
+    uint_t leafSize_;
+    MatXT<Scalar> points_; // points in the order of the leaves
+    std::vector<uint_t> indices_; // index in the input array of each point
+    std::vector<Node> nodes_;
+};
+
+using KDTree = BasicKDTree<matData_t>;
+using KDTreeFloat = BasicKDTree<float>;
+
+
+
+template<typename Scalar>
+constexpr uint_t BasicKDTree<Scalar>::npos;
+
+template<typename Scalar>
+BasicKDTree<Scalar>::BasicKDTree(PointsRefConst points, uint_t leafSize, uint_t numThreads) :
+        leafSize_(std::max(leafSize, 1u))
+{
+    assert(points.cols() == 3 && "KDTree: Nx3 input is required");
+    const uint_t N = points.rows();
+    indices_.resize(N);
+    std::iota(indices_.begin(), indices_.end(), 0);
+    nodes_.resize(this->count_nodes(N));
+
+    // the first levels are split sequentially, until there are a few subtrees for each thread
+    uint_t threads = get_number_threads(numThreads);
+    uint_t depth = 0;
+    while (threads > 1 && (1u << depth) < 4 * threads && depth < 16)
+        depth++;
+    std::vector<Node> pending;
+    this->build(0, 0, N, points, depth, &pending);
+    // pending subtrees are stored with their root id in left
+    parallel_for(pending.size(), numThreads, [&](uint_t s)
+    {
+        this->build(pending[s].left, pending[s].begin, pending[s].end, points, 0, nullptr);
+    });
+
+    // points are stored in the order of the leaves
+    points_.resize(N, 3);
+    parallel_for((N + batchSize_ - 1) / batchSize_, numThreads, [&](uint_t task)
+    {
+        for (uint_t i = task * batchSize_; i < std::min(N, (task + 1) * batchSize_); ++i)
+            points_.row(i) = points.row(indices_[i]);
+    });
+}
+
+template<typename Scalar>
+uint_t BasicKDTree<Scalar>::count_nodes(uint_t n) const
+{
+    if (n <= leafSize_)
+        return 1;
+    return 1 + this->count_nodes(n / 2) + this->count_nodes(n - n / 2);
+}
+
+template<typename Scalar>
+void BasicKDTree<Scalar>::build(uint_t id, uint_t begin, uint_t end, PointsRefConst points,
+                                uint_t depth, std::vector<Node> *pending)
+{
+    if (pending && depth == 0)
+    {
+        pending->push_back(Node{begin, end, id, 0, 0, 0});
+        return;
+    }
+    Node &node = nodes_[id];
+    node = Node{begin, end, 0, 0, 0, 0};
+    if (end - begin <= leafSize_)
+        return;
+
+    // split by the median of the dimension with the largest extent
+    Eigen::Matrix<Scalar, 1, 3> minPoint = points.row(indices_[begin]), maxPoint = minPoint;
+    for (uint_t i = begin + 1; i < end; ++i)
+    {
+        minPoint = minPoint.cwiseMin(points.row(indices_[i]));
+        maxPoint = maxPoint.cwiseMax(points.row(indices_[i]));
+    }
+    uint_t dim;
+    (maxPoint - minPoint).maxCoeff(&dim);
+    uint_t mid = begin + (end - begin) / 2;
+    std::nth_element(indices_.begin() + begin, indices_.begin() + mid, indices_.begin() + end,
+            [&](uint_t a, uint_t b){return points(a, dim) < points(b, dim);});
+
+    // the split is read before the children reorder their ranges
+    node.left = id + 1;
+    node.right = id + 1 + this->count_nodes(mid - begin);
+    node.dim = dim;
+    node.split = points(indices_[mid], dim);
+    this->build(node.left, begin, mid, points, depth - 1, pending);
+    this->build(node.right, mid, end, points, depth - 1, pending);
+}
+
+template<typename Scalar>
+template<typename Bound, typename Visit>
+void BasicKDTree<Scalar>::traverse(const Point &q, Bound bound, Visit visit) const
+{
+    StackEntry stack[maxStack_];
+    uint_t top = 0;
+    stack[top++] = StackEntry{0, 0};
+    while (top > 0)
+    {
+        const StackEntry entry = stack[--top];
+        if (entry.distance2 > bound())
+            continue;
+        const Node &node = nodes_[entry.node];
+        if (node.left == 0)
+        {
+            for (uint_t i = node.begin; i < node.end; ++i)
+                visit(i, (points_.row(i).transpose() - q).squaredNorm());
+            continue;
+        }
+        // the far side is pushed first, so the near side is visited first
+        Scalar diff = q(node.dim) - node.split;
+        uint_t nearNode = diff < 0 ? node.left : node.right;
+        uint_t farNode = diff < 0 ? node.right : node.left;
+        stack[top++] = StackEntry{farNode, diff * diff};
+        stack[top++] = StackEntry{nearNode, entry.distance2};
+    }
+}
+
+template<typename Scalar>
+bool BasicKDTree<Scalar>::nearest(const Point &q, Scalar maxDistance2, uint_t &index, Scalar &distance2) const
+{
+    bool found = false;
+    Scalar best = maxDistance2;
+    this->traverse(q, [&](){return best;}, [&](uint_t i, Scalar d2)
+    {
+        if (d2 < best)
+        {
+            best = d2;
+            index = indices_[i];
+            found = true;
+        }
+    });
+    if (found)
+        distance2 = best;
+    return found;
+}
+
+template<typename Scalar>
+void BasicKDTree<Scalar>::knn(const Point &q, uint_t k, std::vector<uint_t> &indices, std::vector<Scalar> &distances2) const
+{
+    k = std::min<uint_t>(k, indices_.size());
+    indices.clear();
+    distances2.clear();
+    if (k == 0)
+        return;
+    indices.reserve(k);
+    distances2.reserve(k);
+    // current k nearest, sorted by distance
+    auto worst = [&]()
+    {
+        return distances2.size() < k ? std::numeric_limits<Scalar>::infinity() : distances2.back();
+    };
+    this->traverse(q, worst, [&](uint_t i, Scalar d2)
+    {
+        if (d2 >= worst())
+            return;
+        if (distances2.size() == k)
+        {
+            distances2.pop_back();
+            indices.pop_back();
+        }
+        auto pos = std::upper_bound(distances2.begin(), distances2.end(), d2) - distances2.begin();
+        distances2.insert(distances2.begin() + pos, d2);
+        indices.insert(indices.begin() + pos, indices_[i]);
+    });
+}
+
+template<typename Scalar>
+void BasicKDTree<Scalar>::radius(const Point &q, Scalar radius, std::vector<uint_t> &indices, std::vector<Scalar> &distances2) const
+{
+    indices.clear();
+    distances2.clear();
+    const Scalar radius2 = radius * radius;
+    this->traverse(q, [&](){return radius2;}, [&](uint_t i, Scalar d2)
+    {
+        if (d2 <= radius2)
+        {
+            indices.push_back(indices_[i]);
+            distances2.push_back(d2);
+        }
+    });
+}
+
+template<typename Scalar>
+void BasicKDTree<Scalar>::batch_nearest(PointsRefConst Q, Scalar maxDistance2, std::vector<uint_t> &indices,
+                                        std::vector<Scalar> &distances2, uint_t numThreads) const
+{
+    const uint_t M = Q.rows();
+    indices.resize(M);
+    distances2.resize(M);
+    parallel_for((M + batchSize_ - 1) / batchSize_, numThreads, [&](uint_t task)
+    {
+        for (uint_t i = task * batchSize_; i < std::min(M, (task + 1) * batchSize_); ++i)
+        {
+            if (!this->nearest(Q.row(i).transpose(), maxDistance2, indices[i], distances2[i]))
+            {
+                indices[i] = npos;
+                distances2[i] = std::numeric_limits<Scalar>::infinity();
+            }
+        }
+    });
+}
+
+template<typename Scalar>
+void BasicKDTree<Scalar>::batch_knn(PointsRefConst Q, uint_t k, std::vector<uint_t> &indices,
+                                    std::vector<Scalar> &distances2, uint_t numThreads) const
+{
+    const uint_t M = Q.rows();
+    k = std::min<uint_t>(k, indices_.size());
+    indices.resize(M * k);
+    distances2.resize(M * k);
+    parallel_for((M + batchSize_ - 1) / batchSize_, numThreads, [&](uint_t task)
+    {
+        std::vector<uint_t> idx;
+        std::vector<Scalar> d2;
+        for (uint_t i = task * batchSize_; i < std::min(M, (task + 1) * batchSize_); ++i)
+        {
+            this->knn(Q.row(i).transpose(), k, idx, d2);
+            std::copy(idx.begin(), idx.end(), indices.begin() + i * k);
+            std::copy(d2.begin(), d2.end(), distances2.begin() + i * k);
+        }
+    });
+}
+
+template<typename Scalar>
+void BasicKDTree<Scalar>::batch_radius(PointsRefConst Q, Scalar radius, std::vector<std::vector<uint_t>> &indices,
+                                       uint_t numThreads) const
+{
+    const uint_t M = Q.rows();
+    indices.resize(M);
+    parallel_for((M + batchSize_ - 1) / batchSize_, numThreads, [&](uint_t task)
+    {
+        std::vector<Scalar> d2;
+        for (uint_t i = task * batchSize_; i < std::min(M, (task + 1) * batchSize_); ++i)
+            this->radius(Q.row(i).transpose(), radius, indices[i], d2);
+    });
+}
+
+}
+
+#endif /* KD_TREE_HPP_ */
@@ -77,10 +77,24 @@ using Vect = Eigen::Matrix<matData_t, D,1, Eigen::RowMajor>;
 template<int Rw,int Col>
 using Mat = Eigen::Matrix<matData_t, Rw, Col, Eigen::RowMajor>;
 
+// Arrays of points templated on the scalar type. Point clouds from sensors are usually
+// single precision, which are processed as they are, while reductions over the points
+// (Hessians, covariances) are still calculated in matData_t
+template<typename Scalar>
+using MatXT = Eigen::Matrix<Scalar, Eigen::Dynamic,Eigen::Dynamic, Eigen::RowMajor>;
+template<typename Scalar>
+using MatX1T = Eigen::Matrix<Scalar, Eigen::Dynamic,1>;
+using MatXf = MatXT<float>;
+using MatX1f = MatX1T<float>;
+
 // Definition of Ref Eigen
 //we might need this for aligment requirements: Eigen::Ref<const MatX1, Eigen::AlignmentType::Aligned16>
 using VectRefConst = const Eigen::Ref<const MatX1>;
 using MatRefConst = const Eigen::Ref<const MatX>;
+using VectfRefConst = const Eigen::Ref<const MatX1f>;
+using MatfRefConst = const Eigen::Ref<const MatXf>;
+using MatRef = Eigen::Ref<MatX>;
+using MatfRef = Eigen::Ref<MatXf>;
 
 }//end of namespace
 
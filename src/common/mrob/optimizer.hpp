@@ -25,9 +25,94 @@
 #define OPTIMIZER_HPP_
 
 #include "mrob/matrix_base.hpp"
+#include "mrob/iteration_log.hpp"
+#include "mrob/sparse_ldlt.hpp"
+#include <Eigen/Cholesky>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <algorithm>
 
 namespace mrob{
 
+/**
+ * Class TrustRegion keeps the damping lambda of Levenberg-Marquardt and its
+ * trust region update as described in Bertsekas (p.105). Given the fidelity of the
+ * quadratized model m_k at the proposed step dx,
+ *
+ *     f = (err(x_k) - err(x_k + dx)) / (err(x_k) - m_k(dx)),
+ *
+ * the region grows (lambda decreases) if f > sigma2, and shrinks if f < sigma1
+ * or the step is rejected.
+ */
+class TrustRegion
+{
+public:
+    TrustRegion(matData_t lambda = 1e-5);
+    ~TrustRegion() = default;
+
+    void reset(matData_t lambda) {lambda_ = lambda;}
+    matData_t get_lambda() const {return lambda_;}
+    /**
+     * Damped diagonal element d of the Hessian, spherical d + lambda or elliptical (1 + lambda) d
+     */
+    matData_t damp(matData_t d, bool elliptical) const {return elliptical ? (1.0 + lambda_) * d : d + lambda_;}
+    /**
+     * The step did not improve the error, the region shrinks
+     */
+    void reject() {lambda_ *= beta1_;}
+    /**
+     * The step improved the error, the region is updated given the model fidelity
+     */
+    void accept(matData_t modelFidelity);
+
+protected:
+    matData_t lambda_;
+    // sigma reference to the fidelity of the model at the proposed solution, 0 < sigma1 < sigma2 < 1
+    matData_t sigma1_, sigma2_;
+    // lambda updates multiplier values, beta1 > 1 > beta2 > 0
+    matData_t beta1_, beta2_;
+};
+
+
+/**
+ * Class Dogleg calculates Powell's dogleg step and updates its trust region radius.
+ * The step is the Gauss-Newton step if it is inside the region, the Cauchy step
+ * (minimum of the model along the gradient) truncated at the radius if it is
+ * outside, or otherwise the point at the radius on the segment between both.
+ *
+ * After a rejected step only the radius changes, so a new step is calculated from
+ * the same Gauss-Newton and Cauchy steps, without factorizing again.
+ */
+class Dogleg
+{
+public:
+    Dogleg();
+    ~Dogleg() = default;
+
+    /**
+     * The radius is initialized by the norm of the first Gauss-Newton step
+     */
+    void reset() {radius_ = 0.0;}
+    matData_t get_radius() const {return radius_;}
+    /**
+     * Calculates the dogleg step, any sign convention is valid as long as both steps have the same.
+     */
+    void step(const MatX1 &gaussNewton, const MatX1 &cauchy, MatX1 &step);
+    /**
+     * The step did not improve the error, the radius is reduced below the norm of the step
+     */
+    void reject(matData_t stepNorm) {radius_ = 0.5 * stepNorm;}
+    /**
+     * The step improved the error, the radius is updated from the model fidelity
+     */
+    void accept(matData_t modelFidelity, matData_t stepNorm);
+
+protected:
+    matData_t radius_;
+};
+
+
 /**
  * The class optimizer provides a level of abstraction for solving
  * second order optimization problems of the form:
@@ -44,6 +129,18 @@ namespace mrob{
  *         x' = x - (H + lambda * I)^-1 * gradient
  *  - Levenberg-Marquardt: Elliptical approximation
  *         x' = x - (H + lambda * D)^-1 * gradient, where D = diag(H)
+ *  - Powell's Dogleg: combination of the Newton and Cauchy steps inside a trust region (see Dogleg)
+ *  - Newton-Raphson with line search: x' = x - alpha (Hessian)^-1 * Gradient, where
+ *         alpha = 1, 1/2, 1/4... is the first that satisfies the Armijo condition
+ *  - L-BFGS, first order: x' = x - alpha * B * Gradient, where B approximates the inverse
+ *         of the Hessian from the last steps and changes of gradient
+ *  - Nonlinear conjugate gradient (Polak-Ribiere+), first order
+ *
+ *  First order methods only evaluate the gradient (see calculate_gradient()) and
+ *  alpha satisfies the strong Wolfe conditions.
+ *
+ *  All methods may run against a deadline (anytime solve): an iteration only starts
+ *  if it is expected to finish on time, from the time of the previous iterations.
  *
  *  given the following requirements:
  *  - C(x): a Cost function
@@ -58,19 +155,82 @@ public:
 	 *  - NR: Newton-Raphson (Gauss_newtow is a variant with approximations in the Hessian)
 	 *  - LM_S: Levenberg Marquardt: Spherical
 	 *  - LM_E: Levenberg Marquardt: Eliptical
+	 *  - DOGLEG: Powell's Dogleg
+	 *  - NR_LS: Newton-Raphson with backtracking line search
+	 *  - LBFGS: limited memory BFGS
+	 *  - NCG: nonlinear conjugate gradient
+	 */
+	enum optimMethod{NEWTON_RAPHSON=0, LEVENBERG_MARQUARDT_SPHER, LEVENBERG_MARQUARDT_ELLIP, DOGLEG, NEWTON_RAPHSON_LINE_SEARCH,
+	                 LBFGS, NONLINEAR_CG};
+	/**
+	 * Status of the last solve:
+	 *  - Converged: the decrease of the error is below the solution tolerance
+	 *  - Budget exhausted: the maximum number of iterations is reached, or there is no time for another iteration
+	 *  - Diverged: the step could not be calculated or it does not decrease the error (see solve())
+	 *  - Stopped: the iteration callback requested to stop (see set_iteration_callback())
 	 */
-	enum optimMethod{NEWTON_RAPHSON=0, LEVENBERG_MARQUARDT_SPHER, LEVENBERG_MARQUARDT_ELLIP};
+	enum solveStatus{CONVERGED=0, BUDGET_EXHAUSTED, DIVERGED, STOPPED};
+	using Tdeadline = std::chrono::steady_clock::time_point;
     Optimizer(matData_t solutionTolerance = 1e-4, matData_t lambda = 1e-5);
     virtual ~Optimizer();
 
     /**
      * Optimization call.
-     * Input: optmization method from {NR=0, LM_S, LM_E}
+     * Input: optmization method from {NR=0, LM_S, LM_E, DOGLEG, NR_LS, LBFGS, NCG}
      *       - max_iterations
      *       - lambda: initial value of lambda for LM methods
+     *       - deadline: no iteration starts if it is not expected to finish before it
      * output: number of iterations
+     *         0 if Newton-Raphson, Dogleg or the line search find a rank deficient Hessian,
+     *         a Newton-Raphson or Dogleg step has an error that is not a finite number (it is undone)
+     *         or the line search does not find a step that decreases the error. Then the status is DIVERGED.
+     *
+     * Steps rejected by LM, Dogleg and the line searches are undone, LM increases lambda
+     * when the step can not be calculated. Newton-Raphson steps are not checked for a decrease.
+     */
+    uint_t solve(optimMethod method, uint_t max_iters = 1e2, double lambda = 1e-5,
+            Tdeadline deadline = Tdeadline::max());
+    /**
+     * Returns the status of the last solve
+     */
+    solveStatus get_status() const {return status_;}
+    /**
+     * Returns the number of iterations of the last solve, including those not converged
+     */
+    uint_t get_iterations() const {return iterations_;}
+    /**
+     * Returns the estimated time (in microseconds) of one iteration, calculated from
+     * the last solve. It is 0 before any solve.
+     */
+    matData_t get_iteration_time() const {return iterationTime_;}
+
+    /**
+     * Level of messages printed by the optimizer, SUMMARY by default (see IterationLog)
+     */
+    void set_verbosity(IterationLog::verbosityLevel verbosity) {log_.set_verbosity(verbosity);}
+    /**
+     * Records of each iteration of the last solve: lambda, error, its decrease, model fidelity,
+     * norm of the step and the time spent building the problem, factorizing, solving the step
+     * (and the rest of the iteration) and evaluating the error.
+     */
+    const std::vector<IterationRecord>& get_iteration_records() const {return log_.get_records();}
+    /**
+     * Sets a function called after each iteration with its record. If it returns true, the optimizer
+     * stops (with the status STOPPED) keeping the best state found so far.
+     * An empty function removes the callback.
+     */
+    void set_iteration_callback(const IterationLog::Tcallback &callback) {log_.set_callback(callback);}
+    /**
+     * Number of pairs (step, change of gradient) kept by L-BFGS, 10 by default
+     */
+    void set_lbfgs_memory(uint_t memory) {lbfgsMemory_ = std::max<uint_t>(memory, 1);}
+    /**
+     * Constants of the strong Wolfe conditions in the line search of first order methods,
+     * sufficient decrease c1 and curvature c2, with 0 < c1 < c2 < 1. By default c1 = 1e-4, and
+     * c2 = 0.9 for L-BFGS and 0.1 for nonlinear CG, which requires a more accurate line search.
      */
-    uint_t solve(optimMethod method, uint_t max_iters = 1e2, double lambda = 1e-5);
+    void set_wolfe_conditions(matData_t c1 = 1e-4, matData_t c2LBFGS = 0.9, matData_t c2CG = 0.1)
+            {wolfeC1_ = c1; wolfeC2LBFGS_ = c2LBFGS; wolfeC2CG_ = c2CG;}
 
     /**
      * General abstract functions to implement:
@@ -87,6 +247,12 @@ public:
      *    inside the update_bookkeep_state which will have invalid residuals and need update (less prefered option)
      */
     virtual void calculate_gradient_hessian() = 0;
+    /**
+     * Gradient only, for first order methods. It is called right after calculate_error()
+     * at the same state. By default it also calculates the Hessian, so derived classes
+     * with an expensive Hessian should override it.
+     */
+    virtual void calculate_gradient() {this->calculate_gradient_hessian();}
     /**
      * Updates the current solution
      */
@@ -116,9 +282,45 @@ protected:
     uint_t optimize_newton_raphson();
 
     /**
-     * One iteration of the RN method
+     * One iteration of the RN method.
+     * Returns 0 if the step could not be calculated, then the state is not updated.
+     */
+    uint_t optimize_newton_raphson_one_iteration(bool useLambda = false);
+    /**
+     * Builds the problem (gradient and Hessian) and calculates the step
+     *     dx = - (Hessian + lambda * D)^-1 * gradient
+     * without updating the state. Returns false if the step could not be calculated.
+     */
+    virtual bool calculate_newton_step(bool useLambda = false) = 0;
+    /**
+     * Product of the current Hessian (with the damping of the last step, if any) by v
+     */
+    virtual void hessian_product(const MatX1 &v, MatX1 &Hv) = 0;
+    /**
+     * LM step after a rejected one, at the same linearization point and with the state book-kept.
+     * By default it is the Newton step damped by the current lambda. Derived classes may try several
+     * lambdas at once, leaving at dx_ and trustRegion_ those of the chosen step.
+     *
+     * On input, error is the error at the current state. On success, the state is updated by dx_
+     * and error is the error after the step, so it is not evaluated again.
+     * Returns false if no step could be calculated, then the state is not modified.
+     */
+    virtual bool calculate_speculative_step(matData_t &error);
+
+    /**
+     * Returns true if an iteration, as estimated by iterationTime_, finishes before the deadline
+     */
+    bool iteration_fits() const;
+    /**
+     * Evaluates the error, its time is added to the current iteration
      */
-    virtual uint_t optimize_newton_raphson_one_iteration(bool useLambda = false) = 0;
+    matData_t evaluate_error();
+    /**
+     * Adds the record of the iteration, with the time of each phase since the last record, and
+     * updates the number of iterations and the time per iteration. Returns true if the callback requested to stop.
+     */
+    bool add_record(uint_t iter, matData_t lambda, matData_t error, matData_t diffError,
+            matData_t modelFidelity, matData_t stepNorm, bool accepted);
 
     /**
      * Levenberg-Marquardt method, inside will distinguish between elliptic and spherical
@@ -129,13 +331,45 @@ protected:
     uint_t optimize_levenberg_marquardt();
 
     /**
-     * calculate_model_fidely returns the difference between the quadratized
-     * model and the current error, as required for the LM algorithm.
+     * Powell's Dogleg. The problem is only built and factorized after an accepted step
+     */
+    uint_t optimize_dogleg();
+
+    /**
+     * Newton-Raphson with backtracking line search, halving the step
+     * until the Armijo condition (sufficient decrease) is satisfied
+     */
+    uint_t optimize_newton_raphson_line_search();
+
+    /**
+     * L-BFGS, the direction is calculated by the two-loop recursion over the memory.
+     * The memory is cleared if the line search fails, and it fails again from the gradient.
+     */
+    uint_t optimize_lbfgs();
+    void lbfgs_direction();
+
+    /**
+     * Nonlinear conjugate gradient, Polak-Ribiere+ update with restarts when
+     * the direction is not a descent direction.
+     */
+    uint_t optimize_nonlinear_cg();
+
+    /**
+     * Line search along direction_ from the current state, with error and gradient_
+     * already evaluated, starting at step alpha. It finds a step satisfying the strong
+     * Wolfe conditions with c1 (see set_wolfe_conditions()) and c2 (Nocedal and Wright, Alg. 3.5 and 3.6).
      *
-     * This is a an abstrct class since the hessian matrix might be different
-     * for the sparse and the dense case
+     * On success, the state is updated by dx_ = alpha * direction_ and error and gradient_
+     * correspond to it. Otherwise the state is restored and it returns false.
+     * The gradient at the start is kept at previousGradient_.
      */
-    virtual matData_t calculate_model_fidelity(matData_t diff_error) = 0;
+    bool line_search_wolfe(matData_t &error, matData_t alpha, matData_t c2);
+
+    /**
+     * calculate_model_fidely returns the ratio between the error decrease and the
+     * one predicted by the quadratized model at dx_, as required for the LM algorithm.
+     */
+    matData_t calculate_model_fidelity(matData_t diff_error);
 
 
     optimMethod optimization_method_ {};
@@ -143,9 +377,31 @@ protected:
     uint_t max_iters_;
     MatX1 gradient_, dx_;
 
-    // Necessary for LM, Other LM parameters are set to default (see .cpp)
-    matData_t lambda_;
+    // Necessary for LM, damping and update of lambda
+    TrustRegion trustRegion_;
+    // true after LM rejects a step and restores the state, so the last gradient and Hessian are still valid
+    bool reuseLinearization_;
+    // Dogleg radius and steps, Hessian products
+    Dogleg dogleg_;
+    MatX1 dxNewton_, dxCauchy_, Hv_;
+    // First order methods: search direction, gradient before the line search, constants of the
+    // Wolfe conditions and L-BFGS memory, a circular buffer of steps s, changes of gradient y and rho = 1/(y's)
+    MatX1 direction_, previousGradient_;
+    matData_t wolfeC1_, wolfeC2LBFGS_, wolfeC2CG_;
+    uint_t lbfgsMemory_, lbfgsSize_, lbfgsNewest_;
+    std::vector<MatX1> lbfgsS_, lbfgsY_;
+    std::vector<matData_t> lbfgsRho_, lbfgsAlpha_;
 
+    // records of the last solve, verbosity and user callback, and times of each phase of the current iteration
+    IterationLog log_;
+    IterationRecord phaseTimes_;
+
+    // Anytime solve: deadline, start and status of the last solve, cost per iteration in microseconds
+    Tdeadline deadline_;
+    std::chrono::steady_clock::time_point solveStart_;
+    solveStatus status_;
+    uint_t iterations_;
+    matData_t iterationTime_;
 };
 
 class OptimizerDense : public Optimizer
@@ -154,16 +410,102 @@ class OptimizerDense : public Optimizer
     OptimizerDense(matData_t solutionTolerance = 1e-4, matData_t lambda = 1e-5);
     virtual ~OptimizerDense();
   protected:
-    uint_t optimize_newton_raphson_one_iteration(bool useLambda = false);
-    matData_t calculate_model_fidelity(matData_t diff_error);
+    /**
+     * The step is solved by a Cholesky factorization of the Hessian, on a
+     * workspace that is reused while the dimension does not change.
+     * It fails if the Hessian is not positive definite or it is numerically
+     * rank deficient, i.e., the ratio of pivots is below sqrt(n * eps).
+     */
+    bool calculate_newton_step(bool useLambda = false) override;
+    void hessian_product(const MatX1 &v, MatX1 &Hv) override;
     MatX hessian_;
+    Eigen::LLT<MatX> cholesky_;
 };
 
 
+/**
+ * Class OptimizerSparse is the second order engine for sparse problems.
+ * Derived classes only assemble the gradient and the Hessian, a symmetric
+ * sparse matrix storing both triangular parts (only the lower part is read)
+ * and always including the diagonal, and update the state.
+ *
+ * The symbolic factorization (ordering and elimination tree) is cached and only
+ * calculated again when the pattern of the Hessian changes, so each iteration
+ * is a numerical factorization on preallocated memory. Damping is applied on
+ * the diagonal values, saved before, so the Hessian can be damped again with
+ * a different lambda without being assembled again.
+ */
 class OptimizerSparse: public Optimizer
 {
+  public:
+    OptimizerSparse(matData_t solutionTolerance = 1e-4, matData_t lambda = 1e-5);
+    virtual ~OptimizerSparse();
+    /**
+     * Speculative LM: after a rejected step, numLambdas candidates lambda * beta1^k (k = 0, 1...)
+     * are factorized concurrently on up to numThreads threads (0 for all hardware threads),
+     * sharing the symbolic decomposition, and the step with the lowest error is taken.
+     * The errors of the candidates are evaluated one after another, since all of them update
+     * the same state (see update_state()), so only the factorizations run in parallel.
+     * If none improves, lambda continues from the largest candidate.
+     * With numLambdas = 1 (default), lambda is increased once per iteration.
+     */
+    void set_speculative_lambdas(uint_t numLambdas, uint_t numThreads = 0)
+            {speculativeLambdas_ = std::max<uint_t>(numLambdas, 1); speculativeThreads_ = numThreads;}
+    /**
+     * Mixed precision: the Hessian H is factorized in single precision, with half of the memory of the factor,
+     * and the step is refined on the double precision system, dx += H_float^-1 (g - H dx), until
+     * |g - H dx| <= tolerance * |H|_F * |dx| or after maxRefinements corrections. If the single precision
+     * factor is not full rank or the refinement does not reach the tolerance, H is factorized in double
+     * precision. Speculative LM candidates are always factorized in double precision.
+     */
+    void set_mixed_precision(bool enable, uint_t maxRefinements = 5, matData_t tolerance = 1e-14)
+            {mixedPrecision_ = enable; maxRefinements_ = maxRefinements; refinementTolerance_ = tolerance;}
   protected:
-    MatX hessian_;
+    /**
+     * The step is solved by the sparse LDLT. It fails if the Hessian is not positive
+     * definite or it is numerically rank deficient (see SparseLDLT::is_full_rank()).
+     */
+    bool calculate_newton_step(bool useLambda = false) override;
+    void hessian_product(const MatX1 &v, MatX1 &Hv) override;
+    /**
+     * Speculative LM step (see set_speculative_lambdas()). Candidates are factorized and solved
+     * in parallel, and their errors evaluated sequentially, since they share the state.
+     * On return, hessian_ is damped by the lambda of the chosen candidate, and the state is
+     * that of the candidate, which is only updated again if it was not the last one evaluated.
+     */
+    bool calculate_speculative_step(matData_t &error) override;
+    /**
+     * Factorizes the Hessian in single precision and solves the system by iterative refinement
+     * (see set_mixed_precision()). Returns false if the refinement fails, then dx_ is not valid.
+     */
+    bool solve_mixed_precision();
+    /**
+     * Analyzes the pattern of the Hessian if it is not the one analyzed before.
+     * Only the factorization in use is analyzed and keeps its memory. The steps of
+     * each method are sized to the Hessian, so iterations do not allocate.
+     */
+    void update_pattern();
+
+    SMatCol hessian_;
+    SparseLDLT cholesky_;
+    // pattern analyzed and position of the diagonal elements on the values of hessian_
+    std::vector<SMatCol::StorageIndex> analyzedOuter_, analyzedInner_, diagIndex_;
+    MatX1 diagHessian_;
+
+    // Mixed precision, single precision factorization and buffers of the refinement
+    SparseLDLTFloat choleskyFloat_;
+    bool mixedPrecision_;
+    uint_t maxRefinements_;
+    matData_t refinementTolerance_;
+    MatX1 refinementResidual_, refinementCorrection_;
+
+    // Speculative LM: damped copies of the Hessian, factorizations and steps of each candidate lambda
+    uint_t speculativeLambdas_, speculativeThreads_;
+    std::vector<SMatCol> speculativeHessian_;
+    std::vector<std::unique_ptr<SparseLDLT>> speculativeCholesky_;
+    std::vector<MatX1> speculativeDx_;
+    std::vector<TrustRegion> speculativeRegions_;
+    std::vector<uint8_t> speculativeSuccess_;
 };
 
 
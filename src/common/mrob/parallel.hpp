@@ -0,0 +1,49 @@
+/* Copyright (c) 2022, Gonzalo Ferrer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * parallel.hpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Gonzalo Ferrer
+ *              g.ferrer@skoltech.ru
+ *              Mobile Robotics Lab, Skoltech
+ */
+
+#ifndef PARALLEL_HPP_
+#define PARALLEL_HPP_
+
+#include "mrob/matrix_base.hpp"
+#include <functional>
+
+namespace mrob {
+
+/**
+ * Returns the number of threads to be used: numThreads, or the
+ * number of hardware threads if numThreads is 0.
+ */
+uint_t get_number_threads(uint_t numThreads = 0);
+
+/**
+ * Calls function(i) for each i in [0, n), distributing the indices dynamically
+ * over numThreads threads (0 for all hardware threads). The calling thread is
+ * one of them, so with numThreads = 1 or n = 1 no thread is created.
+ *
+ * Calls with different indices must be independent. It returns when all calls have finished.
+ */
+void parallel_for(uint_t n, uint_t numThreads, const std::function<void(uint_t)> &function);
+
+}
+
+#endif /* PARALLEL_HPP_ */
@@ -0,0 +1,123 @@
+/* Copyright (c) 2022, Gonzalo Ferrer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * sparse_ldlt.hpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Gonzalo Ferrer
+ *              g.ferrer@skoltech.ru
+ *              Mobile Robotics Lab, Skoltech
+ */
+
+#ifndef SPARSE_LDLT_HPP_
+#define SPARSE_LDLT_HPP_
+
+#include "mrob/matrix_base.hpp"
+#include <Eigen/SparseCholesky>
+#include <vector>
+
+namespace mrob {
+
+/**
+ * Class BasicSparseLDLT is a sparse Cholesky LDLT decomposition for repeated
+ * factorizations of matrices with the same sparsity pattern.
+ *
+ * Eigen::SimplicialLDLT::factorize() builds a permuted copy of the input
+ * matrix on every call. Here the AMD ordering and the permuted (upper) pattern
+ * are calculated once in analyze_pattern(), together with a map from the
+ * input values to the permuted ones. After that, factorize() and solve()
+ * work on preallocated memory only.
+ *
+ * The input is a symmetric matrix storing both triangular parts (only the
+ * lower part is read), as FGraphSolve does for the information matrix.
+ * Input and solution are always matData_t, while the factor is stored and
+ * calculated in Scalar, which allows a single precision factorization
+ * (SparseLDLTFloat) of the double precision information matrix.
+ *
+ * Working on the preallocated permuted matrix requires protected members of
+ * Eigen::SimplicialCholeskyBase, which are not part of the public Eigen API:
+ * analyzePattern_preordered(), factorize_preordered<true>() and the factor
+ * storage m_matrix and m_diag. They have only been checked for the Eigen 3.3
+ * and 3.4 releases, other versions (including the 3.4.90 development branch)
+ * are rejected at compile time and this class must be revised before
+ * updating Eigen.
+ */
+template<typename Scalar>
+class BasicSparseLDLT : public Eigen::SimplicialLDLT<Eigen::SparseMatrix<Scalar, Eigen::ColMajor>, Eigen::Upper,
+                                                     Eigen::NaturalOrdering<SMatCol::StorageIndex>>
+{
+public:
+    using SMatScalar = Eigen::SparseMatrix<Scalar, Eigen::ColMajor>;
+    using Base = Eigen::SimplicialLDLT<SMatScalar, Eigen::Upper, Eigen::NaturalOrdering<SMatCol::StorageIndex>>;
+    using StorageIndex = SMatCol::StorageIndex;
+
+    static_assert(EIGEN_WORLD_VERSION == 3 && (EIGEN_MAJOR_VERSION == 3 ||
+                  (EIGEN_MAJOR_VERSION == 4 && EIGEN_MINOR_VERSION < 90)),
+                  "BasicSparseLDLT uses protected members of Eigen::SimplicialLDLT, only checked for Eigen 3.3 and 3.4");
+
+    BasicSparseLDLT();
+    ~BasicSparseLDLT() = default;
+    /**
+     * Symbolic decomposition: calculates the fill-in reducing ordering and the
+     * elimination tree. It must be called every time the pattern of L changes.
+     */
+    void analyze_pattern(const SMatCol &L);
+    /**
+     * Numerical decomposition, the pattern of L must be the same as the analyzed one.
+     * Returns true if the factorization succeeded.
+     */
+    bool factorize(const SMatCol &L);
+    /**
+     * Copies the ordering and the permuted pattern of other, so matrices with the same pattern
+     * can be factorized concurrently on several objects without calculating the ordering again.
+     */
+    void copy_analysis(const BasicSparseLDLT &other);
+    /**
+     * Solves L x = b on a preallocated vector x.
+     */
+    void solve(VectRefConst &b, MatX1 &x);
+    /**
+     * Returns true if the last factorized matrix is positive definite and not numerically
+     * rank deficient, i.e., the ratio between the smallest and largest pivots of D is over n * eps,
+     * where eps is the machine precision of Scalar.
+     */
+    bool is_full_rank() const;
+    /**
+     * Returns true if a pattern has been already analyzed
+     */
+    bool is_analyzed() const {return isAnalyzed_;}
+    /**
+     * Releases the memory of the analysis and the factor. analyze_pattern() must be
+     * called again before factorizing.
+     */
+    void clear();
+
+protected:
+    bool isAnalyzed_;
+    SMatScalar permutedUpper_; // P L P' upper triangular part, in the pattern given by the permutation
+    std::vector<StorageIndex> gatherIndex_; // for each value in permutedUpper_, its index at the input L values
+    std::vector<StorageIndex> perm_; // new position of each row (column) after the permutation
+    Eigen::Matrix<Scalar, Eigen::Dynamic, 1> work_;
+};
+
+using SparseLDLT = BasicSparseLDLT<matData_t>;
+using SparseLDLTFloat = BasicSparseLDLT<float>;
+
+extern template class BasicSparseLDLT<matData_t>;
+extern template class BasicSparseLDLT<float>;
+
+}
+
+#endif /* SPARSE_LDLT_HPP_ */
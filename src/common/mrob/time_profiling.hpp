@@ -25,6 +25,7 @@
 #include <chrono>
 #include <vector>
 #include <string>
+#include <cstdint>
 
 
 namespace mrob {
@@ -34,6 +35,11 @@ using Ttim = std::chrono::microseconds;
 /**
  * Class TimeProfiling creates a simple object that stores time
  * profiles for different functions and displays them.
+ *
+ * Times are accumulated per key, so after the first pass over all keys
+ * the profiler does not allocate. If the library is compiled with the
+ * allocation counter (see allocation_counter.hpp), the number of heap
+ * allocations between start() and stop() is also accumulated per key.
  */
 
 
@@ -49,7 +55,7 @@ public:
      */
     ~TimeProfiling();
     /**
-     * Reset method
+     * Reset method. Accumulated values are set to zero, but keys are kept
      */
     void reset();
     /**
@@ -58,9 +64,10 @@ public:
      */
     void start();
     /**
-     * stop() records given the string the time spent since last start() call
+     * stop() records given the key the time spent since last start() call
+     * Keys are literals, so no temporary string is created.
      */
-    void stop(const std::string &key="");
+    void stop(const char *key="");
     /**
      * print: displays the information gathered so far
      */
@@ -70,10 +77,23 @@ public:
      * accumulated in the class
      */
     double total_time();
+    /**
+     * total_allocations: returns the number of heap allocations
+     * accumulated in the class, 0 if the counter is not enabled.
+     */
+    uint64_t total_allocations();
 
 protected:
+    struct Profile
+    {
+        std::string key;
+        double time;
+        uint64_t allocations;
+        uint64_t calls;
+    };
     std::chrono::steady_clock::time_point t1_;
-    std::vector<std::pair<std::string, double>> time_profiles_;
+    uint64_t allocations1_;
+    std::vector<Profile> time_profiles_;
 };
 
 }
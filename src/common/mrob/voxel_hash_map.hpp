@@ -0,0 +1,432 @@
+/* Copyright (c) 2022, Gonzalo Ferrer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * voxel_hash_map.hpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Gonzalo Ferrer
+ *              g.ferrer@skoltech.ru
+ *              Mobile Robotics Lab, Skoltech
+ */
+
+#ifndef VOXEL_HASH_MAP_HPP_
+#define VOXEL_HASH_MAP_HPP_
+
+#include "mrob/matrix_base.hpp"
+#include "mrob/parallel.hpp"
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cassert>
+
+namespace mrob{
+
+/**
+ * Integer coordinates of a cubic voxel, i.e. floor(p / voxelSize)
+ */
+struct VoxelKey
+{
+    int x, y, z;
+    bool operator==(const VoxelKey &k) const {return x == k.x && y == k.y && z == k.z;}
+
+    template<typename Derived>
+    static VoxelKey from_point(const Eigen::MatrixBase<Derived> &p, typename Derived::Scalar voxelSize)
+    {
+        return VoxelKey{int(std::floor(p(0) / voxelSize)), int(std::floor(p(1) / voxelSize)), int(std::floor(p(2) / voxelSize))};
+    }
+};
+
+struct VoxelKeyHash
+{
+    std::size_t operator()(const VoxelKey &k) const
+    {
+        return (std::size_t(k.x) * 73856093) ^ (std::size_t(k.y) * 19349669) ^ (std::size_t(k.z) * 83492791);
+    }
+};
+
+
+/**
+ * Class BasicVoxelHashMap stores 3D points in a hash map of cubic voxels, for
+ * maps that change incrementally, e.g. the local map of an odometry, where a
+ * KDTree would have to be rebuilt.
+ *
+ * Each point inserted receives a consecutive id, which is used to remove it
+ * and is returned by the queries. Insertions and removals are O(1), and queries
+ * only visit the voxels around the query, so their cost grows with the ratio
+ * of the search distance to the voxel size.
+ *
+ * Queries are const and can be run concurrently from several threads, but not
+ * with insertions or removals.
+ */
+template<typename Scalar>
+class BasicVoxelHashMap
+{
+public:
+    using Point = Eigen::Matrix<Scalar, 3, 1>;
+    using PointsRefConst = const Eigen::Ref<const MatXT<Scalar>>;
+    // id returned by batch_nearest() for queries without neighbour
+    static constexpr uint_t npos = std::numeric_limits<uint_t>::max();
+
+    explicit BasicVoxelHashMap(Scalar voxelSize);
+    ~BasicVoxelHashMap() = default;
+
+    /**
+     * Inserts a point and returns its id
+     */
+    uint_t insert(const Point &p);
+    /**
+     * Inserts the rows of an array Nx3 and returns the id of the first one. The rest
+     * have consecutive ids.
+     */
+    uint_t insert_array(PointsRefConst points);
+    /**
+     * Removes the point id. Returns false if it was not in the map.
+     */
+    bool remove(uint_t id);
+    /**
+     * Removes the voxels whose center is farther than distance from center,
+     * and returns the number of points removed.
+     */
+    uint_t remove_far(const Point &center, Scalar distance);
+    void clear();
+
+    /**
+     * Returns false if the point id is not in the map
+     */
+    bool get_point(uint_t id, Point &p) const;
+    /**
+     * Nearest point to q closer than sqrt(maxDistance2). Returns false if there is none,
+     * otherwise its id and squared distance. Voxels are visited in shells of increasing
+     * distance to q, until no closer point can be found. maxDistance2 may be infinite,
+     * the search never goes beyond the occupied voxels.
+     */
+    bool nearest(const Point &q, Scalar maxDistance2, uint_t &id, Scalar &distance2) const;
+    /**
+     * All points at a distance from q lower or equal than radius, in no particular order.
+     */
+    void radius(const Point &q, Scalar radius, std::vector<uint_t> &ids, std::vector<Scalar> &distances2) const;
+    /**
+     * Nearest point of each row of Q (Mx3), in parallel. Queries without a point closer
+     * than sqrt(maxDistance2) have id npos and infinite distance.
+     */
+    void batch_nearest(PointsRefConst Q, Scalar maxDistance2, std::vector<uint_t> &ids,
+                       std::vector<Scalar> &distances2, uint_t numThreads = 0) const;
+
+    uint_t size() const {return location_.size();}
+    uint_t number_voxels() const {return voxels_.size();}
+    Scalar get_voxel_size() const {return voxelSize_;}
+
+protected:
+    using Key = VoxelKey;
+    struct Entry
+    {
+        Point point;
+        uint_t id;
+    };
+    using Voxel = std::vector<Entry>;
+    static constexpr uint_t batchSize_ = 1024;
+
+    Key key(const Point &p) const {return VoxelKey::from_point(p, voxelSize_);}
+    /**
+     * Squared distance from p to the closest point of the voxel k
+     */
+    Scalar distance2_to_voxel(const Point &p, const Key &k) const
+    {
+        Eigen::Array<Scalar, 3, 1> lower = Eigen::Array<Scalar, 3, 1>(k.x, k.y, k.z) * voxelSize_;
+        return (lower - p.array()).max(p.array() - lower - voxelSize_).max(Scalar(0)).matrix().squaredNorm();
+    }
+    /**
+     * Lower bound of the distance from p, in the voxel k, to the voxels at Chebyshev
+     * distance s or more from k
+     */
+    Scalar distance_to_shell(const Point &p, const Key &k, int s) const
+    {
+        if (s == 0)
+            return Scalar(0);
+        Eigen::Array<Scalar, 3, 1> key(k.x, k.y, k.z);
+        return (p.array() - (key - Scalar(s - 1)) * voxelSize_).min((key + Scalar(s)) * voxelSize_ - p.array()).minCoeff();
+    }
+    /**
+     * Last shell around k to visit for points at distance lower or equal than
+     * sqrt(distance2): no further than the box of occupied voxels, so the bound is
+     * finite for any distance2.
+     */
+    int max_shell(const Key &k, Scalar distance2) const;
+    /**
+     * Calls visit(key, voxel) for the voxels at Chebyshev distance s (in voxels) from k.
+     * When the shell has more voxels than the map, the map is scanned instead for the
+     * voxels at distance s or more, and it returns false: further shells are done.
+     */
+    template<typename Visit>
+    bool visit_shell(const Key &k, int s, Visit visit) const;
+
+    Scalar voxelSize_;
+    uint_t nextId_;
+    std::unordered_map<Key, Voxel, VoxelKeyHash> voxels_;
+    std::unordered_map<uint_t, Key> location_; // voxel of each point id
+    Key lower_, upper_; // box containing the occupied voxels, it does not shrink on remove()
+};
+
+using VoxelHashMap = BasicVoxelHashMap<matData_t>;
+using VoxelHashMapFloat = BasicVoxelHashMap<float>;
+
+
+
+template<typename Scalar>
+constexpr uint_t BasicVoxelHashMap<Scalar>::npos;
+
+template<typename Scalar>
+BasicVoxelHashMap<Scalar>::BasicVoxelHashMap(Scalar voxelSize) :
+        voxelSize_(voxelSize), nextId_(0), lower_{0, 0, 0}, upper_{0, 0, 0}
+{
+    assert(voxelSize > 0 && "VoxelHashMap: the voxel size must be positive");
+}
+
+template<typename Scalar>
+uint_t BasicVoxelHashMap<Scalar>::insert(const Point &p)
+{
+    Key k = this->key(p);
+    if (voxels_.empty())
+    {
+        lower_ = k;
+        upper_ = k;
+    }
+    lower_ = Key{std::min(lower_.x, k.x), std::min(lower_.y, k.y), std::min(lower_.z, k.z)};
+    upper_ = Key{std::max(upper_.x, k.x), std::max(upper_.y, k.y), std::max(upper_.z, k.z)};
+    voxels_[k].push_back(Entry{p, nextId_});
+    location_.emplace(nextId_, k);
+    return nextId_++;
+}
+
+template<typename Scalar>
+uint_t BasicVoxelHashMap<Scalar>::insert_array(PointsRefConst points)
+{
+    assert(points.cols() == 3 && "VoxelHashMap: Nx3 input is required");
+    uint_t first = nextId_;
+    location_.reserve(location_.size() + points.rows());
+    for (uint_t i = 0; i < points.rows(); ++i)
+        this->insert(points.row(i).transpose());
+    return first;
+}
+
+template<typename Scalar>
+bool BasicVoxelHashMap<Scalar>::remove(uint_t id)
+{
+    auto loc = location_.find(id);
+    if (loc == location_.end())
+        return false;
+    auto voxel = voxels_.find(loc->second);
+    Voxel &entries = voxel->second;
+    auto entry = std::find_if(entries.begin(), entries.end(), [&](const Entry &e){return e.id == id;});
+    *entry = entries.back();
+    entries.pop_back();
+    if (entries.empty())
+        voxels_.erase(voxel);
+    location_.erase(loc);
+    return true;
+}
+
+template<typename Scalar>
+uint_t BasicVoxelHashMap<Scalar>::remove_far(const Point &center, Scalar distance)
+{
+    uint_t removed = 0;
+    const Scalar distance2 = distance * distance;
+    bool first = true;
+    for (auto voxel = voxels_.begin(); voxel != voxels_.end(); )
+    {
+        const Key &k = voxel->first;
+        Point voxelCenter = (Point(k.x, k.y, k.z).array() + Scalar(0.5)) * voxelSize_;
+        if ((voxelCenter - center).squaredNorm() <= distance2)
+        {
+            // the box of occupied voxels is rebuilt from the ones kept
+            lower_ = first ? k : Key{std::min(lower_.x, k.x), std::min(lower_.y, k.y), std::min(lower_.z, k.z)};
+            upper_ = first ? k : Key{std::max(upper_.x, k.x), std::max(upper_.y, k.y), std::max(upper_.z, k.z)};
+            first = false;
+            ++voxel;
+            continue;
+        }
+        for (const Entry &e : voxel->second)
+            location_.erase(e.id);
+        removed += voxel->second.size();
+        voxel = voxels_.erase(voxel);
+    }
+    return removed;
+}
+
+template<typename Scalar>
+void BasicVoxelHashMap<Scalar>::clear()
+{
+    voxels_.clear();
+    location_.clear();
+}
+
+template<typename Scalar>
+bool BasicVoxelHashMap<Scalar>::get_point(uint_t id, Point &p) const
+{
+    auto loc = location_.find(id);
+    if (loc == location_.end())
+        return false;
+    for (const Entry &e : voxels_.at(loc->second))
+    {
+        if (e.id == id)
+        {
+            p = e.point;
+            break;
+        }
+    }
+    return true;
+}
+
+template<typename Scalar>
+int BasicVoxelHashMap<Scalar>::max_shell(const Key &k, Scalar distance2) const
+{
+    // Chebyshev distance from k to the farthest corner of the occupied box
+    long long extent = std::max({(long long)k.x - lower_.x, (long long)upper_.x - k.x,
+                                 (long long)k.y - lower_.y, (long long)upper_.y - k.y,
+                                 (long long)k.z - lower_.z, (long long)upper_.z - k.z});
+    extent = std::min(extent, (long long)std::numeric_limits<int>::max());
+    // compared before the conversion, which is undefined for infinite distances
+    Scalar shells = std::ceil(std::sqrt(distance2) / voxelSize_);
+    if (shells < Scalar(extent))
+        return int(shells);
+    return int(extent);
+}
+
+template<typename Scalar>
+template<typename Visit>
+bool BasicVoxelHashMap<Scalar>::visit_shell(const Key &k, int s, Visit visit) const
+{
+    const uint_t shellVoxels = s == 0 ? 1 : 24 * uint_t(s) * s + 2;
+    if (shellVoxels > voxels_.size())
+    {
+        for (const auto &voxel : voxels_)
+        {
+            const Key &v = voxel.first;
+            long long d = std::max({std::abs((long long)v.x - k.x), std::abs((long long)v.y - k.y),
+                                    std::abs((long long)v.z - k.z)});
+            if (d >= s)
+                visit(v, voxel.second);
+        }
+        return false;
+    }
+    for (int dx = -s; dx <= s; ++dx)
+        for (int dy = -s; dy <= s; ++dy)
+        {
+            // inner voxels of the shell are skipped, only the faces at dz = +-s are visited
+            bool face = std::abs(dx) == s || std::abs(dy) == s;
+            for (int dz = -s; dz <= s; dz += (face || s == 0) ? 1 : 2 * s)
+            {
+                auto voxel = voxels_.find(Key{k.x + dx, k.y + dy, k.z + dz});
+                if (voxel != voxels_.end())
+                    visit(voxel->first, voxel->second);
+            }
+        }
+    return true;
+}
+
+template<typename Scalar>
+bool BasicVoxelHashMap<Scalar>::nearest(const Point &q, Scalar maxDistance2, uint_t &id, Scalar &distance2) const
+{
+    if (voxels_.empty())
+        return false;
+    bool found = false;
+    Scalar best = maxDistance2;
+    const Key k = this->key(q);
+    const int maxShell = this->max_shell(k, maxDistance2);
+    for (int s = 0; s <= maxShell; ++s)
+    {
+        // no point of this or further shells can be closer than the best one found
+        Scalar bound = this->distance_to_shell(q, k, s);
+        if (bound * bound >= best)
+            break;
+        bool next = this->visit_shell(k, s, [&](const Key &v, const Voxel &voxel)
+        {
+            if (this->distance2_to_voxel(q, v) >= best)
+                return;
+            for (const Entry &e : voxel)
+            {
+                Scalar d2 = (e.point - q).squaredNorm();
+                if (d2 < best)
+                {
+                    best = d2;
+                    id = e.id;
+                    found = true;
+                }
+            }
+        });
+        if (!next)
+            break;
+    }
+    if (found)
+        distance2 = best;
+    return found;
+}
+
+template<typename Scalar>
+void BasicVoxelHashMap<Scalar>::radius(const Point &q, Scalar radius, std::vector<uint_t> &ids, std::vector<Scalar> &distances2) const
+{
+    ids.clear();
+    distances2.clear();
+    if (voxels_.empty())
+        return;
+    const Scalar radius2 = radius * radius;
+    const Key k = this->key(q);
+    const int maxShell = this->max_shell(k, radius2);
+    for (int s = 0; s <= maxShell; ++s)
+    {
+        bool next = this->visit_shell(k, s, [&](const Key &v, const Voxel &voxel)
+        {
+            if (this->distance2_to_voxel(q, v) > radius2)
+                return;
+            for (const Entry &e : voxel)
+            {
+                Scalar d2 = (e.point - q).squaredNorm();
+                if (d2 <= radius2)
+                {
+                    ids.push_back(e.id);
+                    distances2.push_back(d2);
+                }
+            }
+        });
+        if (!next)
+            break;
+    }
+}
+
+template<typename Scalar>
+void BasicVoxelHashMap<Scalar>::batch_nearest(PointsRefConst Q, Scalar maxDistance2, std::vector<uint_t> &ids,
+                                              std::vector<Scalar> &distances2, uint_t numThreads) const
+{
+    const uint_t M = Q.rows();
+    ids.resize(M);
+    distances2.resize(M);
+    parallel_for((M + batchSize_ - 1) / batchSize_, numThreads, [&](uint_t task)
+    {
+        for (uint_t i = task * batchSize_; i < std::min(M, (task + 1) * batchSize_); ++i)
+        {
+            if (!this->nearest(Q.row(i).transpose(), maxDistance2, ids[i], distances2[i]))
+            {
+                ids[i] = npos;
+                distances2[i] = std::numeric_limits<Scalar>::infinity();
+            }
+        }
+    });
+}
+
+}
+
+#endif /* VOXEL_HASH_MAP_HPP_ */
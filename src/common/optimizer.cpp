@@ -22,13 +22,76 @@
  */
 
 #include "mrob/optimizer.hpp"
-#include <Eigen/LU> // for inverse and determinant
-#include <iostream>
+#include "mrob/parallel.hpp"
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <cassert>
 
 using namespace mrob;
 
+namespace {
+matData_t elapsed_microseconds(const std::chrono::steady_clock::time_point &t1)
+{
+    return std::chrono::duration<matData_t, std::micro>(std::chrono::steady_clock::now() - t1).count();
+}
+}
+
+TrustRegion::TrustRegion(matData_t lambda) :
+        lambda_(lambda), sigma1_(0.25), sigma2_(0.8), beta1_(2.0), beta2_(0.25)
+{
+}
+
+void TrustRegion::accept(matData_t modelFidelity)
+{
+    if (modelFidelity < sigma1_)
+        lambda_ *= beta1_;
+    if (modelFidelity > sigma2_)
+        lambda_ *= beta2_;
+}
+
+Dogleg::Dogleg() :
+        radius_(0.0)
+{
+}
+
+void Dogleg::step(const MatX1 &gaussNewton, const MatX1 &cauchy, MatX1 &step)
+{
+    matData_t normGaussNewton = gaussNewton.norm();
+    if (radius_ <= 0.0)
+        radius_ = normGaussNewton;
+    if (normGaussNewton <= radius_)
+    {
+        step = gaussNewton;
+        return;
+    }
+    matData_t normCauchy = cauchy.norm();
+    if (normCauchy >= radius_)
+    {
+        step = (radius_ / normCauchy) * cauchy;
+        return;
+    }
+    // step = cauchy + beta (gaussNewton - cauchy), such as |step| = radius, with beta in [0,1]:
+    // a beta^2 + 2 b beta + c = 0, where c < 0
+    step = gaussNewton - cauchy;
+    matData_t a = step.squaredNorm(), b = cauchy.dot(step), c = normCauchy*normCauchy - radius_*radius_;
+    matData_t beta = (-b + std::sqrt(b*b - a*c)) / a;
+    step = cauchy + beta * step;
+}
+
+void Dogleg::accept(matData_t modelFidelity, matData_t stepNorm)
+{
+    if (modelFidelity > 0.75)
+        radius_ = std::max(radius_, 3.0 * stepNorm);
+    else if (modelFidelity < 0.25)
+        radius_ = 0.5 * stepNorm;
+}
+
 Optimizer::Optimizer(matData_t solutionTolerance, matData_t lambda) :
-        solutionTolerance_(solutionTolerance), max_iters_(1e2), lambda_(lambda)
+        solutionTolerance_(solutionTolerance), max_iters_(1e2), trustRegion_(lambda),
+        reuseLinearization_(false), wolfeC1_(1e-4), wolfeC2LBFGS_(0.9), wolfeC2CG_(0.1),
+        lbfgsMemory_(10), lbfgsSize_(0), lbfgsNewest_(0), phaseTimes_(),
+        deadline_(Tdeadline::max()), status_(CONVERGED), iterations_(0), iterationTime_(0.0)
 {
 
 }
@@ -39,117 +102,248 @@ Optimizer::~Optimizer()
 }
 
 
- uint_t Optimizer::solve(optimMethod method, uint_t max_iters, double lambda)
+uint_t Optimizer::solve(optimMethod method, uint_t max_iters, double lambda, Tdeadline deadline)
 {
     optimization_method_ = method;
     max_iters_ = max_iters;
+    log_.reset(max_iters);
+    reuseLinearization_ = false;
+    deadline_ = deadline;
+    solveStart_ = std::chrono::steady_clock::now();
+    phaseTimes_ = IterationRecord();
+    status_ = BUDGET_EXHAUSTED;
+    iterations_ = 0;
     switch(method)
     {
       case NEWTON_RAPHSON:
           return optimize_newton_raphson();
       case LEVENBERG_MARQUARDT_SPHER:
       case LEVENBERG_MARQUARDT_ELLIP:
-          lambda_ = lambda;
+          trustRegion_.reset(lambda);
           return optimize_levenberg_marquardt();
+      case DOGLEG:
+          return optimize_dogleg();
+      case NEWTON_RAPHSON_LINE_SEARCH:
+          return optimize_newton_raphson_line_search();
+      case LBFGS:
+          return optimize_lbfgs();
+      case NONLINEAR_CG:
+          return optimize_nonlinear_cg();
     }
     return 0;
 }
 
+uint_t Optimizer::optimize_newton_raphson_one_iteration(bool useLambda)
+{
+    if (!this->calculate_newton_step(useLambda))
+        return 0;
+    this->update_state();
+    return 1;
+}
 
-uint_t OptimizerDense::optimize_newton_raphson_one_iteration(bool useLambda)
+bool Optimizer::calculate_speculative_step(matData_t &error)
+{
+    if (!this->calculate_newton_step(true))
+        return false;
+    this->update_state();
+    error = this->evaluate_error();
+    return true;
+}
+
+bool Optimizer::iteration_fits() const
+{
+    // deadline - now does not overflow for Tdeadline::max()
+    return deadline_ - std::chrono::steady_clock::now() >= std::chrono::duration<matData_t, std::micro>(iterationTime_);
+}
+
+matData_t Optimizer::evaluate_error()
+{
+    auto t1 = std::chrono::steady_clock::now();
+    matData_t error = this->calculate_error();
+    phaseTimes_.timeChi2 += elapsed_microseconds(t1);
+    return error;
+}
+
+bool Optimizer::add_record(uint_t iter, matData_t lambda, matData_t error, matData_t diffError,
+        matData_t modelFidelity, matData_t stepNorm, bool accepted)
+{
+    iterations_ = iter;
+    iterationTime_ = elapsed_microseconds(solveStart_) / iter;
+    IterationRecord record{iter, lambda, error, diffError, modelFidelity, stepNorm, accepted,
+                           phaseTimes_.timeBuild, phaseTimes_.timeFactorize, phaseTimes_.timeSolve, phaseTimes_.timeChi2};
+    phaseTimes_ = IterationRecord();
+    return log_.add(record);
+}
+
+matData_t Optimizer::calculate_model_fidelity(matData_t diff_error)
+{
+    // m_k(dx) = err(x_k) + dx'*Grad + 0.5 dx'(Hessian + LM)dx
+    this->hessian_product(dx_, Hv_);
+    return diff_error / (-dx_.dot(gradient_) - 0.5*dx_.dot(Hv_));
+}
+
+
+bool OptimizerDense::calculate_newton_step(bool useLambda)
 {
     // 1) build problem: Gradient and Hessian and re-evaluates
+    auto t1 = std::chrono::steady_clock::now();
     calculate_gradient_hessian();
+    phaseTimes_.timeBuild += elapsed_microseconds(t1);
     if (useLambda)
     {
-        if (optimization_method_ == LEVENBERG_MARQUARDT_SPHER)
-        {
-            for (Eigen::Index i = 0; i < hessian_.diagonalSize() ; ++i)
-                hessian_(i,i) += lambda_;
-        }
-        if (optimization_method_ == LEVENBERG_MARQUARDT_ELLIP)
-        {
-            for (Eigen::Index i = 0; i < hessian_.diagonalSize() ; ++i)
-                hessian_(i,i) *= 1.0 + lambda_;
-        }
+        bool elliptical = optimization_method_ == LEVENBERG_MARQUARDT_ELLIP;
+        for (Eigen::Index i = 0; i < hessian_.diagonalSize() ; ++i)
+            hessian_(i,i) = trustRegion_.damp(hessian_(i,i), elliptical);
     }
 
-    // 2) dx = - h^-1 * grad XXX test for singularities?
-    dx_ = - hessian_.inverse() * gradient_;
-    // 3) update the solution
-    this->update_state();
-
-    return 1;
+    // 2) dx = - h^-1 * grad, by Cholesky. Rank deficiency is detected from the pivots of L
+    t1 = std::chrono::steady_clock::now();
+    cholesky_.compute(hessian_);
+    phaseTimes_.timeFactorize += elapsed_microseconds(t1);
+    if (cholesky_.info() != Eigen::Success)
+        return false;
+    auto pivots = cholesky_.matrixLLT().diagonal();
+    matData_t n = pivots.size();
+    if (n > 0 && pivots.minCoeff() <= std::sqrt(n * Eigen::NumTraits<matData_t>::epsilon()) * pivots.maxCoeff())
+        return false;
+    t1 = std::chrono::steady_clock::now();
+    dx_ = cholesky_.solve(gradient_);
+    dx_ = -dx_;
+    phaseTimes_.timeSolve += elapsed_microseconds(t1);
+    return true;
 }
 
 uint_t Optimizer::optimize_newton_raphson()
 {
     uint_t iters = 0;
     // Calculate error also estimates planes, which are necessary for gradients. XXX this can cause bugs on the first iteration
-    matData_t previous_error = this->calculate_error(), diff_error;
+    matData_t previous_error = this->evaluate_error();
     do
     {
-        this->optimize_newton_raphson_one_iteration(false);
-        matData_t current_error = this->calculate_error();
-        //std::cout << "iter " << iters << ", error = " << current_error <<std::endl;
-        diff_error = previous_error - current_error;
-        previous_error = current_error;
+        // only starts an iteration that is expected to finish before the deadline
+        if (!this->iteration_fits())
+            break;
         iters++;
-    }while(fabs(diff_error) > solutionTolerance_ && iters < max_iters_);
+        if (!this->calculate_newton_step(false))
+        {
+            this->add_record(iters, 0.0, previous_error, 0.0, 0.0, 0.0, false);
+            status_ = DIVERGED;
+            log_.summary("Optimizer::optimize_newton_raphson", "rank deficient Hessian", iters, previous_error);
+            return 0;
+        }
+        this->bookkeep_state();
+        this->update_state();
+        matData_t current_error = this->evaluate_error();
+        matData_t diff_error = previous_error - current_error;
+        bool finite = std::isfinite(current_error);
+        bool stop = this->add_record(iters, 0.0, previous_error, diff_error, 0.0, dx_.norm(), finite);
 
+        // steps are not checked for a decrease of the error, but an error that is not a finite number is undone
+        if (!finite)
+        {
+            this->update_state_from_bookkeep();
+            status_ = DIVERGED;
+            log_.summary("Optimizer::optimize_newton_raphson", "the error is not a finite number", iters, previous_error);
+            return 0;
+        }
+        previous_error = current_error;
+        if (fabs(diff_error) < solutionTolerance_)
+        {
+            status_ = CONVERGED;
+            return iters;
+        }
+        if (stop)
+        {
+            status_ = STOPPED;
+            break;
+        }
+    }while(iters < max_iters_);
 
     return iters;
 }
 
 uint_t Optimizer::optimize_levenberg_marquardt()
 {
-    // LM trust region as described in Bertsekas (p.105)
-    // sigma reference to the fidelity of the model at the proposed solution \in [0,1]
-    matData_t sigma1(0.25), sigma2(0.8);// 0 < sigma1 < sigma2 < 1
-    matData_t beta1(2.0), beta2(0.25); // lambda updates multiplier values, beta1 > 1 > beta2 >0
+    // LM trust region as described in Bertsekas (p.105), see TrustRegion
     uint_t iters = 0;
-    matData_t previous_error = calculate_error();
-    bool improvement; // variable for controlling when no update is done and number of iterations is exceeded.
+    matData_t previous_error = this->evaluate_error();
+    bool improvement = true; // variable for controlling when no update is done and number of iterations is exceeded.
     do
     {
+        // only starts an iteration that is expected to finish before the deadline
+        if (!this->iteration_fits())
+            break;
         iters++;
-        // 1) solve the current subproblem by Newton Raphson
+        // 1) solve the current subproblem by Newton Raphson. After a rejected step the linearization
+        //    is the same, and derived classes may try several lambdas at once
         this->bookkeep_state();
-        optimize_newton_raphson_one_iteration(true);
-        auto current_error = calculate_error();
-        //std::cout << "iter " << iters << ", error = " << current_error << ", lambda = "<< lambda_ << std::endl;
-        auto diff_error = previous_error - current_error;
+        const bool speculative = reuseLinearization_;
+        matData_t current_error = previous_error;
+        bool success = speculative ? this->calculate_speculative_step(current_error)
+                                   : this->calculate_newton_step(true);
+        if (!success)
+        {
+            // the damped Hessian is not positive definite, the step is rejected without an update
+            bool stop = this->add_record(iters, trustRegion_.get_lambda(), previous_error, 0.0, 0.0, 0.0, false);
+            trustRegion_.reject();
+            reuseLinearization_ = true;
+            if (stop)
+            {
+                status_ = STOPPED;
+                break;
+            }
+            continue;
+        }
+        // the speculative step already updates the state and evaluates its error
+        if (!speculative)
+        {
+            this->update_state();
+            current_error = this->evaluate_error();
+        }
+        matData_t diff_error = previous_error - current_error;
         improvement = true;
+        reuseLinearization_ = false;
 
-        // 2) Check for convergence, hillclimb
-        if (diff_error < 0)
+        // 2) Check for convergence, hillclimb. An error that is not a finite number is also rejected
+        if (!(diff_error >= 0))
         {
-            //std::cout << "no improvement\n";
-            lambda_ *= beta1;
+            bool stop = this->add_record(iters, trustRegion_.get_lambda(), previous_error, diff_error, 0.0, dx_.norm(), false);
+            trustRegion_.reject();
             this->update_state_from_bookkeep();
+            reuseLinearization_ = true;
             improvement = false;
+            if (stop)
+            {
+                status_ = STOPPED;
+                break;
+            }
             continue;
         }
-        previous_error = current_error;
 
-        // 2.1) check for convergence, terminal
-        if (diff_error < solutionTolerance_)
-            return iters;
-
-        // 3 Fidelity of the quadratized model vs non-linear error evaluation.
+        // 2.1) Fidelity of the quadratized model vs non-linear error evaluation.
         // f = err(x_k) - err(x_k + dx)  ( >0 if upgrade)
         //     err(x_k) - m_k(dx)
         // where m_k is the quadratized model m_k(dx) = err(x_k) + dx'*Grad r + 0.5 dx'(Hessian + LM)dx
         // => f = d err / (-dx'*Grad r - 0.5 dx'(Hessian + LM)dx)
         //matData_t modelFidelity = diff_error / (-dx_.dot(gradient_) - 0.5*dx_.dot(hessian_* dx_));
         matData_t modelFidelity = calculate_model_fidelity(diff_error);
+        bool stop = this->add_record(iters, trustRegion_.get_lambda(), previous_error, diff_error, modelFidelity, dx_.norm(), true);
+        previous_error = current_error;
 
+        // 3) check for convergence, terminal
+        if (diff_error < solutionTolerance_)
+        {
+            status_ = CONVERGED;
+            return iters;
+        }
+        if (stop)
+        {
+            status_ = STOPPED;
+            break;
+        }
 
         // 4) update lambda
-        if (modelFidelity < sigma1)
-            lambda_ *= beta1;
-        if (modelFidelity > sigma2)
-            lambda_ *= beta2;
+        trustRegion_.accept(modelFidelity);
 
     }while(iters < max_iters_);
 
@@ -158,11 +352,436 @@ uint_t Optimizer::optimize_levenberg_marquardt()
         this->update_state_from_bookkeep();//If no improvement shown, undo again
     }
 
+    // output, the error is only evaluated if it is printed
+    if (log_.get_verbosity() >= IterationLog::SUMMARY)
+        log_.summary("Optimizer::optimize_levenberg_marquardt",
+                status_ == STOPPED ? "stopped by the callback" : "failed to converge", iters, calculate_error());
+
+    return iters;
+}
+
+uint_t Optimizer::optimize_dogleg()
+{
+    uint_t iters = 0;
+    matData_t previous_error = this->evaluate_error();
+    bool relinearize = true, stop = false;
+    dogleg_.reset();
+    do
+    {
+        // only starts an iteration that is expected to finish before the deadline
+        if (!this->iteration_fits())
+            break;
+        iters++;
+        // 1) Newton and Cauchy steps are only calculated after an accepted step
+        if (relinearize)
+        {
+            if (!this->calculate_newton_step(false))
+            {
+                this->add_record(iters, 0.0, previous_error, 0.0, 0.0, 0.0, false);
+                status_ = DIVERGED;
+                log_.summary("Optimizer::optimize_dogleg", "rank deficient Hessian", iters, previous_error);
+                return 0;
+            }
+            dxNewton_ = dx_;
+            // Cauchy step, the minimum of the model along the gradient: - g'g / (g'Hg) g
+            auto t1 = std::chrono::steady_clock::now();
+            this->hessian_product(gradient_, Hv_);
+            dxCauchy_ = -(gradient_.squaredNorm() / gradient_.dot(Hv_)) * gradient_;
+            phaseTimes_.timeSolve += elapsed_microseconds(t1);
+        }
+        dogleg_.step(dxNewton_, dxCauchy_, dx_);
+        this->bookkeep_state();
+        this->update_state();
+        matData_t current_error = this->evaluate_error();
+        matData_t diff_error = previous_error - current_error;
+        matData_t stepNorm = dx_.norm();
+        if (!std::isfinite(current_error))
+        {
+            this->add_record(iters, 0.0, previous_error, diff_error, 0.0, stepNorm, false);
+            this->update_state_from_bookkeep();
+            status_ = DIVERGED;
+            log_.summary("Optimizer::optimize_dogleg", "the error is not a finite number", iters, previous_error);
+            return 0;
+        }
+
+        // 2) rejected steps only reduce the radius
+        if (diff_error < 0)
+        {
+            stop = this->add_record(iters, 0.0, previous_error, diff_error, 0.0, stepNorm, false);
+            this->update_state_from_bookkeep();
+            dogleg_.reject(stepNorm);
+            relinearize = false;
+            // the error does not change within tolerance
+            if (-diff_error < solutionTolerance_)
+            {
+                status_ = CONVERGED;
+                return iters;
+            }
+            if (stop)
+            {
+                status_ = STOPPED;
+                break;
+            }
+            continue;
+        }
+
+        // 3) accepted, check for convergence and update the radius
+        matData_t modelFidelity = calculate_model_fidelity(diff_error);
+        stop = this->add_record(iters, 0.0, previous_error, diff_error, modelFidelity, stepNorm, true);
+        previous_error = current_error;
+        if (diff_error < solutionTolerance_)
+        {
+            status_ = CONVERGED;
+            return iters;
+        }
+        if (stop)
+        {
+            status_ = STOPPED;
+            break;
+        }
+        dogleg_.accept(modelFidelity, stepNorm);
+        relinearize = true;
+    }while(iters < max_iters_);
+
+    // output, the error is only evaluated if it is printed
+    if (log_.get_verbosity() >= IterationLog::SUMMARY)
+        log_.summary("Optimizer::optimize_dogleg",
+                status_ == STOPPED ? "stopped by the callback" : "failed to converge", iters, calculate_error());
+
+    return iters;
+}
+
+uint_t Optimizer::optimize_newton_raphson_line_search()
+{
+    // Armijo condition: err(x + alpha dx) <= err(x) + c alpha dx'Grad
+    const matData_t c = 1e-4;
+    const uint_t maxBacktracks = 10;
+    uint_t iters = 0;
+    matData_t previous_error = this->evaluate_error();
+    do
+    {
+        // only starts an iteration that is expected to finish before the deadline
+        if (!this->iteration_fits())
+            break;
+        iters++;
+        if (!this->calculate_newton_step(false))
+        {
+            this->add_record(iters, 0.0, previous_error, 0.0, 0.0, 0.0, false);
+            status_ = DIVERGED;
+            log_.summary("Optimizer::optimize_newton_raphson_line_search", "rank deficient Hessian", iters, previous_error);
+            return 0;
+        }
+
+        // backtracking, the step is halved until the decrease is sufficient. The slope is
+        // negative for a descent direction (always for a positive definite Hessian)
+        matData_t slope = dx_.dot(gradient_), current_error = previous_error;
+        bool accepted = false;
+        this->bookkeep_state();
+        for (uint_t k = 0; k <= maxBacktracks && slope < 0; ++k)
+        {
+            this->update_state();
+            current_error = this->evaluate_error();
+            if (current_error <= previous_error + c * slope)
+            {
+                accepted = true;
+                break;
+            }
+            this->update_state_from_bookkeep();
+            dx_ *= 0.5;
+            slope *= 0.5;
+        }
+        matData_t diff_error = previous_error - current_error;
+        if (!accepted)
+        {
+            this->add_record(iters, 0.0, previous_error, diff_error, 0.0, dx_.norm(), false);
+            status_ = DIVERGED;
+            log_.summary("Optimizer::optimize_newton_raphson_line_search", "no decrease along the Newton step", iters, previous_error);
+            return 0;
+        }
+        bool stop = this->add_record(iters, 0.0, previous_error, diff_error, calculate_model_fidelity(diff_error),
+                dx_.norm(), true);
+        previous_error = current_error;
+        if (diff_error < solutionTolerance_)
+        {
+            status_ = CONVERGED;
+            return iters;
+        }
+        if (stop)
+        {
+            status_ = STOPPED;
+            break;
+        }
+    }while(iters < max_iters_);
+
+    // output, the error is only evaluated if it is printed
+    if (log_.get_verbosity() >= IterationLog::SUMMARY)
+        log_.summary("Optimizer::optimize_newton_raphson_line_search",
+                status_ == STOPPED ? "stopped by the callback" : "failed to converge", iters, calculate_error());
+
+    return iters;
+}
+
+bool Optimizer::line_search_wolfe(matData_t &error, matData_t alpha, matData_t c2)
+{
+    const matData_t c1 = wolfeC1_;
+    const uint_t maxEvaluations = 20;
+    const matData_t error0 = error;
+    const matData_t slope0 = gradient_.dot(direction_);
+    if (!(slope0 < 0))
+        return false;
+    previousGradient_ = gradient_;
+    this->bookkeep_state();
+
+    // phi(a) = err(x + a * direction) and its derivative. For states on manifolds, updated from the
+    // left (or right) by exp(a * direction), the derivative is also the gradient at the new state by direction
+    bool moved = false;
+    matData_t phi, slope, evaluated = 0.0;
+    auto evaluate = [&](matData_t a)
+    {
+        if (moved)
+            this->update_state_from_bookkeep();
+        dx_ = a * direction_;
+        this->update_state();
+        moved = true;
+        evaluated = a;
+        phi = this->evaluate_error();
+        auto t1 = std::chrono::steady_clock::now();
+        this->calculate_gradient();
+        phaseTimes_.timeBuild += elapsed_microseconds(t1);
+        slope = gradient_.dot(direction_);
+    };
+
+    // 1) bracketing, the step is doubled until an interval containing acceptable steps is found
+    matData_t alphaLo = 0.0, phiLo = error0, slopeLo = slope0, alphaHi = 0.0, phiHi = error0;
+    bool bracketed = false;
+    uint_t evaluations = 0;
+    while (evaluations < maxEvaluations)
+    {
+        evaluate(alpha);
+        evaluations++;
+        if (!std::isfinite(phi) || phi > error0 + c1 * alpha * slope0 || (evaluations > 1 && phi >= phiLo))
+        {
+            alphaHi = alpha;
+            phiHi = phi;
+            bracketed = true;
+            break;
+        }
+        if (std::fabs(slope) <= -c2 * slope0)
+        {
+            error = phi;
+            return true;
+        }
+        if (slope >= 0)
+        {
+            alphaHi = alphaLo;
+            phiHi = phiLo;
+            alphaLo = alpha;
+            phiLo = phi;
+            slopeLo = slope;
+            bracketed = true;
+            break;
+        }
+        alphaLo = alpha;
+        phiLo = phi;
+        slopeLo = slope;
+        alpha *= 2.0;
+    }
+
+    // 2) zoom, the interval is reduced by the minimum of the quadratic interpolation, safeguarded
+    // to the inner part of the interval. alphaLo always satisfies the sufficient decrease
+    while (bracketed && evaluations < maxEvaluations)
+    {
+        matData_t width = alphaHi - alphaLo;
+        matData_t denominator = 2.0 * (phiHi - phiLo - slopeLo * width);
+        alpha = alphaLo - slopeLo * width * width / denominator;
+        if (!std::isfinite(phiHi) || !(denominator > 0) ||
+            !(std::fabs(alpha - alphaLo) > 0.1 * std::fabs(width) && std::fabs(alphaHi - alpha) > 0.1 * std::fabs(width)))
+            alpha = alphaLo + 0.5 * width;
+        evaluate(alpha);
+        evaluations++;
+        if (!std::isfinite(phi) || phi > error0 + c1 * alpha * slope0 || phi >= phiLo)
+        {
+            alphaHi = alpha;
+            phiHi = phi;
+            continue;
+        }
+        if (std::fabs(slope) <= -c2 * slope0)
+        {
+            error = phi;
+            return true;
+        }
+        if (slope * width >= 0)
+        {
+            alphaHi = alphaLo;
+            phiHi = phiLo;
+        }
+        alphaLo = alpha;
+        phiLo = phi;
+        slopeLo = slope;
+    }
 
-    // output
-    std::cout << "Optimizer::optimize_levenberg_marquardt: failed to converge after "
-              << iters << " iterations and error " << calculate_error()
-              << std::endl;
+    // 3) the curvature condition is not met, but a step with sufficient decrease is still taken
+    if (alphaLo > 0.0)
+    {
+        if (evaluated != alphaLo)
+            evaluate(alphaLo);
+        error = phi;
+        return true;
+    }
+    if (moved)
+        this->update_state_from_bookkeep();
+    gradient_ = previousGradient_;
+    return false;
+}
+
+void Optimizer::lbfgs_direction()
+{
+    // two-loop recursion, direction = - B * gradient, from the newest pair to the oldest and back
+    direction_ = gradient_;
+    uint_t k = lbfgsNewest_;
+    for (uint_t i = 0; i < lbfgsSize_; ++i)
+    {
+        lbfgsAlpha_[k] = lbfgsRho_[k] * lbfgsS_[k].dot(direction_);
+        direction_ -= lbfgsAlpha_[k] * lbfgsY_[k];
+        k = (k + lbfgsMemory_ - 1) % lbfgsMemory_;
+    }
+    // initial inverse Hessian gamma * I, scaled by the newest pair
+    if (lbfgsSize_ > 0)
+        direction_ *= 1.0 / (lbfgsRho_[lbfgsNewest_] * lbfgsY_[lbfgsNewest_].squaredNorm());
+    for (uint_t i = 0; i < lbfgsSize_; ++i)
+    {
+        k = (k + 1) % lbfgsMemory_;
+        matData_t beta = lbfgsRho_[k] * lbfgsY_[k].dot(direction_);
+        direction_ += (lbfgsAlpha_[k] - beta) * lbfgsS_[k];
+    }
+    direction_ = -direction_;
+}
+
+uint_t Optimizer::optimize_lbfgs()
+{
+    uint_t iters = 0;
+    matData_t previous_error = this->evaluate_error(), diff_error = 0.0;
+    this->calculate_gradient();
+    lbfgsSize_ = 0;
+    lbfgsNewest_ = lbfgsMemory_ - 1;
+    lbfgsS_.resize(lbfgsMemory_);
+    lbfgsY_.resize(lbfgsMemory_);
+    lbfgsRho_.resize(lbfgsMemory_);
+    lbfgsAlpha_.resize(lbfgsMemory_);
+    bool stop = false;
+    do
+    {
+        // only starts an iteration that is expected to finish before the deadline
+        if (!this->iteration_fits())
+            break;
+        iters++;
+        // 1) direction. Without memory, the first step is scaled by the gradient
+        auto t1 = std::chrono::steady_clock::now();
+        this->lbfgs_direction();
+        matData_t alpha = lbfgsSize_ > 0 ? 1.0 : std::min(1.0, 1.0 / gradient_.norm());
+        phaseTimes_.timeSolve += elapsed_microseconds(t1);
+
+        // 2) line search
+        matData_t current_error = previous_error;
+        bool success = this->line_search_wolfe(current_error, alpha, wolfeC2LBFGS_);
+        if (!success)
+        {
+            stop = this->add_record(iters, 0.0, previous_error, 0.0, 0.0, 0.0, false);
+            if (lbfgsSize_ == 0)
+            {
+                status_ = DIVERGED;
+                log_.summary("Optimizer::optimize_lbfgs", "line search failed", iters, previous_error);
+                return 0;
+            }
+            // the approximation of the Hessian is not valid, it restarts from the gradient
+            lbfgsSize_ = 0;
+            continue;
+        }
+        diff_error = previous_error - current_error;
+        stop = this->add_record(iters, 0.0, previous_error, diff_error, 0.0, dx_.norm(), true);
+        previous_error = current_error;
+
+        // 3) memory update, only if the curvature y's is positive (always under the Wolfe conditions)
+        uint_t next = (lbfgsNewest_ + 1) % lbfgsMemory_;
+        lbfgsS_[next] = dx_;
+        lbfgsY_[next] = gradient_ - previousGradient_;
+        matData_t curvature = lbfgsY_[next].dot(lbfgsS_[next]);
+        if (curvature > Eigen::NumTraits<matData_t>::epsilon() * lbfgsY_[next].norm() * lbfgsS_[next].norm())
+        {
+            lbfgsRho_[next] = 1.0 / curvature;
+            lbfgsNewest_ = next;
+            lbfgsSize_ = std::min(lbfgsSize_ + 1, lbfgsMemory_);
+        }
+    }while((!(diff_error < solutionTolerance_) || lbfgsSize_ == 0) && iters < max_iters_ && !stop);
+    if (diff_error < solutionTolerance_ && lbfgsSize_ > 0)
+        status_ = CONVERGED;
+    else if (stop)
+        status_ = STOPPED;
+    else
+        log_.summary("Optimizer::optimize_lbfgs", "failed to converge", iters, previous_error);
+
+    return iters;
+}
+
+uint_t Optimizer::optimize_nonlinear_cg()
+{
+    uint_t iters = 0;
+    matData_t previous_error = this->evaluate_error(), diff_error = 0.0;
+    this->calculate_gradient();
+    direction_ = -gradient_;
+    // the initial step is scaled by the gradient, and then by the previous step and slope (Nocedal and Wright, 3.60)
+    matData_t alpha = std::min(1.0, 1.0 / gradient_.norm());
+    matData_t previous_slope = gradient_.dot(direction_);
+    bool stop = false, restarted = true;
+    do
+    {
+        // only starts an iteration that is expected to finish before the deadline
+        if (!this->iteration_fits())
+            break;
+        iters++;
+        matData_t current_error = previous_error;
+        bool success = this->line_search_wolfe(current_error, alpha, wolfeC2CG_);
+        if (!success)
+        {
+            stop = this->add_record(iters, 0.0, previous_error, 0.0, 0.0, 0.0, false);
+            if (restarted)
+            {
+                status_ = DIVERGED;
+                log_.summary("Optimizer::optimize_nonlinear_cg", "line search failed", iters, previous_error);
+                return 0;
+            }
+            direction_ = -gradient_;
+            previous_slope = gradient_.dot(direction_);
+            alpha = std::min(1.0, 1.0 / gradient_.norm());
+            restarted = true;
+            continue;
+        }
+        diff_error = previous_error - current_error;
+        alpha = dx_.norm() / direction_.norm();
+
+        // Polak-Ribiere+ update, restarted along the gradient if it is not a descent direction
+        auto t1 = std::chrono::steady_clock::now();
+        matData_t beta = std::max(0.0, gradient_.dot(gradient_ - previousGradient_) / previousGradient_.squaredNorm());
+        direction_ = beta * direction_ - gradient_;
+        matData_t slope = gradient_.dot(direction_);
+        restarted = !(slope < 0);
+        if (restarted)
+        {
+            direction_ = -gradient_;
+            slope = -gradient_.squaredNorm();
+        }
+        alpha *= previous_slope / slope;
+        previous_slope = slope;
+        phaseTimes_.timeSolve += elapsed_microseconds(t1);
+        stop = this->add_record(iters, 0.0, previous_error, diff_error, 0.0, dx_.norm(), true);
+        previous_error = current_error;
+    }while(!(diff_error < solutionTolerance_) && iters < max_iters_ && !stop);
+    if (diff_error < solutionTolerance_ && iters > 0)
+        status_ = CONVERGED;
+    else if (stop)
+        status_ = STOPPED;
+    else
+        log_.summary("Optimizer::optimize_nonlinear_cg", "failed to converge", iters, previous_error);
 
     return iters;
 }
@@ -177,8 +796,234 @@ OptimizerDense::~OptimizerDense()
 
 }
 
-matData_t OptimizerDense::calculate_model_fidelity(matData_t diff_error)
+void OptimizerDense::hessian_product(const MatX1 &v, MatX1 &Hv)
+{
+    Hv.noalias() = hessian_ * v;
+}
+
+
+OptimizerSparse::OptimizerSparse(matData_t solutionTolerance, matData_t lambda):
+        Optimizer(solutionTolerance, lambda), mixedPrecision_(false), maxRefinements_(5),
+        refinementTolerance_(1e-14), speculativeLambdas_(1), speculativeThreads_(0)
+{
+
+}
+OptimizerSparse::~OptimizerSparse()
+{
+
+}
+
+void OptimizerSparse::update_pattern()
+{
+    using StorageIndex = SMatCol::StorageIndex;
+    assert(hessian_.isCompressed() && "OptimizerSparse::update_pattern: Hessian is not compressed");
+    const StorageIndex *outer = hessian_.outerIndexPtr(), *inner = hessian_.innerIndexPtr();
+    const StorageIndex n = hessian_.cols();
+    if (analyzedOuter_.size() == static_cast<size_t>(n + 1) &&
+        analyzedInner_.size() == static_cast<size_t>(hessian_.nonZeros()) &&
+        std::equal(analyzedOuter_.begin(), analyzedOuter_.end(), outer) &&
+        std::equal(analyzedInner_.begin(), analyzedInner_.end(), inner))
+        return;
+
+    // the double precision factorization is analyzed on demand if mixed precision falls back,
+    // and speculative LM copies it when needed
+    if (mixedPrecision_)
+    {
+        choleskyFloat_.analyze_pattern(hessian_);
+        cholesky_.clear();
+    }
+    else
+    {
+        cholesky_.analyze_pattern(hessian_);
+        choleskyFloat_.clear();
+    }
+    speculativeCholesky_.clear();
+    analyzedOuter_.assign(outer, outer + n + 1);
+    analyzedInner_.assign(inner, inner + hessian_.nonZeros());
+    diagIndex_.resize(n);
+    for (StorageIndex j = 0; j < n; ++j)
+    {
+        const StorageIndex *p = std::lower_bound(inner + outer[j], inner + outer[j+1], j);
+        assert(p != inner + outer[j+1] && *p == j && "OptimizerSparse::update_pattern: the diagonal must be in the pattern");
+        diagIndex_[j] = p - inner;
+    }
+    diagHessian_.resize(n);
+    dx_.resize(n);
+    dxNewton_.resize(n);
+    dxCauchy_.resize(n);
+    Hv_.resize(n);
+    refinementResidual_.resize(n);
+    refinementCorrection_.resize(n);
+}
+
+bool OptimizerSparse::calculate_newton_step(bool useLambda)
+{
+    // 1) build problem: Gradient and Hessian and re-evaluates. After a rejected step
+    //    the problem is the same and only the damping changes.
+    auto t1 = std::chrono::steady_clock::now();
+    if (!(useLambda && reuseLinearization_))
+    {
+        calculate_gradient_hessian();
+        update_pattern();
+        for (size_t j = 0; j < diagIndex_.size(); ++j)
+            diagHessian_(j) = hessian_.valuePtr()[diagIndex_[j]];
+    }
+    matData_t *values = hessian_.valuePtr();
+    if (useLambda)
+    {
+        bool elliptical = optimization_method_ == LEVENBERG_MARQUARDT_ELLIP;
+        for (size_t j = 0; j < diagIndex_.size(); ++j)
+            values[diagIndex_[j]] = trustRegion_.damp(diagHessian_(j), elliptical);
+    }
+    phaseTimes_.timeBuild += elapsed_microseconds(t1);
+
+    // 2) dx = - h^-1 * grad, only the numerical factorization is calculated
+    if (mixedPrecision_ && this->solve_mixed_precision())
+    {
+        dx_ = -dx_;
+        return true;
+    }
+    t1 = std::chrono::steady_clock::now();
+    if (!cholesky_.is_analyzed())
+        cholesky_.analyze_pattern(hessian_);
+    bool success = cholesky_.factorize(hessian_) && cholesky_.is_full_rank();
+    phaseTimes_.timeFactorize += elapsed_microseconds(t1);
+    if (!success)
+        return false;
+    t1 = std::chrono::steady_clock::now();
+    cholesky_.solve(gradient_, dx_);
+    dx_ = -dx_;
+    phaseTimes_.timeSolve += elapsed_microseconds(t1);
+    return true;
+}
+
+bool OptimizerSparse::solve_mixed_precision()
+{
+    auto t1 = std::chrono::steady_clock::now();
+    if (!choleskyFloat_.is_analyzed())
+        choleskyFloat_.analyze_pattern(hessian_);
+    // the rank is not checked, pivots of a well scaled problem may be below n * eps in single precision
+    // and the refinement fails anyway if H is too ill-conditioned for the single precision factor
+    bool success = choleskyFloat_.factorize(hessian_);
+    phaseTimes_.timeFactorize += elapsed_microseconds(t1);
+    if (!success)
+        return false;
+
+    // iterative refinement: residuals are calculated in double precision, H stores both triangular parts.
+    // The stop criterion is the normwise backward error, as in LAPACK dsgesv, since the residual of
+    // an ill-conditioned system can not be reduced much below eps |H| |dx|
+    t1 = std::chrono::steady_clock::now();
+    choleskyFloat_.solve(gradient_, dx_);
+    const matData_t normH = hessian_.norm();
+    for (uint_t i = 0; ; ++i)
+    {
+        refinementResidual_.noalias() = gradient_ - hessian_ * dx_;
+        matData_t residualNorm = refinementResidual_.norm();
+        if (residualNorm <= refinementTolerance_ * normH * dx_.norm())
+            break;
+        if (i == maxRefinements_ || !std::isfinite(residualNorm))
+        {
+            success = false;
+            break;
+        }
+        choleskyFloat_.solve(refinementResidual_, refinementCorrection_);
+        dx_ += refinementCorrection_;
+    }
+    phaseTimes_.timeSolve += elapsed_microseconds(t1);
+    return success;
+}
+
+bool OptimizerSparse::calculate_speculative_step(matData_t &error)
 {
+    const uint_t K = speculativeLambdas_;
+    if (K <= 1)
+        return Optimizer::calculate_speculative_step(error);
+    // 1) memory for the candidates, which share the symbolic decomposition, only when the pattern changes
+    if (speculativeCholesky_.size() != K)
+    {
+        if (!cholesky_.is_analyzed())
+            cholesky_.analyze_pattern(hessian_);
+        speculativeHessian_.assign(K, hessian_);
+        speculativeCholesky_.resize(K);
+        for (auto &cholesky : speculativeCholesky_)
+        {
+            cholesky.reset(new SparseLDLT());
+            cholesky->copy_analysis(cholesky_);
+        }
+        speculativeDx_.assign(K, MatX1(hessian_.cols()));
+        speculativeRegions_.resize(K);
+        speculativeSuccess_.resize(K);
+    }
+    // lambda of each candidate, as after k consecutive rejections
+    TrustRegion region = trustRegion_;
+    for (uint_t k = 0; k < K; ++k)
+    {
+        speculativeRegions_[k] = region;
+        region.reject();
+    }
 
-    return diff_error / (-dx_.dot(gradient_) - 0.5*dx_.dot(hessian_* dx_));
+    // 2) damping, factorization and solution of each candidate
+    auto t1 = std::chrono::steady_clock::now();
+    const bool elliptical = optimization_method_ == LEVENBERG_MARQUARDT_ELLIP;
+    parallel_for(K, speculativeThreads_, [&](uint_t k)
+    {
+        matData_t *valuesK = speculativeHessian_[k].valuePtr();
+        std::copy(hessian_.valuePtr(), hessian_.valuePtr() + hessian_.nonZeros(), valuesK);
+        for (size_t j = 0; j < diagIndex_.size(); ++j)
+            valuesK[diagIndex_[j]] = speculativeRegions_[k].damp(diagHessian_(j), elliptical);
+        speculativeSuccess_[k] = speculativeCholesky_[k]->factorize(speculativeHessian_[k]) &&
+                                 speculativeCholesky_[k]->is_full_rank();
+        if (speculativeSuccess_[k])
+        {
+            speculativeCholesky_[k]->solve(gradient_, speculativeDx_[k]);
+            speculativeDx_[k] = -speculativeDx_[k];
+        }
+    });
+    phaseTimes_.timeFactorize += elapsed_microseconds(t1);
+
+    // 3) error of each step. It is evaluated sequentially, since all candidates update the same state,
+    //    book-kept by the LM iteration. The state is left at the last candidate evaluated
+    uint_t best = K, last = K;
+    matData_t bestError = error, lastError = error;
+    for (uint_t k = 0; k < K; ++k)
+    {
+        if (!speculativeSuccess_[k])
+            continue;
+        if (last != K)
+            this->update_state_from_bookkeep();
+        dx_ = speculativeDx_[k];
+        this->update_state();
+        lastError = this->evaluate_error();
+        last = k;
+        if (std::isfinite(lastError) && lastError < bestError)
+        {
+            best = k;
+            bestError = lastError;
+        }
+    }
+    // 4) if none improves, the largest lambda factorized, so it is rejected and lambda keeps increasing
+    if (last == K)
+        return false;
+    if (best == K)
+    {
+        best = last;
+        bestError = lastError;
+    }
+    dx_ = speculativeDx_[best];
+    if (best != last)
+    {
+        this->update_state_from_bookkeep();
+        this->update_state();
+    }
+    error = bestError;
+    trustRegion_ = speculativeRegions_[best];
+    std::copy(speculativeHessian_[best].valuePtr(), speculativeHessian_[best].valuePtr() + hessian_.nonZeros(),
+            hessian_.valuePtr());
+    return true;
+}
+
+void OptimizerSparse::hessian_product(const MatX1 &v, MatX1 &Hv)
+{
+    Hv.resize(v.rows());
+    Hv.noalias() = hessian_.selfadjointView<Eigen::Lower>() * v;
 }
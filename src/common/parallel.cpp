@@ -0,0 +1,65 @@
+/* Copyright (c) 2022, Gonzalo Ferrer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * parallel.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Gonzalo Ferrer
+ *              g.ferrer@skoltech.ru
+ *              Mobile Robotics Lab, Skoltech
+ */
+
+#include "mrob/parallel.hpp"
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+using namespace mrob;
+
+
+uint_t mrob::get_number_threads(uint_t numThreads)
+{
+    if (numThreads > 0)
+        return numThreads;
+    // hardware_concurrency() may return 0 if it is not computable
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void mrob::parallel_for(uint_t n, uint_t numThreads, const std::function<void(uint_t)> &function)
+{
+    uint_t threads = std::min(get_number_threads(numThreads), n);
+    if (threads <= 1)
+    {
+        for (uint_t i = 0; i < n; ++i)
+            function(i);
+        return;
+    }
+
+    // indices are taken one by one, since the cost of each call may be very different
+    std::atomic<uint_t> next(0);
+    auto worker = [&]()
+    {
+        for (uint_t i = next++; i < n; i = next++)
+            function(i);
+    };
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for (uint_t t = 1; t < threads; ++t)
+        pool.emplace_back(worker);
+    worker();
+    for (auto &t : pool)
+        t.join();
+}
@@ -0,0 +1,166 @@
+/* Copyright (c) 2022, Gonzalo Ferrer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * sparse_ldlt.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Gonzalo Ferrer
+ *              g.ferrer@skoltech.ru
+ *              Mobile Robotics Lab, Skoltech
+ */
+
+#include "mrob/sparse_ldlt.hpp"
+#include <Eigen/OrderingMethods>
+#include <algorithm>
+#include <cassert>
+
+using namespace mrob;
+
+
+template<typename Scalar>
+BasicSparseLDLT<Scalar>::BasicSparseLDLT() :
+        Base(), isAnalyzed_(false)
+{
+}
+
+template<typename Scalar>
+void BasicSparseLDLT<Scalar>::analyze_pattern(const SMatCol &L)
+{
+    assert(L.rows() == L.cols() && "SparseLDLT::analyze_pattern: matrix is not square");
+    assert(L.isCompressed() && "SparseLDLT::analyze_pattern: matrix is not compressed");
+    const StorageIndex n = L.cols();
+
+    // 1) fill-in reducing ordering, following the convention in Eigen P = Pinv^-1
+    Eigen::AMDOrdering<StorageIndex> ordering;
+    Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, StorageIndex> Pinv;
+    ordering(L, Pinv);
+    perm_.resize(n);
+    for (StorageIndex i = 0; i < n; ++i)
+        perm_[Pinv.indices()(i)] = i;
+
+    // 2) pattern of the upper part of P L P', only the lower part of L is used
+    std::vector<Eigen::Triplet<Scalar>> pattern;
+    pattern.reserve(L.nonZeros()/2 + n);
+    for (StorageIndex j = 0; j < n; ++j)
+    {
+        for (SMatCol::InnerIterator it(L, j); it; ++it)
+        {
+            if (it.row() < j)
+                continue;
+            StorageIndex pi = perm_[it.row()], pj = perm_[j];
+            pattern.emplace_back(std::min(pi,pj), std::max(pi,pj), 0.0);
+        }
+    }
+    permutedUpper_.resize(n,n);
+    permutedUpper_.setFromTriplets(pattern.begin(), pattern.end());
+    permutedUpper_.makeCompressed();
+
+    // 3) gather map from the input values to the permuted matrix
+    gatherIndex_.resize(permutedUpper_.nonZeros());
+    const StorageIndex *outer = permutedUpper_.outerIndexPtr();
+    const StorageIndex *inner = permutedUpper_.innerIndexPtr();
+    for (StorageIndex j = 0; j < n; ++j)
+    {
+        for (StorageIndex k = L.outerIndexPtr()[j]; k < L.outerIndexPtr()[j+1]; ++k)
+        {
+            StorageIndex i = L.innerIndexPtr()[k];
+            if (i < j)
+                continue;
+            StorageIndex pi = perm_[i], pj = perm_[j];
+            StorageIndex row = std::min(pi,pj), col = std::max(pi,pj);
+            const StorageIndex *p = std::lower_bound(inner + outer[col], inner + outer[col+1], row);
+            gatherIndex_[p - inner] = k;
+        }
+    }
+
+    // 4) elimination tree and memory for the factor
+    Base::analyzePattern_preordered(permutedUpper_, true);
+    work_.resize(n);
+    isAnalyzed_ = true;
+}
+
+template<typename Scalar>
+void BasicSparseLDLT<Scalar>::copy_analysis(const BasicSparseLDLT &other)
+{
+    assert(other.isAnalyzed_ && "SparseLDLT::copy_analysis: pattern not analyzed");
+    permutedUpper_ = other.permutedUpper_;
+    gatherIndex_ = other.gatherIndex_;
+    perm_ = other.perm_;
+    work_.resize(other.work_.rows());
+
+    // the elimination tree is linear on the pattern, the ordering (AMD) is the expensive part
+    Base::analyzePattern_preordered(permutedUpper_, true);
+    isAnalyzed_ = true;
+}
+
+template<typename Scalar>
+bool BasicSparseLDLT<Scalar>::factorize(const SMatCol &L)
+{
+    assert(isAnalyzed_ && "SparseLDLT::factorize: pattern not analyzed");
+    assert(L.nonZeros() >= permutedUpper_.nonZeros() && "SparseLDLT::factorize: pattern has changed");
+    Scalar *values = permutedUpper_.valuePtr();
+    const matData_t *input = L.valuePtr();
+    const size_t nnz = gatherIndex_.size();
+    for (size_t p = 0; p < nnz; ++p)
+        values[p] = static_cast<Scalar>(input[gatherIndex_[p]]);
+
+    Base::template factorize_preordered<true>(permutedUpper_);
+    return this->info() == Eigen::Success;
+}
+
+template<typename Scalar>
+bool BasicSparseLDLT<Scalar>::is_full_rank() const
+{
+    if (this->info() != Eigen::Success)
+        return false;
+    if (this->m_diag.size() == 0)
+        return true;
+    Scalar n = this->m_diag.size();
+    return this->m_diag.minCoeff() > n * Eigen::NumTraits<Scalar>::epsilon() * this->m_diag.maxCoeff();
+}
+
+template<typename Scalar>
+void BasicSparseLDLT<Scalar>::solve(VectRefConst &b, MatX1 &x)
+{
+    const StorageIndex n = static_cast<StorageIndex>(perm_.size());
+    assert(b.rows() == n && "SparseLDLT::solve: incorrect dimensions");
+    x.resize(n);
+    for (StorageIndex i = 0; i < n; ++i)
+        work_(perm_[i]) = static_cast<Scalar>(b(i));
+
+    // P L D L' P' x = b
+    this->matrixL().solveInPlace(work_);
+    work_.array() /= this->m_diag.array();// vectorD() would return a copy
+    this->matrixU().solveInPlace(work_);
+
+    for (StorageIndex i = 0; i < n; ++i)
+        x(i) = work_(perm_[i]);
+}
+
+template<typename Scalar>
+void BasicSparseLDLT<Scalar>::clear()
+{
+    // swapping with empty objects releases the memory, resize() keeps it
+    SMatScalar().swap(permutedUpper_);
+    SMatScalar().swap(this->m_matrix);
+    Eigen::Matrix<Scalar, Eigen::Dynamic, 1>().swap(this->m_diag);
+    Eigen::Matrix<Scalar, Eigen::Dynamic, 1>().swap(work_);
+    std::vector<StorageIndex>().swap(gatherIndex_);
+    std::vector<StorageIndex>().swap(perm_);
+    isAnalyzed_ = false;
+}
+
+template class mrob::BasicSparseLDLT<matData_t>;
+template class mrob::BasicSparseLDLT<float>;
@@ -0,0 +1,221 @@
+/* Copyright (c) 2022, Gonzalo Ferrer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * test_common.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Gonzalo Ferrer
+ *              g.ferrer@skoltech.ru
+ *              Mobile Robotics Lab, Skoltech
+ */
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch.hpp>
+
+#include "mrob/optimizer.hpp"
+#include "mrob/kd_tree.hpp"
+#include "mrob/voxel_hash_map.hpp"
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+
+// Extended Rosenbrock function as a sparse least squares problem, with minimum at x = 1:
+// r_2i = 10 (x_2i+1 - x_2i^2), r_2i+1 = 1 - x_2i
+class RosenbrockSparse : public mrob::OptimizerSparse
+{
+public:
+    RosenbrockSparse(int n, mrob::matData_t tolerance = 1e-4) :
+        mrob::OptimizerSparse(tolerance), x_(2*n), assemblies_(0), gradients_(0), errors_(0)
+    {
+        for (int i = 0; i < n; ++i)
+            x_.segment<2>(2*i) << -1.2, 1.0;
+    }
+    mrob::matData_t calculate_error() override
+    {
+        errors_++;
+        mrob::matData_t error = 0.0;
+        for (int i = 0; i < x_.rows(); i += 2)
+            error += 0.5*(100*std::pow(x_(i+1) - x_(i)*x_(i), 2) + std::pow(1 - x_(i), 2));
+        return error;
+    }
+    void calculate_gradient_hessian() override
+    {
+        assemblies_++;
+        std::vector<mrob::Triplet> triplets;
+        gradient_.resize(x_.rows());
+        for (int i = 0; i < x_.rows(); i += 2)
+        {
+            mrob::Mat2 J;
+            J << -20*x_(i), 10, -1, 0;
+            mrob::Mat21 r(10*(x_(i+1) - x_(i)*x_(i)), 1 - x_(i));
+            mrob::Mat2 H = J.transpose()*J;
+            gradient_.segment<2>(i) = J.transpose()*r;
+            for (int k = 0; k < 2; ++k)
+                for (int l = 0; l < 2; ++l)
+                    triplets.emplace_back(i+k, i+l, H(k,l));
+        }
+        hessian_.resize(x_.rows(), x_.rows());
+        hessian_.setFromTriplets(triplets.begin(), triplets.end());
+    }
+    void calculate_gradient() override
+    {
+        gradients_++;
+        gradient_.resize(x_.rows());
+        for (int i = 0; i < x_.rows(); i += 2)
+            gradient_.segment<2>(i) << -200*x_(i)*(x_(i+1) - x_(i)*x_(i)) - (1 - x_(i)), 100*(x_(i+1) - x_(i)*x_(i));
+    }
+    void update_state() override { x_ += dx_; }
+    void bookkeep_state() override { xAux_ = x_; }
+    void update_state_from_bookkeep() override { x_ = xAux_; }
+
+    mrob::MatX1 x_, xAux_;
+    int assemblies_, gradients_, errors_;
+};
+
+TEST_CASE("Sparse optimizer converges and reuses the Hessian after rejected steps")
+{
+    for (auto method : {mrob::Optimizer::NEWTON_RAPHSON, mrob::Optimizer::LEVENBERG_MARQUARDT_SPHER,
+                        mrob::Optimizer::LEVENBERG_MARQUARDT_ELLIP, mrob::Optimizer::DOGLEG,
+                        mrob::Optimizer::NEWTON_RAPHSON_LINE_SEARCH})
+    {
+        RosenbrockSparse problem(50);
+        problem.set_verbosity(mrob::IterationLog::SILENT);
+        REQUIRE(problem.solve(method, 100, 10.0) > 0);
+        REQUIRE((problem.x_ - mrob::MatX1::Ones(100)).norm() == Approx(0.0).margin(1e-4));
+        // the problem is only assembled again after an accepted step
+        auto &records = problem.get_iteration_records();
+        int assemblies = 1;
+        for (size_t i = 0; i + 1 < records.size(); ++i)
+            assemblies += records[i].accepted;
+        REQUIRE(problem.assemblies_ == assemblies);
+    }
+}
+
+TEST_CASE("Speculative LM evaluates the error once per candidate")
+{
+    const int K = 4;
+    RosenbrockSparse problem(50);
+    problem.set_verbosity(mrob::IterationLog::SILENT);
+    problem.set_speculative_lambdas(K, 1);
+    REQUIRE(problem.solve(mrob::Optimizer::LEVENBERG_MARQUARDT_SPHER, 100, 10.0) > 0);
+    REQUIRE((problem.x_ - mrob::MatX1::Ones(100)).norm() == Approx(0.0).margin(1e-4));
+    // after a rejected step, the K candidates are evaluated and the chosen one is not evaluated again
+    auto &records = problem.get_iteration_records();
+    int expected = 1, speculative = 0;
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        bool afterRejection = i > 0 && !records[i-1].accepted;
+        speculative += afterRejection;
+        expected += afterRejection ? K : 1;
+    }
+    REQUIRE(speculative > 0);
+    REQUIRE(problem.errors_ == expected);
+}
+
+TEST_CASE("L-BFGS and nonlinear CG converge only with gradients")
+{
+    for (auto method : {mrob::Optimizer::LBFGS, mrob::Optimizer::NONLINEAR_CG})
+    {
+        RosenbrockSparse problem(50, 1e-14);
+        problem.set_verbosity(mrob::IterationLog::SILENT);
+        REQUIRE(problem.solve(method, 1000) > 0);
+        REQUIRE((problem.x_ - mrob::MatX1::Ones(100)).norm() == Approx(0.0).margin(1e-4));
+        REQUIRE(problem.assemblies_ == 0);
+        REQUIRE(problem.gradients_ > 0);
+        // the same with the curvature conditions of each method exchanged
+        RosenbrockSparse problem2(50, 1e-14);
+        problem2.set_verbosity(mrob::IterationLog::SILENT);
+        problem2.set_wolfe_conditions(1e-4, 0.1, 0.9);
+        REQUIRE(problem2.solve(method, 1000) > 0);
+        REQUIRE((problem2.x_ - mrob::MatX1::Ones(100)).norm() == Approx(0.0).margin(1e-4));
+    }
+}
+
+TEST_CASE("KD-tree and voxel hash map tests")
+{
+    SECTION("KD-tree and voxel hash map agree with the brute force search")
+    {
+        mrob::MatX points = mrob::MatX::Random(2000, 3);
+        mrob::MatX queries = mrob::MatX::Random(50, 3);
+        mrob::KDTree tree(points, 8, 3);
+        mrob::VoxelHashMap voxels(0.1);
+        voxels.insert_array(points);
+        for (int q = 0; q < queries.rows(); ++q)
+        {
+            mrob::Mat31 x = queries.row(q).transpose();
+            mrob::MatX1 d2 = (points.rowwise() - queries.row(q)).rowwise().squaredNorm();
+            std::vector<mrob::matData_t> sorted(d2.data(), d2.data() + d2.size());
+            std::sort(sorted.begin(), sorted.end());
+            mrob::uint_t index;
+            mrob::matData_t distance2;
+            REQUIRE(tree.nearest(x, 10.0, index, distance2));
+            REQUIRE(distance2 == sorted[0]);
+            REQUIRE(voxels.nearest(x, 10.0, index, distance2));
+            REQUIRE(distance2 == sorted[0]);
+            std::vector<mrob::uint_t> indices;
+            std::vector<mrob::matData_t> distances2;
+            tree.knn(x, 5, indices, distances2);
+            REQUIRE(distances2 == std::vector<mrob::matData_t>(sorted.begin(), sorted.begin() + 5));
+            std::size_t inside = std::upper_bound(sorted.begin(), sorted.end(), 0.2 * 0.2) - sorted.begin();
+            tree.radius(x, 0.2, indices, distances2);
+            REQUIRE(indices.size() == inside);
+            voxels.radius(x, 0.2, indices, distances2);
+            REQUIRE(indices.size() == inside);
+        }
+        // removed points are not found anymore
+        REQUIRE(voxels.remove(0));
+        REQUIRE_FALSE(voxels.remove(0));
+        mrob::uint_t index;
+        mrob::matData_t distance2;
+        REQUIRE((!voxels.nearest(points.row(0).transpose(), 1e-12, index, distance2) || index != 0));
+        REQUIRE(voxels.size() == 1999);
+    }
+
+    SECTION("Voxel hash map searches without a distance limit stop at the occupied voxels")
+    {
+        const mrob::matData_t inf = std::numeric_limits<mrob::matData_t>::infinity();
+        mrob::VoxelHashMap voxels(0.1);
+        mrob::uint_t index;
+        mrob::matData_t distance2;
+        std::vector<mrob::uint_t> indices;
+        std::vector<mrob::matData_t> distances2;
+        REQUIRE_FALSE(voxels.nearest(mrob::Mat31::Zero(), inf, index, distance2));
+        voxels.radius(mrob::Mat31::Zero(), inf, indices, distances2);
+        REQUIRE(indices.empty());
+
+        // a single point far away from the query is found, with no limit on the distance
+        mrob::uint_t far = voxels.insert(mrob::Mat31(100.0, -50.0, 20.0));
+        mrob::uint_t near = voxels.insert(mrob::Mat31(1.0, 0.0, 0.0));
+        REQUIRE(voxels.nearest(mrob::Mat31::Zero(), inf, index, distance2));
+        REQUIRE(index == near);
+        REQUIRE(distance2 == Approx(1.0));
+        REQUIRE(voxels.remove(near));
+        REQUIRE(voxels.nearest(mrob::Mat31::Zero(), inf, index, distance2));
+        REQUIRE(index == far);
+        REQUIRE(distance2 == Approx(100.0*100.0 + 50.0*50.0 + 20.0*20.0));
+        REQUIRE_FALSE(voxels.nearest(mrob::Mat31::Zero(), 100.0, index, distance2));
+        voxels.radius(mrob::Mat31::Zero(), inf, indices, distances2);
+        REQUIRE(indices == std::vector<mrob::uint_t>{far});
+
+        // queries outside of the occupied voxels
+        REQUIRE(voxels.nearest(mrob::Mat31(-1e6, 1e6, 0.0), inf, index, distance2));
+        REQUIRE(index == far);
+        voxels.clear();
+        REQUIRE_FALSE(voxels.nearest(mrob::Mat31::Zero(), inf, index, distance2));
+    }
+}
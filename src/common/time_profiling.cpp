@@ -22,11 +22,13 @@
  */
 
 #include "mrob/time_profiling.hpp"
+#include "mrob/allocation_counter.hpp"
 #include <iostream>
 
 using namespace mrob;
 
-TimeProfiling::TimeProfiling()
+TimeProfiling::TimeProfiling():
+        allocations1_(0)
 {
 
 }
@@ -38,20 +40,39 @@ TimeProfiling::~TimeProfiling()
 
 void TimeProfiling::reset()
 {
-    time_profiles_.clear();
+    for (auto &t : time_profiles_)
+    {
+        t.time = 0.0;
+        t.allocations = 0;
+        t.calls = 0;
+    }
     t1_ = std::chrono::steady_clock::now();
+    allocations1_ = get_allocation_count();
 }
 
 void TimeProfiling::start()
 {
+    allocations1_ = get_allocation_count();
     t1_ = std::chrono::steady_clock::now();
 }
 
-void TimeProfiling::stop(const std::string &key)
+void TimeProfiling::stop(const char *key)
 {
     auto t2 = std::chrono::steady_clock::now();
+    uint64_t allocations = get_allocation_count() - allocations1_;
     auto dif = std::chrono::duration_cast<Ttim>(t2 - t1_);
-    time_profiles_.push_back( std::make_pair(key,  dif.count()) );
+    for (auto &t : time_profiles_)
+    {
+        if (t.key == key)
+        {
+            t.time += dif.count();
+            t.allocations += allocations;
+            t.calls++;
+            return;
+        }
+    }
+    // only new keys allocate
+    time_profiles_.push_back( Profile{key, static_cast<double>(dif.count()), allocations, 1} );
 }
 
 
@@ -61,7 +82,14 @@ void TimeProfiling::print()
 
     std::cout << "\nTime profile for " << sum/1e3 << " [ms]: ";
     for (auto &&t : time_profiles_)
-        std::cout << t.first << " = " << t.second/sum *100 << "%,\n";
+    {
+        if (t.calls == 0)
+            continue;
+        std::cout << t.key << " = " << t.time/sum *100 << "%";
+        if (allocation_counter_enabled())
+            std::cout << " (" << t.allocations << " allocations)";
+        std::cout << ",\n";
+    }
     std::cout << "\n";
 }
 
@@ -69,6 +97,14 @@ double TimeProfiling::total_time()
 {
     double sum = 0;
     for (auto &&t : time_profiles_)
-        sum += t.second;
+        sum += t.time;
+    return sum;
+}
+
+uint64_t TimeProfiling::total_allocations()
+{
+    uint64_t sum = 0;
+    for (auto &&t : time_profiles_)
+        sum += t.allocations;
     return sum;
 }
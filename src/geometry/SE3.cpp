@@ -201,15 +201,28 @@ Mat31 SE3::transform(const Mat31 & p) const
 }
 
 
-MatX SE3::transform_array(const MatX &P) const
+namespace
+{
+template<typename Scalar>
+MatXT<Scalar> transform_array_scalar(const SE3 &T, const MatXT<Scalar> &P)
 {
     assert(P.cols() == 3 && "SE3::transformArray: incorrect data structure, it is required an Nx3 input");
-    uint_t N = P.rows();
-    MatX res(N,3);
-    for (uint_t i = 0; i < N; ++i)
-        res.row(i) << this->transform(P.row(i)).transpose();
+    // rows are points, so the whole array is transformed as P R' + t'
+    MatXT<Scalar> res = P * T.R().transpose().cast<Scalar>();
+    res.rowwise() += T.t().transpose().cast<Scalar>();
     return res;
 }
+}
+
+MatX SE3::transform_array(const MatX &P) const
+{
+    return transform_array_scalar(*this, P);
+}
+
+MatXf SE3::transform_array(const MatXf &P) const
+{
+    return transform_array_scalar(*this, P);
+}
 
 
 SE3 SE3::inv(void) const
@@ -233,6 +246,26 @@ Mat6 SE3::adj() const
     return res;
 }
 
+Mat6 SE3::jacl() const
+{
+    return jacl6(this->ln_vee());
+}
+
+Mat6 SE3::jacr() const
+{
+    return jacr6(this->ln_vee());
+}
+
+Mat6 SE3::jacl_inv() const
+{
+    return jacl_inv6(this->ln_vee());
+}
+
+Mat6 SE3::jacr_inv() const
+{
+    return jacr_inv6(this->ln_vee());
+}
+
 //Mat4 SE3::T() const
 const Eigen::Ref<const Mat4> SE3::T() const
 {
@@ -298,6 +331,69 @@ bool mrob::isSE3(const Mat4 &T)
     return true;
 }
 
+namespace {
+// Q(w,v) block on the SE3 left Jacobian
+Mat3 jacobian_Q(const Mat31 &w, const Mat31 &v)
+{
+    Mat3 W = hat3(w);
+    Mat3 V = hat3(v);
+    double o = w.norm();
+    double o2 = w.squaredNorm();
+    double c1, c2, c3;
+    // c2 and c3 loose precision for small angles due to the o^4 and o^5 denominators
+    if (o > 1e-2)
+    {
+        double s = std::sin(o), c = std::cos(o);
+        c1 = (o - s)/o2/o;
+        c2 = (o2 + 2*c - 2)/(2*o2*o2);
+        c3 = (2*o - 3*s + o*c)/(2*o2*o2*o);
+    }
+    else
+    {
+        // second order Taylor
+        c1 = 1.0/6.0 - o2/120;
+        c2 = 1.0/24.0 - o2/720;
+        c3 = 1.0/120.0 - o2/2520;
+    }
+    Mat3 WV = W*V, VW = V*W, WVW = WV*W, WW = W*W;
+    return 0.5*V + c1*(WV + VW + WVW) + c2*(WW*V + V*WW - 3*WVW) + c3*(WVW*W + W*WVW);
+}
+}
+
+Mat6 mrob::jacl6(const Mat61 &xi)
+{
+    Mat31 w = xi.head<3>();
+    Mat6 res;
+    Mat3 J = jacl3(w);
+    res.topLeftCorner<3,3>() = J;
+    res.topRightCorner<3,3>().setZero();
+    res.bottomLeftCorner<3,3>() = jacobian_Q(w, xi.tail<3>());
+    res.bottomRightCorner<3,3>() = J;
+    return res;
+}
+
+Mat6 mrob::jacr6(const Mat61 &xi)
+{
+    return jacl6(-xi);
+}
+
+Mat6 mrob::jacl_inv6(const Mat61 &xi)
+{
+    Mat31 w = xi.head<3>();
+    Mat6 res;
+    Mat3 Jinv = jacl_inv3(w);
+    res.topLeftCorner<3,3>() = Jinv;
+    res.topRightCorner<3,3>().setZero();
+    res.bottomLeftCorner<3,3>() = -Jinv * jacobian_Q(w, xi.tail<3>()) * Jinv;
+    res.bottomRightCorner<3,3>() = Jinv;
+    return res;
+}
+
+Mat6 mrob::jacr_inv6(const Mat61 &xi)
+{
+    return jacl_inv6(-xi);
+}
+
 Mat41 SE3::transform_plane(const Mat41 &pi)
 {
     return this->inv().T().transpose() * pi;
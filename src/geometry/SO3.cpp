@@ -249,6 +249,26 @@ Mat3 SO3::adj() const
     return R_;
 }
 
+Mat3 SO3::jacl() const
+{
+    return jacl3(this->ln_vee());
+}
+
+Mat3 SO3::jacr() const
+{
+    return jacr3(this->ln_vee());
+}
+
+Mat3 SO3::jacl_inv() const
+{
+    return jacl_inv3(this->ln_vee());
+}
+
+Mat3 SO3::jacr_inv() const
+{
+    return jacr_inv3(this->ln_vee());
+}
+
 Mat3 SO3::R() const
 {
     return R_;
@@ -288,6 +308,54 @@ bool mrob::isSO3(const Mat3 &R)
 
 }
 
+Mat3 mrob::jacl3(const Mat31 &w)
+{
+    Mat3 w_hat = hat3(w);
+    double o = w.norm();
+    double o2 = w.squaredNorm();
+    double c2, c3;
+    // same coefficients and thresholds as in SE3::exp for the matrix V, which is Jl
+    if ( o > 1e-3)
+    {
+        c2 = (1 - std::cos(o))/o2;
+        c3 = (o - std::sin(o))/o2/o;
+    }
+    else
+    {
+        c2 = 0.5 - o2/24;
+        c3 = 1.0/6.0 - o2/120;
+    }
+    return Mat3::Identity() + c2*w_hat + c3*w_hat*w_hat;
+}
+
+Mat3 mrob::jacr3(const Mat31 &w)
+{
+    return jacl3(-w);
+}
+
+Mat3 mrob::jacl_inv3(const Mat31 &w)
+{
+    Mat3 w_hat = hat3(w);
+    double o = w.norm();
+    double k1;
+    // same as V^-1 in SE3::ln. The cotangent form is well defined at o = pi
+    if (o > 5e-3)
+    {
+        k1 = 1/o/o - 0.5/o/std::tan(0.5*o);
+    }
+    else
+    {
+        // f(o) = 1/12 + 1/2*f''*o^2
+        k1 = 1.0/12 + o*o/720;
+    }
+    return Mat3::Identity() - 0.5*w_hat + k1*w_hat*w_hat;
+}
+
+Mat3 mrob::jacr_inv3(const Mat31 &w)
+{
+    return jacl_inv3(-w);
+}
+
 
 Mat3 mrob::quat_to_so3(const Eigen::Ref<const Mat41> v)
 {
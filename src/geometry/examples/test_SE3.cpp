@@ -114,6 +114,32 @@ TEST_CASE("SO3 tests")
         std::cout << "invers = " << Rt.R() << std::endl;
         REQUIRE((Rt.mul(R).R() - mrob::Mat3::Identity()).norm() == Approx(0.0));
     }
+
+    SECTION("Testing Jacobians")
+    {
+        // Jl from numerical differentiation of Exp(w + dw) Exp(w)^-1
+        const double eps = 1e-6;
+        for (double scale : {1e-9, 1e-4, 1e-2, 1.0, 3.0})
+        {
+            mrob::Mat31 w;
+            w << 0.8, -0.5, 0.33;
+            w *= scale;
+            mrob::SO3 R(w);
+            mrob::Mat3 Jl;
+            for (int i = 0; i < 3; ++i)
+            {
+                mrob::Mat31 dw = mrob::Mat31::Zero();
+                dw(i) = eps;
+                mrob::SO3 Rp(mrob::Mat31(w + dw)), Rm(mrob::Mat31(w - dw));
+                Jl.col(i) = ((Rp * R.inv()).ln_vee() - (Rm * R.inv()).ln_vee()) / (2*eps);
+            }
+            REQUIRE((R.jacl() - Jl).norm() == Approx(0.0).margin(1e-8));
+            REQUIRE((mrob::jacl3(w) - Jl).norm() == Approx(0.0).margin(1e-8));
+            REQUIRE((mrob::jacr3(w) - Jl.transpose()).norm() == Approx(0.0).margin(1e-8));
+            REQUIRE((mrob::jacl_inv3(w) * Jl - mrob::Mat3::Identity()).norm() == Approx(0.0).margin(1e-8));
+            REQUIRE((mrob::jacr_inv3(w) * Jl.transpose() - mrob::Mat3::Identity()).norm() == Approx(0.0).margin(1e-8));
+        }
+    }
 }
 
 TEST_CASE("SE3 tests")
@@ -346,4 +372,35 @@ TEST_CASE("SE3 tests")
 
         REQUIRE((T1.mul(T2).T() - gt).norm() == Approx(0.0).margin(1e-12));
     }
+
+    SECTION("Testing Jacobians")
+    {
+        // Jl and Jl^-1 from numerical differentiation, following the conventions of the factors
+        const double eps = 1e-6;
+        for (double scale : {1e-9, 1e-4, 1e-2, 1.0, 2.5})
+        {
+            mrob::Mat61 xi;
+            xi << 0.8, -0.5, 0.33, 1.0, 2.0, -3.0;
+            xi.head<3>() *= scale;
+            mrob::SE3 T(xi);
+            mrob::Mat6 Jl, JlInv;
+            for (int i = 0; i < 6; ++i)
+            {
+                mrob::Mat61 dxi = mrob::Mat61::Zero();
+                dxi(i) = eps;
+                mrob::SE3 Tp(mrob::Mat61(xi + dxi)), Tm(mrob::Mat61(xi - dxi));
+                Jl.col(i) = ((Tp * T.inv()).ln_vee() - (Tm * T.inv()).ln_vee()) / (2*eps);
+                Tp = T; Tp.update_lhs(dxi);
+                Tm = T; Tm.update_lhs(-dxi);
+                JlInv.col(i) = (Tp.ln_vee() - Tm.ln_vee()) / (2*eps);
+            }
+            REQUIRE((T.jacl() - Jl).norm() == Approx(0.0).margin(1e-7));
+            REQUIRE((mrob::jacl6(xi) - Jl).norm() == Approx(0.0).margin(1e-7));
+            REQUIRE((mrob::jacl_inv6(xi) - JlInv).norm() == Approx(0.0).margin(1e-7));
+            REQUIRE((T.jacl_inv() * T.jacl() - mrob::Mat6::Identity()).norm() == Approx(0.0).margin(1e-10));
+            REQUIRE((T.jacr_inv() * T.jacr() - mrob::Mat6::Identity()).norm() == Approx(0.0).margin(1e-10));
+            // Jr = Adj(T)^-1 Jl
+            REQUIRE((T.adj() * mrob::jacr6(xi) - Jl).norm() == Approx(0.0).margin(1e-7));
+        }
+    }
 }
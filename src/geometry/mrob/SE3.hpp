@@ -133,6 +133,10 @@ public:
      * This function saves to transform to homogeneous coordinates.
      */
     MatX transform_array(const MatX &P) const;
+    /**
+     * Transforms a single precision array of points, Nx3, without converting it to double.
+     */
+    MatXf transform_array(const MatXf &P) const;
     /**
      * Inverse: T^-1 = [R', -R't]
      *                 [0      1]
@@ -144,6 +148,26 @@ public:
      *                  [t^R,  R]
      */
     Mat6 adj() const;
+    /**
+     * Left Jacobian of SE3 evaluated at xi = Ln(T), such that
+     * Exp(xi + dxi) = Exp(Jl dxi) Exp(xi)
+     */
+    Mat6 jacl() const;
+    /**
+     * Right Jacobian of SE3 evaluated at xi = Ln(T), such that
+     * Exp(xi + dxi) = Exp(xi) Exp(Jr dxi)
+     */
+    Mat6 jacr() const;
+    /**
+     * Inverse of the left Jacobian evaluated at xi = Ln(T), such that
+     * Ln(Exp(dxi) T) = xi + Jl^-1 dxi
+     */
+    Mat6 jacl_inv() const;
+    /**
+     * Inverse of the right Jacobian evaluated at xi = Ln(T), such that
+     * Ln(T Exp(dxi)) = xi + Jr^-1 dxi
+     */
+    Mat6 jacr_inv() const;
     /**
      * T method returns a matrix 4x4 of the SE3 transformation. Ref<> is more convinient than
      * the matrix for the factor/nodes base class definitions and python bindings
@@ -211,6 +235,28 @@ Mat61 vee6(const Mat4 &xi_hat);
 
 bool isSE3(const Mat4 &T);
 
+/**
+ * Left Jacobian of SE3 in closed form, for xi = [w, v]:
+ *   Jl(xi) = [Jl(w)     0  ]
+ *            [Q(w,v)  Jl(w)]
+ * where Jl(w) is the left Jacobian of SO3 and Q(w,v) is the closed form in
+ * Barfoot, State Estimation for Robotics (7.86), with the rotation first.
+ * The right Jacobian is Jr(xi) = Jl(-xi).
+ */
+Mat6 jacl6(const Mat61 &xi);
+Mat6 jacr6(const Mat61 &xi);
+/**
+ * Inverse of the left Jacobian of SE3, calculated by blocks:
+ *   Jl^-1(xi) = [Jl(w)^-1                  0     ]
+ *               [-Jl(w)^-1 Q Jl(w)^-1   Jl(w)^-1 ]
+ * The inverse of the right Jacobian is Jr^-1(xi) = Jl^-1(-xi).
+ *
+ * For the residual r = Ln(T) and left updates on T, the exact Jacobian
+ * is Jl^-1(r), while the usual approximation is the identity.
+ */
+Mat6 jacl_inv6(const Mat61 &xi);
+Mat6 jacr_inv6(const Mat61 &xi);
+
 /**
  * Returns the generative matrix given the coordinate,
  * considering xi(0..5) = [theta(0..2), rho(3..5)]
@@ -123,6 +123,26 @@ public:
      * Adjoint: Adj_w = R
      */
     Mat3 adj() const;
+    /**
+     * Left Jacobian of SO3 evaluated at w = Ln(R), such that
+     * Exp(w + dw) = Exp(Jl dw) Exp(w)
+     */
+    Mat3 jacl() const;
+    /**
+     * Right Jacobian of SO3 evaluated at w = Ln(R), such that
+     * Exp(w + dw) = Exp(w) Exp(Jr dw)
+     */
+    Mat3 jacr() const;
+    /**
+     * Inverse of the left Jacobian, evaluated at w = Ln(R), such that
+     * Ln(Exp(dw) R) = w + Jl^-1 dw
+     */
+    Mat3 jacl_inv() const;
+    /**
+     * Inverse of the right Jacobian, evaluated at w = Ln(R), such that
+     * Ln(R Exp(dw)) = w + Jr^-1 dw
+     */
+    Mat3 jacr_inv() const;
     /**
      * R method returns the matrix 3x3 of the SO3 rotation
      */
@@ -163,6 +183,22 @@ Mat31 vee3(const Mat3 &w_hat);
 
 bool isSO3(const Mat3 &R);
 
+/**
+ * Left Jacobian of SO3 in closed form, for the Lie algebra coordinates w:
+ *   Jl(w) = I + (1 - cos(o))/o^2 w^ + (o - sin(o))/o^3 (w^)^2,  o = norm(w)
+ * The right Jacobian is Jr(w) = Jl(-w) = Jl(w)'.
+ */
+Mat3 jacl3(const Mat31 &w);
+Mat3 jacr3(const Mat31 &w);
+/**
+ * Inverse of the left Jacobian of SO3:
+ *   Jl^-1(w) = I - 1/2 w^ + (1/o^2 - cot(o/2)/(2o)) (w^)^2
+ * It is singular for o = 2pi, which is outside the image of Ln.
+ * The inverse of the right Jacobian is Jr^-1(w) = Jl^-1(-w).
+ */
+Mat3 jacl_inv3(const Mat31 &w);
+Mat3 jacr_inv3(const Mat31 &w);
+
 
 /**
  * Function converting from quaternion q = [qx, qy, qz, qw](Eigen convention)
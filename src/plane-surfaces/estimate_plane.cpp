@@ -27,33 +27,21 @@
 
 using namespace mrob;
 
-Mat41 estimate_plane_centered(MatRefConst X);
-Mat41 estimate_plane_homogeneous(MatRefConst X);
-
-Mat41 mrob::estimate_plane(MatRefConst X, bool flagCentered)
+namespace
 {
-    // Initialization
-    assert(X.cols() == 3  && "Estimate_plane: Incorrect sizing, we expect Nx3");
-    assert(X.rows() >= 3  && "Estimate_plane: Incorrect sizing, we expect at least 3 correspondences (not aligned)");
-
-    // Plane estimation, centered approach
-    if (flagCentered)
-        return estimate_plane_centered(X);
-    // Plance estimation, homogenous approach
-    return estimate_plane_homogeneous(X);
-}
-
 //local function, we also will test the homogeneous plane estimation
-Mat41 estimate_plane_centered(MatRefConst X)
+template<typename Scalar>
+Mat41 estimate_plane_centered(const Eigen::Ref<const MatXT<Scalar>> &X)
 {
     uint_t N = X.rows();
-    // Calculate center of points:
-    Mat13 c =  X.colwise().sum();
+    // Calculate center of points, accumulated in double precision:
+    Mat13 c =  X.template cast<matData_t>().colwise().sum();
     c /= (double)N;
 
 
-    MatX qx = X.rowwise() - c;
-    Mat3 C = qx.transpose() * qx;
+    // centered points are small, so their products are calculated in the precision of the points
+    MatXT<Scalar> qx = X.rowwise() - c.cast<Scalar>();
+    Mat3 C = (qx.transpose() * qx).template cast<matData_t>();
 
 
     Eigen::SelfAdjointEigenSolver<Mat3> eigs;
@@ -70,15 +58,17 @@ Mat41 estimate_plane_centered(MatRefConst X)
 
 }
 
-Mat41 estimate_plane_homogeneous(MatRefConst X)
+template<typename Scalar>
+Mat41 estimate_plane_homogeneous(const Eigen::Ref<const MatXT<Scalar>> &X)
 {
     uint_t N = X.rows();
     // Calculate center of points:
-    Mat13 c =  X.colwise().sum();
+    Mat13 c =  X.template cast<matData_t>().colwise().sum();
 
 
+    // second moments are not centered, so they are accumulated in double precision
     Mat4 Q;
-    Q.topLeftCorner<3,3>() = X.transpose() * X;
+    Q.topLeftCorner<3,3>() = X.transpose().template cast<matData_t>() * X.template cast<matData_t>();
     Q.topRightCorner<3,1>() = c;
     Q.bottomLeftCorner<1,3>() = c.transpose();
     Q(3,3) = N;
@@ -98,22 +88,64 @@ Mat41 estimate_plane_homogeneous(MatRefConst X)
 
 }
 
-
-Mat31 mrob::estimate_normal(MatRefConst X)
+template<typename Scalar>
+Mat41 estimate_plane_scalar(const Eigen::Ref<const MatXT<Scalar>> &X, bool flagCentered)
 {
-    Mat41 res = estimate_plane(X);
-    return res.head(3);
-}
+    // Initialization
+    assert(X.cols() == 3  && "Estimate_plane: Incorrect sizing, we expect Nx3");
+    assert(X.rows() >= 3  && "Estimate_plane: Incorrect sizing, we expect at least 3 correspondences (not aligned)");
 
+    // Plane estimation, centered approach
+    if (flagCentered)
+        return estimate_plane_centered<Scalar>(X);
+    // Plance estimation, homogenous approach
+    return estimate_plane_homogeneous<Scalar>(X);
+}
 
-Mat31 mrob::estimate_centroid(MatRefConst X)
+template<typename Scalar>
+Mat31 estimate_centroid_scalar(const Eigen::Ref<const MatXT<Scalar>> &X)
 {
     // Initialization
     assert(X.cols() == 3  && "Estimate_centroid: Incorrect sizing, we expect Nx3");
     assert(X.rows() >= 3  && "Estimate_centroid: Incorrect sizing, we expect at least 3 correspondences (not aligned)");
 
     uint_t N = X.rows();
-    Mat13 c =  X.colwise().sum();
+    Mat13 c =  X.template cast<matData_t>().colwise().sum();
     c /= (double)N;
     return c;
 }
+}
+
+Mat41 mrob::estimate_plane(MatRefConst X, bool flagCentered)
+{
+    return estimate_plane_scalar<matData_t>(X, flagCentered);
+}
+
+Mat41 mrob::estimate_plane(MatfRefConst X, bool flagCentered)
+{
+    return estimate_plane_scalar<float>(X, flagCentered);
+}
+
+
+Mat31 mrob::estimate_normal(MatRefConst X)
+{
+    Mat41 res = estimate_plane(X);
+    return res.head(3);
+}
+
+Mat31 mrob::estimate_normal(MatfRefConst X)
+{
+    Mat41 res = estimate_plane(X);
+    return res.head(3);
+}
+
+
+Mat31 mrob::estimate_centroid(MatRefConst X)
+{
+    return estimate_centroid_scalar<matData_t>(X);
+}
+
+Mat31 mrob::estimate_centroid(MatfRefConst X)
+{
+    return estimate_centroid_scalar<float>(X);
+}
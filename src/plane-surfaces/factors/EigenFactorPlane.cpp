@@ -48,8 +48,10 @@ void EigenFactorPlane::evaluate_residuals()
 void EigenFactorPlane::evaluate_jacobians()
 {
     // Assumes residuals evaluated beforehand
-    J_.clear();
-    H_.clear();
+    // containers keep their size between iterations, values are overwritten
+    J_.resize(Q_.size());
+    H_.resize(Q_.size());
+    uint_t nodeIdLocal = 0;
     for (auto &Qt: Q_)
     {
         Mat61 jacobian = Mat61::Zero();
@@ -76,12 +78,32 @@ void EigenFactorPlane::evaluate_jacobians()
                 hessian(i,j) = planeEstimationCenter_.dot(ddQ*planeEstimationCenter_);
             }
         }
-        J_.push_back(jacobian);
-        H_.push_back(hessian);
+        J_[nodeIdLocal] = jacobian;
+        H_[nodeIdLocal] = hessian;
+        nodeIdLocal++;
 
     }
 }
 
+void EigenFactorPlane::evaluate_gradient()
+{
+    // As evaluate_jacobians(), without the Hessians. They keep the values of the last linearization
+    J_.resize(Q_.size());
+    uint_t nodeIdLocal = 0;
+    for (auto &Qt: Q_)
+    {
+        Mat61 jacobian;
+        for (uint_t i = 0 ; i < 6; i++)
+        {
+            Mat4 dQ = SE3GenerativeMatrix(i)*Qt + Qt*SE3GenerativeMatrix(i).transpose();
+            dQ = Tcenter_ * dQ * Tcenter_.transpose();
+            jacobian(i) = planeEstimationCenter_.dot(dQ*planeEstimationCenter_);
+        }
+        J_[nodeIdLocal] = jacobian;
+        nodeIdLocal++;
+    }
+}
+
 void EigenFactorPlane::evaluate_chi2()
 {
     // Point 2 plane exact error requires chi2 = pi' Q pi
@@ -118,7 +140,7 @@ void EigenFactorPlane::add_point(const Mat31& p, std::shared_ptr<Node> &node, ma
 }
 
 
-void EigenFactorPlane::add_points_array(const MatX &P, std::shared_ptr<Node> &node, mrob::matData_t &W)
+void EigenFactorPlane::add_points_array(MatRefConst P, std::shared_ptr<Node> &node, mrob::matData_t &W)
 {
     assert(P.cols() == 3 && "EigenFactorPlane::add_points_array: Nx3 input is required");
     const auto N = P.rows();
@@ -180,7 +202,7 @@ void EigenFactorPlane::calculate_all_matrices_S()
 
 void EigenFactorPlane::calculate_all_matrices_Q()
 {
-    Q_.clear();
+    Q_.resize(S_.size());
     uint_t nodeIdLocal = 0;
     accumulatedQ_ = Mat4::Zero();
     for (auto &S : S_)
@@ -189,7 +211,7 @@ void EigenFactorPlane::calculate_all_matrices_Q()
         // Use the corresponding matrix S
         Mat4 Q;
         Q.noalias() =  T * S * T.transpose();
-        Q_.push_back(Q);
+        Q_[nodeIdLocal] = Q;
         accumulatedQ_ += Q;
         nodeIdLocal++;
     }
@@ -45,8 +45,10 @@ void EigenFactorPlaneCenter::evaluate_residuals()
 void EigenFactorPlaneCenter::evaluate_jacobians()
 {
     // Assumes residuals evaluated beforehand
-    J_.clear();
-    H_.clear();
+    // containers keep their size between iterations, values are overwritten
+    J_.resize(Q_.size());
+    H_.resize(Q_.size());
+    uint_t nodeIdLocal = 0;
     for (auto &Qt: Q_)
     {
         Mat61 jacobian = Mat61::Zero();
@@ -73,12 +75,32 @@ void EigenFactorPlaneCenter::evaluate_jacobians()
                 hessian(i,j) = planeEstimationUnit_.dot(ddQ*planeEstimationUnit_);
             }
         }
-        J_.push_back(jacobian);
-        H_.push_back(hessian);
+        J_[nodeIdLocal] = jacobian;
+        H_[nodeIdLocal] = hessian;
+        nodeIdLocal++;
 
     }
 }
 
+void EigenFactorPlaneCenter::evaluate_gradient()
+{
+    // As evaluate_jacobians(), without the Hessians. They keep the values of the last linearization
+    J_.resize(Q_.size());
+    uint_t nodeIdLocal = 0;
+    for (auto &Qt: Q_)
+    {
+        Mat61 jacobian;
+        for (uint_t i = 0 ; i < 6; i++)
+        {
+            Mat4 dQ = SE3GenerativeMatrix(i)*Qt + Qt*SE3GenerativeMatrix(i).transpose();
+            dQ = Tcenter_ * dQ * Tcenter_.transpose();
+            jacobian(i) = planeEstimationUnit_.dot(dQ*planeEstimationUnit_);
+        }
+        J_[nodeIdLocal] = jacobian;
+        nodeIdLocal++;
+    }
+}
+
 void EigenFactorPlaneCenter::evaluate_chi2()
 {
     // error = lambda from eig
@@ -42,7 +42,7 @@ void EigenFactorPlaneCoordinatesAlign::evaluate_residuals()
     // calculate V's and lambda's for each pose St
     this->estimate_planes_at_poses();
 
-    r1_.clear();r2_.clear();r3_.clear();
+    r1_.resize(S_.size());r2_.resize(S_.size());r3_.resize(S_.size());
     uint_t nodeIdLocal = 0;
     Mat31 normal = this->get_estimate_normal();// these are in global coordinates
     Mat31 mean = this->get_estimate_mean();
@@ -53,14 +53,14 @@ void EigenFactorPlaneCoordinatesAlign::evaluate_residuals()
         //    where n_k is the number of points, l_1, max eigenvalue. and R_k the transformation
         Mat4 pose_state = this->neighbourNodes_[nodeIdLocal]->get_state();
         SE3 T(pose_state);
-        r1_.push_back(normal.dot(T.R() * v1_[nodeIdLocal]));
+        r1_[nodeIdLocal] = normal.dot(T.R() * v1_[nodeIdLocal]);
 
         // residual 2, same for vor VAP 2
-        r2_.push_back(normal.dot(T.R() * v2_[nodeIdLocal]));
+        r2_[nodeIdLocal] = normal.dot(T.R() * v2_[nodeIdLocal]);
 
         // residual 3
         Mat31 local_mean = St.topRightCorner<3,1>()/St(3,3);
-        r3_.push_back(normal.dot(T.transform(local_mean) - mean));
+        r3_[nodeIdLocal] = normal.dot(T.transform(local_mean) - mean);
 
         // residual 3:
         nodeIdLocal++;
@@ -70,8 +70,9 @@ void EigenFactorPlaneCoordinatesAlign::evaluate_residuals()
 void EigenFactorPlaneCoordinatesAlign::evaluate_jacobians()
 {
     // Assumes residuals evaluated beforehand
-    J_.clear();
-    H_.clear();
+    // containers keep their size between iterations, values are overwritten
+    J_.resize(S_.size());
+    H_.resize(S_.size());
     uint_t nodeIdLocal = 0;
     Mat31 normal = this->get_estimate_normal();// these are in global coordinates
     for (auto &St: S_)
@@ -113,8 +114,8 @@ void EigenFactorPlaneCoordinatesAlign::evaluate_jacobians()
         jacobian += k*r3_[nodeIdLocal]*dr;
         hessian += k* dr * dr.transpose();
 
-        J_.push_back(jacobian);
-        H_.push_back(hessian);
+        J_[nodeIdLocal] = jacobian;
+        H_[nodeIdLocal] = hessian;
         nodeIdLocal++;
     }
 }
@@ -47,8 +47,10 @@ void EigenFactorPlaneRaw::evaluate_residuals()
 void EigenFactorPlaneRaw::evaluate_jacobians()
 {
     // Assumes residuals evaluated beforehand
-    J_.clear();
-    H_.clear();
+    // containers keep their size between iterations, values are overwritten
+    J_.resize(Q_.size());
+    H_.resize(Q_.size());
+    uint_t nodeIdLocal = 0;
     for (auto &Qt: Q_)
     {
         Mat61 jacobian = Mat61::Zero();
@@ -72,12 +74,31 @@ void EigenFactorPlaneRaw::evaluate_jacobians()
                 hessian(i,j) = planeEstimationUnit_.dot(ddQ*planeEstimationUnit_);
             }
         }
-        J_.push_back(jacobian);
-        H_.push_back(hessian);
+        J_[nodeIdLocal] = jacobian;
+        H_[nodeIdLocal] = hessian;
+        nodeIdLocal++;
 
     }
 }
 
+void EigenFactorPlaneRaw::evaluate_gradient()
+{
+    // As evaluate_jacobians(), without the Hessians. They keep the values of the last linearization
+    J_.resize(Q_.size());
+    uint_t nodeIdLocal = 0;
+    for (auto &Qt: Q_)
+    {
+        Mat61 jacobian;
+        for (uint_t i = 0 ; i < 6; i++)
+        {
+            Mat4 dQ = SE3GenerativeMatrix(i)*Qt + Qt*SE3GenerativeMatrix(i).transpose();
+            jacobian(i) = planeEstimationUnit_.dot(dQ*planeEstimationUnit_);
+        }
+        J_[nodeIdLocal] = jacobian;
+        nodeIdLocal++;
+    }
+}
+
 void EigenFactorPlaneRaw::evaluate_chi2()
 {
     // Point 2 plane exact error requires chi2 = pi' Q pi
@@ -114,7 +135,7 @@ void EigenFactorPlaneRaw::add_point(const Mat31& p, std::shared_ptr<Node> &node,
 }
 
 
-void EigenFactorPlaneRaw::add_points_array(const MatX &P, std::shared_ptr<Node> &node, mrob::matData_t &W)
+void EigenFactorPlaneRaw::add_points_array(MatRefConst P, std::shared_ptr<Node> &node, mrob::matData_t &W)
 {
     assert(P.cols() == 3 && "EigenFactorPlaneRaw::add_points_array: Nx3 input is required");
     const auto N = P.rows();
@@ -169,7 +190,7 @@ void EigenFactorPlaneRaw::calculate_all_matrices_S(bool reset)
 
 void EigenFactorPlaneRaw::calculate_all_matrices_Q()
 {
-    Q_.clear();
+    Q_.resize(S_.size());
     uint_t nodeIdLocal = 0;
     accumulatedQ_ = Mat4::Zero();
     for (auto &S : S_)
@@ -178,7 +199,7 @@ void EigenFactorPlaneRaw::calculate_all_matrices_Q()
         // Use the corresponding matrix S
         Mat4 Q;
         Q.noalias() =  T * S * T.transpose();
-        Q_.push_back(Q);
+        Q_[nodeIdLocal] = Q;
         accumulatedQ_ += Q;
         nodeIdLocal++;
     }
@@ -43,8 +43,8 @@ void EigenFactorPoint::evaluate_residuals()
 
     // 2) Calculate the residual, same structure as in EigenFactorPlane::calculate_matrices_Q()
     //    r = To^{-1}T * mu(Qi) - mu(Q0)
-    r_.clear();
-    transformed_mu_.clear();
+    r_.resize(S_.size());
+    transformed_mu_.resize(S_.size());
     uint_t nodeIdLocal = 0;
     Mat4 initial_transform = this->neighbourNodes_[nodeIdLocal]->get_state();
     T_ini_inv_ = SE3(initial_transform).inv();
@@ -57,10 +57,10 @@ void EigenFactorPoint::evaluate_residuals()
         SE3 T(Tnode);
         Mat31 local_mean_point = S.topRightCorner<3,1>()/S(3,3);
         Mat31 Tmu = T.transform(local_mean_point);
-        transformed_mu_.emplace_back(Tmu);
+        transformed_mu_[nodeIdLocal] = Tmu;
         // we need to store T_t * mu, and then transform the full sequence T0^{-1}*T_t * mu
         Mat31 residual = T_ini_inv_.transform(Tmu) - initial_mean_point;
-        r_.emplace_back(residual);
+        r_[nodeIdLocal] = residual;
         nodeIdLocal++;
     }
 }
@@ -68,8 +68,9 @@ void EigenFactorPoint::evaluate_residuals()
 void EigenFactorPoint::evaluate_jacobians()
 {
     // Assumes residuals evaluated beforehand
-    J_.clear();
-    H_.clear();
+    // containers keep their size between iterations, values are overwritten
+    J_.resize(r_.size());
+    H_.resize(r_.size());
     uint_t nodeIdLocal = 0;
     for (auto &rt: r_)
     {
@@ -81,11 +82,11 @@ void EigenFactorPoint::evaluate_jacobians()
         dr << -hat3(Tx_t) , Mat3::Identity();
         dr = T_ini_inv_.R() * dr;
         jacobian = W * dr.transpose() * rt;
-        J_.push_back(jacobian);
+        J_[nodeIdLocal] = jacobian;
         // Hessian = dr/dxi_t' * W_t * dr/dxi_t
         Mat6 hessian = Mat6::Zero();
         hessian = W* dr.transpose() * dr;
-        H_.push_back(hessian);
+        H_[nodeIdLocal] = hessian;
         nodeIdLocal++;
     }
 }
@@ -37,6 +37,12 @@ namespace mrob{
  */
 
 Mat41 estimate_plane(MatRefConst X, bool flagCentered = true);
+/**
+ * Single precision points: the centroid is accumulated in double. In the centered
+ * approach, the second moments of the centered points are calculated in float,
+ * while in the homogeneous approach (not centered) they are accumulated in double.
+ */
+Mat41 estimate_plane(MatfRefConst X, bool flagCentered = true);
 
 
 /**
@@ -47,6 +53,7 @@ Mat41 estimate_plane(MatRefConst X, bool flagCentered = true);
  */
 
 Mat31 estimate_normal(MatRefConst X);
+Mat31 estimate_normal(MatfRefConst X);
 
 
 /**
@@ -57,6 +64,7 @@ Mat31 estimate_normal(MatRefConst X);
  */
 
 Mat31 estimate_centroid(MatRefConst X);
+Mat31 estimate_centroid(MatfRefConst X);
 
 
 }
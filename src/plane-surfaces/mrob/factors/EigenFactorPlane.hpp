@@ -70,6 +70,10 @@ public:
      * It also evaluated the Hessians
      */
     void evaluate_jacobians() override;
+    /**
+     * Evaluates only the Jacobians, without the second derivatives over the generators
+     */
+    void evaluate_gradient() override;
     /**
      * Chi2 is a scaling of the plane error
      */
@@ -115,7 +119,8 @@ public:
     /**
      * Add point array: uses internally add_point in a block operation
      */
-    void add_points_array(const MatX &P, std::shared_ptr<Node> &node, mrob::matData_t &W) override;
+    void add_points_array(MatRefConst P, std::shared_ptr<Node> &node, mrob::matData_t &W) override;
+    using EigenFactor::add_points_array;
     /**
      * Add point S matrix: directly stores S matrices as S = sum p_i'*p_i the homogenoues outer product sum
      * This is done when you dont want to store all points, but process them outside
@@ -72,6 +72,10 @@ public:
      * It also evaluated the Hessians
      */
     void evaluate_jacobians() override;
+    /**
+     * Evaluates only the Jacobians, without the second derivatives over the generators
+     */
+    void evaluate_gradient() override;
     /**
      * Chi2 is a scaling of the plane error from lambda_min
      */
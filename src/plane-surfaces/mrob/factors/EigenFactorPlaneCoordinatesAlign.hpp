@@ -59,6 +59,10 @@ public:
      * It also evaluated the Hessians
      */
     void evaluate_jacobians() override;
+    /**
+     * The Hessians are products of the Jacobians of the residuals, evaluated together
+     */
+    void evaluate_gradient() override {this->evaluate_jacobians();}
     /**
      * Chi2 is a scaling of the plane error from lambda_min
      */
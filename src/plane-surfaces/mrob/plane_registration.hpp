@@ -57,7 +57,9 @@ class PlaneRegistration: public OptimizerDense{
                    GN_HESSIAN,
                    GN_CLAMPED_HESSIAN,
                    LM_SPHER,
-                   LM_ELLIP};
+                   LM_ELLIP,
+                   LBFGS,
+                   NONLINEAR_CG};
 
   public:
     PlaneRegistration();
@@ -67,6 +69,11 @@ class PlaneRegistration: public OptimizerDense{
     // Function from the parent class Optimizer
     virtual matData_t calculate_error() override;
     virtual void calculate_gradient_hessian() override;
+    /**
+     * Gradient without Hessians, for L-BFGS and nonlinear CG. Planes are
+     * already estimated by calculate_error() at the current state.
+     */
+    virtual void calculate_gradient() override;
     virtual void update_state() override;
     virtual void bookkeep_state() override;
     virtual void update_state_from_bookkeep() override;
@@ -197,7 +204,6 @@ class PlaneRegistration: public OptimizerDense{
     // 1st order parameters methods if used
     PlaneRegistration::SolveMode solveMode_;
     std::vector<Mat61> previousState_;
-    double c1_, c2_;    //parameters for the Wolfe conditions DEPRECATED?
     double alpha_, beta_;
 
 
@@ -37,7 +37,7 @@ using namespace mrob;
 PlaneRegistration::PlaneRegistration():
         numberPlanes_(0), numberPoses_(0),numberPoints_(0),isSolved_(0), trajectory_(new std::vector<SE3>(8,SE3())),
         solveMode_(SolveMode::GRADIENT),
-        c1_(1e-4), c2_(0.9), alpha_(0.75), beta_(0.1)
+        alpha_(0.75), beta_(0.1)
 {
     // Optmizer does not establish the size for this matrices and thus it is required
     gradient_.resize(6);
@@ -120,6 +120,16 @@ uint_t PlaneRegistration::solve(SolveMode mode, bool singleIteration)
             solveIters_ = Optimizer::solve(LEVENBERG_MARQUARDT_ELLIP,100,1e-2);
             time_profiles_.stop();
             break;
+        case SolveMode::LBFGS:
+            time_profiles_.start();
+            solveIters_ = Optimizer::solve(Optimizer::LBFGS,1000);
+            time_profiles_.stop();
+            break;
+        case SolveMode::NONLINEAR_CG:
+            time_profiles_.start();
+            solveIters_ = Optimizer::solve(Optimizer::NONLINEAR_CG,1000);
+            time_profiles_.stop();
+            break;
         default:
             return 0;
     }
@@ -443,6 +453,13 @@ std::vector<double> PlaneRegistration::print_evaluate()
             gradient__ = gradient_;
             hessian__ = hessian_;
             break;
+        case SolveMode::LBFGS:
+        case SolveMode::NONLINEAR_CG:
+            // first order methods do not calculate the Hessian, it is evaluated at the solution
+            calculate_gradient_hessian();
+            gradient__ = gradient_;
+            hessian__ = hessian_;
+            break;
         case SolveMode::INITIALIZE:
         case SolveMode::GN_CLAMPED_HESSIAN:
             std::cout << "PlaneRegistration::print_evaluate: Not handled" << std::endl;
@@ -510,6 +527,20 @@ void PlaneRegistration::calculate_gradient_hessian()
     }
 }
 
+void PlaneRegistration::calculate_gradient()
+{
+    Mat61 gradient;
+    gradient_.setZero();
+    double  tau = 1.0 / (double)(numberPoses_-1);
+    for (uint_t t = 1 ; t < numberPoses_; ++t)
+    {
+        gradient.setZero();
+        for (auto it = planes_.cbegin();  it != planes_.cend(); ++it)
+            gradient += it->second->calculate_gradient(t);
+        gradient_ +=  (tau *  t)  * gradient;
+    }
+}
+
 void PlaneRegistration::update_state()
 {
     // XXX this ws before passed as a function argument. Deprecated?